@@ -18,6 +18,16 @@ struct hdql_AnnotatedSelection {
        ;
 };
 
+/* Function call made within the expression; function attribute definitions
+ * are opaque, so calls are recorded to make them comparable by compile-time
+ * optimizations */
+struct hdql_FuncCall {
+    struct hdql_Query * q;
+    char * funcName;
+    struct hdql_Query ** args;
+    size_t nArgs;
+};
+
 typedef struct Workspace {
     struct {
         const struct hdql_Compound * compoundPtr;
@@ -30,6 +40,9 @@ typedef struct Workspace {
     char * errMsg;
     unsigned int errMsgSize;
     unsigned int errPos[4]; /* first column, first line, last column, last line */
+    struct hdql_FuncCall * funcCalls;
+    size_t nFuncCalls, nFuncCallsAllocated;
+    int errCode;  /* set when parsing is aborted by an action */
 } * Workspace_t;
 
 typedef void *yyscan_t;  /* circumvent circular dep: YACC/BISON does not know this type */
@@ -46,6 +59,11 @@ typedef void *yyscan_t;  /* circumvent circular dep: YACC/BISON does not know th
 %parse-param {yyscan_t yyscanner}
 
 %code {
+#include "hdql/internal-api.h"
+
+#include <math.h>
+#include <string.h>
+
 static int
 _resolve_query_top_as_compound( struct hdql_Query * q
                               , char * identifier
@@ -53,6 +71,27 @@ _resolve_query_top_as_compound( struct hdql_Query * q
                               , struct Workspace * ws
                               , const struct hdql_AttrDef ** r
                               );
+static bool
+_push_down_filter( Workspace_t ws
+                 , struct hdql_Query * collectionQuery
+                 , struct hdql_Query * filterQuery
+                 );
+static int
+_eliminate_common_subexpressions( Workspace_t ws
+                                , struct hdql_Compound * vCompound
+                                , struct hdql_Query * filterQuery
+                                , struct hdql_SharedQuery *** sharedQueries
+                                , size_t * nSharedQueries
+                                );
+static int
+_fuse_arithmetics(Workspace_t ws, struct hdql_Query * q);
+static int
+_fuse_scope_arithmetics( Workspace_t ws
+                       , struct hdql_Compound * vCompound
+                       , struct hdql_Query * filterQuery
+                       , struct hdql_SharedQuery ** sharedQueries
+                       , size_t nSharedQueries
+                       );
 static struct hdql_Query *
 _new_virtual_compound_query( YYLTYPE * yylloc
                            , Workspace_t ws
@@ -60,6 +99,13 @@ _new_virtual_compound_query( YYLTYPE * yylloc
                            , struct hdql_Compound * compoundPtr
                            , struct hdql_Query * filterPtr
                            );
+static struct hdql_Query *
+_new_expression_scope_query( YYLTYPE * yylloc
+                           , Workspace_t ws
+                           , struct hdql_Query * ownerQuery
+                           , struct hdql_Query * valueQuery
+                           , struct hdql_Query * filterQuery
+                           );
 static struct hdql_Compound *
 _vcompound_append_with_query(YYLTYPE * yyloc, struct Workspace * ws, yyscan_t yyscanner
             , struct hdql_Compound * vCompound
@@ -77,6 +123,17 @@ _new_function( YYLTYPE * yyloc, struct Workspace * ws, yyscan_t yyscanner
              , const char * funcName
              , struct hdql_FuncArgList * argsList
              );
+static struct hdql_Query *
+_simplify_operation( struct Workspace * ws
+                   , struct hdql_Query * a
+                   , hdql_OperationCode_t opCode
+                   , struct hdql_Query * b
+                   , const struct hdql_OperationEvaluator * evaluator
+                   );
+static struct hdql_Query *
+_new_transient_query(struct Workspace * ws, struct hdql_AttrDef * ad);
+static struct hdql_Query *
+_fold_static_query(struct Workspace * ws, struct hdql_Query * q);
 static int
 _operation( struct hdql_Query * a
           , hdql_OperationCode_t opCode
@@ -87,9 +144,14 @@ _operation( struct hdql_Query * a
           , const char * opDescription
           , struct hdql_Query ** r
           );
+/* Aborts parsing with given error code. Symbols of the current rule are
+ * not destroyed (action is responsible for them), others left on parser's
+ * stack are (see `%destructor'). */
+#define M_ABORT(code) do { ws->errCode = (code); YYABORT; } while(0)
+
 #define M_OP(op1, opName, op2, opDescr, R) \
     int rc = _operation(op1, hdql_k ## opName, op2, &yyloc, ws, NULL, opDescr, &(R)); \
-    if(0 != rc) return rc;
+    if(0 != rc) M_ABORT(rc);
 
 #define M_TOP_COMPOUND_NAME(q, buf) \
     const struct hdql_AttrDef * qAD = hdql_query_top_attr(q); \
@@ -147,7 +209,8 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
     hdql_Int_t intStaticValue;
     hdql_Flt_t fltStaticValue;
     hdql_Bool_t boolStaticValue;
-    struct { struct hdql_Compound * compoundPtr; struct hdql_Query * filter; } vCompound;
+    struct { struct hdql_Compound * compoundPtr; struct hdql_Query * filter;
+             struct hdql_Query * valueQuery; } vCompound;
     struct hdql_Query * queryPtr;
     struct hdql_FuncArgList * funcArgsList;
     struct hdql_AnnotatedSelection annotatedSelection;
@@ -224,15 +287,27 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
 %start toplev
 
 /*YYERROR;*/ /* see #20 */
-//%destructor { printf("query dtr called\n"); hdql_query_destroy($$, ws->context); } <queryPtr>
-//%destructor { printf("strID dtr called\n"); free($$); } <strID>
+%destructor { hdql_query_destroy($$, ws->context); } <queryPtr>
+%destructor { free($$); } <strID> <selexpr>
+%destructor {
+    for(struct hdql_FuncArgList * cArg = $$; NULL != cArg; ) {
+        struct hdql_FuncArgList * toFree = cArg;
+        cArg = cArg->nextArgument;
+        hdql_query_destroy(toFree->thisArgument, ws->context);
+        free(toFree);
+    }
+} <funcArgsList>
 
 %%
 
      toplev : error
-            { /*ws->root = NULL;*/ return HDQL_ERR_TRANSLATION_FAILURE; }
+            { /*ws->root = NULL;*/ M_ABORT(HDQL_ERR_TRANSLATION_FAILURE); }
             //| queryExpr { ws->query = $1; }
-            | aQExpr { ws->query = $1; }
+            | aQExpr {
+                ws->query = $1;
+                int rc = _fuse_arithmetics(ws, $1);
+                if(HDQL_ERR_CODE_OK != rc) M_ABORT(rc);
+            }
             ;
 
      aQExpr : aOp  { $$ = $1; }
@@ -288,7 +363,7 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                 free($1);
                 if(NULL == $$) {
                     /*YYERROR;*/ /* see #20 */
-                    return HDQL_ERR_TRANSLATION_FAILURE;
+                    M_ABORT(HDQL_ERR_TRANSLATION_FAILURE);
                 }
             }
             ;
@@ -297,6 +372,12 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
             { 
                 $$ = (struct hdql_FuncArgList*)
                         malloc(sizeof(struct hdql_FuncArgList));
+                if(NULL == $$) {
+                    hdql_query_destroy($1, ws->context);
+                    hdql_error(&yyloc, ws, yyscanner
+                            , "Failed to allocate function argument");
+                    M_ABORT(HDQL_ERR_MEMORY);
+                }
                 $$->thisArgument = $1;
                 $$->nextArgument = NULL;
             }
@@ -304,6 +385,12 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
             {
                 $$ = (struct hdql_FuncArgList*)
                         malloc(sizeof(struct hdql_FuncArgList));
+                if(NULL == $$) {
+                    hdql_query_destroy($3, ws->context);
+                    hdql_error(&yyloc, ws, yyscanner
+                            , "Failed to allocate function argument");
+                    M_ABORT(HDQL_ERR_MEMORY);
+                }
                 $$->thisArgument = $3;
                 $$->nextArgument = $1;
             }
@@ -319,15 +406,18 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                 if( NULL == valueCopy ) {
                     hdql_error(&yyloc, ws, yyscanner
                             , "Failed to allocate memory for floating point constant value");
-                    return HDQL_ERR_MEMORY;
+                    M_ABORT(HDQL_ERR_MEMORY);
                 }
                 *((hdql_Flt_t *) valueCopy) = $1;
                 struct hdql_AttrDef * attrDef
                         = hdql_attr_def_create_static_atomic_scalar_value(vtCode, valueCopy, ws->context);
-                assert(hdql_attr_def_is_transient(attrDef));
-                $$ = hdql_query_create(attrDef, NULL, ws->context);
-                hdql_query_set_transient_subject_ownership($$);
-                assert($$);
+                if(NULL == attrDef) hdql_context_free(ws->context, valueCopy);
+                $$ = _new_transient_query(ws, attrDef);
+                if(NULL == $$) {
+                    hdql_error(&yyloc, ws, yyscanner
+                            , "Failed to allocate query for constant value");
+                    M_ABORT(HDQL_ERR_MEMORY);
+                }
                 assert(vtCode == hdql_attr_def_get_atomic_value_type_code(hdql_query_top_attr($$)));
             }
             | T_INT_STATIC_VALUE
@@ -340,15 +430,18 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                 if( NULL == valueCopy ) {
                     hdql_error(&yyloc, ws, yyscanner
                             , "Failed to allocate memory for integer constant value");
-                    return HDQL_ERR_MEMORY;
+                    M_ABORT(HDQL_ERR_MEMORY);
                 }
                 *((hdql_Int_t *) valueCopy) = $1;
                 struct hdql_AttrDef * attrDef
                         = hdql_attr_def_create_static_atomic_scalar_value(vtCode, valueCopy, ws->context);
-                assert(hdql_attr_def_is_transient(attrDef));
-                $$ = hdql_query_create(attrDef, NULL, ws->context);
-                hdql_query_set_transient_subject_ownership($$);
-                assert($$);
+                if(NULL == attrDef) hdql_context_free(ws->context, valueCopy);
+                $$ = _new_transient_query(ws, attrDef);
+                if(NULL == $$) {
+                    hdql_error(&yyloc, ws, yyscanner
+                            , "Failed to allocate query for constant value");
+                    M_ABORT(HDQL_ERR_MEMORY);
+                }
                 assert(vtCode == hdql_attr_def_get_atomic_value_type_code(hdql_query_top_attr($$)));
             }
             | T_BOOL_STATIC_VALUE
@@ -361,15 +454,18 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                 if( NULL == valueCopy ) {
                     hdql_error(&yyloc, ws, yyscanner
                             , "Failed to allocate memory for integer constant value");
-                    return HDQL_ERR_MEMORY;
+                    M_ABORT(HDQL_ERR_MEMORY);
                 }
                 *((hdql_Bool_t *) valueCopy) = $1;
                 struct hdql_AttrDef * attrDef
                         = hdql_attr_def_create_static_atomic_scalar_value(vtCode, valueCopy, ws->context);
-                assert(hdql_attr_def_is_transient(attrDef));
-                $$ = hdql_query_create(attrDef, NULL, ws->context);
-                hdql_query_set_transient_subject_ownership($$);
-                assert($$);
+                if(NULL == attrDef) hdql_context_free(ws->context, valueCopy);
+                $$ = _new_transient_query(ws, attrDef);
+                if(NULL == $$) {
+                    hdql_error(&yyloc, ws, yyscanner
+                            , "Failed to allocate query for constant value");
+                    M_ABORT(HDQL_ERR_MEMORY);
+                }
                 assert(vtCode == hdql_attr_def_get_atomic_value_type_code(hdql_query_top_attr($$)));
             }
             | queryExpr { $$ = $1; }
@@ -399,11 +495,14 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                             , hdql_compound_get_name(hdql_virtual_compound_get_parent(topCompound)), $2);
                     }
                     free($2);
-                    return HDQL_ERR_UNKNOWN_ATTRIBUTE;
+                    M_ABORT(HDQL_ERR_UNKNOWN_ATTRIBUTE);
                 }
                 $$ = hdql_query_create(attrDef, NULL, ws->context);
                 free($2);
-                assert($$);
+                if(NULL == $$) {
+                    hdql_error(&yyloc, ws, yyscanner, "Failed to allocate query");
+                    M_ABORT(HDQL_ERR_MEMORY);
+                }
             }
             | T_PERIOD T_IDENTIFIER selection
             {   
@@ -419,7 +518,7 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                     free($2);
                     if($3.selectionExpression) free($3.selectionExpression);
                     if($3.label)               free($3.label);
-                    return HDQL_ERR_UNKNOWN_ATTRIBUTE;
+                    M_ABORT(HDQL_ERR_UNKNOWN_ATTRIBUTE);
                 }
                 if(is_scalar(attrDef)) {
                     const struct hdql_Compound * topCompound = hdql_parser_top_compound(ws);
@@ -432,7 +531,7 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                     free($2);
                     if($3.selectionExpression) free($3.selectionExpression);
                     if($3.label)               free($3.label);
-                    return HDQL_ERR_UNKNOWN_ATTRIBUTE;
+                    M_ABORT(HDQL_ERR_UNKNOWN_ATTRIBUTE);
                 }
                 const struct hdql_CollectionAttrInterface * iface
                         = hdql_attr_def_collection_iface(attrDef);
@@ -450,7 +549,7 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                         free($2);
                         if($3.selectionExpression) free($3.selectionExpression);
                         if($3.label)               free($3.label);
-                        return HDQL_BAD_QUERY_EXPRESSION;
+                        M_ABORT(HDQL_BAD_QUERY_EXPRESSION);
                     }
                     selection = iface->compile_selection($3.selectionExpression
                                 , iface->definitionData, ws->context );
@@ -465,33 +564,43 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                         free($2);
                         if($3.selectionExpression) free($3.selectionExpression);
                         if($3.label)               free($3.label);
-                        return HDQL_BAD_QUERY_EXPRESSION;
+                        M_ABORT(HDQL_BAD_QUERY_EXPRESSION);
                     }
                 }
                 free($2);
                 if($3.selectionExpression) free($3.selectionExpression);
                 $$ = hdql_query_create( attrDef, selection, ws->context);
+                if(NULL == $$) {
+                    if(selection) iface->free_selection(iface->definitionData
+                                , selection, ws->context);
+                    if($3.label) free($3.label);
+                    hdql_error(&yyloc, ws, yyscanner, "Failed to allocate query");
+                    M_ABORT(HDQL_ERR_MEMORY);
+                }
                 if($3.label) {
                     char * label = (char*) hdql_context_alloc(ws->context, strlen($3.label)+1);
                     if(!label) {
                         free($3.label);
                         hdql_query_destroy($$, ws->context);
-                        return HDQL_ERR_MEMORY;
+                        M_ABORT(HDQL_ERR_MEMORY);
                     }
                     strcpy(label, $3.label);
                     hdql_query_assign_label($$, label);
                     free($3.label);
                 }
-                assert($$);
             }
             | queryExpr T_PERIOD T_IDENTIFIER
             {
                 const struct hdql_AttrDef * attrDef;
                 int rc = _resolve_query_top_as_compound($1, $3, &yyloc, ws, &attrDef);
-                if(0 != rc) { free($3); return rc; }
+                if(0 != rc) { free($3); M_ABORT(rc); }
                 struct hdql_Query * cq = hdql_query_create(attrDef, NULL, ws->context);
-                assert(cq);
                 free($3);
+                if(NULL == cq) {
+                    hdql_query_destroy($1, ws->context);
+                    hdql_error(&yyloc, ws, yyscanner, "Failed to allocate query");
+                    M_ABORT(HDQL_ERR_MEMORY);
+                }
                 $$ = hdql_query_append($1, cq);
             }
             | queryExpr T_PERIOD T_IDENTIFIER selection
@@ -502,7 +611,7 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                     free($3);
                     if($4.selectionExpression) free($4.selectionExpression);
                     if($4.label)               free($4.label);
-                    return rc;
+                    M_ABORT(rc);
                 }
 
                 if(is_scalar(attrDef)) {
@@ -514,7 +623,7 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                     free($3);
                     if($4.selectionExpression) free($4.selectionExpression);
                     if($4.label)               free($4.label);
-                    return HDQL_ERR_ATTRIBUTE;
+                    M_ABORT(HDQL_ERR_ATTRIBUTE);
                 }
 
                 const struct hdql_CollectionAttrInterface * iface = hdql_attr_def_collection_iface(attrDef);
@@ -529,7 +638,7 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                         free($3);
                         if($4.selectionExpression) free($4.selectionExpression);
                         if($4.label)               free($4.label);
-                        return HDQL_BAD_QUERY_EXPRESSION;
+                        M_ABORT(HDQL_BAD_QUERY_EXPRESSION);
                     }
                     selection = iface->compile_selection( $4.selectionExpression
                                 , iface->definitionData, ws->context);
@@ -542,20 +651,27 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                         free($3);
                         if($4.selectionExpression) free($4.selectionExpression);
                         if($4.label)               free($4.label);
-                        return HDQL_BAD_QUERY_EXPRESSION;
+                        M_ABORT(HDQL_BAD_QUERY_EXPRESSION);
                     }
                 }
                 free($3);
                 if($4.selectionExpression) free($4.selectionExpression);
 
                 struct hdql_Query * cq = hdql_query_create(attrDef, selection, ws->context);
-                assert(cq);
+                if(NULL == cq) {
+                    if(selection) iface->free_selection(iface->definitionData
+                                , selection, ws->context);
+                    if($4.label) free($4.label);
+                    hdql_query_destroy($1, ws->context);
+                    hdql_error(&yyloc, ws, yyscanner, "Failed to allocate query");
+                    M_ABORT(HDQL_ERR_MEMORY);
+                }
                 if($4.label) {
                     char * label = (char*) hdql_context_alloc(ws->context, strlen($4.label)+1);
                     if(!label) {
                         free($4.label);
                         hdql_query_destroy(cq, ws->context);
-                        return HDQL_ERR_MEMORY;
+                        M_ABORT(HDQL_ERR_MEMORY);
                     }
                     strcpy(label, $4.label);
                     hdql_query_assign_label(cq, label);
@@ -570,57 +686,96 @@ const struct hdql_Compound * hdql_parser_top_compound(struct Workspace *);
                         hdql_error(&yyloc, ws, yyscanner
                                   , "Compound scope operator `{}' can not be"
                                     " applied to atomic value." );
-                        return HDQL_BAD_QUERY_EXPRESSION;
+                        M_ABORT(HDQL_BAD_QUERY_EXPRESSION);
                     }
                     int rc = _push_cmpd(ws, hdql_attr_def_compound_type_info(topAttrDef));
                     //int rc = hdql_parser_push(&yyloc, ws, $1);
-                    if(0 != rc) return rc;
+                    if(0 != rc) M_ABORT(rc);
                 } scopedDefs T_RCRLBC {
                     int rc;
-                    assert( (bool) hdql_virtual_compound_is_bound($4.compoundPtr)
-                         == (0x1 == ws->compoundStack[ws->compoundStackTop].isBound) ); /* XXX */
-                    struct hdql_Query * scopeQuery = _new_virtual_compound_query(
-                            &yyloc, ws, yyscanner,
-                            $4.compoundPtr, $4.filter);
-                    if(NULL == scopeQuery) return HDQL_BAD_QUERY_EXPRESSION;
-                    hdql_query_set_transient_subject_ownership(scopeQuery);
+                    struct hdql_Query * scopeQuery;
+                    if(NULL == $4.compoundPtr) {
+                        /* scalar expression scope: `.tracks{.chi2/.ndf : ...}' */
+                        scopeQuery = _new_expression_scope_query(
+                                &yyloc, ws, $1, $4.valueQuery, $4.filter);
+                        if(NULL == scopeQuery) M_ABORT(HDQL_BAD_QUERY_EXPRESSION);
+                    } else {
+                        assert( (bool) hdql_virtual_compound_is_bound($4.compoundPtr)
+                             == (0x1 == ws->compoundStack[ws->compoundStackTop].isBound) ); /* XXX */
+                        struct hdql_Query * filter = $4.filter;
+                        if( filter
+                         && !hdql_virtual_compound_is_bound($4.compoundPtr)
+                         && _push_down_filter(ws, $1, filter) ) {
+                            /* filter is handled by collection interface */
+                            hdql_query_destroy(filter, ws->context);
+                            filter = NULL;
+                        }
+                        scopeQuery = _new_virtual_compound_query(
+                                &yyloc, ws, yyscanner,
+                                $4.compoundPtr, filter);
+                        if(NULL == scopeQuery) M_ABORT(HDQL_BAD_QUERY_EXPRESSION);
+                        hdql_query_set_transient_subject_ownership(scopeQuery);
+                    }
 
                     rc = _pop_cmpd(ws);
-                    if(0 != rc) return rc;
+                    if(0 != rc) M_ABORT(rc);
                     /* append virtual compound query to the query before scope
                      * operator */
                     $$ = hdql_query_append($1, scopeQuery);
                     assert($$ == $1);
                 }
             | T_LCRLBC scopedDefs T_RCRLBC {
-                    assert( (bool) hdql_virtual_compound_is_bound($2.compoundPtr)
-                         == (0x1 == ws->compoundStack[ws->compoundStackTop].isBound) ); /* XXX */
-                    struct hdql_Query * scopeQuery = _new_virtual_compound_query(
-                            &yyloc, ws, yyscanner,
-                            $2.compoundPtr, $2.filter);
-                    if(NULL == scopeQuery) return HDQL_BAD_QUERY_EXPRESSION;
-                    hdql_query_set_transient_subject_ownership(scopeQuery);
-                    /* append virtual compound query to the query before scope
-                     * operator */
-                    $$ = scopeQuery;
+                    if(NULL == $2.compoundPtr) {
+                        $$ = _new_expression_scope_query(&yyloc, ws, NULL
+                                , $2.valueQuery, $2.filter);
+                        if(NULL == $$) M_ABORT(HDQL_BAD_QUERY_EXPRESSION);
+                    } else {
+                        assert( (bool) hdql_virtual_compound_is_bound($2.compoundPtr)
+                             == (0x1 == ws->compoundStack[ws->compoundStackTop].isBound) ); /* XXX */
+                        struct hdql_Query * scopeQuery = _new_virtual_compound_query(
+                                &yyloc, ws, yyscanner,
+                                $2.compoundPtr, $2.filter);
+                        if(NULL == scopeQuery) M_ABORT(HDQL_BAD_QUERY_EXPRESSION);
+                        hdql_query_set_transient_subject_ownership(scopeQuery);
+                        $$ = scopeQuery;
+                    }
                 }
             ;
 
 scopedDefs : vCompoundDef {
                 $$.filter = NULL;
+                $$.valueQuery = NULL;
            }
            | vCompoundDef T_COLON {
                 _push_cmpd(ws, $1.compoundPtr); 
            } aQExpr {
                 $$.filter = $4;
+                $$.valueQuery = NULL;
                 _pop_cmpd(ws);
            }
            | T_COLON aQExpr {
                 $$.compoundPtr
                         = hdql_virtual_compound_new(hdql_parser_top_compound(ws), ws->context);
+                if(NULL == $$.compoundPtr) {
+                    hdql_query_destroy($2, ws->context);
+                    hdql_error(&yyloc, ws, yyscanner, "Failed to allocate virtual compound");
+                    M_ABORT(HDQL_ERR_MEMORY);
+                }
                 hdql_context_add_virtual_compound(ws->context, $$.compoundPtr);
                 assert(hdql_compound_is_virtual($$.compoundPtr));
                 $$.filter = $2;
+                $$.valueQuery = NULL;
+           }
+           | aQExpr {
+                /* single expression does not need a virtual compound */
+                $$.compoundPtr = NULL;
+                $$.valueQuery = $1;
+                $$.filter = NULL;
+           }
+           | aQExpr T_COLON aQExpr {
+                $$.compoundPtr = NULL;
+                $$.valueQuery = $1;
+                $$.filter = $3;
            }
            ;
 
@@ -631,41 +786,54 @@ vCompoundDef : vNamedCompoundDef
 vNamedCompoundDef : T_IDENTIFIER T_WALRUS aQExpr {
                 struct hdql_Compound * nvc = _vcompound_def_start(&yyloc, ws, yyscanner, $1, $3, false);
                 free($1);
-                if(!nvc) { return HDQL_BAD_QUERY_EXPRESSION; }
+                if(!nvc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
                 $$.compoundPtr = nvc;
             }
             | T_IDENTIFIER T_WALRUS T_ASTERISK aQExpr {
                 struct hdql_Compound * nvc = _vcompound_def_start(&yyloc, ws, yyscanner, $1, $4, true);
                 free($1);
-                if(!nvc) { return HDQL_BAD_QUERY_EXPRESSION; }
+                if(!nvc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
                 $$.compoundPtr = nvc;
             }
             | vNamedCompoundDef T_COMMA T_IDENTIFIER T_WALRUS aQExpr {
                 struct hdql_Compound * vc = _vcompound_append_with_query(&yyloc, ws, yyscanner
                             , $1.compoundPtr, $3, $5, false);
                 free($3);
-                if(!vc) { return HDQL_BAD_QUERY_EXPRESSION; }
+                if(!vc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
                 $$.compoundPtr = vc;
             }
             | vNamedCompoundDef T_COMMA T_IDENTIFIER T_WALRUS T_ASTERISK aQExpr {
                 struct hdql_Compound * vc = _vcompound_append_with_query(&yyloc, ws, yyscanner
                             , $1.compoundPtr, $3, $6, true);
                 free($3); 
-                if(!vc) { return HDQL_BAD_QUERY_EXPRESSION; }
+                if(!vc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
                 ws->compoundStack[ws->compoundStackTop].isBound = 0x1;
                 $$.compoundPtr = vc;
             }
             ;
 
-vPositionalCompoundDef : aQExpr {
+vPositionalCompoundDef : aQExpr T_COMMA aQExpr {
                 struct hdql_Compound * nvc = _vcompound_def_start(&yyloc, ws, yyscanner, "#1", $1, false);
-                if(!nvc) { return HDQL_BAD_QUERY_EXPRESSION; }
-                ws->compoundStack[ws->compoundStackTop].posCompoundNArg = 2;
+                if(!nvc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
+                nvc = _vcompound_append_with_query(&yyloc, ws, yyscanner
+                            , nvc, "#2", $3, false);
+                if(!nvc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
+                ws->compoundStack[ws->compoundStackTop].posCompoundNArg = 3;
+                $$.compoundPtr = nvc;
+            }
+            | aQExpr T_COMMA T_ASTERISK aQExpr {
+                struct hdql_Compound * nvc = _vcompound_def_start(&yyloc, ws, yyscanner, "#1", $1, false);
+                if(!nvc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
+                nvc = _vcompound_append_with_query(&yyloc, ws, yyscanner
+                            , nvc, "#2", $4, true);
+                if(!nvc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
+                ws->compoundStack[ws->compoundStackTop].isBound = 0x1;
+                ws->compoundStack[ws->compoundStackTop].posCompoundNArg = 3;
                 $$.compoundPtr = nvc;
             }
             | T_ASTERISK aQExpr {
                 struct hdql_Compound * nvc = _vcompound_def_start(&yyloc, ws, yyscanner, "#1", $2, true);
-                if(!nvc) { return HDQL_BAD_QUERY_EXPRESSION; }
+                if(!nvc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
                 ws->compoundStack[ws->compoundStackTop].posCompoundNArg = 2;
                 $$.compoundPtr = nvc;
             }
@@ -674,7 +842,7 @@ vPositionalCompoundDef : aQExpr {
                 snprintf(attrName, sizeof(attrName), "#%u", ws->compoundStack[ws->compoundStackTop].posCompoundNArg++);
                 struct hdql_Compound * vc = _vcompound_append_with_query(&yyloc, ws, yyscanner
                             , $1.compoundPtr, attrName, $3, false);
-                if(!vc) { return HDQL_BAD_QUERY_EXPRESSION; }
+                if(!vc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
                 $$.compoundPtr = vc;
             }
             | vPositionalCompoundDef T_COMMA T_ASTERISK aQExpr {
@@ -682,7 +850,7 @@ vPositionalCompoundDef : aQExpr {
                 snprintf(attrName, sizeof(attrName), "#%u", ws->compoundStack[ws->compoundStackTop].posCompoundNArg++);
                 struct hdql_Compound * vc = _vcompound_append_with_query(&yyloc, ws, yyscanner
                             , $1.compoundPtr, attrName, $4, true);
-                if(!vc) { return HDQL_BAD_QUERY_EXPRESSION; }
+                if(!vc) { M_ABORT(HDQL_BAD_QUERY_EXPRESSION); }
                 ws->compoundStack[ws->compoundStackTop].isBound = 0x1;
                 $$.compoundPtr = vc;
             }
@@ -814,6 +982,11 @@ static void _transient_dtr__virtual_compound(hdql_Datum_t q_, hdql_Context_t ctx
     hdql_query_destroy((struct hdql_Query *) q_, ctx);
 }
 
+static hdql_Datum_t _transient_cpy__virtual_compound(const struct hdql_Datum * q_
+        , struct hdql_QueryCloneState * cs, hdql_Context_t ctx) {
+    return (hdql_Datum_t) hdql_query_clone_with((const struct hdql_Query *) q_, cs, ctx);
+}
+
 static void _transient_dtr__bound_virtual_compound(hdql_Datum_t dd_, hdql_Context_t ctx) {
     assert(dd_);
     struct hdql_BindingCompoundCollectionDefData * dd
@@ -823,6 +996,391 @@ static void _transient_dtr__bound_virtual_compound(hdql_Datum_t dd_, hdql_Contex
         hdql_query_destroy(dd->filterQuery, ctx);
     hdql_context_free(ctx, (hdql_Datum_t) dd);
 }
+
+static hdql_Datum_t _transient_cpy__bound_virtual_compound(const struct hdql_Datum * dd_
+        , struct hdql_QueryCloneState * cs, hdql_Context_t ctx) {
+    const struct hdql_BindingCompoundCollectionDefData * dd
+                = hdql_cast(ctx, const struct hdql_BindingCompoundCollectionDefData, dd_);
+    struct hdql_BindingCompoundCollectionDefData * copy
+                = hdql_alloc(ctx, struct hdql_BindingCompoundCollectionDefData);
+    if(!copy) return NULL;
+    copy->vCompound = hdql_query_clone_compound(dd->vCompound, cs, ctx);
+    copy->filterQuery = NULL;
+    if( (!copy->vCompound)
+     || (dd->filterQuery && !(copy->filterQuery = hdql_query_clone_with(dd->filterQuery, cs, ctx)))
+      ) {
+        hdql_context_free(ctx, (hdql_Datum_t) copy);
+        return NULL;
+    }
+    return (hdql_Datum_t) copy;
+}
+
+/* Tries to hand over filtering expression applied to collection items to the
+ * collection interface (predicate pushdown). Applicable when the filter is a
+ * comparison of item's attribute with a constant value and interface of the
+ * last collection in a chain implements `compile_predicate()`, e.g.:
+ *
+ *      .hits{: .energyDeposition > 10}
+ *
+ * Returns true if the filter has been accepted by the collection, so it does
+ * not need to be evaluated on every item. */
+static bool
+_push_down_filter( Workspace_t ws
+                 , struct hdql_Query * collectionQuery
+                 , struct hdql_Query * filterQuery
+                 ) {
+    /* filtered collection */
+    struct hdql_Query * cq = collectionQuery, * next;
+    while(!!(next = hdql_query_next_query(cq))) cq = next;
+    const struct hdql_AttrDef * cAD = hdql_query_get_subject(cq);
+    if( (!is_collection(cAD)) || (!is_compound(cAD))
+     || hdql_attr_def_is_transient(cAD) ) return false;
+    const struct hdql_CollectionAttrInterface * cIFace
+            = hdql_attr_def_collection_iface(cAD);
+    if(NULL == cIFace->compile_predicate) return false;
+    /* filter shall be a binary comparison operation */
+    if(hdql_query_next_query(filterQuery)) return false;
+    const struct hdql_AttrDef * fAD = hdql_query_get_subject(filterQuery);
+    if((!is_scalar(fAD)) || (!hdql_attr_def_is_transient(fAD))) return false;
+    const struct hdql_ScalarAttrInterface * fIFace = hdql_attr_def_scalar_iface(fAD);
+    if(fIFace->reset != _hdql_gScalarArithOpIFace.reset) return false;
+    const struct hdql_ArithOpDefData * op
+            = (const struct hdql_ArithOpDefData *) fIFace->definitionData;
+    if(NULL == op->args[1]) return false;  /* unary operation */
+    struct hdql_CollectionPredicate p;
+    struct hdql_Query * attrQ = op->args[0], * valueQ = op->args[1];
+    p.opCode = op->opCode;
+    if(is_static(hdql_query_get_subject(attrQ))) {
+        /* constant is on the left, mirror the comparison */
+        attrQ = op->args[1];
+        valueQ = op->args[0];
+        switch(p.opCode) {
+            case hdql_kOpLT:  p.opCode = hdql_kOpGT;  break;
+            case hdql_kOpLTE: p.opCode = hdql_kOpGTE; break;
+            case hdql_kOpGT:  p.opCode = hdql_kOpLT;  break;
+            case hdql_kOpGTE: p.opCode = hdql_kOpLTE; break;
+            default: break;
+        }
+    }
+    switch(p.opCode) {
+        case hdql_kOpLT: case hdql_kOpLTE: case hdql_kOpGT: case hdql_kOpGTE:
+        case hdql_kOpEq: case hdql_kOpNEq:
+            break;
+        default:
+            return false;
+    }
+    if(hdql_query_next_query(attrQ) || hdql_query_next_query(valueQ)) return false;
+    p.attrDef = hdql_query_get_subject(attrQ);
+    const struct hdql_AttrDef * vAD = hdql_query_get_subject(valueQ);
+    if( (!is_static(vAD)) || (!is_atomic(p.attrDef)) || (!is_scalar(p.attrDef))
+     || hdql_attr_def_is_transient(p.attrDef) ) return false;
+    /* compared attribute shall be one of the collection item's attributes */
+    const struct hdql_Compound * itemCompound = hdql_attr_def_compound_type_info(cAD);
+    const size_t nAttrs = hdql_compound_get_nattrs(itemCompound);
+    const char ** names = (const char **) malloc(sizeof(char *)*nAttrs);
+    if(NULL == names) return false;
+    hdql_compound_get_attr_names(itemCompound, names);
+    p.attrName = NULL;
+    for(size_t i = 0; i < nAttrs; ++i) {
+        if(hdql_compound_get_attr(itemCompound, names[i]) != p.attrDef) continue;
+        p.attrName = names[i];
+        break;
+    }
+    free(names);
+    if(NULL == p.attrName) return false;
+    p.valueTypeCode = hdql_attr_def_get_atomic_value_type_code(vAD);
+    p.value = hdql_attr_def_get_static_value(vAD);
+    hdql_SelectionArgs_t selArgs = cIFace->compile_predicate(&p
+            , hdql_query_get_collection_selection(cq)
+            , cIFace->definitionData, ws->context);
+    if(NULL == selArgs) return false;
+    hdql_query_set_collection_selection(cq, selArgs);
+    return true;
+}
+
+/*
+ * Common sub-expression elimination
+ *
+ * Sub-expressions computed within a scope (attributes of unbound virtual
+ * compound and its filter) are compared structurally -- same attribute
+ * definitions, same operations and functions applied to the same arguments.
+ * Identical ones are substituted with occurrences of shared query evaluated
+ * once per owner (see `_hdql_gScalarSharedQueryIFace`), e.g. in
+ *
+ *      .hits{r := sqrt(.x*.x + .y*.y), rr := sqrt(.x*.x + .y*.y)*2 : r > 5}
+ *
+ * the square root is computed once per hit. Only calls of pure functions (see
+ * `hdql_functions_is_pure()`) are merged, so that, e.g. two `narb()` calls
+ * still yield independent draws.
+ */
+
+/* Operation or function call node description */
+struct CSEOperation {
+    const struct hdql_OperationEvaluator * evaluator;  /* NULL for functions */
+    hdql_OperationCode_t opCode;
+    const char * funcName;  /* NULL for operations */
+    bool isPure;  /* false for calls of impure functions */
+    struct hdql_Query * const * args;
+    size_t nArgs;
+};
+
+/* Sub-expression that can be shared */
+struct CSECandidate {
+    struct hdql_Query * q;
+    size_t size;  /* number of query nodes in sub-expression */
+    long parent;  /* index of encompassing candidate, -1 if none */
+    enum { kCSEFree, kCSEShared, kCSERemoved } state;
+};
+
+static struct hdql_FuncCall *
+_func_call_find(Workspace_t ws, const struct hdql_Query * q) {
+    for(size_t i = 0; i < ws->nFuncCalls; ++i) {
+        if(ws->funcCalls[i].q == q) return ws->funcCalls + i;
+    }
+    return NULL;
+}
+
+static bool
+_cse_operation(Workspace_t ws, struct hdql_Query * q, struct CSEOperation * op) {
+    const struct hdql_AttrDef * ad = hdql_query_get_subject(q);
+    const struct hdql_ArithOpDefData * dd = NULL;
+    if(is_scalar(ad)) {
+        const struct hdql_ScalarAttrInterface * iface = hdql_attr_def_scalar_iface(ad);
+        if(iface->reset == _hdql_gScalarArithOpIFace.reset)
+            dd = (const struct hdql_ArithOpDefData *) iface->definitionData;
+    } else {
+        const struct hdql_CollectionAttrInterface * iface = hdql_attr_def_collection_iface(ad);
+        if(iface->reset_iterator == _hdql_gCollectionArithOpIFace.reset_iterator)
+            dd = (const struct hdql_ArithOpDefData *) iface->definitionData;
+    }
+    if(dd) {
+        op->evaluator = dd->evaluator;
+        op->opCode = dd->opCode;
+        op->funcName = NULL;
+        op->isPure = true;
+        op->args = dd->args;
+        op->nArgs = dd->args[1] ? 2 : 1;
+        return true;
+    }
+    const struct hdql_FuncCall * fc = _func_call_find(ws, q);
+    if(!fc) return false;
+    op->evaluator = NULL;
+    op->opCode = 0x0;
+    op->funcName = fc->funcName;
+    op->isPure = hdql_functions_is_pure(hdql_context_get_functions(ws->context)
+            , fc->funcName);
+    op->args = fc->args;
+    op->nArgs = fc->nArgs;
+    return true;
+}
+
+/* Returns true if query chains are structurally identical */
+static bool
+_cse_queries_equal(Workspace_t ws, struct hdql_Query * a, struct hdql_Query * b) {
+    for( ; a && b; a = hdql_query_next_query(a), b = hdql_query_next_query(b) ) {
+        const struct hdql_AttrDef * adA = hdql_query_get_subject(a)
+                                 , * adB = hdql_query_get_subject(b);
+        if(is_collection(adA) != is_collection(adB)) return false;
+        if( is_collection(adA)
+         && hdql_query_get_collection_selection(a) != hdql_query_get_collection_selection(b) )
+            return false;
+        /* the same (non-owned) attribute definition */
+        if(adA == adB) continue;
+        if(is_static(adA) || is_static(adB)) {
+            if(!(is_static(adA) && is_static(adB))) return false;
+            hdql_ValueTypeCode_t vtc = hdql_attr_def_get_atomic_value_type_code(adA);
+            if(vtc != hdql_attr_def_get_atomic_value_type_code(adB)) return false;
+            const struct hdql_ValueInterface * vi
+                    = hdql_types_get_type(hdql_context_get_types(ws->context), vtc);
+            if( (!vi) || memcmp( hdql_attr_def_get_static_value(adA)
+                               , hdql_attr_def_get_static_value(adB), vi->size) )
+                return false;
+            continue;
+        }
+        struct CSEOperation opA, opB;
+        if( (!_cse_operation(ws, a, &opA)) || (!_cse_operation(ws, b, &opB)) )
+            return false;
+        if(!(opA.isPure && opB.isPure)) return false;
+        if( opA.evaluator != opB.evaluator || opA.opCode != opB.opCode
+         || opA.nArgs != opB.nArgs ) return false;
+        if( opA.funcName && strcmp(opA.funcName, opB.funcName) ) return false;
+        for(size_t i = 0; i < opA.nArgs; ++i) {
+            if(!_cse_queries_equal(ws, opA.args[i], opB.args[i])) return false;
+        }
+    }
+    return a == b;  /* both chains depleted */
+}
+
+/* Collects candidates of query chain, returns number of nodes in chain */
+static size_t
+_cse_collect( Workspace_t ws, struct hdql_Query * q, long parent
+            , struct CSECandidate ** cands, size_t * nCands, size_t * nAllocated
+            ) {
+    size_t size = 0;
+    const bool isSingleNode = NULL == hdql_query_next_query(q);
+    for( ; q; q = hdql_query_next_query(q) ) {
+        ++size;
+        struct CSEOperation op;
+        if(!_cse_operation(ws, q, &op)) continue;
+        const struct hdql_AttrDef * ad = hdql_query_get_subject(q);
+        long idx = parent;
+        if( isSingleNode && is_scalar(ad) && is_atomic(ad)
+         && 0x0 == hdql_attr_def_get_key_type_code(ad) ) {
+            if(*nCands == *nAllocated) {
+                const size_t n = *nAllocated ? 2*(*nAllocated) : 16;
+                struct CSECandidate * newCands = (struct CSECandidate *)
+                        realloc(*cands, n*sizeof(struct CSECandidate));
+                if(newCands) {
+                    *cands = newCands;
+                    *nAllocated = n;
+                }
+            }
+            /* (if candidates list can not be extended, sub-expression is
+             * just not shared) */
+            if(*nCands < *nAllocated) {
+                idx = (*nCands)++;
+                (*cands)[idx].q = q;
+                (*cands)[idx].parent = parent;
+                (*cands)[idx].state = kCSEFree;
+            }
+        }
+        size_t nodeSize = 1;
+        for(size_t i = 0; i < op.nArgs; ++i) {
+            nodeSize += _cse_collect(ws, op.args[i], idx, cands, nCands, nAllocated);
+        }
+        size += nodeSize - 1;
+        if(idx != parent) (*cands)[idx].size = nodeSize;
+    }
+    return size;
+}
+
+/* Drops function call records of sub-expression to be deleted */
+static void
+_cse_forget(Workspace_t ws, struct hdql_Query * q) {
+    for( ; q; q = hdql_query_next_query(q) ) {
+        struct CSEOperation op;
+        if(!_cse_operation(ws, q, &op)) continue;
+        for(size_t i = 0; i < op.nArgs; ++i) _cse_forget(ws, op.args[i]);
+        struct hdql_FuncCall * fc = _func_call_find(ws, q);
+        if(!fc) continue;
+        free(fc->funcName);
+        free(fc->args);
+        *fc = ws->funcCalls[--(ws->nFuncCalls)];
+    }
+}
+
+static bool
+_cse_is_within(const struct CSECandidate * cands, long i, long ancestor) {
+    for( ; i >= 0; i = cands[i].parent ) {
+        if(i == ancestor) return true;
+    }
+    return false;
+}
+
+/* Substitutes identical sub-expressions of virtual compound's forwarding
+ * queries and filter with shared queries. Returns array of created shared
+ * queries (referenced, to be released by caller) */
+static int
+_eliminate_common_subexpressions( Workspace_t ws
+                                , struct hdql_Compound * vCompound
+                                , struct hdql_Query * filterQuery
+                                , struct hdql_SharedQuery *** sharedQueries
+                                , size_t * nSharedQueries
+                                ) {
+    *sharedQueries = NULL;
+    *nSharedQueries = 0;
+    /* collect candidates from forwarding queries and filter */
+    struct CSECandidate * cands = NULL;
+    size_t nCands = 0, nAllocated = 0;
+    const size_t nAttrs = hdql_compound_get_nattrs(vCompound);
+    const char ** names = (const char **) malloc(sizeof(char *)*(nAttrs + 1));
+    if(NULL == names) {
+        hdql_context_err_push(ws->context, HDQL_ERR_MEMORY
+                , "failed to allocate attribute names of virtual compound");
+        return HDQL_ERR_MEMORY;
+    }
+    hdql_compound_get_attr_names(vCompound, names);
+    for(size_t i = 0; i < nAttrs; ++i) {
+        const struct hdql_AttrDef * ad = hdql_compound_get_attr(vCompound, names[i]);
+        if(!hdql__attr_def_is_fwd_query(ad)) continue;
+        _cse_collect(ws, hdql__attr_def_fwd_query(ad), -1, &cands, &nCands, &nAllocated);
+    }
+    free(names);
+    if(filterQuery)
+        _cse_collect(ws, filterQuery, -1, &cands, &nCands, &nAllocated);
+    /* order candidates by decreasing size, so largest sub-expressions are
+     * shared first */
+    size_t * order = (size_t *) malloc(sizeof(size_t)*(nCands + 1));
+    if(NULL == order) {
+        free(cands);
+        hdql_context_err_push(ws->context, HDQL_ERR_MEMORY
+                , "failed to allocate common sub-expressions order");
+        return HDQL_ERR_MEMORY;
+    }
+    for(size_t i = 0; i < nCands; ++i) {
+        size_t j = i;
+        for( ; j && cands[order[j-1]].size < cands[i].size; --j) order[j] = order[j-1];
+        order[j] = i;
+    }
+    int rc = HDQL_ERR_CODE_OK;
+    for(size_t oi = 0; oi < nCands && HDQL_ERR_CODE_OK == rc; ++oi) {
+        struct CSECandidate * c = cands + order[oi];
+        if(kCSEFree != c->state) continue;
+        struct hdql_SharedQuery * sq = NULL;
+        const struct hdql_AtomicTypeFeatures * typeInfo
+                = hdql_attr_def_atomic_type_info(hdql_query_get_subject(c->q));
+        for( size_t oj = oi + 1
+           ; oj < nCands && cands[order[oj]].size == c->size
+           ; ++oj ) {
+            struct CSECandidate * d = cands + order[oj];
+            if(kCSEFree != d->state || !_cse_queries_equal(ws, c->q, d->q)) continue;
+            if(!sq) {
+                /* first pair found -- move sub-expression into shared query
+                 * and substitute the origin with its occurrence */
+                struct hdql_Query * sqQuery = NULL;
+                if( (!(sq = hdql_shared_query_create(NULL, ws->context)))
+                 || (!(sqQuery = _new_transient_query(ws
+                            , hdql_attr_def_create_shared_query(sq, typeInfo, ws->context)))) ) {
+                    if(sq) hdql_shared_query_unref(sq, ws->context);
+                    rc = HDQL_ERR_MEMORY;
+                    break;
+                }
+                hdql_query_swap_subjects(c->q, sqQuery);
+                struct hdql_FuncCall * fc = _func_call_find(ws, c->q);
+                if(fc) fc->q = sqQuery;
+                hdql_shared_query_set_query(sq, sqQuery);
+                c->state = kCSEShared;
+                struct hdql_SharedQuery ** newSharedQueries = (struct hdql_SharedQuery **)
+                        realloc(*sharedQueries
+                            , sizeof(struct hdql_SharedQuery *)*(*nSharedQueries + 1));
+                if(NULL == newSharedQueries) {
+                    hdql_shared_query_unref(sq, ws->context);
+                    rc = HDQL_ERR_MEMORY;
+                    break;
+                }
+                *sharedQueries = newSharedQueries;
+                (*sharedQueries)[(*nSharedQueries)++] = sq;
+            }
+            /* substitute duplicate with occurrence of shared query */
+            struct hdql_Query * dup = _new_transient_query(ws
+                    , hdql_attr_def_create_shared_query(sq, typeInfo, ws->context));
+            if(!dup) {
+                rc = HDQL_ERR_MEMORY;
+                break;
+            }
+            for(size_t k = 0; k < nCands; ++k) {
+                if(_cse_is_within(cands, k, d - cands)) cands[k].state = kCSERemoved;
+            }
+            _cse_forget(ws, d->q);
+            hdql_query_swap_subjects(d->q, dup);
+            hdql_query_destroy(dup, ws->context);
+        }
+    }
+    free(order);
+    free(cands);
+    return rc;
+}
+
 /* This function gets called upon finalizing a new virtual compound with scope
  * operator (after `}' in `{...}' and produces filtering or trivial query node
  * that should return
@@ -847,20 +1405,58 @@ _new_virtual_compound_query( YYLTYPE * yylloc
     struct hdql_AttrDef * vCompoundAttrDef;
     if(!hdql_virtual_compound_is_bound(vCompoundPtr)) {
         struct hdql_ScalarAttrInterface iface;
-        if(NULL == filterQuery) {
+        if( filterQuery
+         && !hdql_attr_def_is_scalar(hdql_query_top_attr(filterQuery)) ) {
+            hdql_error(yylloc, ws, NULL
+                , "filtering expression result is not a scalar value"
+                );
+            /*return HDQL_ERR_OPERATION_NOT_SUPPORTED;*/
+            return NULL;
+        }
+        /* identical sub-expressions within the scope are evaluated once per
+         * instance; scope node then has to invalidate their results */
+        struct hdql_SharedQuery ** sharedQueries;
+        size_t nSharedQueries;
+        if(HDQL_ERR_CODE_OK != _eliminate_common_subexpressions(ws
+                    , vCompoundPtr, filterQuery, &sharedQueries, &nSharedQueries)) {
+            hdql_error(yylloc, ws, NULL
+                , "failed to share common sub-expressions of the scope"
+                );
+            return NULL;
+        }
+        if(HDQL_ERR_CODE_OK != _fuse_scope_arithmetics(ws
+                    , vCompoundPtr, filterQuery, sharedQueries, nSharedQueries)) {
+            hdql_error(yylloc, ws, NULL
+                , "failed to fuse arithmetic expressions of the scope"
+                );
+            for(size_t i = 0; i < nSharedQueries; ++i)
+                hdql_shared_query_unref(sharedQueries[i], ws->context);
+            free(sharedQueries);
+            return NULL;
+        }
+        if(nSharedQueries) {
+            iface = _hdql_gSharedQueriesScopeIFace;
+            if(NULL == filterQuery) {
+                iface.new_dyn_data = NULL;
+                iface.destroy_dyn_data = NULL;
+            }
+            iface.definitionData = hdql_shared_queries_scope_definition_data_init(
+                    filterQuery, sharedQueries, nSharedQueries, ws->context);
+            for(size_t i = 0; i < nSharedQueries; ++i)
+                hdql_shared_query_unref(sharedQueries[i], ws->context);
+            free(sharedQueries);
+            if(NULL == iface.definitionData) {
+                hdql_error(yylloc, ws, NULL
+                    , "failed to allocate shared sub-expressions of the scope"
+                    );
+                return NULL;
+            }
+        } else if(NULL == filterQuery) {
             bzero(&iface, sizeof(iface));
             iface.reset = _dereference_to_self_on_reset;
         } else {
             iface = _hdql_gFilteredCompoundIFace;
             iface.definitionData = (hdql_Datum_t) filterQuery;
-            const struct hdql_AttrDef *ad = hdql_query_top_attr(filterQuery);
-            if(!hdql_attr_def_is_scalar(ad)) {
-                hdql_error(yylloc, ws, NULL
-                    , "filtering expression result is not a scalar value"
-                    );
-                /*return HDQL_ERR_OPERATION_NOT_SUPPORTED;*/
-                return NULL;
-            }
         }
         vCompoundAttrDef = hdql_attr_def_create_compound_scalar(
                   vCompoundPtr  /* ... compound ptr */
@@ -869,10 +1465,25 @@ _new_virtual_compound_query( YYLTYPE * yylloc
                 , NULL  /* ........... key copy callback */
                 , ws->context  /* .... context */
                 );
-        if(NULL == filterQuery) {
+        if(NULL == vCompoundAttrDef) {
+            if(nSharedQueries)
+                hdql_shared_queries_scope_definition_data_destroy(
+                        (hdql_Datum_t) iface.definitionData, ws->context);
+            hdql_error(yylloc, ws, NULL
+                , "failed to allocate virtual compound attribute definition"
+                );
+            return NULL;
+        }
+        if(nSharedQueries) {
+            hdql_attr_def_set_transient(vCompoundAttrDef
+                    , hdql_shared_queries_scope_definition_data_destroy);
+            hdql_attr_def_set_transient_copy(vCompoundAttrDef
+                    , hdql_shared_queries_scope_definition_data_copy);
+        } else if(NULL == filterQuery) {
             hdql_attr_def_set_transient(vCompoundAttrDef, NULL);
         } else {
             hdql_attr_def_set_transient(vCompoundAttrDef, _transient_dtr__virtual_compound);
+            hdql_attr_def_set_transient_copy(vCompoundAttrDef, _transient_cpy__virtual_compound);
         }
     } else {
         /* Binding compounds always results in a collection: {*.a} where .a is
@@ -882,6 +1493,13 @@ _new_virtual_compound_query( YYLTYPE * yylloc
          * Re-setting or advancing query to bound v-compound shall cause
          * evaluation of the bound forwarding queries first, setting
          * corresponding attributes. */
+        if(HDQL_ERR_CODE_OK != _fuse_scope_arithmetics(ws
+                    , vCompoundPtr, filterQuery, NULL, 0)) {
+            hdql_error(yylloc, ws, NULL
+                , "failed to fuse arithmetic expressions of the scope"
+                );
+            return NULL;
+        }
         struct hdql_CollectionAttrInterface iface = _hdql_gBindingCompoundCollectionIFace;
         /* filtering query and pointer to (not yet finalized) virtual compound
          * definition have to be transferred to the iterator instantiation
@@ -889,6 +1507,12 @@ _new_virtual_compound_query( YYLTYPE * yylloc
          * product results */
         struct hdql_BindingCompoundCollectionDefData * dd
                 = hdql_alloc(ws->context, struct hdql_BindingCompoundCollectionDefData);
+        if(NULL == dd) {
+            hdql_error(yylloc, ws, NULL
+                , "failed to allocate binding compound definition"
+                );
+            return NULL;
+        }
         dd->vCompound = vCompoundPtr;
         dd->filterQuery = filterQuery;
         iface.definitionData = (hdql_Datum_t) dd;
@@ -900,13 +1524,83 @@ _new_virtual_compound_query( YYLTYPE * yylloc
                 , hdql_bound_compound_key_reserve  /* key reserve callback */
                 , ws->context  /* .... context */
                 );
+        if(NULL == vCompoundAttrDef) {
+            hdql_context_free(ws->context, (hdql_Datum_t) dd);
+            hdql_error(yylloc, ws, NULL
+                , "failed to allocate virtual compound attribute definition"
+                );
+            return NULL;
+        }
         hdql_attr_def_set_transient(vCompoundAttrDef, _transient_dtr__bound_virtual_compound);
+        hdql_attr_def_set_transient_copy(vCompoundAttrDef, _transient_cpy__bound_virtual_compound);
+    }
+    struct hdql_Query * q = _new_transient_query(ws, vCompoundAttrDef);
+    if(NULL == q) {
+        hdql_error(yylloc, ws, NULL, "failed to allocate virtual compound query");
     }
-    struct hdql_Query * q = hdql_query_create(vCompoundAttrDef, NULL, ws->context);
-    hdql_query_set_transient_subject_ownership(q);
     return q;
 }
 
+/* Creates query of scalar expression scope: `.tracks{chi2prob(.chi2, .ndf)}'
+ * yields the expression value for every item, keyed by collection keys, the
+ * same way as `.tracks{p := chi2prob(.chi2, .ndf)}.p' does, but without
+ * virtual compound and forwarding query -- the expression is evaluated
+ * directly on items. Optional filter is evaluated on the item before the
+ * expression (or handed to the collection interface, if possible). Returned
+ * query has to be appended to the owner query, if any. */
+static struct hdql_Query *
+_new_expression_scope_query( YYLTYPE * yylloc
+                           , Workspace_t ws
+                           , struct hdql_Query * ownerQuery
+                           , struct hdql_Query * valueQuery
+                           , struct hdql_Query * filterQuery
+                           ) {
+    assert(valueQuery);
+    if(NULL == filterQuery) return valueQuery;
+    if(!hdql_attr_def_is_scalar(hdql_query_top_attr(filterQuery))) {
+        hdql_error(yylloc, ws, NULL
+            , "filtering expression result is not a scalar value"
+            );
+        hdql_query_destroy(valueQuery, ws->context);
+        hdql_query_destroy(filterQuery, ws->context);
+        return NULL;
+    }
+    if(ownerQuery && _push_down_filter(ws, ownerQuery, filterQuery)) {
+        /* filter is handled by collection interface */
+        hdql_query_destroy(filterQuery, ws->context);
+        return valueQuery;
+    }
+    if(HDQL_ERR_CODE_OK != _fuse_arithmetics(ws, filterQuery)) {
+        hdql_error(yylloc, ws, NULL
+            , "failed to fuse arithmetic expressions of the filter"
+            );
+        hdql_query_destroy(valueQuery, ws->context);
+        hdql_query_destroy(filterQuery, ws->context);
+        return NULL;
+    }
+    /* filter node yields item itself (as virtual compound of unbound scope
+     * does), if filter is satisfied. Item compound is not changed by
+     * attribute definition, it just refers it */
+    struct hdql_ScalarAttrInterface iface = _hdql_gFilteredCompoundIFace;
+    iface.definitionData = (hdql_Datum_t) filterQuery;
+    struct hdql_AttrDef * filterAttrDef = hdql_attr_def_create_compound_scalar(
+              (struct hdql_Compound *) hdql_parser_top_compound(ws)
+            , &iface, 0x0, NULL, ws->context );
+    if(filterAttrDef) {
+        hdql_attr_def_set_transient(filterAttrDef, _transient_dtr__virtual_compound);
+        hdql_attr_def_set_transient_copy(filterAttrDef, _transient_cpy__virtual_compound);
+    } else {
+        hdql_query_destroy(filterQuery, ws->context);
+    }
+    struct hdql_Query * q = _new_transient_query(ws, filterAttrDef);
+    if(NULL == q) {
+        hdql_error(yylloc, ws, NULL, "failed to allocate filter query");
+        hdql_query_destroy(valueQuery, ws->context);
+        return NULL;
+    }
+    return hdql_query_append(q, valueQuery);
+}
+
 static void
 _transient_dtr__arith_op(hdql_Datum_t d, hdql_Context_t ctx) {
     struct hdql_ArithOpDefData * defData = (struct hdql_ArithOpDefData *) d;
@@ -915,6 +1609,317 @@ _transient_dtr__arith_op(hdql_Datum_t d, hdql_Context_t ctx) {
     hdql_context_free(ctx, d);
 }
 
+static hdql_Datum_t
+_transient_cpy__arith_op(const struct hdql_Datum * d
+        , struct hdql_QueryCloneState * cs, hdql_Context_t ctx) {
+    const struct hdql_ArithOpDefData * defData = (const struct hdql_ArithOpDefData *) d;
+    struct hdql_ArithOpDefData * copy = hdql_alloc(ctx, struct hdql_ArithOpDefData);
+    if(!copy) return NULL;
+    copy->evaluator = defData->evaluator;
+    copy->opCode = defData->opCode;
+    copy->args[0] = hdql_query_clone_with(defData->args[0], cs, ctx);
+    copy->args[1] = NULL;
+    if( (!copy->args[0])
+     || (defData->args[1] && !(copy->args[1] = hdql_query_clone_with(defData->args[1], cs, ctx)))
+      ) {
+        if(copy->args[0]) hdql_query_destroy(copy->args[0], ctx);
+        hdql_context_free(ctx, (hdql_Datum_t) copy);
+        return NULL;
+    }
+    return (hdql_Datum_t) copy;
+}
+
+/* Returns arithmetic operation definition data of the attribute definition,
+ * if it is an operation node */
+static struct hdql_ArithOpDefData *
+_arith_op_def_data(const struct hdql_AttrDef * ad) {
+    if(is_scalar(ad)) {
+        const struct hdql_ScalarAttrInterface * iface = hdql_attr_def_scalar_iface(ad);
+        if(iface->reset != _hdql_gScalarArithOpIFace.reset) return NULL;
+        return (struct hdql_ArithOpDefData *) iface->definitionData;
+    }
+    const struct hdql_CollectionAttrInterface * iface = hdql_attr_def_collection_iface(ad);
+    if(iface->reset_iterator != _hdql_gCollectionArithOpIFace.reset_iterator) return NULL;
+    return (struct hdql_ArithOpDefData *) iface->definitionData;
+}
+
+/* Retrieves numeric value of static constant query */
+static bool
+_static_numeric_value(struct Workspace * ws, struct hdql_Query * q, hdql_Flt_t * v) {
+    const struct hdql_AttrDef * ad = hdql_query_get_subject(q);
+    if(hdql_query_next_query(q) || !is_static(ad)) return false;
+    const struct hdql_ValueInterface * vi = hdql_types_get_type(
+            hdql_context_get_types(ws->context), hdql_attr_def_get_atomic_value_type_code(ad));
+    if((!vi) || !vi->get_as_float) return false;
+    *v = vi->get_as_float(hdql_attr_def_get_static_value(ad));
+    return true;
+}
+
+static bool
+_is_floating_point(struct Workspace * ws, hdql_ValueTypeCode_t vtc) {
+    const struct hdql_ValueTypes * types = hdql_context_get_types(ws->context);
+    return vtc == hdql_types_get_type_code(types, "float")
+        || vtc == hdql_types_get_type_code(types, "double");
+}
+
+/* Applies algebraic identities to the operation being created, returning
+ * operand the operation can be substituted with (other operands get
+ * destroyed). Returns NULL if operation can not be omitted.
+ *
+ * Only identities exact for the operand type are applied (e.g. `x + 0.' is
+ * not an identity for floating point `x = -0.'), with operation result type
+ * matching operand type, so no conversion is lost. To keep keys layout,
+ * operand must be a single-node scalar query. */
+static struct hdql_Query *
+_simplify_operation( struct Workspace * ws
+                   , struct hdql_Query * a
+                   , hdql_OperationCode_t opCode
+                   , struct hdql_Query * b
+                   , const struct hdql_OperationEvaluator * evaluator
+                   ) {
+    if(NULL == b) {
+        /* involutions: -(-x), ~(~x), !(!x) */
+        if( hdql_kUOpMinus != opCode && hdql_kUOpBNot != opCode
+         && hdql_kUOpNot != opCode ) return NULL;
+        if(hdql_query_next_query(a) || !is_scalar(hdql_query_get_subject(a))) return NULL;
+        struct hdql_ArithOpDefData * dd = _arith_op_def_data(hdql_query_get_subject(a));
+        if((!dd) || dd->opCode != opCode || dd->args[1]) return NULL;
+        struct hdql_Query * x = dd->args[0];
+        if( hdql_query_next_query(x) || !is_scalar(hdql_query_get_subject(x))
+         || hdql_attr_def_get_atomic_value_type_code(hdql_query_get_subject(x))
+                != evaluator->returnType ) return NULL;
+        /* detach the operand and drop inner operation */
+        dd->args[0] = NULL;
+        hdql_query_destroy(a, ws->context);
+        return x;
+    }
+    /* neutral elements */
+    struct hdql_Query * x, * c;
+    hdql_Flt_t v;
+    if(_static_numeric_value(ws, b, &v)) {
+        x = a;
+        c = b;
+    } else if(_static_numeric_value(ws, a, &v)) {
+        x = b;
+        c = a;
+    } else return NULL;
+    const bool cIsRight = (c == b);
+    if( hdql_query_next_query(x) || !is_scalar(hdql_query_get_subject(x)) ) return NULL;
+    const hdql_ValueTypeCode_t xCode
+            = hdql_attr_def_get_atomic_value_type_code(hdql_query_get_subject(x));
+    if(xCode != evaluator->returnType) return NULL;
+    const bool isFloat = _is_floating_point(ws, xCode);
+    bool isIdentity = false;
+    switch(opCode) {
+        case hdql_kOpProduct:
+        case hdql_kOpLAnd:
+            isIdentity = (1 == v);
+            break;
+        case hdql_kOpDivide:
+            isIdentity = cIsRight && 1 == v;
+            break;
+        case hdql_kOpSum:
+            /* -0. + 0. is +0. */
+            isIdentity = 0 == v && ((!isFloat) || signbit(v));
+            break;
+        case hdql_kOpMinus:
+            /* -0. - (-0.) is +0. */
+            isIdentity = cIsRight && 0 == v && ((!isFloat) || !signbit(v));
+            break;
+        case hdql_kOpBOr:
+        case hdql_kOpBXOr:
+        case hdql_kOpLOr:
+            isIdentity = (0 == v);
+            break;
+        case hdql_kOpLBShift:
+        case hdql_kOpRBShift:
+            isIdentity = cIsRight && 0 == v;
+            break;
+        default:
+            break;
+    };
+    if(!isIdentity) return NULL;
+    hdql_query_destroy(c, ws->context);
+    return x;
+}
+
+/* Creates query owning given transient attribute definition. Returns NULL if
+ * definition is NULL or query can not be allocated, destroying the
+ * definition in the latter case */
+static struct hdql_Query *
+_new_transient_query(struct Workspace * ws, struct hdql_AttrDef * ad) {
+    if(NULL == ad) return NULL;
+    struct hdql_Query * q = hdql_query_create(ad, NULL, ws->context);
+    if(NULL == q) {
+        hdql_attr_def_destroy(ad, ws->context);
+        return NULL;
+    }
+    hdql_query_set_transient_subject_ownership(q);
+    return q;
+}
+
+/* Evaluates query of pure computation over static values and substitutes it
+ * with a static value. Returns NULL (keeping query intact) if evaluation
+ * failed */
+static struct hdql_Query *
+_fold_static_query(struct Workspace * ws, struct hdql_Query * q) {
+    const struct hdql_AttrDef * ad = hdql_query_get_subject(q);
+    const hdql_ValueTypeCode_t vtc = hdql_attr_def_get_atomic_value_type_code(ad);
+    const struct hdql_ValueInterface * vi
+            = hdql_types_get_type(hdql_context_get_types(ws->context), vtc);
+    if((!vi) || vi->isVariadic || 0 == vi->size) return NULL;
+    hdql_Datum_t r = hdql_query_reset(q, NULL, NULL, ws->context);
+    if(!r) return NULL;
+    hdql_Datum_t value = hdql_create_value(vtc, ws->context);
+    if(!value) return NULL;
+    if(vi->copy) {
+        if(0 != vi->copy(value, r, vi->size, ws->context)) {
+            hdql_destroy_value(vtc, value, ws->context);
+            return NULL;
+        }
+    } else {
+        memcpy(value, r, vi->size);
+    }
+    struct hdql_AttrDef * valueAD
+            = hdql_attr_def_create_static_atomic_scalar_value(vtc, value, ws->context);
+    if(!valueAD) {
+        hdql_destroy_value(vtc, value, ws->context);
+        return NULL;
+    }
+    struct hdql_Query * sq = _new_transient_query(ws, valueAD);
+    if(!sq) return NULL;
+    hdql_query_destroy(q, ws->context);
+    return sq;
+}
+
+/*
+ * Fusion of arithmetic expressions
+ *
+ * Maximal sub-trees of nested arithmetic operations, like `(.x - x0)*k + b',
+ * are collapsed into single node evaluating list of instructions over typed
+ * slots (see `_hdql_gScalarFusedArithOpIFace'), so evaluation does not
+ * involve reset and result datum of every intermediate node. Fused nodes are
+ * opaque for other compile-time optimizations, so fusion is performed once
+ * the scope is complete -- for forwarding queries, filter and shared
+ * sub-expressions of the virtual compound (after common sub-expression
+ * elimination) and for the resulting query.
+ */
+
+/* Substitutes nested arithmetic operations found in query chain (and in
+ * arguments of functions and operations) with fused nodes */
+static int
+_fuse_arithmetics(Workspace_t ws, struct hdql_Query * q) {
+    int rc;
+    for( ; q; q = hdql_query_next_query(q) ) {
+        struct hdql_ArithOpDefData * dd = _arith_op_def_data(hdql_query_get_subject(q));
+        if(!dd) {
+            const struct hdql_FuncCall * fc = _func_call_find(ws, q);
+            for(size_t i = 0; fc && i < fc->nArgs; ++i) {
+                if(HDQL_ERR_CODE_OK != (rc = _fuse_arithmetics(ws, fc->args[i])))
+                    return rc;
+            }
+            continue;
+        }
+        bool isNested = false;
+        for(int i = 0; i < 2; ++i) {
+            if( dd->args[i] && !hdql_query_next_query(dd->args[i])
+             && _arith_op_def_data(hdql_query_get_subject(dd->args[i])) )
+                isNested = true;
+        }
+        if(!isNested) {
+            /* single operation is not fused */
+            for(int i = 0; i < 2; ++i) {
+                if( dd->args[i]
+                 && HDQL_ERR_CODE_OK != (rc = _fuse_arithmetics(ws, dd->args[i])) )
+                    return rc;
+            }
+            continue;
+        }
+        struct hdql_AtomicTypeFeatures typeInfo;
+        typeInfo.isReadOnly = 0x1;
+        typeInfo.arithTypeCode = dd->evaluator->returnType;
+        struct hdql_FusedArithOpDefData * fd
+                = hdql_fused_arith_op_def_data_create(dd, ws->context);
+        if(!fd) return HDQL_ERR_MEMORY;
+        struct hdql_AttrDef * fAD;
+        if(fd->collectionLeaf == fd->nLeaves) {
+            struct hdql_ScalarAttrInterface scalarIFace = _hdql_gScalarFusedArithOpIFace;
+            scalarIFace.definitionData = (hdql_Datum_t) fd;
+            fAD = hdql_attr_def_create_atomic_scalar(
+                    &typeInfo, &scalarIFace, 0x0, NULL, ws->context );
+        } else {
+            struct hdql_CollectionAttrInterface collectionIFace
+                    = _hdql_gCollectionFusedArithOpIFace;
+            collectionIFace.definitionData = (hdql_Datum_t) fd;
+            fAD = hdql_attr_def_create_atomic_collection(
+                      &typeInfo, &collectionIFace, 0x0
+                    , hdql_reserve_fused_arith_op_collection_key, ws->context );
+        }
+        if(!fAD) {
+            hdql_fused_arith_op_def_data_destroy((hdql_Datum_t) fd, ws->context);
+            return HDQL_ERR_MEMORY;
+        }
+        hdql_attr_def_set_transient(fAD, hdql_fused_arith_op_def_data_destroy);
+        hdql_attr_def_set_transient_copy(fAD, hdql_fused_arith_op_def_data_copy);
+        /* substitute operation node keeping pointer to it intact, operation
+         * nodes left without arguments are dropped */
+        struct hdql_Query * fq = _new_transient_query(ws, fAD);
+        if(!fq) return HDQL_ERR_MEMORY;
+        hdql_query_swap_subjects(q, fq);
+        hdql_query_destroy(fq, ws->context);
+        /* leaves may have operations within (e.g. in function arguments) */
+        for(size_t i = 0; i < fd->nLeaves; ++i) {
+            if(HDQL_ERR_CODE_OK != (rc = _fuse_arithmetics(ws, fd->leaves[i])))
+                return rc;
+        }
+    }
+    return HDQL_ERR_CODE_OK;
+}
+
+/* Fuses arithmetics of forwarding queries, filter and shared sub-expressions
+ * of the scope */
+static int
+_fuse_scope_arithmetics( Workspace_t ws
+                       , struct hdql_Compound * vCompound
+                       , struct hdql_Query * filterQuery
+                       , struct hdql_SharedQuery ** sharedQueries
+                       , size_t nSharedQueries
+                       ) {
+    int rc = HDQL_ERR_CODE_OK;
+    const size_t nAttrs = hdql_compound_get_nattrs(vCompound);
+    const char ** names = (const char **) malloc(sizeof(char *)*(nAttrs + 1));
+    if(NULL == names) {
+        hdql_context_err_push(ws->context, HDQL_ERR_MEMORY
+                , "failed to allocate attribute names of virtual compound");
+        return HDQL_ERR_MEMORY;
+    }
+    hdql_compound_get_attr_names(vCompound, names);
+    for(size_t i = 0; i < nAttrs && HDQL_ERR_CODE_OK == rc; ++i) {
+        const struct hdql_AttrDef * ad = hdql_compound_get_attr(vCompound, names[i]);
+        if(!hdql__attr_def_is_fwd_query(ad)) continue;
+        rc = _fuse_arithmetics(ws, hdql__attr_def_fwd_query(ad));
+    }
+    free(names);
+    if(filterQuery && HDQL_ERR_CODE_OK == rc)
+        rc = _fuse_arithmetics(ws, filterQuery);
+    for(size_t i = 0; i < nSharedQueries && HDQL_ERR_CODE_OK == rc; ++i)
+        rc = _fuse_arithmetics(ws, hdql_shared_query_get_query(sharedQueries[i]));
+    return rc;
+}
+
+/* Destroys operands of failed operation, returns given code */
+static int
+_operands_destroy( struct Workspace * ws
+                 , struct hdql_Query * a, struct hdql_Query * b
+                 , int rc ) {
+    hdql_query_destroy(a, ws->context);
+    if(b) hdql_query_destroy(b, ws->context);
+    return rc;
+}
+
+/* Creates arithmetic operation node (or folds static one) for operand(s)
+ *
+ * Operands are owned by the result; on failure they are destroyed. */
 static int
 _operation( struct hdql_Query * a
           , hdql_OperationCode_t opCode
@@ -942,7 +1947,7 @@ _operation( struct hdql_Query * a
                 , opDescription
                 , b ? "first " : ""
                 , hdql_compound_get_name(hdql_attr_def_compound_type_info(attrA)));
-        return HDQL_ERR_OPERATION_NOT_SUPPORTED;
+        return _operands_destroy(ws, a, b, HDQL_ERR_OPERATION_NOT_SUPPORTED);
     }
     if(attrB && is_compound(attrB)) {
         hdql_error(yyloc, ws, NULL
@@ -950,7 +1955,7 @@ _operation( struct hdql_Query * a
                   " (can't use compound instance in arithmetics)"
                 , opDescription
                 , hdql_compound_get_name(hdql_attr_def_compound_type_info(attrB)));
-        return HDQL_ERR_OPERATION_NOT_SUPPORTED;
+        return _operands_destroy(ws, a, b, HDQL_ERR_OPERATION_NOT_SUPPORTED);
     }
     /* Figure out query types, this time not just top attribute definition,
      * but query result as a whole. If all queries in a chain returns  */
@@ -962,7 +1967,7 @@ _operation( struct hdql_Query * a
         hdql_error(yyloc, ws, NULL
                 , "can't apply %s arithmetic operator to arguments which are both collections"
                 , opDescription );
-        return HDQL_ERR_OPERATION_NOT_SUPPORTED;
+        return _operands_destroy(ws, a, b, HDQL_ERR_OPERATION_NOT_SUPPORTED);
     }
 
     /* obtain the arithmetic operator implementation based on type code(s) for
@@ -983,7 +1988,7 @@ _operation( struct hdql_Query * a
                       , viA ? viA->name : "(null type)"
                       , viB ? viB->name : "(null type)"
                       );
-            return HDQL_ERR_OPERATION_NOT_SUPPORTED;
+            return _operands_destroy(ws, a, b, HDQL_ERR_OPERATION_NOT_SUPPORTED);
         } else {
             const struct hdql_ValueInterface * viA = hdql_types_get_type(types, codeA);
             hdql_error( yyloc, ws, NULL
@@ -991,7 +1996,7 @@ _operation( struct hdql_Query * a
                       , opDescription
                       , viA ? viA->name : "(null type)"
                       );
-            return HDQL_ERR_OPERATION_NOT_SUPPORTED;
+            return _operands_destroy(ws, a, b, HDQL_ERR_OPERATION_NOT_SUPPORTED);
         }
     }
 
@@ -1012,6 +2017,11 @@ _operation( struct hdql_Query * a
         assert(valueA);
         assert((!b) || NULL != valueB);
         hdql_Datum_t result = hdql_create_value(evaluator->returnType, ws->context);
+        if(NULL == result) {
+            hdql_error( yyloc, ws, NULL, "%s: failed to allocate result"
+                      , opDescription );
+            return _operands_destroy(ws, a, b, HDQL_ERR_MEMORY);
+        }
         
         char errBf[128];
         int rc = evaluator->op(valueA, valueB, result);
@@ -1020,22 +2030,33 @@ _operation( struct hdql_Query * a
         if(0 != rc) {
             hdql_error( yyloc, ws, NULL, "%s %s", opDescription, errBf );
             hdql_destroy_value(evaluator->returnType, result, ws->context);
-            return HDQL_ERR_ARITH_OPERATION;
+            return _operands_destroy(ws, a, b, HDQL_ERR_ARITH_OPERATION);
         }
 
         /* new value calculated, create the result */
         struct hdql_AttrDef * resultAD
             = hdql_attr_def_create_static_atomic_scalar_value(evaluator->returnType, result, ws->context);
-        assert(hdql_attr_def_is_transient(resultAD));
-        *r = hdql_query_create(resultAD, NULL, ws->context);
-        hdql_query_set_transient_subject_ownership(*r);
-        assert(*r);
+        if(NULL == resultAD)
+            hdql_destroy_value(evaluator->returnType, result, ws->context);
+        *r = _new_transient_query(ws, resultAD);
+        if(NULL == *r) {
+            hdql_error( yyloc, ws, NULL, "%s: failed to allocate result query"
+                      , opDescription );
+            return _operands_destroy(ws, a, b, HDQL_ERR_MEMORY);
+        }
         /* destroy sub-queries */
         hdql_query_destroy(a, ws->context);
         if(b) hdql_query_destroy(b, ws->context);
         /* TODO (?): destroy owned attribute definitions */
         return 0;
     }
+    /* ...otherwise, try to omit the operation that does not change the
+     * operand (e.g. `x*1', `-(-x)') */
+    struct hdql_Query * operand = _simplify_operation(ws, a, opCode, b, evaluator);
+    if(operand) {
+        *r = operand;
+        return 0;
+    }
     /* ...otherwise, create operation node */
     struct hdql_AtomicTypeFeatures typeInfo;
     typeInfo.isReadOnly = 0x1; /* result is RO */
@@ -1043,10 +2064,15 @@ _operation( struct hdql_Query * a
     struct hdql_AttrDef * rAD;
     struct hdql_ArithOpDefData * defData = (struct hdql_ArithOpDefData *) hdql_context_alloc(
             ws->context, sizeof(struct hdql_ArithOpDefData));
-    assert(defData);
+    if(NULL == defData) {
+        hdql_error( yyloc, ws, NULL, "%s: failed to allocate operation"
+                  , opDescription );
+        return _operands_destroy(ws, a, b, HDQL_ERR_MEMORY);
+    }
     defData->args[0] = a;
     defData->args[1] = b;
     defData->evaluator = evaluator;
+    defData->opCode = opCode;
     if(attrAIsFullScalar && attrBIsFullScalar) {
         /* operation results in scalar */
         struct hdql_ScalarAttrInterface scalarIFace = _hdql_gScalarArithOpIFace;
@@ -1061,9 +2087,21 @@ _operation( struct hdql_Query * a
                   &typeInfo, &collectionIFace, 0x0
                 , hdql_reserve_arith_op_collection_key, ws->context );
     }
+    if(NULL == rAD) {
+        hdql_context_free(ws->context, (hdql_Datum_t) defData);
+        hdql_error( yyloc, ws, NULL, "%s: failed to allocate operation"
+                  , opDescription );
+        return _operands_destroy(ws, a, b, HDQL_ERR_MEMORY);
+    }
     hdql_attr_def_set_transient(rAD, _transient_dtr__arith_op);
-    *r = hdql_query_create(rAD, NULL, ws->context);
-    hdql_query_set_transient_subject_ownership(*r);
+    hdql_attr_def_set_transient_copy(rAD, _transient_cpy__arith_op);
+    *r = _new_transient_query(ws, rAD);
+    if(NULL == *r) {
+        /* operands are destroyed with the definition */
+        hdql_error( yyloc, ws, NULL, "%s: failed to allocate operation query"
+                  , opDescription );
+        return HDQL_ERR_MEMORY;
+    }
     return 0;
 }  /* _operation() */
 
@@ -1078,11 +2116,12 @@ _new_function( YYLTYPE * yyloc, struct Workspace * ws, yyscan_t yyscanner
         ++nArgs;
         if(NULL == cArg->nextArgument) break;
     }
-    /* build plain temporary array of arguments */
+    /* build plain temporary array of arguments (list is in reversed order
+     * as it is built by left-recursive rule) */
     struct hdql_Query ** argsArray = alloca(sizeof(struct hdql_Query *)*(nArgs + 1));
     size_t nArg = 0;
     for(struct hdql_FuncArgList * cArg = argsList; NULL != cArg; ) {
-        argsArray[nArg++] = cArg->thisArgument;
+        argsArray[nArgs - 1 - (nArg++)] = cArg->thisArgument;
         struct hdql_FuncArgList * toFree = cArg;
         cArg = cArg->nextArgument;
         free(toFree);
@@ -1113,8 +2152,59 @@ _new_function( YYLTYPE * yyloc, struct Workspace * ws, yyscan_t yyscanner
     assert(hdql_attr_def_is_transient(fAD));
     /* Otherwise, create a new query object wrapping "function attribute
      * definition */
-    struct hdql_Query * q = hdql_query_create(fAD, NULL, ws->context);
-    hdql_query_set_transient_subject_ownership(q);
+    struct hdql_Query * q = _new_transient_query(ws, fAD);
+    if(NULL == q) {
+        hdql_error( yyloc, ws, NULL
+                  , "Failed to allocate query of function %s(...)", funcName );
+        return NULL;
+    }
+    /* calls of pure functions on static values are evaluated at compile
+     * time (e.g. `sqrt(2)', `cos(pi/4)') */
+    bool isStatic = is_scalar(fAD) && is_atomic(fAD)
+                 && hdql_functions_is_pure(fDict, funcName);
+    for(size_t i = 0; isStatic && i < nArgs; ++i) {
+        isStatic = NULL == hdql_query_next_query(argsArray[i])
+                && is_static(hdql_query_get_subject(argsArray[i]));
+    }
+    if(isStatic) {
+        struct hdql_Query * sq = _fold_static_query(ws, q);
+        if(sq) return sq;
+    }
+    /* record the call */
+    if(ws->nFuncCalls == ws->nFuncCallsAllocated) {
+        const size_t n = ws->nFuncCallsAllocated ? 2*ws->nFuncCallsAllocated : 8;
+        struct hdql_FuncCall * funcCalls = (struct hdql_FuncCall *) realloc(ws->funcCalls
+                , sizeof(struct hdql_FuncCall)*n);
+        if(NULL == funcCalls) {
+            hdql_query_destroy(q, ws->context);
+            hdql_context_err_push(ws->context, HDQL_ERR_MEMORY
+                    , "failed to record call of function %s(...)", funcName);
+            hdql_error( yyloc, ws, NULL
+                      , "Failed to record call of function %s(...)", funcName );
+            return NULL;
+        }
+        ws->funcCalls = funcCalls;
+        ws->nFuncCallsAllocated = n;
+    }
+    char * funcNameCopy = strdup(funcName);
+    struct hdql_Query ** args
+            = (struct hdql_Query **) malloc(sizeof(struct hdql_Query *)*nArgs);
+    if(NULL == funcNameCopy || NULL == args) {
+        free(funcNameCopy);
+        free(args);
+        hdql_query_destroy(q, ws->context);
+        hdql_context_err_push(ws->context, HDQL_ERR_MEMORY
+                , "failed to record call of function %s(...)", funcName);
+        hdql_error( yyloc, ws, NULL
+                  , "Failed to record call of function %s(...)", funcName );
+        return NULL;
+    }
+    struct hdql_FuncCall * fc = ws->funcCalls + (ws->nFuncCalls++);
+    fc->q = q;
+    fc->funcName = funcNameCopy;
+    fc->nArgs = nArgs;
+    fc->args = args;
+    memcpy(fc->args, argsArray, sizeof(struct hdql_Query *)*nArgs);
     return q;
 }  /* _new_function() */
 
@@ -1207,10 +2297,15 @@ _vcompound_def_start(YYLTYPE * yyloc, struct Workspace * ws, yyscan_t yyscanner
     /* _substitute_ compound with new virtual one */
     struct hdql_Compound * vCompound
                 = hdql_virtual_compound_new(hdql_parser_top_compound(ws), ws->context);
-    hdql_context_add_virtual_compound(ws->context, vCompound);
+    if(NULL == vCompound) {
+        hdql_error(yyloc, ws, yyscanner, "failed to allocate virtual compound");
+        return NULL;
+    }
     struct hdql_Compound * nvc = _vcompound_append_with_query(
             yyloc, ws, yyscanner, vCompound, attrName, firstQuery, isBinding);
     if(nvc) {
+        /* (registered only when defined, as failed one is destroyed here) */
+        hdql_context_add_virtual_compound(ws->context, vCompound);
         ws->compoundStack[ws->compoundStackTop].compoundPtr = nvc;
         ws->compoundStack[ws->compoundStackTop].posCompoundNArg = 0;
         ws->compoundStack[ws->compoundStackTop].isBound = isBinding ? 0x1 : 0x0;
@@ -1222,6 +2317,21 @@ _vcompound_def_start(YYLTYPE * yyloc, struct Workspace * ws, yyscan_t yyscanner
     return nvc;
 }
 
+/* Returns true if memory error is among ones pushed to the context after it
+ * has had given number of errors pushed */
+static bool
+_memory_error_since(struct hdql_Context * ctx, size_t nPushed) {
+    const size_t nKept = hdql_context_errors_count(ctx)
+               , nTotal = nKept + hdql_context_errors_overflow(ctx)
+               ;
+    for(size_t n = nTotal > nPushed ? nTotal - nPushed : 0; n && nKept; --n) {
+        if(n > nKept) continue;
+        if(HDQL_ERR_MEMORY == hdql_context_error_get(ctx, nKept - n)->code)
+            return true;
+    }
+    return false;
+}
+
 /* 
  * Main parser function
  */
@@ -1247,6 +2357,12 @@ hdql_compile_query( const char * strexpr
     ws.compoundStackTop = 0;
     /* init result */
     ws.query = NULL;
+    ws.funcCalls = NULL;
+    ws.nFuncCalls = ws.nFuncCallsAllocated = 0;
+    ws.errCode = HDQL_ERR_CODE_OK;
+    /* to tell memory shortage from other failures */
+    const size_t nErrorsPushed = hdql_context_errors_count(ctx)
+                               + hdql_context_errors_overflow(ctx);
 
     /* do lex scanning */
     void * scannerPtr;
@@ -1254,6 +2370,10 @@ hdql_compile_query( const char * strexpr
     struct yy_buffer_state * buffer = yy_scan_string(strexpr, scannerPtr);
     /* parse scanned */
     int rc = yyparse(&ws, scannerPtr);
+    if(0 != rc && HDQL_ERR_CODE_OK != ws.errCode)
+        rc = ws.errCode;
+    if(0 != rc && _memory_error_since(ctx, nErrorsPushed))
+        rc = HDQL_ERR_MEMORY;
     /* copy error details on failure */
     if(0 != (errDetails[0] = rc)) {
         errDetails[1] = ws.errPos[0];       errDetails[2] = ws.errPos[1];
@@ -1262,6 +2382,23 @@ hdql_compile_query( const char * strexpr
     /* free scanner buffer, destroy scanner */
     yy_delete_buffer(buffer, scannerPtr);
     yylex_destroy(scannerPtr);
+    /* free function call records */
+    for(size_t i = 0; i < ws.nFuncCalls; ++i) {
+        free(ws.funcCalls[i].funcName);
+        free(ws.funcCalls[i].args);
+    }
+    free(ws.funcCalls);
+    /* build execution plan of the compiled query */
+    if(0 == rc && ws.query) {
+        if(HDQL_ERR_CODE_OK != (rc = hdql_query_finalize(ws.query, ws.context))) {
+            errDetails[0] = rc;
+        }
+    }
+    /* query can be set by the time parsing failed */
+    if(0 != rc && ws.query) {
+        hdql_query_destroy(ws.query, ws.context);
+        ws.query = NULL;
+    }
 
     return ws.query;
 }
@@ -15,9 +15,128 @@ struct hdql_Allocator {
 
 HDQL_API extern const struct hdql_Allocator hdql_gHeapAllocator;
 
+/*
+ * Arena allocator
+ */
+
+/**\brief Huge page size assumed for arena blocks backed by huge pages */
+#ifndef HDQL_ARENA_HUGE_PAGE_SIZE
+#   define HDQL_ARENA_HUGE_PAGE_SIZE (2*1024*1024)
+#endif
+
+/**\brief Arena allocator parameters */
+struct hdql_ArenaParameters {
+    /** Minimal size of the block mapped by arena, bytes; zero means single
+     * page (allocations larger than the block get their own block) */
+    size_t blockSize;
+    /** When set, blocks are mapped with `MAP_HUGETLB' falling back to
+     * ordinary pages with `madvise(MADV_HUGEPAGE)' hint; block size is
+     * rounded up to `HDQL_ARENA_HUGE_PAGE_SIZE' */
+    int hugePages;
+};
+
+/**\brief Arena usage statistics */
+struct hdql_ArenaStats {
+    /** Number of blocks mapped, including retained free ones */
+    size_t nBlocks;
+    /** Number of blocks mapped with `MAP_HUGETLB' */
+    size_t nHugeTLBBlocks;
+    /** Bytes allocated (since last rewind), including alignment padding */
+    size_t bytesUsed;
+    /** Bytes mapped */
+    size_t bytesReserved;
+    /** Maximum of `bytesUsed' */
+    size_t peakBytesUsed;
+};
+
+/**\brief Arena savepoint, see `hdql_alloc_arena_mark()' */
+struct hdql_ArenaMark {
+    void * block;
+    size_t used;
+    size_t bytesUsed;
+};
+
+/**\brief Initializes arena allocator with default parameters */
 HDQL_API void hdql_alloc_arena_init(struct hdql_Allocator *);
+
+/**\brief Initializes arena allocator with given parameters
+ *
+ * Parameters pointer may be NULL for defaults. Returns -1 on failure. */
+HDQL_API int hdql_alloc_arena_init_with(struct hdql_Allocator *
+        , const struct hdql_ArenaParameters *);
+
+/**\brief Returns savepoint of the arena to rewind to */
+HDQL_API struct hdql_ArenaMark hdql_alloc_arena_mark(const struct hdql_Allocator *);
+
+/**\brief Releases all the memory allocated since the mark was taken
+ *
+ * Blocks allocated after the mark are retained for reuse by further
+ * allocations (see `hdql_alloc_arena_trim()'). Marks taken after the given
+ * one are invalidated. */
+HDQL_API void hdql_alloc_arena_rewind(struct hdql_Allocator *, struct hdql_ArenaMark);
+
+/**\brief Releases all the memory allocated by arena, retaining blocks */
+HDQL_API void hdql_alloc_arena_reset(struct hdql_Allocator *);
+
+/**\brief Unmaps retained free blocks */
+HDQL_API void hdql_alloc_arena_trim(struct hdql_Allocator *);
+
+/**\brief Copies arena usage statistics */
+HDQL_API void hdql_alloc_arena_get_stats(const struct hdql_Allocator *
+        , struct hdql_ArenaStats *);
+
+/**\brief Unmaps all the arena blocks and frees arena */
 HDQL_API void hdql_alloc_arena_destroy(struct hdql_Allocator *);
 
+/*
+ * Size-class pool allocator
+ */
+
+/**\brief Size of the slab pool allocator takes from backing allocator */
+#ifndef HDQL_POOL_SLAB_SIZE
+#   define HDQL_POOL_SLAB_SIZE (64*1024)
+#endif
+
+/**\brief Number of objects moved between pool and thread cache at once */
+#ifndef HDQL_POOL_BATCH
+#   define HDQL_POOL_BATCH 32
+#endif
+
+/**\brief Pool usage statistics */
+struct hdql_PoolStats {
+    /** Number of slabs taken from backing allocator */
+    size_t nSlabs;
+    /** Bytes taken from backing allocator for slabs */
+    size_t bytesReserved;
+};
+
+/**\brief Process-wide size-class pool allocator backed by system heap
+ *
+ * Serves blocks up to 512 bytes from size classes with per-thread caches of
+ * free objects, forwarding larger ones to heap. Contexts using pool keep
+ * accounting info in pool's object header. Used by default for
+ * contexts (see `hdql_context_create()') unless library is built with
+ * `POOL_ALLOCATOR' option disabled. Never destroyed. */
+HDQL_API extern const struct hdql_Allocator hdql_gPoolAllocator;
+
+/**\brief Initializes own size-class pool allocator
+ *
+ * Slabs and large blocks are taken from backing allocator (heap, if NULL
+ * given) that must provide blocks aligned for any fundamental type. Pool can
+ * be used from multiple threads. Returns -1 on failure. */
+HDQL_API int hdql_alloc_pool_init(struct hdql_Allocator *
+        , const struct hdql_Allocator * backing);
+
+/**\brief Copies pool usage statistics */
+HDQL_API void hdql_alloc_pool_get_stats(const struct hdql_Allocator *
+        , struct hdql_PoolStats *);
+
+/**\brief Returns all the slabs to backing allocator and frees pool
+ *
+ * Blocks larger than the largest size class that were not freed are not
+ * released. */
+HDQL_API void hdql_alloc_pool_destroy(struct hdql_Allocator *);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -3,6 +3,7 @@
 
 #include "hdql/types.h"
 #include "hdql/value.h"
+#include "hdql/operations.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -78,6 +79,26 @@ struct hdql_ScalarAttrInterface {
 typedef int (*hdql_ReserveKeysListCallback_t)( struct hdql_Key *,
             const struct hdql_Datum *defData, hdql_Context_t );
 
+/**\brief Simple predicate on collection item's attribute
+ *
+ * Describes filtering expression of the form `.attr <op> <constant>` applied
+ * to items of collection, like in `.hits{: .energyDeposition > 10}`. Given
+ * to collection interface's `compile_predicate()` at query compile time. */
+struct hdql_CollectionPredicate {
+    /** Name of the item's attribute being compared */
+    const char * attrName;
+    /** Definition of the item's attribute being compared */
+    const struct hdql_AttrDef * attrDef;
+    /** Comparison operator (`hdql_kOpLT`, `hdql_kOpLTE`, `hdql_kOpGT`,
+     * `hdql_kOpGTE`, `hdql_kOpEq` or `hdql_kOpNEq`); attribute is always the
+     * left operand */
+    hdql_OperationCode_t opCode;
+    /** Type code of constant value (right operand) */
+    hdql_ValueTypeCode_t valueTypeCode;
+    /** Constant value (right operand) */
+    const struct hdql_Datum * value;
+};
+
 /**\brief Interface to collection attribute (foreign column or array) */
 struct hdql_CollectionAttrInterface {
     /**\brief Static definition data for collection interface */
@@ -130,6 +151,53 @@ struct hdql_CollectionAttrInterface {
                           , hdql_SelectionArgs_t
                           , hdql_Context_t ctx
                           );
+    /**\brief Optional batched version of `yield()`
+     *
+     * If not NULL, shall advance the iterator by up to \p n elements,
+     * writing datum pointers into \p dest. If \p keys is not NULL, it is an
+     * array of \p n datum keys to be set, one per written element. Result
+     * must be equivalent to calling `yield()` up to \p n times, so written
+     * datums must stay valid till next reset of the iterator (i.e. they
+     * may not refer to iterator's internal buffer).
+     *
+     * \return number of written elements, less than \p n if collection
+     *         got depleted. */
+    size_t (*yield_batch)( hdql_It_t
+                         , const struct hdql_Datum *defData
+                         , hdql_Datum_t * dest
+                         , struct hdql_Key ** keys
+                         , size_t n
+                         , struct hdql_Context *context
+                         );
+    /**\brief Optional predicate pushdown
+     *
+     * If not NULL, is called at query compile time when collection items are
+     * filtered by simple comparison (see `hdql_CollectionPredicate`). Shall
+     * return selection arguments restricting the iterator to items that
+     * satisfy both the predicate and given \p selection (that may be NULL),
+     * or NULL if predicate is not supported -- filter is then evaluated on
+     * every item in the generic way. On success returned selection replaces
+     * \p selection, so the latter must be freed or incorporated by the
+     * implementation. */
+    hdql_SelectionArgs_t (*compile_predicate)( const struct hdql_CollectionPredicate *
+                                             , hdql_SelectionArgs_t selection
+                                             , const struct hdql_Datum *definitionData
+                                             , hdql_Context_t ctx );
+    /**\brief Optional number of elements in the collection
+     *
+     * If not NULL, shall return number of elements the iterator yields for
+     * \p owner when no selection is applied, without iterating. Used by
+     * `len()` for unfiltered collections. */
+    size_t (*size)( hdql_Datum_t owner
+                  , const struct hdql_Datum *definitionData
+                  , hdql_Context_t ctx );
+    /**\brief Optional emptiness check
+     *
+     * Same as `size()`, shall return whether iterator yields no elements for
+     * \p owner when no selection is applied. Used by `empty()`. */
+    bool (*is_empty)( hdql_Datum_t owner
+                    , const struct hdql_Datum *definitionData
+                    , hdql_Context_t ctx );
 };  /* struct hdql_CollectionAttrInterface */
 
 /**\brief Compound's attribute definition descriptor
@@ -294,6 +362,36 @@ HDQL_API void
 hdql_attr_def_set_transient(struct hdql_AttrDef *
         , void (*dtr)(hdql_Datum_t, hdql_Context_t) );
 
+struct hdql_QueryCloneState;  /* fwd, see query.h */
+
+/**\brief Copy callback for transient attribute definition data
+ *
+ * Must return new instance of definition data, with all the sub-queries
+ * cloned by `hdql_query_clone_with()` using given clone state, so that copied
+ * attribute definition has no runtime state in common with original one. */
+typedef hdql_Datum_t (*hdql_TransientCopyCallback_t)( const struct hdql_Datum * defData
+        , struct hdql_QueryCloneState * cs
+        , hdql_Context_t );
+
+/**\brief Sets definition data copy callback of transient attribute
+ *
+ * Transient attribute definitions without copy callback can not be copied
+ * (and queries referring them can't be cloned), unless they have no
+ * definition data or bring static values. */
+HDQL_API void
+hdql_attr_def_set_transient_copy(struct hdql_AttrDef *, hdql_TransientCopyCallback_t);
+
+/**\brief Creates copy of transient attribute definition
+ *
+ * Copies definition data using copy callback set with
+ * `hdql_attr_def_set_transient_copy()`. Virtual compound type of the
+ * attribute is substituted with its clone within clone state. Returns NULL
+ * and pushes error to context if attribute definition can not be copied. */
+HDQL_API struct hdql_AttrDef *
+hdql_attr_def_copy_transient( const struct hdql_AttrDef *
+        , struct hdql_QueryCloneState * cs
+        , hdql_Context_t );
+
 
 HDQL_API bool hdql_attr_def_is_atomic(hdql_AttrDef_t);
 HDQL_API bool hdql_attr_def_is_compound(hdql_AttrDef_t);
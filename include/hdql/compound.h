@@ -86,7 +86,11 @@ HDQL_API char *
 hdql_compound_get_full_type_str( const struct hdql_Compound * c
         , char * buf, size_t bufSize
         );
-/**\brief Deletes compound type */
+/**\brief Deletes compound type
+ *
+ * Compound can be destroyed after the context it was created within. Its
+ * attribute definitions are then freed directly with the context's allocator
+ * and \p context is not used. */
 HDQL_API void hdql_compound_destroy(struct hdql_Compound *, hdql_Context_t context);
 
 /**\brief Returns number of compound attributes
@@ -55,6 +55,7 @@ struct hdql_Func;
 struct hdql_Constants;
 struct hdql_Query;
 struct hdql_RandGen;
+struct hdql_Allocator;
 
 /**\brief Creates new HDQL context
  *
@@ -67,17 +68,106 @@ struct hdql_RandGen;
  * */
 HDQL_API hdql_Context_t hdql_context_create(uint32_t flags);
 
-/**\brief Used for C-types allocations */
+/**\brief Creates new HDQL context using given memory allocator
+ *
+ * Every allocation made with `hdql_context_alloc()` (queries, iterators,
+ * keys, values, etc) and variadic data of the context are provided by the
+ * allocator, including ones of descendant contexts, which inherit it.
+ * `hdql_context_create()` uses `hdql_gPoolAllocator` (or `hdql_gHeapAllocator`
+ * if library is built without `POOL_ALLOCATOR` option).
+ *
+ * Allocator instance is copied, while its user data is not owned and must
+ * outlive the context, all its descendants and compounds created within
+ * them. */
+HDQL_API hdql_Context_t hdql_context_create_with_allocator(uint32_t flags
+        , const struct hdql_Allocator * allocator);
+
+/**\brief Returns memory allocator used by the context */
+HDQL_API const struct hdql_Allocator * hdql_context_get_allocator(hdql_Context_t);
+
+/**\brief Categories of context allocations, used for memory accounting */
+typedef enum hdql_MemoryCategory {
+    hdql_kMemOther = 0,     /* definitions, tables, states, etc */
+    hdql_kMemQuery,         /* queries, query plans and tries */
+    hdql_kMemIterator,      /* collection iterators */
+    hdql_kMemKey,           /* keys and key lists */
+    hdql_kMemDatum,         /* values and evaluation frames */
+    hdql_kMemVariadic,      /* variadic data */
+    hdql_kMemNCategories
+} hdql_MemoryCategory_t;
+
+/**\brief Used for C-types allocations
+ *
+ * Allocation is accounted as `hdql_kMemOther`. Returns NULL with
+ * `HDQL_ERR_MEMORY` pushed to the context if allocation fails or would exceed
+ * memory limit of the context. */
 HDQL_API hdql_Datum_t hdql_context_alloc(hdql_Context_t, size_t);
 
+/**\brief Same as `hdql_context_alloc()`, accounted within given category */
+HDQL_API hdql_Datum_t hdql_context_alloc_as(hdql_Context_t, size_t
+        , hdql_MemoryCategory_t);
+
 #ifdef HDQL_TYPES_DEBUG
 HDQL_API hdql_Datum_t hdql_context_alloc_typed(hdql_Context_t, size_t, const char *);
 HDQL_API hdql_Datum_t hdql_context_check_type(hdql_Context_t, hdql_Datum_t, const char *);
 #endif
 
-/**\brief Used to free C-type allocations */
+/**\brief Used to free C-type allocations
+ *
+ * Memory must be freed with the context it was allocated by (or the one
+ * sharing the allocator, yet accounting of both contexts will be skewed
+ * then). */
 HDQL_API int hdql_context_free(hdql_Context_t, hdql_Datum_t);
 
+/**\brief Memory usage of the context
+ *
+ * Only sizes requested by allocations made with the context are taken into
+ * account (fixed per-allocation overhead and allocator's own overhead are
+ * not). */
+struct hdql_ContextMemoryStats {
+    /** Bytes currently allocated */
+    size_t bytesLive;
+    /** Max of `bytesLive` during context's lifetime */
+    size_t bytesPeak;
+    /** Number of allocations failed, including ones denied by the limit */
+    size_t nFailed;
+    /** Number of live allocations, by category */
+    size_t nLive[hdql_kMemNCategories];
+    /** Bytes currently allocated, by category */
+    size_t bytesLiveByCategory[hdql_kMemNCategories];
+};
+
+/**\brief Copies current memory usage of the context */
+HDQL_API void hdql_context_get_memory_stats(hdql_Context_t
+        , struct hdql_ContextMemoryStats * dest);
+
+/**\brief Sets limit of bytes allocated by the context, zero for no limit
+ *
+ * Allocation that would make `bytesLive` exceed the limit fails (returning
+ * NULL with `HDQL_ERR_MEMORY` pushed to the context), so runaway evaluation
+ * stops instead of growing unbounded.
+ *
+ * Limit is per context: descendants created afterwards inherit the same
+ * value, but account their own allocations only, so each of them (e.g.
+ * context of every worker thread) can take the whole budget. To bound total
+ * memory of the context and N descendants, set limit of each one to a share
+ * of the total. */
+HDQL_API void hdql_context_set_memory_limit(hdql_Context_t, size_t bytes);
+
+/**\brief Returns limit of bytes allocated by the context, zero if not set */
+HDQL_API size_t hdql_context_get_memory_limit(hdql_Context_t);
+
+#ifdef HDQL_TYPES_DEBUG
+/**\brief Calls given function for every C-type allocated with
+ *        `hdql_context_alloc_typed()` and not yet freed
+ *
+ * Provides number of live instances and bytes they occupy. Iteration stops if
+ * callback returns non-zero value, which is then returned. */
+HDQL_API int hdql_context_memory_by_type(hdql_Context_t
+        , int (*callback)(const char * typeName, size_t nLive, size_t bytes, void * userdata)
+        , void * userdata);
+#endif
+
 
 /**\brief Returns pointer to value types table */
 HDQL_API struct hdql_ValueTypes * hdql_context_get_types(hdql_Context_t ctx);
@@ -100,12 +190,72 @@ HDQL_API struct hdql_RandGen * hdql_context_get_randgen(hdql_Context_t ctx);
 /**\brief Used by parser routines to create virtual compound types */
 HDQL_API void hdql_context_add_virtual_compound(hdql_Context_t, struct hdql_Compound * );
 
-/**\brief Used to keep error details in case of unwidning errors */
+/**\brief Destroys virtual compounds created within the context
+ *
+ * Virtual compounds refer to attribute definitions of the compounds they are
+ * based on, so they must be destroyed before these compounds. Called by
+ * `hdql_context_destroy()`, so compounds can be destroyed either before or
+ * after the context (see `hdql_compound_destroy()`). */
+HDQL_API void hdql_context_destroy_virtual_compounds(hdql_Context_t);
+
+/**\brief Max length of error message kept by context, including terminator
+ *
+ * Not configurable as it defines layout of public `hdql_ErrorRecord`. */
+#define HDQL_ERROR_MESSAGE_LENGTH 256
+
+/**\brief Number of error records kept by context
+ *
+ * Not configurable, so library and its clients agree on it. */
+#define HDQL_CONTEXT_ERRORS_CAPACITY 16
+
+/**\brief Error record kept by context */
+struct hdql_ErrorRecord {
+    /** Error code */
+    hdql_Err_t code;
+    /** Source file and line the error was pushed from, file can be NULL */
+    const char * file;
+    int line;
+    /** Error message, truncated */
+    char message[HDQL_ERROR_MESSAGE_LENGTH];
+};
+
+/**\brief Used to keep error details in case of unwidning errors
+ *
+ * Errors are kept in bounded ring buffer preallocated within the context, so
+ * pushing an error involves no memory allocation and can be done on the
+ * evaluation path. Once buffer is full, the oldest record gets overwritten
+ * and counted as overflow (see `hdql_context_errors_overflow()`).
+ *
+ * Normally called with `hdql_context_err_push()` macro that provides source
+ * location. */
+HDQL_API void hdql_context_err_push_at(hdql_Context_t, hdql_Err_t
+        , const char * file, int line, const char * format, ...);
+
+/**\brief Pushes error without source location
+ *
+ * \note shadowed by macro of the same name */
 HDQL_API void hdql_context_err_push(hdql_Context_t, hdql_Err_t, const char * format, ...);
 
+#define hdql_context_err_push(ctx, code, ...) \
+    hdql_context_err_push_at(ctx, code, __FILE__, __LINE__, __VA_ARGS__)
+
 /**\brief Retrurns true if error stack is not empty */
 HDQL_API bool hdql_context_has_errors(hdql_Context_t);
 
+/**\brief Returns number of error records kept by context */
+HDQL_API size_t hdql_context_errors_count(hdql_Context_t);
+
+/**\brief Returns n-th kept error record, oldest first
+ *
+ * \returns NULL if `n` exceeds number of records */
+HDQL_API const struct hdql_ErrorRecord * hdql_context_error_get(hdql_Context_t, size_t n);
+
+/**\brief Returns number of error records dropped due to ring buffer overflow */
+HDQL_API size_t hdql_context_errors_overflow(hdql_Context_t);
+
+/**\brief Drops all error records and resets overflow counter */
+HDQL_API void hdql_context_errors_clear(hdql_Context_t);
+
 /**\brief Destroys HDQL expression evaluation context */
 HDQL_API void hdql_context_destroy(hdql_Context_t);
 
@@ -138,6 +288,11 @@ hdql_context_new_function( struct hdql_Context * ctx
  */
 
 /**\brief Allocates "variadic datum"
+ *
+ * Variadic datum is a block of data of varying size (strings, arrays of
+ * samples, etc). Used and allocated sizes are kept in a header preceding the
+ * block, so size retrieval, re-allocation and deletion do not involve any
+ * lookup. Block is aligned for any fundamental type.
  *
  * \returns NULL on allocation failure.
  * */
@@ -145,19 +300,70 @@ HDQL_API hdql_Datum_t hdql_context_variadic_datum_alloc(hdql_Context_t, uint32_t
 
 /**\brief Returns used size of "variadic datum" in bytes
  *
- * \returns `UINT32_MAX` on error
+ * \returns `UINT32_MAX` for null pointer
  * */
 HDQL_API uint32_t hdql_context_variadic_datum_size(hdql_Context_t, hdql_Datum_t datumPtr);
 
 /**\brief Re-allocates variadic datum ptr
+ *
+ * Sets used size of the datum, reallocating it if allocated size is not
+ * sufficient. Allocated size grows at least twice, so sequence of growing
+ * reallocations takes amortized constant time. Used data is preserved.
  *
  * \returns null pointer on error pushing error description in the context
  * */
 HDQL_API hdql_Datum_t hdql_context_variadic_datum_realloc(hdql_Context_t, hdql_Datum_t, uint32_t);
 
-/**\brief Deletes variadic datum */
+/**\brief Deletes variadic datum (null pointer is ignored) */
 HDQL_API void hdql_context_variadic_datum_free(hdql_Context_t, hdql_Datum_t);
 
+/*                                                            ________________
+ * _________________________________________________________/ Evaluation frames
+ */
+
+/**\brief Default size of the block of evaluation frame arena, bytes */
+#ifndef HDQL_CONTEXT_FRAME_BLOCK_SIZE
+#   define HDQL_CONTEXT_FRAME_BLOCK_SIZE (16*1024)
+#endif
+
+/**\brief Opens evaluation frame
+ *
+ * Evaluation frame delimits lifetime of evaluation-scoped allocations made
+ * with `hdql_context_frame_alloc()`, typically ones needed only while results
+ * of the query are being retrieved for single root datum (an event). Frames
+ * can be nested. Called by `hdql_query_results_process_records_from()` and
+ * C++ `Query` wrapper around each root datum; interfaces open nested frames
+ * for scratch buffers of single call (e.g. quantile functions merge sketch
+ * levels in such a buffer).
+ *
+ * \returns `HDQL_ERR_CODE_OK` on success */
+HDQL_API int hdql_context_frame_begin(hdql_Context_t);
+
+/**\brief Allocates evaluation-scoped memory block
+ *
+ * Memory is taken by bumping a pointer within blocks of context's frame arena
+ * that are allocated with context's allocator and retained till the context
+ * is destroyed. Returned block is aligned for any fundamental type and must
+ * not be freed individually: it is released by `hdql_context_frame_rewind()`
+ * of the current frame (or by context destruction, if allocated out of any
+ * frame). Frame arena is not shared with descendant contexts.
+ *
+ * \returns NULL on allocation failure pushing error description in the context
+ * */
+HDQL_API hdql_Datum_t hdql_context_frame_alloc(hdql_Context_t, size_t);
+
+/**\brief Releases all the allocations made within current frame and closes it
+ *
+ * Merely restores arena pointer saved by `hdql_context_frame_begin()`, so
+ * cost does not depend on number of allocations made; no memory is returned
+ * to the allocator.
+ *
+ * \returns `HDQL_ERR_BAD_ARGUMENT` if no frame is open */
+HDQL_API int hdql_context_frame_rewind(hdql_Context_t);
+
+/**\brief Returns number of currently open evaluation frames */
+HDQL_API size_t hdql_context_frame_depth(hdql_Context_t);
+
 /*                                               _____________________________
  * ____________________________________________/ Custom arbitrary user's data
  */
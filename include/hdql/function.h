@@ -27,6 +27,28 @@ hdql_func_helper__try_len_empty(
         , hdql_Context_t context
         );
 
+/**\brief instantiates functions computing approximate quantiles
+ *
+ * Expects \p userdata of const char type to bring either 'm', 'q' or 'p',
+ * making the instantiated function to behave as `median(expr[, k])`,
+ * `quantile(expr, q[, k])` or `percentile(expr, p[, k])` correspondingly.
+ * Quantile `q` (in [0:1]) or percentile `p` (in [0:100]) and accuracy `k`
+ * must be static numbers.
+ *
+ * Values are accumulated in bounded memory sketch; result is exact for up to
+ * `k` values (`HDQL_QUANTILE_SKETCH_K` by default), rank error grows as
+ * `log2(N/k)/k` for larger sets. Result is of `double` type, NaNs are
+ * ignored.
+ *
+ * Registered by `hdql_functions_add_monoids()`, requires `double` type.
+ * */
+HDQL_API struct hdql_AttrDef *
+hdql_func_helper__try_quantile(
+          struct hdql_Query ** args, void * userdata
+        , char * failureBuffer, size_t failureBufferSize
+        , hdql_Context_t context
+        );
+
 /**\file
  * \brief HDQL function definition
  *
@@ -65,6 +87,19 @@ hdql_functions_define( struct hdql_Functions *
                      , void * userdata
                      );
 
+/**\brief Marks all the functions defined with given name as pure
+ *
+ * Result of pure function depends only on its arguments (no side effects,
+ * no state, no randomness), so calls with static arguments can be evaluated
+ * at compile time. Returns `HDQL_ERR_FUNC_UNKNOWN` if no function of given
+ * name defined in the dictionary. */
+HDQL_API int
+hdql_functions_set_pure(struct hdql_Functions *, const char * name);
+
+/**\brief Returns whether all functions of given name are pure */
+HDQL_API bool
+hdql_functions_is_pure(const struct hdql_Functions *, const char * name);
+
 /**\brief Instantiates function object based on name and argument queries */
 HDQL_API int
 hdql_functions_resolve( struct hdql_Functions * funcDict
@@ -113,8 +148,19 @@ hdql_functions_add_standard_math(struct hdql_Functions * functions);
  *     count     | a += b? 0:1  | 0           | all             | uin64_t
  *     mean      | (a +=b)/N    | 0           | all numeric     | promoted
  *     narb      | pick random  | -           | all             | promoted
+ *     variance  | moment 2     | 0           | all numeric     | float / double
+ *     stddev    | moment 2     | 0           | all numeric     | float / double
+ *     rms       | moment 2     | 0           | all numeric     | float / double
+ *     skewness  | moment 3     | 0           | all numeric     | float / double
+ *     kurtosis  | moment 4     | 0           | all numeric     | float / double
  *     len       | ++a          | 0           | any collection  | uint64_t
  *     empty     | a = false    | true        | any collection  | bool
+ *     median    | sketch       | -           | all numeric     | double
+ *     quantile  | sketch       | -           | all numeric     | double
+ *     percentile| sketch       | -           | all numeric     | double
+ *
+ * Statistical moments are accumulated in a single pass with numerically
+ * stable update (population moments, excess kurtosis).
  *
  * The usefulness of XOR-based boolean monoid ("all odd are true") is doubtful,
  * yet one may imagine some practical applications still.
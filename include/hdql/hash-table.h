@@ -28,6 +28,20 @@ extern "C" {
 #define HDQL_HT_ERR_MEM         (HDQL_HT_ERROR | 1)
 #define HDQL_HT_RC_ERR_NOENT    (HDQL_HT_ERROR | 2)
 
+/**\brief Creation flag selecting open addressing variant of the table
+ *
+ * Open addressing table keeps entries in a flat array of slots with keys up to
+ * `HDQL_HT_INLINE_KEY_SIZE` bytes stored inline (longer ones are copied to
+ * separate blocks). Array is accompanied by control bytes keeping 7 bits of
+ * entry's hash, probed by groups with SSE2/AVX2 (if available at compile
+ * time). Probing is linear, deletion shifts subsequent entries backward, so
+ * no tombstones get accumulated. Same `hdql_ht_*()` functions apply to both
+ * variants. */
+#define HDQL_HT_OPEN_ADDRESSING 0x1
+
+/**\brief Max length of key stored inline by open addressing table */
+#define HDQL_HT_INLINE_KEY_SIZE 16
+
 typedef struct hdql_ht hdql_ht;  /* fwd, opaque */
 struct hdql_htEntry;  /* fwd, opaque */
 
@@ -41,6 +55,17 @@ struct hdql_htEntry;  /* fwd, opaque */
  * */
 HDQL_API hdql_ht * hdql_ht_create(const struct hdql_Allocator *, size_t dftCapacity, size_t hashSeed );
 
+/**\brief Creates a new hash table of variant chosen by flags
+ *
+ * Same as `hdql_ht_create()` (which creates chained table), with `flags`
+ * selecting the implementation (`HDQL_HT_OPEN_ADDRESSING`). As for
+ * `hdql_ht_create()`, capacity is a binary logarithm of initial number of
+ * buckets (slots); for open addressing table it is rounded up to the size of
+ * probing group.
+ * */
+HDQL_API hdql_ht * hdql_ht_create_with(const struct hdql_Allocator *
+        , size_t dftCapacity, size_t hashSeed, int flags );
+
 /**\brief Destroys the hash table
  *
  * Instance must be previously created with `hdql_ht_create()` */
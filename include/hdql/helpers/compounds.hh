@@ -481,7 +481,9 @@ struct IFace< ptr
           , const struct hdql_Datum * defData
           , hdql_Context_t context
           ) {
-        Iterator * it = reinterpret_cast<Iterator *>(hdql_context_alloc(context, sizeof(Iterator)));
+        Iterator * it = reinterpret_cast<Iterator *>(hdql_context_alloc_as(context
+                    , sizeof(Iterator), hdql_kMemIterator));
+        if(!it) return NULL;
         it->owner = reinterpret_cast<OwnerT*>(owner);
         return reinterpret_cast<hdql_It_t>(it);
     }
@@ -528,6 +530,20 @@ struct IFace< ptr
         hdql_context_free(context, reinterpret_cast<hdql_Datum_t>(it_));
     }
 
+    static size_t
+    size( hdql_Datum_t owner
+        , const struct hdql_Datum *defData
+        , hdql_Context_t ) {
+        return std::extent<AttrT>::value;
+    }
+
+    static bool
+    is_empty( hdql_Datum_t owner
+            , const struct hdql_Datum *defData
+            , hdql_Context_t ) {
+        return 0 == std::extent<AttrT>::value;
+    }
+
     static hdql_CollectionAttrInterface iface() {
         return hdql_CollectionAttrInterface{
                   .definitionData = NULL
@@ -537,6 +553,8 @@ struct IFace< ptr
                 , .destroy_iterator = destroy_iterator
                 , .compile_selection = NULL
                 , .free_selection = NULL
+                , .size = size
+                , .is_empty = is_empty
             };
     }
 
@@ -577,7 +595,9 @@ struct IFace< ptr
           , const struct hdql_Datum * defData
           , hdql_Context_t context
           ) {
-        Iterator * it = reinterpret_cast<Iterator *>(hdql_context_alloc(context, sizeof(Iterator)));
+        Iterator * it = reinterpret_cast<Iterator *>(hdql_context_alloc_as(context
+                    , sizeof(Iterator), hdql_kMemIterator));
+        if(!it) return NULL;
         it->owner = reinterpret_cast<OwnerT*>(owner);
         return reinterpret_cast<hdql_It_t>(it);
     }
@@ -648,6 +668,20 @@ struct IFace< ptr
                 , definitionData, *context);
     }
 
+    static size_t
+    size( hdql_Datum_t owner
+        , const struct hdql_Datum *defData
+        , hdql_Context_t ) {
+        return std::extent<AttrT>::value;
+    }
+
+    static bool
+    is_empty( hdql_Datum_t owner
+            , const struct hdql_Datum *defData
+            , hdql_Context_t ) {
+        return 0 == std::extent<AttrT>::value;
+    }
+
     static hdql_CollectionAttrInterface iface() {
         return hdql_CollectionAttrInterface{
                   .definitionData = NULL
@@ -657,6 +691,8 @@ struct IFace< ptr
                 , .destroy_iterator = destroy_iterator
                 , .compile_selection = compile_selection
                 , .free_selection = free_selection
+                , .size = size
+                , .is_empty = is_empty
             };
     }
 
@@ -696,7 +732,9 @@ struct IFace< ptr
           , hdql_Context_t context
           ) {
         assert(owner);
-        Iterator * it = reinterpret_cast<Iterator *>(hdql_context_alloc(context, sizeof(Iterator)));
+        Iterator * it = reinterpret_cast<Iterator *>(hdql_context_alloc_as(context
+                    , sizeof(Iterator), hdql_kMemIterator));
+        if(!it) return NULL;
         it->owner = reinterpret_cast<OwnerT*>(owner);
         it->it = (it->owner->*ptr).begin();
         return reinterpret_cast<hdql_It_t>(it);
@@ -729,6 +767,31 @@ struct IFace< ptr
                 detail::STLContainerTraits<AttrT>::get(it->it));
     }
 
+    static size_t
+    yield_batch( hdql_It_t it_
+         , const hdql_Datum *defData
+         , hdql_Datum_t * dest
+         , hdql_Key ** keys
+         , size_t n
+         , hdql_Context *context
+         ) {
+        Iterator * it = reinterpret_cast<Iterator*>(it_);
+        AttrT & container = it->owner->*ptr;
+        size_t i = 0;
+        if(it->it == container.end()) return 0;
+        for(; i < n; ++i) {
+            ++(it->it);
+            if(it->it == container.end()) break;
+            if(keys) {
+                assert(0x0 != hdql_key_datum_get_type_code(keys[i]));
+                detail::STLContainerTraits<AttrT>::get_key(container, it->it, *keys[i]);
+            }
+            dest[i] = reinterpret_cast<hdql_Datum_t>(
+                    detail::STLContainerTraits<AttrT>::get(it->it));
+        }
+        return i;
+    }
+
     static hdql_Datum_t
     reset_iterator( hdql_It_t it_
          , hdql_Datum_t newOwner
@@ -756,6 +819,20 @@ struct IFace< ptr
         hdql_context_free(context, reinterpret_cast<hdql_Datum_t>(it_));
     }
 
+    static size_t
+    size( hdql_Datum_t owner
+        , const struct hdql_Datum *defData
+        , hdql_Context_t ) {
+        return (reinterpret_cast<OwnerT *>(owner)->*ptr).size();
+    }
+
+    static bool
+    is_empty( hdql_Datum_t owner
+            , const struct hdql_Datum *defData
+            , hdql_Context_t ) {
+        return (reinterpret_cast<OwnerT *>(owner)->*ptr).empty();
+    }
+
     static hdql_CollectionAttrInterface iface() {
         return hdql_CollectionAttrInterface{
                   .definitionData = NULL
@@ -765,6 +842,9 @@ struct IFace< ptr
                 , .destroy_iterator = destroy_iterator
                 , .compile_selection = NULL
                 , .free_selection = NULL
+                , .yield_batch = yield_batch
+                , .size = size
+                , .is_empty = is_empty
             };
     }
 
@@ -799,7 +879,9 @@ struct IFace< ptr
           , const struct hdql_Datum * defData
           , hdql_Context_t context
           ) {
-        Iterator * it = reinterpret_cast<Iterator *>(hdql_context_alloc(context, sizeof(Iterator)));
+        Iterator * it = reinterpret_cast<Iterator *>(hdql_context_alloc_as(context
+                    , sizeof(Iterator), hdql_kMemIterator));
+        if(!it) return NULL;
         it->owner = reinterpret_cast<OwnerT*>(owner);
         return reinterpret_cast<hdql_It_t>(it);
     }
@@ -836,6 +918,34 @@ struct IFace< ptr
                 detail::STLContainerTraits<AttrT>::get(it->it));
     }
 
+    static size_t
+    yield_batch( hdql_It_t it_
+         , const hdql_Datum *defData
+         , hdql_Datum_t * dest
+         , hdql_Key ** keys
+         , size_t n
+         , hdql_Context *context
+         ) {
+        Iterator * it = reinterpret_cast<Iterator*>(it_);
+        AttrT & container = it->owner->*ptr;
+        size_t i = 0;
+        if(it->it == container.end()) return 0;
+        for(; i < n; ++i) {
+            it->it = ConcreteSelectionTraits::advance( container
+                    , it->selection ? reinterpret_cast<SelectionT*>(it->selection) : nullptr
+                    , it->it
+                    );
+            if(container.end() == it->it) break;
+            if(keys) {
+                assert(0x0 != hdql_key_datum_get_type_code(keys[i]));
+                detail::STLContainerTraits<AttrT>::get_key(container, it->it, *keys[i]);
+            }
+            dest[i] = reinterpret_cast<hdql_Datum_t>(
+                    detail::STLContainerTraits<AttrT>::get(it->it));
+        }
+        return i;
+    }
+
     static hdql_Datum_t
     reset_iterator( hdql_It_t it_
          , hdql_Datum_t newOwner
@@ -886,6 +996,20 @@ struct IFace< ptr
                 , definitionData, *context );
     }
 
+    static size_t
+    size( hdql_Datum_t owner
+        , const struct hdql_Datum *defData
+        , hdql_Context_t ) {
+        return (reinterpret_cast<OwnerT *>(owner)->*ptr).size();
+    }
+
+    static bool
+    is_empty( hdql_Datum_t owner
+            , const struct hdql_Datum *defData
+            , hdql_Context_t ) {
+        return (reinterpret_cast<OwnerT *>(owner)->*ptr).empty();
+    }
+
     static hdql_CollectionAttrInterface iface() {
         return hdql_CollectionAttrInterface{
                   .definitionData = NULL
@@ -895,6 +1019,9 @@ struct IFace< ptr
                 , .destroy_iterator = destroy_iterator
                 , .compile_selection = compile_selection
                 , .free_selection = free_selection
+                , .yield_batch = yield_batch
+                , .size = size
+                , .is_empty = is_empty
             };
     }
 
@@ -72,6 +72,14 @@ int
 hdql_query_results_process_records_from( struct hdql_Datum * d
         , struct hdql_QueryResultsWorkspace * ws );
 
+/**\brief Returns flat key views of the workspace
+ *
+ * Returns same array as was provided to `handle_keys()` (NULL if keys are
+ * not handled by the interface), number of views is written in \p n. */
+struct hdql_Key **
+hdql_query_results_get_flat_keys( struct hdql_QueryResultsWorkspace * ws
+        , size_t * n );
+
 int hdql_query_results_destroy( struct hdql_QueryResultsWorkspace * );
 
 #ifdef __cplusplus
@@ -0,0 +1,82 @@
+#ifndef H_HDQL_QUERY_RESULTS_PARALLEL_H
+#define H_HDQL_QUERY_RESULTS_PARALLEL_H 1
+
+#include "hdql/helpers/query-results-handler.h"
+#include "hdql/types.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct hdql_QueryResultsParallelDriver;  /* opaque */
+
+/**\brief Default number of root datums processed per window
+ *
+ * Records of root datums within the window are buffered until they can be
+ * delivered in order, so window size limits memory used by pending results. */
+#ifndef HDQL_QUERY_RESULTS_PARALLEL_WINDOW
+#   define HDQL_QUERY_RESULTS_PARALLEL_WINDOW 1024
+#endif
+
+/**\brief Creates driver evaluating query on multiple root datums in parallel
+ *
+ * Driver is a multi-threaded counterpart of
+ * `hdql_query_results_process_records_from()`. It is initialized with
+ * results handler in the same way as `hdql_query_results_init()` does, but
+ * also runs \p nWorkers threads, each evaluating its own clone of the query
+ * (see `hdql_query_clone()`) within its own descendant context. Root datums
+ * are distributed among workers in contiguous ranges; workers that have
+ * exhausted their range steal half of the remaining range of other
+ * workers. Results are copied into per-datum buffers and delivered to the
+ * handler's `handle_record()` in the original order of root datums, from the
+ * thread calling `hdql_query_results_parallel_process()`, with keys
+ * provided to `handle_keys()` set accordingly.
+ *
+ * Only atomic query results of fixed size are supported as query results
+ * must outlive the evaluation state. When \p nWorkers is zero, root datums
+ * are processed sequentially by the calling thread.
+ *
+ * \p windowSize limits the number of root datums processed simultaneously
+ * (zero stands for `HDQL_QUERY_RESULTS_PARALLEL_WINDOW`).
+ *
+ * \note Descendant contexts of workers inherit the allocator of \p ctx, so
+ *       if the context was created with `hdql_context_create_with_allocator()`,
+ *       the allocator must be thread-safe (default pool and heap allocators
+ *       are).
+ *
+ * Returns NULL on failure, with error pushed to context. */
+HDQL_API struct hdql_QueryResultsParallelDriver *
+hdql_query_results_parallel_init(
+          struct hdql_Query * q
+        , struct hdql_iQueryResultsHandler * iqr
+        , size_t nWorkers
+        , size_t windowSize
+        , struct hdql_Context * ctx
+        );
+
+/**\brief Evaluates query on given root datums, delivers results in order
+ *
+ * Returns `HDQL_ERR_CODE_OK` on success or error code of first failed
+ * evaluation, in order of root datums (first error pushed to worker's
+ * context or `HDQL_ERR_MEMORY` if results could not be buffered). Records of
+ * failed and subsequent root datums are not delivered, error is pushed to the
+ * driver's context. Handler's `handle_record()` non-zero return code
+ * interrupts delivery and is returned. */
+HDQL_API int
+hdql_query_results_parallel_process(
+          struct hdql_Datum ** roots
+        , size_t nRoots
+        , struct hdql_QueryResultsParallelDriver * drv
+        );
+
+/**\brief Stops workers and frees driver resources */
+HDQL_API int
+hdql_query_results_parallel_destroy(struct hdql_QueryResultsParallelDriver * drv);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  /* H_HDQL_QUERY_RESULTS_PARALLEL_H */
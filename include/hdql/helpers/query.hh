@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <stdexcept>
 #include <type_traits>
 #include <typeindex>
@@ -329,6 +330,11 @@ protected:
      * error if conversion is not defined.
      * */
     Converter _get_converter_to(const std::type_info &) const;
+
+    /// Reserves keys list and flat keys view for the query
+    void _reserve_keys(const char * expression);
+    /// Cloning ctr, takes ownership over given (descendant) context
+    Query(const Query & orig, hdql_Context * ctx);
 public:
     ///\brief Ctr for expressions expecting atomic or map query result
     ///
@@ -350,6 +356,14 @@ public:
 
     ~Query();
 
+    ///\brief Returns independent instance of the same compiled query
+    ///
+    /// Clone shares compiled (immutable) parts of the query with this
+    /// instance, but maintains its own runtime state and context, so it can
+    /// be evaluated concurrently with the original (e.g. one clone per
+    /// worker thread). Clones must be deleted before the original.
+    std::unique_ptr<Query> clone() const;
+
     /**\brief Returns whether the query result type of simple type
      *
      * True for simple arithmetic types and strings. Note, that collections
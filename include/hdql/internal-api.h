@@ -2,6 +2,7 @@
 #define H_HDQL_INTERNAL_API_H 1
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 /* These functions are used within the library and not supposed to be exported
@@ -38,6 +39,29 @@ void _hdql_converters_destroy(struct hdql_Converters *, struct hdql_Context *);
 struct hdql_RandGen * _hdql_randgen_create(struct hdql_RandGen *, struct hdql_Context *);
 void _hdql_randgen_destroy(struct hdql_RandGen *, struct hdql_Context *);
 
+/* from src/allocator.c */
+struct hdql_Allocator;
+/* Returns word in header of the block allocated by `alloc()' that allocator
+ * keeps for the user */
+typedef uint64_t * (*hdql_AllocatorTagCallback_t)(void * data, void * userdata);
+/* Returns tag word getter if allocator is library's own one providing it,
+ * NULL otherwise. Context uses it for accounting instead of prefixing blocks
+ * with own header. */
+hdql_AllocatorTagCallback_t hdql__allocator_get_tag(const struct hdql_Allocator *);
+
+/* from src/context.cc */
+struct hdql_Compound;
+/* Frees block allocated by context using given allocator, without accounting;
+ * used for blocks that outlive their context */
+void hdql__allocator_free(const struct hdql_Allocator *, struct hdql_Datum *);
+void hdql__context_add_compound(struct hdql_Context *, struct hdql_Compound *);
+void hdql__context_remove_compound(struct hdql_Context *, struct hdql_Compound *);
+
+/* from src/compound.cc */
+/* Makes compound to not refer to its context anymore, called on context
+ * destruction */
+void hdql__compound_detach_context(struct hdql_Compound *);
+
 /* from src/attr-def.c */
 bool hdql__attr_def_is_fwd_query(const struct hdql_AttrDef * ad);
 struct hdql_Query * hdql__attr_def_fwd_query(const struct hdql_AttrDef * ad);
@@ -25,6 +25,8 @@ HDQL_API extern const struct hdql_CollectionAttrInterface    _hdql_gCollectionFw
 struct hdql_ArithOpDefData {
     struct hdql_Query * args[2];
     const struct hdql_OperationEvaluator * evaluator;
+    /** Operator code, used by compile-time optimizations */
+    hdql_OperationCode_t opCode;
 };
 
 HDQL_API extern const struct hdql_ScalarAttrInterface        _hdql_gScalarArithOpIFace;
@@ -35,21 +37,158 @@ hdql_reserve_arith_op_collection_key(struct hdql_Key * key
         , const struct hdql_Datum * dd_
         , hdql_Context_t context);
 
+#ifndef HDQL_ARITH_OP_BATCH_SIZE
+/** Number of collection elements evaluated at once by batched operations */
+#   define HDQL_ARITH_OP_BATCH_SIZE 64
+#endif
+
+/** Values of collection query elements prefetched into contiguous buffer
+ * (with keys, optionally) for batched arithmetics */
+struct hdql_CollectionPrefetch {
+    /** Prefetched query, not owned */
+    struct hdql_Query * query;
+    /** Number of prefetched elements */
+    size_t nItems;
+    /** Number of elements to prefetch next time; starts from one and
+     * doubles up to `HDQL_ARITH_OP_BATCH_SIZE', so consumer interrupting
+     * iteration early (e.g. `any()') does not get whole batch evaluated */
+    size_t nNext;
+    /** Set when query got depleted */
+    bool depleted;
+    /** Set when keys of elements are retrieved */
+    bool withKeys;
+    /** Contiguous buffer of `HDQL_ARITH_OP_BATCH_SIZE' values */
+    hdql_Datum_t values;
+    size_t valueSize;
+    /** Keys of prefetched elements, allocated on first use */
+    struct hdql_Key ** keys;
+};
+
+/** Returns true if values of query elements can be prefetched (are of known
+ * non-variadic type) */
+HDQL_API bool
+hdql_collection_prefetch_is_possible(struct hdql_Query *, hdql_Context_t);
+/** Creates prefetch state for the query, returns NULL if query values
+ * can not be copied (are of variadic or unknown type) or on memory error */
+HDQL_API struct hdql_CollectionPrefetch *
+hdql_collection_prefetch_create(struct hdql_Query *, hdql_Context_t);
+HDQL_API void
+hdql_collection_prefetch_destroy(struct hdql_CollectionPrefetch *, hdql_Context_t);
+/** Re-sets query with new owner and prefetches first element, returns
+ * number of prefetched elements */
+HDQL_API size_t
+hdql_collection_prefetch_reset(struct hdql_CollectionPrefetch *, hdql_Datum_t
+        , bool withKeys, hdql_Context_t);
+/** Prefetches next elements, returns their number (zero if depleted) */
+HDQL_API size_t
+hdql_collection_prefetch_next(struct hdql_CollectionPrefetch *, hdql_Context_t);
+
+/*
+ * Fused arithmetic expressions
+ * */
+
+/** Instruction of fused arithmetic expression, applies operation to operand
+ * slots writing result to its own slot */
+struct hdql_FusedArithInstruction {
+    const struct hdql_OperationEvaluator * evaluator;
+    /** Operand slots (`b' refers to always-NULL slot for unary operation)
+     * and result slot */
+    size_t a, b, r;
+};
+
+/** Definition data for fused arithmetic expression access interfaces */
+struct hdql_FusedArithOpDefData {
+    /** Leaf (argument) queries, owned; their results are first slots */
+    struct hdql_Query ** leaves;
+    size_t nLeaves;
+    /** Index of collection leaf, `nLeaves' for scalar expression */
+    size_t collectionLeaf;
+    /** Instructions; `nHoisted' first ones do not depend on collection leaf */
+    struct hdql_FusedArithInstruction * instructions;
+    size_t nInstructions, nHoisted;
+    /** Slot of the expression result */
+    size_t resultSlot;
+};
+
+HDQL_API extern const struct hdql_ScalarAttrInterface        _hdql_gScalarFusedArithOpIFace;
+HDQL_API extern const struct hdql_CollectionAttrInterface    _hdql_gCollectionFusedArithOpIFace;
+
+/** Collapses sub-tree of arithmetic operation nodes into fused expression
+ * definition data, taking ownership of leaf queries (operation nodes are left
+ * without arguments) */
+HDQL_API struct hdql_FusedArithOpDefData *
+hdql_fused_arith_op_def_data_create(struct hdql_ArithOpDefData *, hdql_Context_t);
+HDQL_API void hdql_fused_arith_op_def_data_destroy(hdql_Datum_t, hdql_Context_t);
+HDQL_API hdql_Datum_t hdql_fused_arith_op_def_data_copy(const struct hdql_Datum *
+        , struct hdql_QueryCloneState *, hdql_Context_t);
+
+HDQL_API int
+hdql_reserve_fused_arith_op_collection_key(struct hdql_Key * key
+        , const struct hdql_Datum * dd_
+        , hdql_Context_t context);
+
 /*
  * Filtered compound collection
  **/
 
 HDQL_API extern const struct hdql_ScalarAttrInterface _hdql_gFilteredCompoundIFace;
 
+/*
+ * Shared (common) sub-queries
+ **/
+
+/** Shared query cell, caches result of sub-query evaluated once per owner */
+struct hdql_SharedQuery;
+
+/** Interface of attribute definition referring to shared query cell */
+HDQL_API extern const struct hdql_ScalarAttrInterface _hdql_gScalarSharedQueryIFace;
+/** Creates shared query cell owning given query (may be NULL to be set later) */
+HDQL_API struct hdql_SharedQuery * hdql_shared_query_create(struct hdql_Query *, hdql_Context_t);
+/** Sets query of the cell created without one */
+HDQL_API void hdql_shared_query_set_query(struct hdql_SharedQuery *, struct hdql_Query *);
+/** Returns query of the cell */
+HDQL_API struct hdql_Query * hdql_shared_query_get_query(struct hdql_SharedQuery *);
+HDQL_API void hdql_shared_query_ref(struct hdql_SharedQuery *);
+/** Decreases refcount, destroys the cell with its query when it drops to zero */
+HDQL_API void hdql_shared_query_unref(struct hdql_SharedQuery *, hdql_Context_t);
+/** Drops cached result so the query will be re-evaluated on next access */
+HDQL_API void hdql_shared_query_invalidate(struct hdql_SharedQuery *);
+/** Returns (referenced) clone of the cell within the cloning procedure */
+HDQL_API struct hdql_SharedQuery * hdql_shared_query_clone(const struct hdql_SharedQuery *
+        , struct hdql_QueryCloneState *, hdql_Context_t);
+/** Creates transient attribute definition of shared query occurrence */
+HDQL_API struct hdql_AttrDef * hdql_attr_def_create_shared_query(struct hdql_SharedQuery *
+        , const struct hdql_AtomicTypeFeatures *, hdql_Context_t);
+
+/** Interface of virtual compound scope invalidating shared queries on reset,
+ * optionally filtered */
+HDQL_API extern const struct hdql_ScalarAttrInterface _hdql_gSharedQueriesScopeIFace;
+/** Definition data for `_hdql_gSharedQueriesScopeIFace` */
+struct hdql_SharedQueriesScopeDefData {
+    struct hdql_Query * filterQuery;  /* optional, owned */
+    struct hdql_SharedQuery ** sharedQueries;  /* referenced */
+    size_t nSharedQueries;
+};
+/** Instantiates shared queries scope definition data, takes filter ownership */
+HDQL_API hdql_Datum_t hdql_shared_queries_scope_definition_data_init(struct hdql_Query * filterQuery
+        , struct hdql_SharedQuery **, size_t, hdql_Context_t);
+HDQL_API void hdql_shared_queries_scope_definition_data_destroy(hdql_Datum_t, hdql_Context_t);
+HDQL_API hdql_Datum_t hdql_shared_queries_scope_definition_data_copy(const struct hdql_Datum *
+        , struct hdql_QueryCloneState *, hdql_Context_t);
+
 /*
  * Binding queries, bound attributes and bound compound interface
  **/
 
 /** Attribute, bound to a query (to be finalized with definition data) */
 HDQL_API extern const struct hdql_ScalarAttrInterface        _hdql_gBoundQueryIFace;
-/** Returns new instance of bound value interface's definition data */
+/** Returns new instance of bound value interface's definition data
+ *
+ * Takes ownership over the query on success. */
 HDQL_API hdql_Datum_t hdql_bound_value_interface_definition_data_init(struct hdql_Query *, hdql_Context_t);
-/** Destroys instance of bound value interface's definition data */
+/** Returns query of bound value interface's definition data */
+HDQL_API struct hdql_Query * hdql_bound_value_interface_definition_data_get_query(const struct hdql_Datum * d);
+/** Destroys instance of bound value interface's definition data and its query */
 HDQL_API void hdql_bound_value_interface_definition_data_destroy(hdql_Datum_t d, hdql_Context_t ctx);
 
 /** Interface to a collection of bound compounds */
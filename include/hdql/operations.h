@@ -21,10 +21,23 @@ struct hdql_Operations;
 
 typedef int (*hdql_ArithOpCallback_t)(const struct hdql_Datum * a, const struct hdql_Datum * b, hdql_Datum_t result);
 
+/**\brief Batched operation callback type
+ *
+ * Evaluates operation on \p n pairs of operands, writing results
+ * contiguously into \p result. Operands are read from \p a and \p b with
+ * strides \p aStride and \p bStride (in bytes), zero stride means same
+ * (scalar) operand for all the pairs. Arrays must be aligned for their
+ * types. */
+typedef int (*hdql_ArithOpBatchCallback_t)( const struct hdql_Datum * a, size_t aStride
+                                          , const struct hdql_Datum * b, size_t bStride
+                                          , size_t n, hdql_Datum_t result );
+
 /**\brief Callback type for operation */
 typedef const struct hdql_OperationEvaluator {
     hdql_ValueTypeCode_t returnType;
     hdql_ArithOpCallback_t op;
+    /** Optional batched version of `op`, used for collections (can be NULL) */
+    hdql_ArithOpBatchCallback_t batchOp;
 } * hdql_OperationEvaluator_t;
 
 /**\brief Standard arithmetic operator codes */
@@ -69,6 +82,10 @@ hdql_op_define( struct hdql_Operations *
         );
 
 /**\brief Returns previously defined operation callback
+ *
+ * Definitions of the table take precedence over ones of the parent tables.
+ * If table is frozen (see `hdql_op_freeze()`) and no definitions were added
+ * since then (to the table or its parents), resolved with dense index.
  *
  * \return NULL if callback is not found */
 HDQL_API hdql_OperationEvaluator_t
@@ -93,7 +110,21 @@ hdql_op_eval( hdql_Datum_t valueA
             );
 #endif
 
-/**\brief Fills index of operations with standard numerical arithmetics */
+/**\brief Builds dense index of operations for faster lookup
+ *
+ * Index is flattened across parent tables and addressed by operation code and
+ * compact indexes of operand types, so `hdql_op_get()` costs few array loads
+ * instead of hash lookups along the chain of tables. Once operations get
+ * defined in this table or its parents, index is not used till next freeze.
+ * Descendant tables without own definitions use parent's index. Table must
+ * not be used concurrently with this function.
+ *
+ * \returns 0 on success */
+HDQL_API int hdql_op_freeze(struct hdql_Operations *);
+
+/**\brief Fills index of operations with standard numerical arithmetics
+ *
+ * Freezes the table (see `hdql_op_freeze()`). */
 HDQL_API int hdql_op_define_std_arith(struct hdql_Operations *, struct hdql_ValueTypes *);
 
 /*                                                          ___________________
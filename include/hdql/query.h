@@ -58,6 +58,17 @@ hdql_query_append(
         , struct hdql_Query * next
         );
 
+/**\brief Builds execution plan of the query chain
+ *
+ * Resolves interfaces of all the chain's attribute definitions into
+ * contiguous immutable plan used by `hdql_query_reset()` and
+ * `hdql_query_get()`. Called by `hdql_compile_query()`; for manually
+ * assembled chains it is called on first reset, so explicit call is only
+ * needed to avoid this at evaluation time. Chain can not be appended once
+ * finalized. Returns non-zero error code on failure. */
+HDQL_API int
+hdql_query_finalize(struct hdql_Query * q, hdql_Context_t context);
+
 /**\brief Returns depth of hdql query */
 HDQL_API size_t
 hdql_query_depth(struct hdql_Query * current);
@@ -76,6 +87,23 @@ hdql_query_top_attr( const struct hdql_Query * );
 /**\brief Returns collection query's selection arguments */
 HDQL_API hdql_SelectionArgs_t hdql_query_get_collection_selection(struct hdql_Query *);
 
+/**\brief Replaces collection query's selection arguments
+ *
+ * Previous selection is not freed. Used by compile-time optimizations (e.g.
+ * predicate pushdown, see `hdql_CollectionAttrInterface::compile_predicate`). */
+HDQL_API void
+hdql_query_set_collection_selection(struct hdql_Query *, hdql_SelectionArgs_t);
+
+/**\brief Exchanges subjects of two query nodes
+ *
+ * Both subjects must be either scalar or collection ones (with no selection).
+ * Subject ownership is exchanged as well. Queries must not be evaluated or
+ * finalized yet. Used by compile-time optimizations to substitute the node
+ * evaluation while keeping pointers to the node intact (e.g. common
+ * sub-expression elimination). */
+HDQL_API void
+hdql_query_swap_subjects(struct hdql_Query *, struct hdql_Query *);
+
 /**\brief Tags query with a string label
  *
  * The label pointer must be allocated at the same context that was used to
@@ -117,6 +145,61 @@ hdql_query_set_transient_subject_ownership(struct hdql_Query * q);
 
 HDQL_API void hdql_query_destroy(struct hdql_Query *, hdql_Context_t ctx);
 
+/**\brief Opaque state of cloning procedure
+ *
+ * Maps original virtual compounds and their attribute definitions onto
+ * clones to keep cloned queries and sub-queries consistent. */
+struct hdql_QueryCloneState;
+
+/**\brief Creates new query instance from the compiled one
+ *
+ * Clone shares immutable attribute definitions, selection arguments and
+ * static values with the original, while transient attribute definitions
+ * carrying sub-queries (forwarding queries, arithmetics, functions, virtual
+ * compounds) are copied so that clone gets its own runtime state. Clone can
+ * then be evaluated independently from the original (e.g. in other thread,
+ * with its own context).
+ *
+ * Clone must be destroyed with `hdql_query_destroy()` before the original
+ * query. Virtual compounds of the clone are managed by the given context.
+ * Returns NULL on failure, with error pushed to the context. */
+HDQL_API struct hdql_Query *
+hdql_query_clone(const struct hdql_Query *, hdql_Context_t ctx);
+
+/**\brief Clones query within the cloning procedure
+ *
+ * Meant to be used by copy callbacks of transient attribute definitions to
+ * clone sub-queries (see `hdql_TransientCopyCallback_t`). */
+HDQL_API struct hdql_Query *
+hdql_query_clone_with( const struct hdql_Query *
+                     , struct hdql_QueryCloneState * cs
+                     , hdql_Context_t ctx
+                     );
+
+/**\brief Returns clone of virtual compound within the cloning procedure
+ *
+ * Non-virtual compounds are returned as is. */
+HDQL_API struct hdql_Compound *
+hdql_query_clone_compound( struct hdql_Compound *
+                         , struct hdql_QueryCloneState * cs
+                         , hdql_Context_t ctx
+                         );
+
+/**\brief Returns copy of an object made within the cloning procedure
+ *
+ * Returns NULL if object was not cloned yet. Copy callbacks may use it to
+ * keep data shared among multiple transient attribute definitions shared
+ * within the clone as well. */
+HDQL_API void *
+hdql_query_clone_state_find(struct hdql_QueryCloneState * cs, const void * orig);
+
+/**\brief Registers copy of an object within the cloning procedure */
+HDQL_API int
+hdql_query_clone_state_add( struct hdql_QueryCloneState * cs
+                          , const void * orig, void * copy
+                          , hdql_Context_t ctx
+                          );
+
 /**\brief Dumps built query internals */
 HDQL_API void hdql_query_dump(FILE *, struct hdql_Query *, hdql_Context_t);
 
@@ -171,6 +254,68 @@ hdql_query_product_advance( struct hdql_Query ** qs
         , hdql_Context_t ctx
         );
 
+/**\brief Evaluator of multiple queries sharing common prefixes
+ *
+ * Queries applied to the same root object often start with the same path,
+ * e.g. `.hits.x`, `.hits.y`, `.hits{:.x > 4}.time`. Query trie merges such
+ * chains by common leading queries (same attribute and selection), so shared
+ * collection gets iterated once per root object for all the queries, with
+ * results dispatched to diverging suffixes.
+ *
+ * Selections are compiled into opaque arguments which can not be compared by
+ * content, so collection links with selection are merged only when they
+ * share the same compiled selection (e.g. clones of the same query). Queries
+ * compiled separately never share selected links, even if selection
+ * expressions are identical.
+ *
+ * Trie steers runtime state of the given queries, so queries must not be
+ * evaluated by other means while being used in a trie and must outlive it.
+ * Keys are not provided. */
+struct hdql_QueryTrie;
+
+/**\brief Callback receiving result of the query of given index
+ *
+ * Non-zero return code interrupts processing. */
+typedef int (*hdql_QueryTrieResultCallback_t)( size_t nQuery
+                                             , hdql_Datum_t result
+                                             , void * userdata
+                                             );
+
+/**\brief Builds query trie from the set of queries
+ *
+ * Queries are referred by their index in \p qs by result callback. Returns
+ * NULL on failure, with error pushed to the context. */
+HDQL_API struct hdql_QueryTrie *
+hdql_query_trie_create( struct hdql_Query ** qs
+                      , size_t nQueries
+                      , hdql_Context_t ctx
+                      );
+
+/**\brief Returns number of distinct query chain links in the trie */
+HDQL_API size_t
+hdql_query_trie_n_nodes(const struct hdql_QueryTrie *);
+
+/**\brief Evaluates all the queries of the trie on given root object
+ *
+ * For every query, results are delivered in the same order as
+ * `hdql_query_reset()`/`hdql_query_get()` yield them, while results of
+ * different queries are interleaved.
+ *
+ * \returns `HDQL_ERR_CODE_OK` on success
+ * \returns non-zero code returned by \p callback, if it interrupted
+ *          processing */
+HDQL_API int
+hdql_query_trie_process( const struct hdql_QueryTrie *
+                       , hdql_Datum_t root
+                       , hdql_QueryTrieResultCallback_t callback
+                       , void * userdata
+                       , hdql_Context_t ctx
+                       );
+
+/**\brief Deletes query trie (queries are not affected) */
+HDQL_API void
+hdql_query_trie_destroy(struct hdql_QueryTrie *, hdql_Context_t ctx);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
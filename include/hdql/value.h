@@ -138,28 +138,78 @@ hdql_converters_add( struct hdql_Converters *cnvs
 
 /**\brief Returns value converter function or NULL if conversion is forbidden
  *
- * Recursively expands converters till root. */
+ * Recursively expands converters till root. If table is frozen (see
+ * `hdql_converters_freeze()`), resolved with dense index. */
 HDQL_API hdql_TypeConverter
 hdql_converters_get( const struct hdql_Converters *cnvs
                    , hdql_ValueTypeCode_t to
                    , hdql_ValueTypeCode_t from
                    );
 
-/* \brief Computes conversion chain
+/**\brief Freezes converters table
+ *
+ * Builds dense index of converters (flattened across parent tables) used
+ * by `hdql_converters_get()` while no converters are added to the table or
+ * its parents. Frozen table is re-frozen automatically on addition.
+ *
+ * \returns `HDQL_ERR_CODE_OK` on success, `HDQL_ERR_MEMORY` on allocation
+ *          failure */
+HDQL_API int
+hdql_converters_freeze(struct hdql_Converters *cnvs);
+
+#ifndef HDQL_CONVERTERS_MAX_CHAIN_LENGTH
+/**\def HDQL_CONVERTERS_MAX_CHAIN_LENGTH
+ * \brief Max number of steps in multi-step conversion */
+#   define HDQL_CONVERTERS_MAX_CHAIN_LENGTH 4
+#endif
+
+/**\brief Resolved multi-step conversion
+ *
+ * Steps are applied in order, `types[0]` is the source type and
+ * `types[nSteps]` is the target one. Intermediate values are owned by the
+ * chain. */
+struct hdql_TypeConverterChain {
+    size_t nSteps;
+    hdql_TypeConverter converters[HDQL_CONVERTERS_MAX_CHAIN_LENGTH];
+    hdql_ValueTypeCode_t types[HDQL_CONVERTERS_MAX_CHAIN_LENGTH + 1];
+    hdql_Datum_t intermediates[HDQL_CONVERTERS_MAX_CHAIN_LENGTH - 1];
+};
+
+/**\brief Computes conversion chain
  *
  * Among existing converters (if any), calculates the shortest conversion
- * chain.
- * */
-//int
-//hdql_converters_get_chained(
-//                     const struct hdql_Converters *cnvs
-//                   , hdql_ValueTypeCode_t to
-//                   , hdql_ValueTypeCode_t from
-//                   , hdql_TypeConverterList * conversions
-//                   , hdql_Context_t context
-//                   );
-
-/**\brief Adds standard conversion functions*/
+ * chain and allocates intermediate values. Freezes the table if it is not
+ * frozen yet.
+ *
+ * \returns `HDQL_ERR_CODE_OK` on success, `HDQL_ERR_CONVERSION` if there is
+ *          no chain of allowed length, `HDQL_ERR_MEMORY` on allocation
+ *          failure */
+HDQL_API int
+hdql_converters_get_chained( const struct hdql_Converters *cnvs
+                           , hdql_ValueTypeCode_t to
+                           , hdql_ValueTypeCode_t from
+                           , struct hdql_TypeConverterChain * chain
+                           , hdql_Context_t context
+                           );
+
+/**\brief Converts value with conversion chain
+ *
+ * \returns `HDQL_ERR_CODE_OK` on success, or error code of failed step */
+HDQL_API int
+hdql_converters_chain_apply( const struct hdql_TypeConverterChain * chain
+                           , hdql_Datum_t dest
+                           , hdql_Datum_t src
+                           );
+
+/**\brief Frees intermediate values of the conversion chain */
+HDQL_API void
+hdql_converters_chain_free( struct hdql_TypeConverterChain * chain
+                          , hdql_Context_t context
+                          );
+
+/**\brief Adds standard conversion functions
+ *
+ * Freezes the table (see `hdql_converters_freeze()`). */
 HDQL_API void
 hdql_converters_add_std(struct hdql_Converters *cnvs, struct hdql_ValueTypes * vts, hdql_Context_t);
 
@@ -1,4 +1,5 @@
 #include "hdql/allocator.h"
+#include "hdql/internal-api.h"
 
 #include <memory.h>
 #include <assert.h>
@@ -6,9 +7,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/mman.h>
-#include <assert.h>
+#include <pthread.h>
+
+/* alignment of blocks returned by arena and pool allocators */
+#define HDQL_ALLOC_ALIGNMENT _Alignof(max_align_t)
 
 /*
  * Allocator, forwarding calls to system malloc()/free()
@@ -32,6 +37,12 @@ const struct hdql_Allocator hdql_gHeapAllocator = {
 
 /*
  * Arena allocator
+ *
+ * Allocates memory by bumping a pointer within blocks mapped with mmap().
+ * Blocks in use form a stack (most recent first), so rewinding to a mark
+ * merely pops blocks allocated after the mark and moves them to the list of
+ * retained free blocks to be reused by subsequent allocations without new
+ * syscalls. Individual free() is a no-op.
  */
 
 #ifndef PAGE_SIZE
@@ -42,42 +53,105 @@ struct ArenaBlock {
     struct ArenaBlock *next;
     size_t used;
     size_t capacity;
-    char data[];
+    /* size of mapping, including header */
+    size_t mappedSize;
+    /* set if block is mapped with MAP_HUGETLB */
+    int isHugeTLB;
+    _Alignas(HDQL_ALLOC_ALIGNMENT) char data[];
 };
 
 typedef struct {
+    /* blocks in use, current first */
     struct ArenaBlock *head;
+    /* retained blocks available for reuse */
+    struct ArenaBlock *freeBlocks;
     size_t pageSize;
+    struct hdql_ArenaParameters pars;
+    struct hdql_ArenaStats stats;
 } Arena;
 
+static size_t
+_arena_round_up(size_t sz, size_t granularity) {
+    return ((sz + granularity - 1) / granularity) * granularity;
+}
+
+/* Maps new block of (at least) given capacity, respecting huge pages
+ * settings; returns NULL on failure */
+static struct ArenaBlock *
+_arena_map_block(Arena * arena, size_t capacity) {
+    size_t allocSize = capacity + sizeof(struct ArenaBlock);
+    if(allocSize < arena->pars.blockSize) allocSize = arena->pars.blockSize;
+    struct ArenaBlock * block = MAP_FAILED;
+    int isHugeTLB = 0;
+    if(arena->pars.hugePages) {
+        allocSize = _arena_round_up(allocSize, HDQL_ARENA_HUGE_PAGE_SIZE);
+        #ifdef MAP_HUGETLB
+        /* requires pre-allocated huge pages pool; fallback otherwise */
+        block = (struct ArenaBlock *) mmap(NULL, allocSize, PROT_READ | PROT_WRITE
+                , MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        isHugeTLB = (MAP_FAILED != block);
+        #endif
+    } else {
+        allocSize = _arena_round_up(allocSize, arena->pageSize);
+    }
+    if(MAP_FAILED == block) {
+        block = (struct ArenaBlock *) mmap(NULL, allocSize, PROT_READ | PROT_WRITE
+                , MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(MAP_FAILED == block) return NULL;
+        #ifdef MADV_HUGEPAGE
+        /* transparent huge pages hint; failure is not an error */
+        if(arena->pars.hugePages) madvise(block, allocSize, MADV_HUGEPAGE);
+        #endif
+    }
+    block->next = NULL;
+    block->used = 0;
+    block->mappedSize = allocSize;
+    block->capacity = allocSize - sizeof(struct ArenaBlock);
+    block->isHugeTLB = isHugeTLB;
+    ++(arena->stats.nBlocks);
+    if(isHugeTLB) ++(arena->stats.nHugeTLBBlocks);
+    arena->stats.bytesReserved += allocSize;
+    return block;
+}
+
+static void
+_arena_unmap_block(Arena * arena, struct ArenaBlock * block) {
+    --(arena->stats.nBlocks);
+    if(block->isHugeTLB) --(arena->stats.nHugeTLBBlocks);
+    arena->stats.bytesReserved -= block->mappedSize;
+    munmap(block, block->mappedSize);
+}
+
 static void *arena_alloc(size_t size, void *userdata) {
     Arena *arena = (Arena *)userdata;
 
-    // Align to pointer-size
-    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    size = _arena_round_up(size, HDQL_ALLOC_ALIGNMENT);
 
     struct ArenaBlock *block = arena->head;
 
     if (!block || block->used + size > block->capacity) {
-        size_t allocSize = size + sizeof(struct ArenaBlock);
-        allocSize = ((allocSize + arena->pageSize - 1) / arena->pageSize) * arena->pageSize;
-
-        struct ArenaBlock * newBlock
-            = (struct ArenaBlock * ) mmap(NULL, allocSize, PROT_READ | PROT_WRITE,
-                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-        if (!newBlock || newBlock == MAP_FAILED)
-            return NULL;
-
+        /* look for retained block to reuse, map new one otherwise */
+        struct ArenaBlock ** fbPtr = &arena->freeBlocks;
+        while(*fbPtr && (*fbPtr)->capacity < size) fbPtr = &(*fbPtr)->next;
+        struct ArenaBlock * newBlock;
+        if(*fbPtr) {
+            newBlock = *fbPtr;
+            *fbPtr = newBlock->next;
+            newBlock->used = 0;
+        } else {
+            newBlock = _arena_map_block(arena, size);
+            if(!newBlock) return NULL;
+        }
         newBlock->next = block;
-        newBlock->used = 0;
-        newBlock->capacity = allocSize - sizeof(struct ArenaBlock);
-
         arena->head = newBlock;
         block = newBlock;
     }
 
     void *mem = block->data + block->used;
     block->used += size;
+    arena->stats.bytesUsed += size;
+    if(arena->stats.bytesUsed > arena->stats.peakBytesUsed)
+        arena->stats.peakBytesUsed = arena->stats.bytesUsed;
     return mem;
 }
 
@@ -87,27 +161,429 @@ static void arena_free(void *data, void *userdata) {
     (void)userdata;
 }
 
-void
-hdql_alloc_arena_init(struct hdql_Allocator * alloc) {
+/* public API */
+int
+hdql_alloc_arena_init_with( struct hdql_Allocator * alloc
+                          , const struct hdql_ArenaParameters * pars
+                          ) {
     Arena * arena = (Arena*) malloc(sizeof(Arena));
+    if(!arena) return -1;
     arena->head = NULL;
+    arena->freeBlocks = NULL;
     arena->pageSize = sysconf(_SC_PAGESIZE);
     if (arena->pageSize <= 0) arena->pageSize = PAGE_SIZE;
+    if(pars) {
+        arena->pars = *pars;
+    } else {
+        arena->pars.blockSize = 0;
+        arena->pars.hugePages = 0;
+    }
+    memset(&arena->stats, 0, sizeof(arena->stats));
 
     alloc->alloc = arena_alloc;
     alloc->free = arena_free;
     alloc->userdata = arena;
+    return 0;
 }
 
+/* public API */
 void
-hdql_alloc_arena_destroy(struct hdql_Allocator * alloc) {
+hdql_alloc_arena_init(struct hdql_Allocator * alloc) {
+    hdql_alloc_arena_init_with(alloc, NULL);
+}
+
+/* public API */
+struct hdql_ArenaMark
+hdql_alloc_arena_mark(const struct hdql_Allocator * alloc) {
+    const Arena * arena = (const Arena*) alloc->userdata;
+    struct hdql_ArenaMark m = { arena->head
+                              , arena->head ? arena->head->used : 0
+                              , arena->stats.bytesUsed };
+    return m;
+}
+
+/* public API */
+void
+hdql_alloc_arena_rewind(struct hdql_Allocator * alloc, struct hdql_ArenaMark m) {
     Arena * arena = (Arena*) alloc->userdata;
-    struct ArenaBlock * blk = arena->head;
-    while (blk) {
-        struct ArenaBlock *next = blk->next;
-        munmap(blk, blk->capacity + sizeof(struct ArenaBlock));
-        blk = next;
+    /* retain blocks allocated after the mark */
+    while(arena->head != m.block) {
+        assert(arena->head);  /* mark does not belong to the arena */
+        struct ArenaBlock * blk = arena->head;
+        arena->head = blk->next;
+        blk->next = arena->freeBlocks;
+        arena->freeBlocks = blk;
     }
+    if(arena->head) arena->head->used = m.used;
+    arena->stats.bytesUsed = m.bytesUsed;
+}
+
+/* public API */
+void
+hdql_alloc_arena_reset(struct hdql_Allocator * alloc) {
+    struct hdql_ArenaMark m = {NULL, 0, 0};
+    hdql_alloc_arena_rewind(alloc, m);
+}
+
+/* public API */
+void
+hdql_alloc_arena_trim(struct hdql_Allocator * alloc) {
+    Arena * arena = (Arena*) alloc->userdata;
+    while(arena->freeBlocks) {
+        struct ArenaBlock * next = arena->freeBlocks->next;
+        _arena_unmap_block(arena, arena->freeBlocks);
+        arena->freeBlocks = next;
+    }
+}
+
+/* public API */
+void
+hdql_alloc_arena_get_stats( const struct hdql_Allocator * alloc
+                          , struct hdql_ArenaStats * stats
+                          ) {
+    *stats = ((const Arena*) alloc->userdata)->stats;
+}
+
+/* public API */
+void
+hdql_alloc_arena_destroy(struct hdql_Allocator * alloc) {
+    Arena * arena = (Arena*) alloc->userdata;
+    hdql_alloc_arena_reset(alloc);
+    hdql_alloc_arena_trim(alloc);
     free(arena);
 }
 
+/*
+ * Size-class pool allocator
+ *
+ * Small blocks are served from per-class free lists of objects carved from
+ * slabs taken from the backing allocator. Each object is prefixed with a
+ * header keeping its size class, so free() does not need size; blocks
+ * larger than the largest class are forwarded to the backing allocator with
+ * the same header. Rest of the header is kept as tag word for contexts (see
+ * `hdql__allocator_get_tag()`).
+ *
+ * Threads allocate from and free to their own caches of free objects, so
+ * the pool's lock is taken only to move batches of objects between thread
+ * cache and pool. Thread keeps caches for few pools at once; a cache of
+ * alive pool gets returned to the pool on eviction and on thread exit.
+ */
+
+#define HDQL_POOL_N_CLASSES 16
+#define HDQL_POOL_MAX_SIZE 512
+#define HDQL_POOL_LARGE_CLASS UINT32_MAX
+#define HDQL_POOL_HEADER_SIZE HDQL_ALLOC_ALIGNMENT
+/* offset of the tag word in object header; no tag if header has no room
+ * for it besides the size class */
+#define HDQL_POOL_TAG_OFFSET (HDQL_POOL_HEADER_SIZE - sizeof(uint64_t))
+#define HDQL_POOL_TAG \
+    (HDQL_POOL_TAG_OFFSET >= sizeof(uint32_t) ? pool_tag : NULL)
+/* number of pools thread keeps caches for */
+#define HDQL_POOL_N_CACHED_POOLS 4
+
+static const size_t _gPoolClassSizes[HDQL_POOL_N_CLASSES] = {
+     16,  32,  48,  64,  80,  96, 112, 128,
+    160, 192, 224, 256,
+    320, 384, 448, 512
+};
+
+static unsigned
+_pool_size_class(size_t sz) {
+    if(sz <= 128) return sz ? (sz - 1) >> 4 : 0;
+    if(sz <= 256) return 8 + ((sz - 129) >> 5);
+    return 12 + ((sz - 257) >> 6);
+}
+
+/* Free object, linked through its header */
+struct PoolFreeObj {
+    struct PoolFreeObj * next;
+};
+
+/* Slab of objects, allocated with backing allocator */
+struct PoolSlab {
+    struct PoolSlab * next;
+};
+
+typedef struct Pool {
+    /* unique identifier, distinguishes pools allocated at same address */
+    uint64_t id;
+    struct hdql_Allocator backing;
+    pthread_mutex_t lock;
+    struct PoolFreeObj * freeLists[HDQL_POOL_N_CLASSES];
+    struct PoolSlab * slabs;
+    /* not yet carved remainder of the latest slab */
+    char * slabCur;
+    size_t slabLeft;
+    struct hdql_PoolStats stats;
+    /* next alive pool, see `_gPools' */
+    struct Pool * nextPool;
+} Pool;
+
+/* Thread's cache of free objects for certain pool */
+struct PoolCacheSlot {
+    const Pool * pool;
+    uint64_t poolId;
+    struct PoolFreeObj * lists[HDQL_POOL_N_CLASSES];
+    unsigned counts[HDQL_POOL_N_CLASSES];
+};
+
+struct PoolThreadCache {
+    int isRegistered;
+    unsigned nEvict;
+    struct PoolCacheSlot slots[HDQL_POOL_N_CACHED_POOLS];
+};
+
+static _Thread_local struct PoolThreadCache _gPoolThreadCache;
+
+/* Process-wide pool, never destroyed */
+static Pool _gPool = {
+    .id = 1,
+    .backing = { NULL, _hdql_std_malloc, _hdql_std_free },
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/* Registry of alive (non-global) pools, to return thread caches to */
+static pthread_mutex_t _gPoolsLock = PTHREAD_MUTEX_INITIALIZER;
+static Pool * _gPools = NULL;
+static uint64_t _gPoolLastId = 1;
+
+static pthread_once_t _gPoolKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t _gPoolKey;
+
+/* Returns cached objects to the pool if pool is still alive (to be called
+ * with `_gPoolsLock' acquired), clears the slot */
+static void
+_pool_flush_slot_locked(struct PoolCacheSlot * slot) {
+    Pool * pool = NULL;
+    if(slot->pool == &_gPool) {
+        pool = &_gPool;
+    } else if(slot->pool) {
+        for(Pool * p = _gPools; p; p = p->nextPool) {
+            if(p == slot->pool && p->id == slot->poolId) { pool = p; break; }
+        }
+    }
+    if(pool) {
+        pthread_mutex_lock(&pool->lock);
+        for(unsigned c = 0; c < HDQL_POOL_N_CLASSES; ++c) {
+            struct PoolFreeObj * o = slot->lists[c];
+            if(!o) continue;
+            while(o->next) o = o->next;
+            o->next = pool->freeLists[c];
+            pool->freeLists[c] = slot->lists[c];
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    memset(slot, 0, sizeof(*slot));
+}
+
+static void
+_pool_thread_cache_release(void * tc_) {
+    struct PoolThreadCache * tc = (struct PoolThreadCache *) tc_;
+    pthread_mutex_lock(&_gPoolsLock);
+    for(unsigned i = 0; i < HDQL_POOL_N_CACHED_POOLS; ++i) {
+        _pool_flush_slot_locked(tc->slots + i);
+    }
+    pthread_mutex_unlock(&_gPoolsLock);
+}
+
+static void
+_pool_key_create(void) {
+    pthread_key_create(&_gPoolKey, _pool_thread_cache_release);
+}
+
+/* Returns calling thread's cache for the pool, (re)binding a slot if need */
+static struct PoolCacheSlot *
+_pool_cache_slot(const Pool * pool) {
+    struct PoolThreadCache * tc = &_gPoolThreadCache;
+    struct PoolCacheSlot * empty = NULL;
+    for(unsigned i = 0; i < HDQL_POOL_N_CACHED_POOLS; ++i) {
+        struct PoolCacheSlot * slot = tc->slots + i;
+        if(slot->pool == pool && slot->poolId == pool->id) return slot;
+        if(!empty && !slot->pool) empty = slot;
+    }
+    if(!tc->isRegistered) {
+        /* to return cached objects on thread exit */
+        pthread_once(&_gPoolKeyOnce, _pool_key_create);
+        pthread_setspecific(_gPoolKey, tc);
+        tc->isRegistered = 1;
+    }
+    if(!empty) {
+        empty = tc->slots + (tc->nEvict++ % HDQL_POOL_N_CACHED_POOLS);
+        pthread_mutex_lock(&_gPoolsLock);
+        _pool_flush_slot_locked(empty);
+        pthread_mutex_unlock(&_gPoolsLock);
+    }
+    empty->pool = pool;
+    empty->poolId = pool->id;
+    return empty;
+}
+
+/* Moves batch of free objects of given class to thread cache, carving new
+ * ones from slabs if need; returns non-zero on failure */
+static int
+_pool_refill(Pool * pool, struct PoolCacheSlot * slot, unsigned c) {
+    const size_t stride = HDQL_POOL_HEADER_SIZE + _gPoolClassSizes[c];
+    unsigned n = 0;
+    pthread_mutex_lock(&pool->lock);
+    while(pool->freeLists[c] && n < HDQL_POOL_BATCH) {
+        struct PoolFreeObj * o = pool->freeLists[c];
+        pool->freeLists[c] = o->next;
+        o->next = slot->lists[c];
+        slot->lists[c] = o;
+        ++n;
+    }
+    while(n < HDQL_POOL_BATCH) {
+        if(pool->slabLeft < stride) {
+            struct PoolSlab * slab = (struct PoolSlab *) pool->backing.alloc(
+                    HDQL_POOL_SLAB_SIZE, pool->backing.userdata);
+            if(!slab) break;
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            pool->slabCur = ((char *) slab) + HDQL_POOL_HEADER_SIZE;
+            pool->slabLeft = HDQL_POOL_SLAB_SIZE - HDQL_POOL_HEADER_SIZE;
+            ++(pool->stats.nSlabs);
+            pool->stats.bytesReserved += HDQL_POOL_SLAB_SIZE;
+        }
+        struct PoolFreeObj * o = (struct PoolFreeObj *) pool->slabCur;
+        pool->slabCur += stride;
+        pool->slabLeft -= stride;
+        o->next = slot->lists[c];
+        slot->lists[c] = o;
+        ++n;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    slot->counts[c] += n;
+    return n ? 0 : -1;
+}
+
+/* Returns batch of free objects of given class from thread cache to pool */
+static void
+_pool_release_batch(Pool * pool, struct PoolCacheSlot * slot, unsigned c) {
+    struct PoolFreeObj * first = slot->lists[c], * last = first;
+    for(unsigned n = 1; n < HDQL_POOL_BATCH; ++n) last = last->next;
+    slot->lists[c] = last->next;
+    slot->counts[c] -= HDQL_POOL_BATCH;
+    pthread_mutex_lock(&pool->lock);
+    last->next = pool->freeLists[c];
+    pool->freeLists[c] = first;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void *
+pool_alloc(size_t size, void * userdata) {
+    Pool * pool = (Pool *) userdata;
+    char * p;
+    if(size > HDQL_POOL_MAX_SIZE) {
+        p = (char *) pool->backing.alloc(HDQL_POOL_HEADER_SIZE + size
+                , pool->backing.userdata);
+        if(!p) return NULL;
+        *((uint32_t *) p) = HDQL_POOL_LARGE_CLASS;
+        return p + HDQL_POOL_HEADER_SIZE;
+    }
+    const unsigned c = _pool_size_class(size);
+    struct PoolCacheSlot * slot = _pool_cache_slot(pool);
+    if(!slot->lists[c] && _pool_refill(pool, slot, c)) return NULL;
+    p = (char *) slot->lists[c];
+    slot->lists[c] = slot->lists[c]->next;
+    --(slot->counts[c]);
+    *((uint32_t *) p) = c;
+    return p + HDQL_POOL_HEADER_SIZE;
+}
+
+static void
+pool_free(void * ptr, void * userdata) {
+    Pool * pool = (Pool *) userdata;
+    char * p = ((char *) ptr) - HDQL_POOL_HEADER_SIZE;
+    const uint32_t c = *((uint32_t *) p);
+    if(HDQL_POOL_LARGE_CLASS == c) {
+        pool->backing.free(p, pool->backing.userdata);
+        return;
+    }
+    assert(c < HDQL_POOL_N_CLASSES);
+    struct PoolCacheSlot * slot = _pool_cache_slot(pool);
+    struct PoolFreeObj * o = (struct PoolFreeObj *) p;
+    o->next = slot->lists[c];
+    slot->lists[c] = o;
+    if(++(slot->counts[c]) > 2*HDQL_POOL_BATCH)
+        _pool_release_batch(pool, slot, c);
+}
+
+static uint64_t *
+pool_tag(void * ptr, void * userdata) {
+    return (uint64_t *) (((char *) ptr) - HDQL_POOL_HEADER_SIZE + HDQL_POOL_TAG_OFFSET);
+}
+
+const struct hdql_Allocator hdql_gPoolAllocator = {
+    .userdata = &_gPool,
+    .alloc = pool_alloc,
+    .free = pool_free
+};
+
+/* internal API */
+hdql_AllocatorTagCallback_t
+hdql__allocator_get_tag(const struct hdql_Allocator * alloc) {
+    return alloc->alloc == pool_alloc ? HDQL_POOL_TAG : NULL;
+}
+
+/* public API */
+int
+hdql_alloc_pool_init( struct hdql_Allocator * alloc
+                    , const struct hdql_Allocator * backing
+                    ) {
+    Pool * pool = (Pool *) malloc(sizeof(Pool));
+    if(!pool) return -1;
+    memset(pool, 0, sizeof(Pool));
+    pool->backing = backing ? *backing : hdql_gHeapAllocator;
+    if(pthread_mutex_init(&pool->lock, NULL)) {
+        free(pool);
+        return -1;
+    }
+    pthread_mutex_lock(&_gPoolsLock);
+    pool->id = ++_gPoolLastId;
+    pool->nextPool = _gPools;
+    _gPools = pool;
+    pthread_mutex_unlock(&_gPoolsLock);
+
+    alloc->alloc = pool_alloc;
+    alloc->free = pool_free;
+    alloc->userdata = pool;
+    return 0;
+}
+
+/* public API */
+void
+hdql_alloc_pool_get_stats( const struct hdql_Allocator * alloc
+                         , struct hdql_PoolStats * stats
+                         ) {
+    Pool * pool = (Pool *) alloc->userdata;
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* public API */
+void
+hdql_alloc_pool_destroy(struct hdql_Allocator * alloc) {
+    Pool * pool = (Pool *) alloc->userdata;
+    assert(pool != &_gPool);
+    pthread_mutex_lock(&_gPoolsLock);
+    for(Pool ** pp = &_gPools; *pp; pp = &(*pp)->nextPool) {
+        if(*pp != pool) continue;
+        *pp = pool->nextPool;
+        break;
+    }
+    pthread_mutex_unlock(&_gPoolsLock);
+    /* caches of other threads become stale and get dropped on eviction */
+    for(unsigned i = 0; i < HDQL_POOL_N_CACHED_POOLS; ++i) {
+        struct PoolCacheSlot * slot = _gPoolThreadCache.slots + i;
+        if(slot->pool == pool && slot->poolId == pool->id)
+            memset(slot, 0, sizeof(*slot));
+    }
+    while(pool->slabs) {
+        struct PoolSlab * next = pool->slabs->next;
+        pool->backing.free(pool->slabs, pool->backing.userdata);
+        pool->slabs = next;
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
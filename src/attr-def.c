@@ -48,6 +48,7 @@ struct hdql_AttrDef {
     } typeInfo;
 
     void (*transient_dtr)(hdql_Datum_t, hdql_Context_t ctx);
+    hdql_TransientCopyCallback_t transient_cpy;
 };  /* struct hdql_AttrDef */
 
 /*                          * * *   * * *   * * *                            */
@@ -90,6 +91,7 @@ hdql_attr_def_create_atomic_scalar(
     }
     /* ... other validity checks */
     struct hdql_AttrDef * ad = hdql_alloc(context, struct hdql_AttrDef);
+    if(!ad) return NULL;
     bzero((void*) ad, sizeof(struct hdql_AttrDef));
 
     ad->isAtomic         = 0x1;
@@ -131,6 +133,7 @@ hdql_attr_def_create_atomic_collection(
     }
     /* ... other validity checks */
     struct hdql_AttrDef * ad = hdql_alloc(context, struct hdql_AttrDef);
+    if(!ad) return NULL;
     bzero((void*) ad, sizeof(struct hdql_AttrDef));
 
     ad->isAtomic         = 0x1;
@@ -172,6 +175,7 @@ hdql_attr_def_create_compound_scalar(
     }
     /* ... other validity checks */
     struct hdql_AttrDef * ad = hdql_alloc(context, struct hdql_AttrDef);
+    if(!ad) return NULL;
     bzero((void*) ad, sizeof(struct hdql_AttrDef));
 
     ad->isAtomic         = 0x0;
@@ -213,6 +217,7 @@ hdql_attr_def_create_compound_collection(
     }
     /* ... other validity checks */
     struct hdql_AttrDef * ad = hdql_alloc(context, struct hdql_AttrDef);
+    if(!ad) return NULL;
     bzero((void*) ad, sizeof(struct hdql_AttrDef));
 
     ad->isAtomic         = 0x0;
@@ -240,7 +245,7 @@ static int _hdql_reserve_key_for_fwd_query(
         ) {
     struct hdql_Query * sq = (struct hdql_Query *) fwdQ_;
     int rc = hdql_key_reserve_for_query(sq, k, context);
-    assert(hdql_key_is_list(k));
+    assert(HDQL_ERR_CODE_OK != rc || hdql_key_is_list(k));
     return rc;
 }
 
@@ -252,6 +257,12 @@ static void _transient_dtr__fwd_query(hdql_Datum_t d, hdql_Context_t ctx) {
     }
 }
 
+/* Copies definition data of the forwarding query AD by cloning the query */
+static hdql_Datum_t _transient_cpy__fwd_query(const struct hdql_Datum * d
+        , struct hdql_QueryCloneState * cs, hdql_Context_t ctx) {
+    return (hdql_Datum_t) hdql_query_clone_with((const struct hdql_Query *) d, cs, ctx);
+}
+
 struct hdql_AttrDef *
 hdql_attr_def_create_fwd_query(
           struct hdql_Query * subquery
@@ -290,6 +301,7 @@ hdql_attr_def_create_fwd_query(
     }
 
     hdql_attr_def_set_transient(ad, _transient_dtr__fwd_query);
+    hdql_attr_def_set_transient_copy(ad, _transient_cpy__fwd_query);
 
     ad->keyTypeCode = 0x0;
     ad->reserve_key = _hdql_reserve_key_for_fwd_query;
@@ -329,6 +341,7 @@ hdql_attr_def_create_static_atomic_scalar_value(
     assert(valueType != 0x0);
 
     struct hdql_AttrDef * ad = hdql_alloc(context, struct hdql_AttrDef);
+    if(!ad) return NULL;
     bzero((void*) ad, sizeof(struct hdql_AttrDef));
 
     ad->isAtomic         = 0x1;
@@ -362,6 +375,16 @@ static void _transient_dtr__binding_query(hdql_Datum_t d, hdql_Context_t ctx) {
     hdql_bound_value_interface_definition_data_destroy(d, ctx);
 }
 
+static hdql_Datum_t _transient_cpy__binding_query(const struct hdql_Datum * d
+        , struct hdql_QueryCloneState * cs, hdql_Context_t ctx) {
+    struct hdql_Query * q = hdql_query_clone_with(
+            hdql_bound_value_interface_definition_data_get_query(d), cs, ctx);
+    if(!q) return NULL;
+    hdql_Datum_t dd = hdql_bound_value_interface_definition_data_init(q, ctx);
+    if(!dd) hdql_query_destroy(q, ctx);
+    return dd;
+}
+
 struct hdql_AttrDef *
 hdql_attr_def_create_bound(
           struct hdql_Query * subquery
@@ -391,6 +414,7 @@ hdql_attr_def_create_bound(
     /* always transient */
     ad->isTransient = 0x1;
     ad->transient_dtr = _transient_dtr__binding_query;
+    ad->transient_cpy = _transient_cpy__binding_query;
     /* attribute has no key  */
     ad->keyTypeCode = 0x0;
     ad->reserve_key = NULL;
@@ -401,6 +425,11 @@ hdql_attr_def_create_bound(
     ad->interface.scalar = _hdql_gBoundQueryIFace;
     ad->interface.scalar.definitionData
         = hdql_bound_value_interface_definition_data_init(subquery, context);
+    if(!ad->interface.scalar.definitionData) {
+        hdql_context_free(context, (hdql_Datum_t) ad);
+        *rc = HDQL_ERR_MEMORY;
+        return NULL;
+    }
     
     return ad;
 }
@@ -428,6 +457,60 @@ hdql_attr_def_set_transient(struct hdql_AttrDef * ad
     ad->transient_dtr = dtr;
 }
 
+void
+hdql_attr_def_set_transient_copy(struct hdql_AttrDef * ad
+        , hdql_TransientCopyCallback_t cpy ) {
+    assert(ad);
+    assert(ad->isTransient);
+    ad->transient_cpy = cpy;
+}
+
+struct hdql_AttrDef *
+hdql_attr_def_copy_transient( const struct hdql_AttrDef * ad
+        , struct hdql_QueryCloneState * cs
+        , hdql_Context_t ctx
+        ) {
+    assert(ad);
+    assert(ad->isTransient);
+    const struct hdql_Datum * defData = ad->isCollection
+                ? ad->interface.collection.definitionData
+                : ad->interface.scalar.definitionData;
+    if(NULL != defData && NULL == ad->transient_cpy) {
+        hdql_context_err_push(ctx, HDQL_ERR_OPERATION_NOT_SUPPORTED
+                , "transient attribute definition %p has no copy callback"
+                  " for its definition data", ad );
+        return NULL;
+    }
+    struct hdql_AttrDef * copy = hdql_alloc(ctx, struct hdql_AttrDef);
+    if(!copy) return NULL;
+    memcpy(copy, ad, sizeof(struct hdql_AttrDef));
+    /* virtual compounds have to be substituted first as copied definition
+     * data can refer to its attributes */
+    if(!ad->isAtomic && ad->typeInfo.compound) {
+        copy->typeInfo.compound
+            = hdql_query_clone_compound(ad->typeInfo.compound, cs, ctx);
+        if(!copy->typeInfo.compound) {
+            hdql_context_free(ctx, (hdql_Datum_t) copy);
+            return NULL;
+        }
+    }
+    if(NULL == defData) return copy;
+    hdql_Datum_t newDefData = ad->transient_cpy(defData, cs, ctx);
+    if(!newDefData) {
+        hdql_context_err_push(ctx, HDQL_ERR_GENERIC
+                , "failed to copy definition data of transient attribute"
+                  " definition %p", ad );
+        hdql_context_free(ctx, (hdql_Datum_t) copy);
+        return NULL;
+    }
+    if(copy->isCollection) {
+        copy->interface.collection.definitionData = newDefData;
+    } else {
+        copy->interface.scalar.definitionData = newDefData;
+    }
+    return copy;
+}
+
 bool
 hdql_attr_def_is_atomic(const struct hdql_AttrDef * ad) {
     if(ad->isFwdQuery) return false;
@@ -553,12 +636,10 @@ hdql_attr_def_reserve_key( const struct hdql_AttrDef * ad
         return HDQL_ERR_CODE_OK;
     }
     if( hdql_attr_def_is_collection(ad) ) {
-        ad->reserve_key(key, ad->interface.collection.definitionData, context);
-    } else {
-        assert(hdql_attr_def_is_scalar(ad));
-        ad->reserve_key(key, ad->interface.scalar.definitionData, context);
+        return ad->reserve_key(key, ad->interface.collection.definitionData, context);
     }
-    return HDQL_ERR_CODE_OK;
+    assert(hdql_attr_def_is_scalar(ad));
+    return ad->reserve_key(key, ad->interface.scalar.definitionData, context);
     #endif
 }
 
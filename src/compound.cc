@@ -2,6 +2,8 @@
 #include "hdql/attr-def.h"
 #include "hdql/context.h"
 #include "hdql/types.h"
+#include "hdql/allocator.h"
+#include "hdql/internal-api.h"
 
 #include <unordered_map>
 #include <string>
@@ -21,9 +23,16 @@ struct Compound {
 
     std::unordered_map<std::string, hdql_AttrDef *> attrsByName;
 
+    /* context compound was created within, NULL once the context is
+     * destroyed; allocator of attribute definitions then is used directly */
+    hdql_Context_t context;
+    hdql_Allocator allocator;
+
     Compound(const char * nm, const hdql_Compound * parent_)
             : name(nm)
             , parent(parent_)
+            , context(nullptr)
+            , allocator{nullptr, nullptr, nullptr}
             {}
 };  // class Table
 
@@ -38,13 +47,22 @@ struct hdql_Compound : public hdql::Compound {
 
 extern "C" hdql_Compound *
 hdql_compound_new(const char * name, struct hdql_Context * ctx) {
-    ((void) ctx);
     #ifdef HDQL_CONTEXT_BASED_COMPOUNDS_CREATION
     char * bf = reinterpret_cast<char *>(hdql_alloc(ctx, struct hdql_Compound));
-    return new (bf) hdql_Compound(name, NULL);
+    if(!bf) return NULL;
+    hdql_Compound * compound = new (bf) hdql_Compound(name, NULL);
     #else
-    return new hdql_Compound(name, NULL);
+    hdql_Compound * compound = new hdql_Compound(name, NULL);
     #endif
+    compound->context = ctx;
+    compound->allocator = *hdql_context_get_allocator(ctx);
+    hdql__context_add_compound(ctx, compound);
+    return compound;
+}
+
+void
+hdql__compound_detach_context(hdql_Compound * compound) {
+    compound->context = NULL;
 }
 
 extern "C" hdql_Compound *
@@ -54,6 +72,7 @@ hdql_virtual_compound_new(const hdql_Compound * parent, struct hdql_Context * ct
     //assert(!parent->name.empty());
     #ifdef  HDQL_CONTEXT_BASED_COMPOUNDS_CREATION
     char * bf = reinterpret_cast<char *>(hdql_alloc(ctx, struct hdql_Compound));
+    if(!bf) return NULL;
     return new (bf) hdql_Compound("", parent);
     #else
     return new hdql_Compound("", parent);
@@ -215,6 +234,22 @@ hdql_compound_get_attr_names_recursive(const struct hdql_Compound * c, const cha
 
 extern "C" void
 hdql_compound_destroy(hdql_Compound * compound, hdql_Context_t context) {
+    if(NULL == compound->context) {
+        /* context is gone, free attribute definitions with its allocator */
+        const hdql_Allocator allocator = compound->allocator;
+        for(auto & attrDef : compound->attrsByName ) {
+            hdql__allocator_free(&allocator
+                    , reinterpret_cast<hdql_Datum_t>(attrDef.second));
+        }
+        #ifdef HDQL_CONTEXT_BASED_COMPOUNDS_CREATION
+        compound->~hdql_Compound();
+        hdql__allocator_free(&allocator, reinterpret_cast<hdql_Datum_t>(compound));
+        #else
+        delete compound;
+        #endif
+        return;
+    }
+    hdql__context_remove_compound(compound->context, compound);
     for(auto & attrDef : compound->attrsByName ) {
         hdql_context_free(context, reinterpret_cast<hdql_Datum_t>(attrDef.second));
     }
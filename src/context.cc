@@ -1,4 +1,5 @@
 #include "hdql/context.h"
+#include "hdql/allocator.h"
 #include "hdql/compound.h"
 #include "hdql/errors.h"
 #include "hdql/function.h"
@@ -11,21 +12,113 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <list>
 #include <string>
 #include <cstdarg>
+#include <cstddef>
 #include <unordered_map>
+#include <vector>
 #include <stdexcept>
 
-struct VariadicDatumInfo {
+/* Block of evaluation frame arena; data follows the header */
+struct FrameBlock {
+    FrameBlock * next;
+    size_t capacity, used;
+};
+
+/* Position within frame arena saved by `hdql_context_frame_begin()` */
+struct FrameMark {
+    FrameBlock * block;
+    size_t used;
+};
+
+static const size_t gMaxAlignment = alignof(std::max_align_t);
+
+static inline size_t
+_max_aligned(size_t sz) {
+    return (sz + gMaxAlignment - 1) & ~(gMaxAlignment - 1);
+}
+
+static inline unsigned char *
+_frame_block_data(FrameBlock * b) {
+    return reinterpret_cast<unsigned char *>(b) + _max_aligned(sizeof(FrameBlock));
+}
+
+/* Header preceding every context allocation, used for accounting when
+ * allocator provides no tag word (see `hdql__allocator_get_tag()`) */
+struct AllocationHeader {
+    size_t size;
+    hdql_MemoryCategory_t category;
+};
+
+static const size_t gAllocationHeaderSize = _max_aligned(sizeof(AllocationHeader));
+
+/* Tag word keeps allocation size in lower bits, category in highest byte */
+static const unsigned gTagCategoryShift = 56;
+
+/* Returns size of header context prefixes allocations with */
+static inline size_t
+_allocation_overhead(hdql_AllocatorTagCallback_t tag) {
+    return tag ? 0 : gAllocationHeaderSize;
+}
+
+/* Stores accounting info of allocation, returns pointer to user data */
+static hdql_Datum_t
+_allocation_set( hdql_AllocatorTagCallback_t tag, const hdql_Allocator & a
+               , unsigned char * bf
+               , size_t size, hdql_MemoryCategory_t category ) {
+    if(tag) {
+        *tag(bf, a.userdata) = (((uint64_t) category) << gTagCategoryShift)
+                               | size;
+        return reinterpret_cast<hdql_Datum_t>(bf);
+    }
+    AllocationHeader * h = reinterpret_cast<AllocationHeader *>(bf);
+    h->size = size;
+    h->category = category;
+    return reinterpret_cast<hdql_Datum_t>(bf + gAllocationHeaderSize);
+}
+
+/* Retrieves accounting info of allocation, returns block to free */
+static void *
+_allocation_get( hdql_AllocatorTagCallback_t tag, const hdql_Allocator & a
+               , hdql_Datum_t ptr
+               , size_t & size, hdql_MemoryCategory_t & category ) {
+    if(tag) {
+        const uint64_t t = *tag(ptr, a.userdata);
+        size = t & ((((uint64_t) 1) << gTagCategoryShift) - 1);
+        category = static_cast<hdql_MemoryCategory_t>(t >> gTagCategoryShift);
+        return ptr;
+    }
+    unsigned char * bf = reinterpret_cast<unsigned char *>(ptr) - gAllocationHeaderSize;
+    const AllocationHeader * h = reinterpret_cast<const AllocationHeader *>(bf);
+    size = h->size;
+    category = h->category;
+    return bf;
+}
+
+/* Header preceding variadic datum */
+struct VariadicDatumHeader {
     uint32_t nUsedBytes, nAllocatedBytes;
 };
 
+static const size_t gVariadicHeaderSize = _max_aligned(sizeof(VariadicDatumHeader));
+
+static inline VariadicDatumHeader *
+_variadic_datum_header(hdql_Datum_t d) {
+    return reinterpret_cast<VariadicDatumHeader *>(
+            reinterpret_cast<unsigned char *>(d) - gVariadicHeaderSize);
+}
+
 struct hdql_Context {
     #ifdef HDQL_TYPES_DEBUG
     std::unordered_map<hdql_Datum_t, std::string> typesByPtr;
     #endif
     uint32_t flags;
+    /* memory allocator, inherited by descendants */
+    struct hdql_Allocator allocator;
+    /* allocator's tag word getter, if any */
+    hdql_AllocatorTagCallback_t allocatorTag;
 
     struct hdql_ValueTypes * valueTypes;
     struct hdql_Operations * operations;
@@ -35,19 +128,52 @@ struct hdql_Context {
     struct hdql_RandGen    * randgen;
 
     std::list<hdql_Compound *> virtualCompounds;
+    /* alive (non-virtual) compounds created within the context, detached on
+     * context destruction */
+    std::list<hdql_Compound *> compounds;
 
-    std::list<std::pair<hdql_Err_t, std::string>> errors;
-
-    std::unordered_map<hdql_Datum_t, VariadicDatumInfo> variadicDataSizes;
+    /* ring buffer of errors: `nErrors` records starting from `errorsBegin`,
+     * number of dropped ones */
+    hdql_ErrorRecord errors[HDQL_CONTEXT_ERRORS_CAPACITY];
+    size_t errorsBegin, nErrors, nErrorsOverflow;
 
     std::pair<hdql_Context *, std::unordered_map<std::string, void *>> customData;
+
+    /* evaluation frame arena: chain of retained blocks, block currently
+     * allocated from and stack of open frames */
+    FrameBlock * frameBlocks, * frameCurrent;
+    std::vector<FrameMark> frames;
+
+    /* memory accounting and limit (0 for none) */
+    hdql_ContextMemoryStats memStats;
+    size_t memLimit;
 };
 
 extern "C" hdql_Context_t
 hdql_context_create(uint32_t flags) {
+    #ifdef HDQL_POOL_ALLOCATOR
+    return hdql_context_create_with_allocator(flags, &hdql_gPoolAllocator);
+    #else
+    return hdql_context_create_with_allocator(flags, &hdql_gHeapAllocator);
+    #endif
+}
+
+extern "C" hdql_Context_t
+hdql_context_create_with_allocator(uint32_t flags, const struct hdql_Allocator * allocator) {
+    assert(allocator);
+    assert(allocator->alloc);
+    assert(allocator->free);
     // ...
     auto ctx = new hdql_Context;
     ctx->flags = flags;
+    ctx->allocator = *allocator;
+    ctx->allocatorTag = hdql__allocator_get_tag(allocator);
+    /* fields used by allocations and errors go first, as tables created
+     * below do allocate */
+    ctx->frameBlocks = ctx->frameCurrent = nullptr;
+    ctx->errorsBegin = ctx->nErrors = ctx->nErrorsOverflow = 0;
+    memset(&ctx->memStats, 0, sizeof(ctx->memStats));
+    ctx->memLimit = 0;
     ctx->valueTypes = _hdql_value_types_table_create(NULL, ctx);
     ctx->converters = _hdql_converters_create(NULL, ctx);
     ctx->operations = _hdql_operations_create(NULL, ctx);
@@ -63,6 +189,12 @@ extern "C" hdql_Context_t
 hdql_context_create_descendant(hdql_Context_t pCtx, uint32_t flags) {
     auto ctx = new hdql_Context;
     ctx->flags = flags;
+    ctx->allocator = pCtx->allocator;
+    ctx->allocatorTag = pCtx->allocatorTag;
+    ctx->frameBlocks = ctx->frameCurrent = nullptr;
+    ctx->errorsBegin = ctx->nErrors = ctx->nErrorsOverflow = 0;
+    memset(&ctx->memStats, 0, sizeof(ctx->memStats));
+    ctx->memLimit = pCtx->memLimit;
     ctx->valueTypes = _hdql_value_types_table_create(pCtx->valueTypes, ctx);
     ctx->converters = _hdql_converters_create(pCtx->converters, ctx);
     ctx->operations = _hdql_operations_create(pCtx->operations, ctx);
@@ -80,11 +212,9 @@ extern "C" void
 hdql_context_destroy(hdql_Context_t ctx) {
     if(ctx->functions)
         _hdql_functions_destroy(ctx->functions, ctx);
-    // iterate v compounds backwards as they can be based on each other and
-    // are created from basic to derived. Unwinding them backwards should
-    // prevent double free
-    for( auto it = ctx->virtualCompounds.rbegin(); it != ctx->virtualCompounds.rend(); ++it ) {
-        hdql_virtual_compound_destroy(*it, ctx);
+    hdql_context_destroy_virtual_compounds(ctx);
+    for(hdql_Compound * c : ctx->compounds) {
+        hdql__compound_detach_context(c);
     }
     if(ctx->operations)
         _hdql_operations_destroy(ctx->operations, ctx);
@@ -96,6 +226,11 @@ hdql_context_destroy(hdql_Context_t ctx) {
         _hdql_constants_destroy(ctx->constants, ctx);
     if(ctx->randgen)
         _hdql_randgen_destroy(ctx->randgen, ctx);
+    for(FrameBlock * b = ctx->frameBlocks; b; ) {
+        FrameBlock * next = b->next;
+        hdql_context_free(ctx, reinterpret_cast<hdql_Datum_t>(b));
+        b = next;
+    }
     delete ctx;
 }
 
@@ -130,13 +265,63 @@ hdql_context_get_randgen(hdql_Context_t ctx) {
     return ctx->randgen;
 }
 
+extern "C" const struct hdql_Allocator *
+hdql_context_get_allocator(hdql_Context_t ctx) {
+    return &ctx->allocator;
+}
+
+
+extern "C" hdql_Datum_t
+hdql_context_alloc_as( hdql_Context_t ctx
+                     , size_t len
+                     , hdql_MemoryCategory_t category
+                     ) {
+    assert(category < hdql_kMemNCategories);
+    hdql_ContextMemoryStats & s = ctx->memStats;
+    if(ctx->memLimit && (len > ctx->memLimit || s.bytesLive > ctx->memLimit - len)) {
+        ++s.nFailed;
+        hdql_context_err_push(ctx, HDQL_ERR_MEMORY
+                , "Allocation of %zub exceeds memory limit of context"
+                  " (%zub of %zub in use)", len, s.bytesLive, ctx->memLimit);
+        return NULL;
+    }
+    unsigned char * bf = reinterpret_cast<unsigned char *>(
+            ctx->allocator.alloc(_allocation_overhead(ctx->allocatorTag) + len
+                               , ctx->allocator.userdata));
+    if(NULL == bf) {
+        ++s.nFailed;
+        hdql_context_err_push(ctx, HDQL_ERR_MEMORY
+                , "Failed to allocate %zub", len);
+        return NULL;
+    }
+    s.bytesLive += len;
+    if(s.bytesLive > s.bytesPeak) s.bytesPeak = s.bytesLive;
+    ++s.nLive[category];
+    s.bytesLiveByCategory[category] += len;
+    return _allocation_set(ctx->allocatorTag, ctx->allocator, bf, len, category);
+}
 
 extern "C" hdql_Datum_t
 hdql_context_alloc( hdql_Context_t ctx
                   , size_t len
                   ) {
-    // TODO: page-aligned/pool allocation
-    return reinterpret_cast<hdql_Datum_t>(malloc(len));
+    return hdql_context_alloc_as(ctx, len, hdql_kMemOther);
+}
+
+extern "C" void
+hdql_context_get_memory_stats(hdql_Context_t ctx, struct hdql_ContextMemoryStats * dest) {
+    assert(dest);
+    *dest = ctx->memStats;
+}
+
+extern "C" void
+hdql_context_set_memory_limit(hdql_Context_t ctx, size_t bytes) {
+    ctx->memLimit = bytes;
+}
+
+extern "C" size_t
+hdql_context_get_memory_limit(hdql_Context_t ctx) {
+    return ctx->memLimit;
 }
 
 
@@ -146,13 +331,15 @@ hdql_context_variadic_datum_alloc( hdql_Context_t context
                                  , uint32_t preallocSize
                                  ) {
     assert(context);
-    if(0 == preallocSize) {
+    if(preallocSize < usedSize) preallocSize = usedSize;
+    if(0 == preallocSize || UINT32_MAX - gVariadicHeaderSize < preallocSize) {
         hdql_context_err_push(context, HDQL_ERR_MEMORY
                     , "Bad size for new variadic data block: %ub"
                     , preallocSize );
         return NULL;
     }
-    hdql_Datum_t newBlock = reinterpret_cast<hdql_Datum_t>(malloc(preallocSize));
+    hdql_Datum_t newBlock = hdql_context_alloc_as(context
+            , gVariadicHeaderSize + preallocSize, hdql_kMemVariadic);
     if(NULL == newBlock) {
         hdql_context_err_push(context, HDQL_ERR_MEMORY
                     , "Failed to allocate new variadic data block of size %ub (to use %ub)"
@@ -161,27 +348,18 @@ hdql_context_variadic_datum_alloc( hdql_Context_t context
                     );
         return NULL;
     }
-    auto ir = context->variadicDataSizes.emplace(newBlock
-            , VariadicDatumInfo{.nUsedBytes=usedSize, .nAllocatedBytes=preallocSize});
-    if(!ir.second) {
-        hdql_context_err_push(context, HDQL_ERR_MEMORY
-                    , "Failed to emplace new allocated variadic data"
-                      " block %p of size %ub (to use %ub)"
-                    , newBlock
-                    , preallocSize
-                    , usedSize
-                    );
-        free(newBlock);
-        return NULL;
-    }
-    return ir.first->first;
+    hdql_Datum_t d = reinterpret_cast<hdql_Datum_t>(
+            reinterpret_cast<unsigned char *>(newBlock) + gVariadicHeaderSize);
+    VariadicDatumHeader * h = _variadic_datum_header(d);
+    h->nUsedBytes = usedSize;
+    h->nAllocatedBytes = preallocSize;
+    return d;
 }
 
 extern "C" uint32_t
 hdql_context_variadic_datum_size(hdql_Context_t context, hdql_Datum_t datumPtr) {
-    auto it = context->variadicDataSizes.find(datumPtr);
-    if(context->variadicDataSizes.end() == it) return UINT32_MAX;
-    return it->second.nUsedBytes;
+    if(NULL == datumPtr) return UINT32_MAX;
+    return _variadic_datum_header(datumPtr)->nUsedBytes;
 }
 
 hdql_Datum_t
@@ -189,48 +367,30 @@ hdql_context_variadic_datum_realloc(hdql_Context_t context, hdql_Datum_t datum,
     assert(context);
     assert(datum);
     assert(size);
-    auto it = context->variadicDataSizes.find(datum);
-    assert(context->variadicDataSizes.end() != it);
-    if(it->second.nAllocatedBytes >= size) {
-        it->second.nUsedBytes = size;
-        return it->first;
-    } else {
-        void * newData = realloc(datum, size);
-        if(NULL == newData) {
-            hdql_context_err_push(context, HDQL_ERR_MEMORY
-                        , "Failed to reallocate variadic data block of size %ub"
-                        , size );
-            return NULL;
-        }
-        if(it->first == newData) {
-            it->second.nAllocatedBytes = size;
-            it->second.nUsedBytes = size;
-            return it->first;
-        } else {
-            context->variadicDataSizes.erase(it);
-            auto ir = context->variadicDataSizes.emplace(
-                      reinterpret_cast<hdql_Datum_t>(newData)
-                    , VariadicDatumInfo{.nUsedBytes=size, .nAllocatedBytes=size});
-            if(!ir.second) {
-                hdql_context_err_push(context, HDQL_ERR_MEMORY
-                        , "Failed to emplace new variadic data ptr %p", newData);
-                free(newData);
-                return NULL;
-            }
-            return ir.first->first;
-        }
+    VariadicDatumHeader * h = _variadic_datum_header(datum);
+    if(h->nAllocatedBytes >= size) {
+        h->nUsedBytes = size;
+        return datum;
     }
+    /* grow geometrically to amortize repeated appends; allocator has no
+     * realloc(), so data is always moved */
+    const uint32_t maxSize = UINT32_MAX - gVariadicHeaderSize;
+    uint32_t nAllocated = h->nAllocatedBytes > maxSize/2 ? maxSize : 2*h->nAllocatedBytes;
+    if(nAllocated < size) nAllocated = size;
+    hdql_Datum_t newData = hdql_context_variadic_datum_alloc(context, size, nAllocated);
+    if(NULL == newData) return NULL;
+    memcpy(newData, datum, h->nUsedBytes);
+    hdql_context_variadic_datum_free(context, datum);
+    return newData;
 }
 
 extern "C" void
 hdql_context_variadic_datum_free(hdql_Context_t context, hdql_Datum_t datumPtr) {
-    auto it = context->variadicDataSizes.find(datumPtr);
-    if(context->variadicDataSizes.end() == it) return;
-    free(datumPtr);
-    context->variadicDataSizes.erase(it);
+    if(NULL == datumPtr) return;
+    hdql_context_free(context
+            , reinterpret_cast<hdql_Datum_t>(_variadic_datum_header(datumPtr)));
 }
 
-
 #ifdef HDQL_TYPES_DEBUG
 hdql_Datum_t
 hdql_context_alloc_typed( hdql_Context_t ctx
@@ -240,10 +400,31 @@ hdql_context_alloc_typed( hdql_Context_t ctx
     // TODO: strip off `const' qualifier
     assert(size > 0);
     hdql_Datum_t ptr = hdql_context_alloc(ctx, size);
-    ctx->typesByPtr.emplace(ptr, typeName);
+    if(ptr) ctx->typesByPtr[ptr] = typeName;
     return ptr;
 }
 
+extern "C" int
+hdql_context_memory_by_type( hdql_Context_t ctx
+        , int (*callback)(const char *, size_t, size_t, void *)
+        , void * userdata
+        ) {
+    std::unordered_map<std::string, std::pair<size_t, size_t>> byType;
+    for(const auto & p : ctx->typesByPtr) {
+        auto & e = byType[p.second];
+        ++e.first;
+        size_t size;
+        hdql_MemoryCategory_t category;
+        _allocation_get(ctx->allocatorTag, ctx->allocator, p.first, size, category);
+        e.second += size;
+    }
+    for(const auto & e : byType) {
+        int rc = callback(e.first.c_str(), e.second.first, e.second.second, userdata);
+        if(rc) return rc;
+    }
+    return 0;
+}
+
 hdql_Datum_t
 hdql_context_check_type( hdql_Context_t ctx
                        , hdql_Datum_t ptr
@@ -268,35 +449,191 @@ hdql_context_check_type( hdql_Context_t ctx
 
 extern "C" int
 hdql_context_free(hdql_Context_t ctx, hdql_Datum_t ptr) {
-    // TODO: page-aligned/pool allocation
-    free(ptr);
+    if(NULL == ptr) return 0;  /* user allocators may not expect null ptr */
+    #ifdef HDQL_TYPES_DEBUG
+    ctx->typesByPtr.erase(ptr);
+    #endif
+    size_t size;
+    hdql_MemoryCategory_t c;
+    void * bf = _allocation_get(ctx->allocatorTag, ctx->allocator, ptr, size, c);
+    hdql_ContextMemoryStats & s = ctx->memStats;
+    /* (guards against skew when freed by another context) */
+    s.bytesLive -= size < s.bytesLive ? size : s.bytesLive;
+    if(s.nLive[c]) --s.nLive[c];
+    s.bytesLiveByCategory[c] -= size < s.bytesLiveByCategory[c]
+                              ? size : s.bytesLiveByCategory[c];
+    ctx->allocator.free(bf, ctx->allocator.userdata);
     return 0;
 }
 
+void
+hdql__allocator_free(const struct hdql_Allocator * allocator, hdql_Datum_t ptr) {
+    if(NULL == ptr) return;
+    allocator->free(reinterpret_cast<unsigned char *>(ptr)
+                        - _allocation_overhead(hdql__allocator_get_tag(allocator))
+                  , allocator->userdata);
+}
+
+void
+hdql__context_add_compound(hdql_Context_t ctx, struct hdql_Compound * compound) {
+    ctx->compounds.push_back(compound);
+}
+
+void
+hdql__context_remove_compound(hdql_Context_t ctx, struct hdql_Compound * compound) {
+    ctx->compounds.remove(compound);
+}
+
 extern "C" void
 hdql_context_add_virtual_compound(hdql_Context_t ctx, struct hdql_Compound * compoundPtr) {
     ctx->virtualCompounds.push_back(compoundPtr);
 }
 
 extern "C" void
-hdql_context_err_push( hdql_Context_t context
-                     , hdql_Err_t code
-                     , const char * format, ...) {
-    char errBuf[1024];  // TODO: macro parameter?
-    va_list argptr;
-    va_start(argptr, format);
-    vsnprintf(errBuf, sizeof(errBuf), format, argptr);
-    va_end(argptr);
+hdql_context_destroy_virtual_compounds(hdql_Context_t ctx) {
+    // iterate v compounds backwards as they can be based on each other and
+    // are created from basic to derived. Unwinding them backwards should
+    // prevent double free
+    for( auto it = ctx->virtualCompounds.rbegin(); it != ctx->virtualCompounds.rend(); ++it ) {
+        hdql_virtual_compound_destroy(*it, ctx);
+    }
+    ctx->virtualCompounds.clear();
+}
+
+extern "C" int
+hdql_context_frame_begin(hdql_Context_t ctx) {
+    ctx->frames.push_back(FrameMark{ ctx->frameCurrent
+            , ctx->frameCurrent ? ctx->frameCurrent->used : 0 });
+    return HDQL_ERR_CODE_OK;
+}
+
+extern "C" hdql_Datum_t
+hdql_context_frame_alloc(hdql_Context_t ctx, size_t size) {
+    assert(size);
+    size = _max_aligned(size);
+    FrameBlock * b = ctx->frameCurrent;
+    if(b && b->capacity - b->used >= size) {
+        hdql_Datum_t r = reinterpret_cast<hdql_Datum_t>(_frame_block_data(b) + b->used);
+        b->used += size;
+        return r;
+    }
+    /* current block exhausted -- proceed with next retained one, if it fits
+     * or insert new block after the current one */
+    FrameBlock * next = b ? b->next : ctx->frameBlocks;
+    if(next && next->capacity >= size) {
+        b = next;
+    } else {
+        const size_t capacity = size > HDQL_CONTEXT_FRAME_BLOCK_SIZE
+                              ? size : HDQL_CONTEXT_FRAME_BLOCK_SIZE;
+        FrameBlock * nb = reinterpret_cast<FrameBlock *>(hdql_context_alloc_as(ctx
+                    , _max_aligned(sizeof(FrameBlock)) + capacity, hdql_kMemDatum));
+        if(!nb) {
+            hdql_context_err_push(ctx, HDQL_ERR_MEMORY
+                    , "Failed to allocate evaluation frame block of size %zub"
+                    , capacity );
+            return NULL;
+        }
+        nb->capacity = capacity;
+        nb->next = next;
+        if(b) b->next = nb;
+        else ctx->frameBlocks = nb;
+        b = nb;
+    }
+    b->used = size;
+    ctx->frameCurrent = b;
+    return reinterpret_cast<hdql_Datum_t>(_frame_block_data(b));
+}
+
+extern "C" int
+hdql_context_frame_rewind(hdql_Context_t ctx) {
+    if(ctx->frames.empty()) {
+        hdql_context_err_push(ctx, HDQL_ERR_BAD_ARGUMENT
+                , "No evaluation frame to rewind" );
+        return HDQL_ERR_BAD_ARGUMENT;
+    }
+    const FrameMark & m = ctx->frames.back();
+    ctx->frameCurrent = m.block;
+    if(m.block) m.block->used = m.used;
+    ctx->frames.pop_back();
+    return HDQL_ERR_CODE_OK;
+}
+
+extern "C" size_t
+hdql_context_frame_depth(hdql_Context_t ctx) {
+    return ctx->frames.size();
+}
+
+static void
+_hdql_context_err_vpush( hdql_Context_t context
+                       , hdql_Err_t code
+                       , const char * file, int line
+                       , const char * format, va_list argptr) {
+    hdql_ErrorRecord * r;
+    if(context->nErrors < HDQL_CONTEXT_ERRORS_CAPACITY) {
+        r = context->errors
+          + (context->errorsBegin + context->nErrors++) % HDQL_CONTEXT_ERRORS_CAPACITY;
+    } else {
+        /* overwrite the oldest one */
+        r = context->errors + context->errorsBegin;
+        context->errorsBegin = (context->errorsBegin + 1) % HDQL_CONTEXT_ERRORS_CAPACITY;
+        ++(context->nErrorsOverflow);
+    }
+    r->code = code;
+    r->file = file;
+    r->line = line;
+    vsnprintf(r->message, sizeof(r->message), format, argptr);
     if(HDQL_CTX_PRINT_PUSH_ERROR & context->flags) {
-        fputs(errBuf, stderr);
+        fputs(r->message, stderr);
         fputc('\n', stderr);
     }
-    context->errors.push_back(std::pair<hdql_Err_t, std::string>(code, errBuf));
+}
+
+extern "C" void
+hdql_context_err_push_at( hdql_Context_t context
+                        , hdql_Err_t code
+                        , const char * file, int line
+                        , const char * format, ...) {
+    va_list argptr;
+    va_start(argptr, format);
+    _hdql_context_err_vpush(context, code, file, line, format, argptr);
+    va_end(argptr);
+}
+
+/* (name in parentheses prevents macro expansion) */
+extern "C" void
+(hdql_context_err_push)( hdql_Context_t context
+                       , hdql_Err_t code
+                       , const char * format, ...) {
+    va_list argptr;
+    va_start(argptr, format);
+    _hdql_context_err_vpush(context, code, NULL, 0, format, argptr);
+    va_end(argptr);
 }
 
 extern "C" bool
 hdql_context_has_errors(hdql_Context_t context) {
-    return !context->errors.empty();
+    return context->nErrors;
+}
+
+extern "C" size_t
+hdql_context_errors_count(hdql_Context_t context) {
+    return context->nErrors;
+}
+
+extern "C" const struct hdql_ErrorRecord *
+hdql_context_error_get(hdql_Context_t context, size_t n) {
+    if(n >= context->nErrors) return NULL;
+    return context->errors + (context->errorsBegin + n) % HDQL_CONTEXT_ERRORS_CAPACITY;
+}
+
+extern "C" size_t
+hdql_context_errors_overflow(hdql_Context_t context) {
+    return context->nErrorsOverflow;
+}
+
+extern "C" void
+hdql_context_errors_clear(hdql_Context_t context) {
+    context->errorsBegin = context->nErrors = context->nErrorsOverflow = 0;
 }
 
 
@@ -11,8 +11,6 @@
 #   define HDQL_CONVERTERS_REALLOC_INCREMENT 16
 #endif
 
-/* TODO: utilize BFS for types lookup */
-
 typedef struct {
     union {
         struct {
@@ -24,13 +22,33 @@ typedef struct {
     hdql_TypeConverter converter;
 } TypeConverterRecord_t;
 
+/* Frozen dense index of converters, flattened across the parent chain:
+ * converters are addressed by compact indexes of target and source types.
+ * Index 0 is reserved for types without converters. */
+typedef struct {
+    /* sum of revisions along the chain at the moment of building */
+    size_t chainRevision;
+    size_t nTypes, nCodes;
+    /* compact type index by type code */
+    uint16_t * typeIndex;
+    /* type code by compact index */
+    hdql_ValueTypeCode_t * typeCodes;
+    /* converters by [to][from] */
+    hdql_TypeConverter * converters;
+} DenseConverters_t;
+
 struct hdql_Converters {
     size_t nEntres, nAvailable;
     bool sorted;
     TypeConverterRecord_t * records;
     struct hdql_Converters * parent;
+    struct hdql_Context * context;
+    /* incremented on every addition */
+    size_t revision;
+    /* set by `hdql_converters_freeze()`, used while chain revision stays
+     * same */
+    DenseConverters_t * dense;
 };
-
 static int _compare_records(const void * a_, const void * b_) {
     const TypeConverterRecord_t * a = (const TypeConverterRecord_t *) a_;
     const TypeConverterRecord_t * b = (const TypeConverterRecord_t *) b_;
@@ -42,6 +60,24 @@ static int _compare_records(const void * a_, const void * b_) {
 //                                    _________________________________________
 // _________________________________/ Context-private converter routines mgmnt
 
+static size_t
+_hdql_converters_chain_revision(const struct hdql_Converters * cnvs) {
+    size_t r = 0;
+    for(; cnvs; cnvs = cnvs->parent) r += cnvs->revision;
+    return r;
+}
+
+static void
+_hdql_converters_free_dense(struct hdql_Converters * cnvs) {
+    DenseConverters_t * d = cnvs->dense;
+    if(!d) return;
+    if(d->typeIndex)  hdql_context_free(cnvs->context, (hdql_Datum_t) d->typeIndex);
+    if(d->typeCodes)  hdql_context_free(cnvs->context, (hdql_Datum_t) d->typeCodes);
+    if(d->converters) hdql_context_free(cnvs->context, (hdql_Datum_t) d->converters);
+    hdql_context_free(cnvs->context, (hdql_Datum_t) d);
+    cnvs->dense = NULL;
+}
+
 struct hdql_Converters *
 _hdql_converters_create(struct hdql_Converters * parent, struct hdql_Context * context) {
     struct hdql_Converters * converters = hdql_alloc(context, struct hdql_Converters);
@@ -51,6 +87,9 @@ _hdql_converters_create(struct hdql_Converters * parent, struct hdql_Context * c
     converters->records = NULL;
     converters->sorted = false;
     converters->parent = parent;
+    converters->context = context;
+    converters->revision = 0;
+    converters->dense = NULL;
     return converters;
 }
 
@@ -109,6 +148,9 @@ hdql_converters_add( struct hdql_Converters *cnvs
 
     cnvs->records[cnvs->nEntres++] = newRecord;
     cnvs->sorted = false;
+    ++cnvs->revision;
+    /* keep frozen table frozen */
+    if(cnvs->dense) return hdql_converters_freeze(cnvs);
     return HDQL_ERR_CODE_OK;
 }
 
@@ -117,6 +159,13 @@ hdql_converters_get( const struct hdql_Converters *cnvs
                    , hdql_ValueTypeCode_t to
                    , hdql_ValueTypeCode_t from
                    ) {
+    const DenseConverters_t * d = cnvs->dense;
+    if(d && d->chainRevision == _hdql_converters_chain_revision(cnvs)) {
+        const size_t iTo   = to   < d->nCodes ? d->typeIndex[to]   : 0
+                   , iFrom = from < d->nCodes ? d->typeIndex[from] : 0
+                   ;
+        return d->converters[iTo*d->nTypes + iFrom];
+    }
     if(0 == cnvs->nEntres)
         goto lookParent;
     if(!cnvs->sorted) {  /* recache */
@@ -133,20 +182,195 @@ hdql_converters_get( const struct hdql_Converters *cnvs
             , sizeof(TypeConverterRecord_t)
             , _compare_records);
 
-    if(!r_) return NULL;
-    return ((TypeConverterRecord_t*) r_)->converter;
+    if(r_) return ((TypeConverterRecord_t*) r_)->converter;
 lookParent:
     if(!cnvs->parent) return NULL;
     return hdql_converters_get(cnvs->parent, to, from);
 }
 
+int
+hdql_converters_freeze(struct hdql_Converters * cnvs) {
+    assert(cnvs);
+    /* collect tables from root to this one, so descendants' converters
+     * override */
+    size_t nTables = 0;
+    for(const struct hdql_Converters * c = cnvs; c; c = c->parent) ++nTables;
+    const struct hdql_Converters ** chain = (const struct hdql_Converters **)
+        hdql_context_alloc(cnvs->context, nTables*sizeof(struct hdql_Converters *));
+    if(!chain) return HDQL_ERR_MEMORY;
+    {
+        size_t n = nTables;
+        for(const struct hdql_Converters * c = cnvs; c; c = c->parent) chain[--n] = c;
+    }
+    _hdql_converters_free_dense(cnvs);
+    DenseConverters_t * d = hdql_alloc(cnvs->context, DenseConverters_t);
+    if(!d) {
+        hdql_context_free(cnvs->context, (hdql_Datum_t) chain);
+        return HDQL_ERR_MEMORY;
+    }
+    memset(d, 0x0, sizeof(DenseConverters_t));
+    cnvs->dense = d;
+    /* assign compact indexes */
+    for(size_t i = 0; i < nTables; ++i) {
+        for(size_t j = 0; j < chain[i]->nEntres; ++j) {
+            const TypeConverterRecord_t * r = chain[i]->records + j;
+            if(r->key.semantic.to   >= d->nCodes) d->nCodes = r->key.semantic.to + 1;
+            if(r->key.semantic.from >= d->nCodes) d->nCodes = r->key.semantic.from + 1;
+        }
+    }
+    d->typeIndex = (uint16_t *) hdql_context_alloc(cnvs->context
+            , (d->nCodes ? d->nCodes : 1)*sizeof(uint16_t));
+    d->typeCodes = (hdql_ValueTypeCode_t *) hdql_context_alloc(cnvs->context
+            , (d->nCodes + 1)*sizeof(hdql_ValueTypeCode_t));
+    if(!(d->typeIndex && d->typeCodes)) goto noMemory;
+    memset(d->typeIndex, 0x0, (d->nCodes ? d->nCodes : 1)*sizeof(uint16_t));
+    d->typeCodes[0] = 0;
+    d->nTypes = 1;
+    for(size_t i = 0; i < nTables; ++i) {
+        for(size_t j = 0; j < chain[i]->nEntres; ++j) {
+            const TypeConverterRecord_t * r = chain[i]->records + j;
+            if(!d->typeIndex[r->key.semantic.to]) {
+                d->typeCodes[d->nTypes] = r->key.semantic.to;
+                d->typeIndex[r->key.semantic.to] = d->nTypes++;
+            }
+            if(!d->typeIndex[r->key.semantic.from]) {
+                d->typeCodes[d->nTypes] = r->key.semantic.from;
+                d->typeIndex[r->key.semantic.from] = d->nTypes++;
+            }
+        }
+    }
+    /* fill the matrix */
+    d->converters = (hdql_TypeConverter *) hdql_context_alloc(cnvs->context
+            , d->nTypes*d->nTypes*sizeof(hdql_TypeConverter));
+    if(!d->converters) goto noMemory;
+    memset(d->converters, 0x0, d->nTypes*d->nTypes*sizeof(hdql_TypeConverter));
+    for(size_t i = 0; i < nTables; ++i) {
+        for(size_t j = 0; j < chain[i]->nEntres; ++j) {
+            const TypeConverterRecord_t * r = chain[i]->records + j;
+            d->converters[ d->typeIndex[r->key.semantic.to]*d->nTypes
+                         + d->typeIndex[r->key.semantic.from] ] = r->converter;
+        }
+    }
+    d->chainRevision = _hdql_converters_chain_revision(cnvs);
+    hdql_context_free(cnvs->context, (hdql_Datum_t) chain);
+    return HDQL_ERR_CODE_OK;
+noMemory:
+    _hdql_converters_free_dense(cnvs);
+    hdql_context_free(cnvs->context, (hdql_Datum_t) chain);
+    return HDQL_ERR_MEMORY;
+}
+
+int
+hdql_converters_get_chained( const struct hdql_Converters *cnvs
+                           , hdql_ValueTypeCode_t to
+                           , hdql_ValueTypeCode_t from
+                           , struct hdql_TypeConverterChain * chain
+                           , hdql_Context_t context
+                           ) {
+    assert(cnvs);
+    assert(chain);
+    assert(context);
+    chain->nSteps = 0;
+    /* BFS is performed over the dense index, (re)build it if need */
+    if( !cnvs->dense
+     || cnvs->dense->chainRevision != _hdql_converters_chain_revision(cnvs) ) {
+        int rc = hdql_converters_freeze((struct hdql_Converters *) cnvs);
+        if(HDQL_ERR_CODE_OK != rc) return rc;
+    }
+    const DenseConverters_t * d = cnvs->dense;
+    const size_t iTo   = to   < d->nCodes ? d->typeIndex[to]   : 0
+               , iFrom = from < d->nCodes ? d->typeIndex[from] : 0
+               ;
+    if(!(iTo && iFrom)) return HDQL_ERR_CONVERSION;
+    /* per-type predecessor (compact index) and BFS queue (source may get
+     * enqueued twice) */
+    uint16_t * prev = (uint16_t *) hdql_context_alloc(context
+            , (2*d->nTypes + 1)*sizeof(uint16_t));
+    if(!prev) return HDQL_ERR_MEMORY;
+    uint16_t * queue = prev + d->nTypes;
+    memset(prev, 0x0, d->nTypes*sizeof(uint16_t));
+    size_t qBegin = 0, qEnd = 0;
+    queue[qEnd++] = iFrom;
+    /* (source is not marked as visited to find converter to the same type) */
+    bool found = false;
+    while(qBegin < qEnd && !found) {
+        const uint16_t u = queue[qBegin++];
+        for(uint16_t v = 1; v < d->nTypes; ++v) {
+            if(prev[v] || !d->converters[v*d->nTypes + u]) continue;
+            prev[v] = u;
+            if(v == iTo) { found = true; break; }
+            queue[qEnd++] = v;
+        }
+    }
+    if(!found) {
+        hdql_context_free(context, (hdql_Datum_t) prev);
+        return HDQL_ERR_CONVERSION;
+    }
+    /* unwind path */
+    size_t nSteps = 0;
+    uint16_t path[HDQL_CONVERTERS_MAX_CHAIN_LENGTH + 1];
+    path[0] = iTo;
+    for(uint16_t v = iTo; ; v = prev[v]) {
+        if(nSteps == HDQL_CONVERTERS_MAX_CHAIN_LENGTH) {
+            hdql_context_free(context, (hdql_Datum_t) prev);
+            return HDQL_ERR_CONVERSION;
+        }
+        path[++nSteps] = prev[v];
+        if(prev[v] == iFrom) break;
+    }
+    hdql_context_free(context, (hdql_Datum_t) prev);
+    /* fill the chain in direct order */
+    for(size_t i = 0; i <= nSteps; ++i) {
+        chain->types[i] = d->typeCodes[path[nSteps - i]];
+    }
+    for(size_t i = 0; i < nSteps; ++i) {
+        chain->converters[i] = d->converters[ path[nSteps - i - 1]*d->nTypes
+                                            + path[nSteps - i] ];
+    }
+    for(size_t i = 0; i + 1 < nSteps; ++i) {
+        chain->intermediates[i] = hdql_create_value(chain->types[i + 1], context);
+        if(!chain->intermediates[i]) {
+            chain->nSteps = i + 1;
+            hdql_converters_chain_free(chain, context);
+            return HDQL_ERR_MEMORY;
+        }
+    }
+    chain->nSteps = nSteps;
+    return HDQL_ERR_CODE_OK;
+}
+
+int
+hdql_converters_chain_apply( const struct hdql_TypeConverterChain * chain
+                           , hdql_Datum_t dest
+                           , hdql_Datum_t src
+                           ) {
+    if(0 == chain->nSteps) return HDQL_ERR_CONVERSION;
+    for(size_t i = 0; i < chain->nSteps; ++i) {
+        int rc = chain->converters[i]( i + 1 == chain->nSteps ? dest : chain->intermediates[i]
+                                     , i ? chain->intermediates[i - 1] : src
+                                     );
+        if(HDQL_ERR_CODE_OK != rc) return rc;
+    }
+    return HDQL_ERR_CODE_OK;
+}
+
+void
+hdql_converters_chain_free( struct hdql_TypeConverterChain * chain
+                          , hdql_Context_t context
+                          ) {
+    for(size_t i = 0; i + 1 < chain->nSteps; ++i) {
+        hdql_destroy_value(chain->types[i + 1], chain->intermediates[i], context);
+    }
+    chain->nSteps = 0;
+}
+
 void
 _hdql_converters_destroy(struct hdql_Converters * cnvs, struct hdql_Context * context) {
     assert(context);
     if(!cnvs) return;
+    _hdql_converters_free_dense(cnvs);
     if(cnvs->records) {
         hdql_context_free(context, (hdql_Datum_t) cnvs->records);
     }
     hdql_context_free(context, (hdql_Datum_t) cnvs);
 }
-
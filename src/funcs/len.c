@@ -6,13 +6,11 @@
 #include <string.h>
 #include <assert.h>
 
-/* TODO: generally, we can anticipate optional `length`/`empty` method(s)
- *       for the collection interface in future to enhance performance of these
- *       methods.
- */
-
 typedef struct {
     struct hdql_Query * query;
+    /* set if query is a single unfiltered collection attribute, which
+     * interface provides `size()`/`is_empty()`, to avoid iteration */
+    const struct hdql_CollectionAttrInterface * iface;
 } LenEmptyFuncDefData_t;
 
 typedef struct {
@@ -21,6 +19,18 @@ typedef struct {
 } LenEmptyFuncDynData_t;
 
 
+/* Returns collection interface of the query if it is a single collection
+ * attribute with no selection, NULL otherwise */
+static const struct hdql_CollectionAttrInterface *
+_len_empty__plain_collection_iface(struct hdql_Query * q) {
+    if(hdql_query_next_query(q)) return NULL;
+    const struct hdql_AttrDef * ad = hdql_query_get_subject(q);
+    if( !hdql_attr_def_is_collection(ad)
+     || hdql_attr_def_is_static_const_value(ad) ) return NULL;
+    if(hdql_query_get_collection_selection(q)) return NULL;
+    return hdql_attr_def_collection_iface(ad);
+}
+
 static hdql_Datum_t
 _len_empty__new_dyn_data
             ( hdql_Datum_t newOwner
@@ -42,6 +52,11 @@ _len__reset ( hdql_Datum_t newOwner
     assert(defData_);
     const LenEmptyFuncDefData_t *defData = hdql_cast(context, const LenEmptyFuncDefData_t, defData_);
     LenEmptyFuncDynData_t *dynData = hdql_cast(context, LenEmptyFuncDynData_t, dynData_);
+    if(defData->iface && defData->iface->size) {
+        dynData->counter = defData->iface->size(newOwner
+                , defData->iface->definitionData, context);
+        return (hdql_Datum_t) &dynData->counter;
+    }
     dynData->counter = 0;
     for( hdql_Datum_t r = hdql_query_reset(defData->query, newOwner, key, context)
        ; r
@@ -60,6 +75,11 @@ _empty__reset ( hdql_Datum_t newOwner
     const LenEmptyFuncDefData_t *defData = hdql_cast(context, const LenEmptyFuncDefData_t, defData_);
     LenEmptyFuncDynData_t *dynData = hdql_cast(context, LenEmptyFuncDynData_t, dynData_);
     dynData->counter = 0;
+    if(defData->iface && defData->iface->is_empty) {
+        dynData->isEmpty = defData->iface->is_empty(newOwner
+                , defData->iface->definitionData, context);
+        return (hdql_Datum_t) &dynData->isEmpty;
+    }
     dynData->isEmpty = true;
     if(hdql_query_reset(defData->query, newOwner, key, context))
         dynData->isEmpty = false;
@@ -88,6 +108,22 @@ _transient_dtr__len_empty(hdql_Datum_t dd_, hdql_Context_t context) {
     hdql_context_free(context, dd_);
 }
 
+static hdql_Datum_t
+_transient_cpy__len_empty( const struct hdql_Datum * dd_
+                         , struct hdql_QueryCloneState * cs
+                         , hdql_Context_t context
+                         ) {
+    const LenEmptyFuncDefData_t *dd = hdql_cast(context, const LenEmptyFuncDefData_t, dd_);
+    LenEmptyFuncDefData_t * copy = hdql_alloc(context, LenEmptyFuncDefData_t);
+    copy->query = hdql_query_clone_with(dd->query, cs, context);
+    if(!copy->query) {
+        hdql_context_free(context, (hdql_Datum_t) copy);
+        return NULL;
+    }
+    copy->iface = _len_empty__plain_collection_iface(copy->query);
+    return (hdql_Datum_t) copy;
+}
+
 struct hdql_AttrDef *
 hdql_func_helper__try_len_empty(
           struct hdql_Query ** args, void * userdata
@@ -118,6 +154,7 @@ hdql_func_helper__try_len_empty(
     LenEmptyFuncDefData_t * dd = (LenEmptyFuncDefData_t *)
                 hdql_context_alloc(context, sizeof(LenEmptyFuncDefData_t));
     dd->query = args[0];
+    dd->iface = _len_empty__plain_collection_iface(dd->query);
 
     /* form interface */
     struct hdql_ScalarAttrInterface iface;
@@ -144,6 +181,7 @@ hdql_func_helper__try_len_empty(
             , context);
     if(r) {
         hdql_attr_def_set_transient(r, _transient_dtr__len_empty);
+        hdql_attr_def_set_transient_copy(r, _transient_cpy__len_empty);
     }
     return r;
 }
@@ -8,6 +8,7 @@
 #include "hdql/random.h"
 
 #include <float.h>
+#include <math.h>
 #include <string.h>
 #include <assert.h>
 #include <limits.h>
@@ -87,6 +88,8 @@ typedef struct {
  * Implements Common monoid lifecycle
  */
 
+static void _monoid__destroy(hdql_Datum_t, const struct hdql_Datum *, hdql_Context_t);
+
 hdql_Datum_t
 _monoid__new_dyn_data
             ( hdql_Datum_t newOwner
@@ -96,9 +99,15 @@ _monoid__new_dyn_data
     ((void) newOwner);  /* owner unused here */
     const SMADefData_t *defData = hdql_cast(context, const SMADefData_t, defData_);
     SMADynamicData_t *dynData = hdql_alloc(context, SMADynamicData_t);
+    if(!dynData) return NULL;
+    dynData->result = NULL;
     /* allocate destinations */
     dynData->convertedValues
         = (struct hdql_Datum **) hdql_context_alloc(context, sizeof(struct hdql_Datum *)*defData->nQueries);
+    if(!dynData->convertedValues) {
+        hdql_context_free(context, (hdql_Datum_t) dynData);
+        return NULL;
+    }
     /* mark reserved values with zeros to conditionally free them on failure */
     bzero(dynData->convertedValues, sizeof(struct hdql_Datum *)*defData->nQueries);
     /* allocate destinations */
@@ -113,14 +122,37 @@ _monoid__new_dyn_data
         }
         /* conversion is needed -- allocate destination */
         dynData->convertedValues[nq] = hdql_create_value(defData->rTypeCode, context);
-        assert(dynData->convertedValues[nq]);  /* allocation error */
+        if(!dynData->convertedValues[nq]) {  /* allocation error */
+            _monoid__destroy((hdql_Datum_t) dynData, defData_, context);
+            return NULL;
+        }
     }
     /* allocate result datum */
     dynData->result = defData->instantiate_result(defData->rTypeCode, context);
-    assert(dynData->result);
+    if(!dynData->result) {
+        _monoid__destroy((hdql_Datum_t) dynData, defData_, context);
+        return NULL;
+    }
     return (struct hdql_Datum *) dynData;
 }
 
+/* Applies monoid operation to i-th argument's value, converting it if need;
+ * forwards operation's return code (non-zero interrupts convolution) */
+static int
+_monoid__apply( const SMADefData_t * defData
+              , SMADynamicData_t * dynData
+              , size_t i
+              , hdql_Datum_t r
+              ) {
+    if(defData->converters && defData->converters[i]) {
+        /* apply operation with converted */
+        defData->converters[i](dynData->convertedValues[i], r);
+        return defData->monoidDef->operation(dynData->result, dynData->convertedValues[i]);
+    }
+    /* apply operation without conversion */
+    return defData->monoidDef->operation(dynData->result, r);
+}
+
 static hdql_Datum_t
 _monoid__reset
             ( hdql_Datum_t newOwner
@@ -134,8 +166,12 @@ _monoid__reset
     /* set result to neutral element */
     defData->monoidDef->set_neutral(dynData->result);
 
-    /* compute */
+    /* compute; once operation interrupts convolution (result is determined,
+     * like for any() or all()), remaining values are not retrieved, so
+     * argument queries do not descend into the rest of their collections.
+     * All the arguments are still reset as empty argument affects result */
     hdql_Datum_t r;
+    int interrupted = 0;
     for(size_t i = 0; i < defData->nQueries; ++i) {
         r = hdql_query_reset(defData->queries[i], newOwner, key, context);
         if(!r) {
@@ -144,25 +180,13 @@ _monoid__reset
             else
                 goto returnResult;
         }
-        if(defData->converters && defData->converters[i]) {
-            /* apply operation with converted */
-            defData->converters[i](dynData->convertedValues[i], r);
-            defData->monoidDef->operation(dynData->result, dynData->convertedValues[i]);
-        } else {
-            /* apply operation without conversion */
-            defData->monoidDef->operation(dynData->result, r);
-        }
+        if(!interrupted)
+            interrupted = _monoid__apply(defData, dynData, i, r);
     }
-    for(size_t i = 0; i < defData->nQueries; ++i) {
+    for(size_t i = 0; i < defData->nQueries && !interrupted; ++i) {
         while(!!(r = hdql_query_get(defData->queries[i], NULL, context))) {
-            if(defData->converters && defData->converters[i]) {
-                /* apply operation with converted */
-                defData->converters[i](dynData->convertedValues[i], r);
-                defData->monoidDef->operation(dynData->result, dynData->convertedValues[i]);
-            } else {
-                /* apply operation without conversion */
-                defData->monoidDef->operation(dynData->result, r);
-            }
+            if(0 != (interrupted = _monoid__apply(defData, dynData, i, r)))
+                break;
         }
     }
 returnResult:
@@ -203,6 +227,39 @@ _transient_dtr__simple_monoid_arith(hdql_Datum_t dd_, hdql_Context_t context) {
     hdql_context_free(context, (hdql_Datum_t) dd);
 }
 
+static hdql_Datum_t
+_transient_cpy__simple_monoid_arith( const struct hdql_Datum * dd_
+                                   , struct hdql_QueryCloneState * cs
+                                   , hdql_Context_t context
+                                   ) {
+    const SMADefData_t *dd = hdql_cast(context, const SMADefData_t, dd_);
+    SMADefData_t * copy = hdql_alloc(context, SMADefData_t);
+    if(!copy) return NULL;
+    *copy = *dd;
+    copy->queries = (struct hdql_Query **) hdql_context_alloc(context
+            , sizeof(struct hdql_Query *)*dd->nQueries);
+    copy->converters = (hdql_TypeConverter *) hdql_context_alloc(context
+            , sizeof(hdql_TypeConverter)*dd->nQueries);
+    if(!(copy->queries && copy->converters)) {
+        hdql_context_free(context, (hdql_Datum_t) copy->converters);
+        hdql_context_free(context, (hdql_Datum_t) copy->queries);
+        hdql_context_free(context, (hdql_Datum_t) copy);
+        return NULL;
+    }
+    memcpy(copy->converters, dd->converters, sizeof(hdql_TypeConverter)*dd->nQueries);
+    for(size_t i = 0; i < dd->nQueries; ++i) {
+        copy->queries[i] = hdql_query_clone_with(dd->queries[i], cs, context);
+        if(copy->queries[i]) continue;
+        /* cloning failure, release copied queries */
+        while(i--) hdql_query_destroy(copy->queries[i], context);
+        hdql_context_free(context, (hdql_Datum_t) copy->converters);
+        hdql_context_free(context, (hdql_Datum_t) copy->queries);
+        hdql_context_free(context, (hdql_Datum_t) copy);
+        return NULL;
+    }
+    return (hdql_Datum_t) copy;
+}
+
 /*
  * Monoid argument type inference
  */
@@ -451,6 +508,37 @@ _infer_check_atomic_type_to_logic_as_logic(struct hdql_Query ** args
                 failureBufferSize, rTypeCode);
 }
 
+/* Result type inference for statistical moments: variance(), rms(), etc.
+ * - takes numerical (no bool)
+ * - result is of floating point type; integer arguments result in double
+ *
+ * Returns:
+ * <-1 on failure with reason written to failureBuffer
+ *  -1 on case when all the arguments are static arithmetic const
+ *  >0 on suceess
+ */
+static int
+_infer_floating_point_type(struct hdql_Query ** args
+        , struct hdql_ValueTypes * types
+        , char * failureBuffer, size_t failureBufferSize
+        , hdql_ValueTypeCode_t * rTypeCode
+        ) {
+    int rc = _infer_simple_arithmetic_type(args, types
+            , failureBuffer, failureBufferSize, rTypeCode);
+    if(rc < -1) return rc;
+    hdql_ValueTypeCode_t floatTC = hdql_types_get_type_code(types, "float")
+                       , doubleTC = hdql_types_get_type_code(types, "double");
+    if(*rTypeCode == floatTC || *rTypeCode == doubleTC) return rc;
+    if(0x0 == doubleTC) {
+        if(failureBufferSize)
+            snprintf( failureBuffer, failureBufferSize
+                    , "no \"double\" type defined in the evaluation context");
+        return -5;
+    }
+    *rTypeCode = doubleTC;
+    return rc;
+}
+
 /* Trivial result retrieve -- used for monoids when internal state is the
  * results itself (sum, product, bitwise convolutions);
  *
@@ -529,10 +617,20 @@ hdql_func_helper__try_monoid(
     /* allocate function "definition data" */
     assert(nArgs > 0);
     SMADefData_t * dd = hdql_alloc(context, SMADefData_t);
+    if(!dd) {
+        if(failureBufferSize)
+            snprintf(failureBuffer, failureBufferSize, "failed to allocate monoid definition");
+        return NULL;
+    }
     dd->monoidDef = monoidDefPtr;
     dd->nQueries = nArgs;
     dd->queries = (struct hdql_Query **) hdql_context_alloc(context, sizeof(struct hdql_Query *)*nArgs);
     dd->converters = (hdql_TypeConverter *) hdql_context_alloc(context, sizeof(hdql_TypeConverter)*nArgs);
+    if(!dd->queries || !dd->converters) {
+        if(failureBufferSize)
+            snprintf(failureBuffer, failureBufferSize, "failed to allocate monoid definition");
+        goto onFailCleanup;
+    }
     bzero(dd->converters, sizeof(hdql_TypeConverter)*nArgs);
     dd->instantiate_result = monoidDefPtr->alloc_result;
     dd->retrieve_result = monoidDefPtr->retrieve;
@@ -600,6 +698,7 @@ hdql_func_helper__try_monoid(
         goto onFailCleanup;
     }
     hdql_attr_def_set_transient(r, _transient_dtr__simple_monoid_arith);
+    hdql_attr_def_set_transient_copy(r, _transient_cpy__simple_monoid_arith);
     assert(dd->monoidDef);
     return r;
 onFailCleanup:
@@ -639,7 +738,7 @@ static int  _bAND_ ## suffix ## _operation(hdql_Datum_t r, hdql_Datum_t v)  \
 #define _M_implement_bOR(suffix, type)  \
 static void _bOR_ ## suffix ## _set_neutral(hdql_Datum_t d)  {  *((type *)  d) =  ((type) 0x0); }  \
 static int  _bOR_ ## suffix ## _operation(hdql_Datum_t r, hdql_Datum_t v)  \
-    { if( ((type)~0) != (*((type *) r) |= *((type *) v))); return 0; return INT_MAX; }
+    { if( ((type)~0) != (*((type *) r) |= *((type *) v))) return 0; return INT_MAX; }
 
 #define _M_implement_bXOR(suffix, type)  \
 static void _bXOR_ ## suffix ## _set_neutral(hdql_Datum_t d)  {  *((type *)  d) =  ((type) 0x0); }  \
@@ -778,6 +877,125 @@ static int  _mean_ ## suffix ## _operation(hdql_Datum_t d_, hdql_Datum_t v) {  \
 _M_for_each_integer_type(_M_implment_mean)
 _M_for_each_fp_type(_M_implment_mean)
 
+/* Streaming statistical moments: variance(), stddev(), rms(), skewness(),
+ * kurtosis()
+ *
+ * Central moments are accumulated in a single pass with numerically stable
+ * update (Welford's for mean and second moment, Terriberry's extension for
+ * third and fourth), in double precision regardless of the argument type.
+ * Moments are of population (i.e. variance is normalized by N, not N-1).
+ * Functions not using higher moments do not update them. */
+typedef struct {
+    uint64_t n;
+    double mean, m2, m3, m4;
+} Moments_t;
+
+static void
+_moments_set_neutral(Moments_t * d) {
+    d->n = 0;
+    d->mean = d->m2 = d->m3 = d->m4 = 0;
+}
+
+/* updates mean and second central moment only */
+static void
+_moments2_update(Moments_t * d, double x) {
+    ++(d->n);
+    const double delta = x - d->mean;
+    d->mean += delta/d->n;
+    d->m2 += delta*(x - d->mean);
+}
+
+/* updates mean and central moments up to fourth */
+static void
+_moments4_update(Moments_t * d, double x) {
+    const double n1 = (double) d->n
+               , n = (double) ++(d->n)
+               , delta = x - d->mean
+               , deltaN = delta/n
+               , deltaN2 = deltaN*deltaN
+               , term1 = delta*deltaN*n1
+               ;
+    d->mean += deltaN;
+    d->m4 += term1*deltaN2*(n*n - 3*n + 3) + 6*deltaN2*d->m2 - 4*deltaN*d->m3;
+    d->m3 += term1*deltaN*(n - 2) - 3*deltaN*d->m2;
+    d->m2 += term1;
+}
+
+static double _moments_variance(const Moments_t * d) {
+    return d->n ? d->m2/d->n : 0;
+}
+
+static double _moments_stddev(const Moments_t * d) {
+    return sqrt(_moments_variance(d));
+}
+
+static double _moments_rms(const Moments_t * d) {
+    return sqrt(_moments_variance(d) + d->mean*d->mean);
+}
+
+/* undefined (NaN) for degenerate distribution */
+static double _moments_skewness(const Moments_t * d) {
+    if(!d->m2) return NAN;
+    return sqrt((double) d->n)*d->m3/pow(d->m2, 1.5);
+}
+
+/* excess kurtosis, undefined (NaN) for degenerate distribution */
+static double _moments_kurtosis(const Moments_t * d) {
+    if(!d->m2) return NAN;
+    return d->n*d->m4/(d->m2*d->m2) - 3;
+}
+
+#define _M_implement_moments(suffix, type)  \
+typedef struct {                            \
+    Moments_t m;                            \
+    type v;                                 \
+} moments_ ## suffix ## _t;                 \
+                                            \
+static hdql_Datum_t                         \
+_moments_ ## suffix ## _instantiate(        \
+        hdql_ValueTypeCode_t tc,            \
+        hdql_Context_t context ) {          \
+    return hdql_context_alloc(              \
+            context,                        \
+            sizeof(moments_ ## suffix ## _t)    \
+            );                              \
+}                                           \
+                                            \
+static void _moments_ ## suffix ## _set_neutral(hdql_Datum_t d_) {  \
+    moments_ ## suffix ## _t * d = (moments_ ## suffix ## _t *) d_; \
+    _moments_set_neutral(&d->m);            \
+    d->v = 0;                               \
+}                                           \
+                                            \
+static int  _moments2_ ## suffix ## _operation(hdql_Datum_t d_, hdql_Datum_t v) {  \
+    _moments2_update(&((moments_ ## suffix ## _t *) d_)->m, *((type*)v)); \
+    return 0;                               \
+}                                           \
+                                            \
+static int  _moments4_ ## suffix ## _operation(hdql_Datum_t d_, hdql_Datum_t v) {  \
+    _moments4_update(&((moments_ ## suffix ## _t *) d_)->m, *((type*)v)); \
+    return 0;                               \
+}
+_M_for_each_fp_type(_M_implement_moments)
+
+#define _M_implement_moments_retrieve(suffix, type, stat)   \
+static hdql_Datum_t                         \
+_ ## stat ## _retrieve_ ## suffix ## _result(   \
+        hdql_Datum_t d_,                    \
+        hdql_ValueTypeCode_t tc,            \
+        hdql_Context_t context ) {          \
+    moments_ ## suffix ## _t * d = (moments_ ## suffix ## _t *) d_; \
+    d->v = (type) _moments_ ## stat(&d->m); \
+    return (hdql_Datum_t) &d->v;            \
+}
+#define _M_implement_moments_retrieve_all(suffix, type) \
+    _M_implement_moments_retrieve(suffix, type, variance) \
+    _M_implement_moments_retrieve(suffix, type, stddev)   \
+    _M_implement_moments_retrieve(suffix, type, rms)      \
+    _M_implement_moments_retrieve(suffix, type, skewness) \
+    _M_implement_moments_retrieve(suffix, type, kurtosis)
+_M_for_each_fp_type(_M_implement_moments_retrieve_all)
+
 /* arb() */
 #define _M_implment_arb(suffix, type)       \
 typedef struct {                            \
@@ -992,6 +1210,26 @@ hdql_functions_add_monoids(struct hdql_Functions * functions) {
         .overrideRType = NULL,
         .resultDefinedForEmptySet = false
     };
+    /* statistical moments */
+    #define _M_implement_moments_records(stat, order)   \
+    static const MonoidRecords_t _ ## stat ## MonoidRecords = { \
+        .records = {    \
+            { "float",  { _moments_float_set_neutral, _moments ## order ## _float_operation \
+                , _moments_float_instantiate, _ ## stat ## _retrieve_float_result } },      \
+            { "double", { _moments_double_set_neutral, _moments ## order ## _double_operation \
+                , _moments_double_instantiate, _ ## stat ## _retrieve_double_result } },    \
+            { "", {NULL, NULL} }    \
+        },  \
+        .infer_result_type = _infer_floating_point_type, \
+        .overrideRType = NULL,  \
+        .resultDefinedForEmptySet = false   \
+    };
+    _M_implement_moments_records(variance, 2)
+    _M_implement_moments_records(stddev,   2)
+    _M_implement_moments_records(rms,      2)
+    _M_implement_moments_records(skewness, 4)
+    _M_implement_moments_records(kurtosis, 4)
+    #undef _M_implement_moments_records
     /* arb */
     static const MonoidRecords_t _arbMonoidRecords = {
         .records = {
@@ -1065,6 +1303,31 @@ hdql_functions_add_monoids(struct hdql_Functions * functions) {
             , (void *) &_meanMonoidRecords );
     if(HDQL_ERR_CODE_OK != rc) return rc;
 
+    rc = hdql_functions_define(functions, "variance"
+            , hdql_func_helper__try_monoid
+            , (void *) &_varianceMonoidRecords );
+    if(HDQL_ERR_CODE_OK != rc) return rc;
+
+    rc = hdql_functions_define(functions, "stddev"
+            , hdql_func_helper__try_monoid
+            , (void *) &_stddevMonoidRecords );
+    if(HDQL_ERR_CODE_OK != rc) return rc;
+
+    rc = hdql_functions_define(functions, "rms"
+            , hdql_func_helper__try_monoid
+            , (void *) &_rmsMonoidRecords );
+    if(HDQL_ERR_CODE_OK != rc) return rc;
+
+    rc = hdql_functions_define(functions, "skewness"
+            , hdql_func_helper__try_monoid
+            , (void *) &_skewnessMonoidRecords );
+    if(HDQL_ERR_CODE_OK != rc) return rc;
+
+    rc = hdql_functions_define(functions, "kurtosis"
+            , hdql_func_helper__try_monoid
+            , (void *) &_kurtosisMonoidRecords );
+    if(HDQL_ERR_CODE_OK != rc) return rc;
+
     rc = hdql_functions_define(functions, "narb"
             , hdql_func_helper__try_monoid
             , (void *) &_arbMonoidRecords );
@@ -1080,6 +1343,21 @@ hdql_functions_add_monoids(struct hdql_Functions * functions) {
             , "e" );
     if(HDQL_ERR_CODE_OK != rc) return rc;
 
+    rc = hdql_functions_define(functions, "median"
+            , hdql_func_helper__try_quantile
+            , "m" );
+    if(HDQL_ERR_CODE_OK != rc) return rc;
+
+    rc = hdql_functions_define(functions, "quantile"
+            , hdql_func_helper__try_quantile
+            , "q" );
+    if(HDQL_ERR_CODE_OK != rc) return rc;
+
+    rc = hdql_functions_define(functions, "percentile"
+            , hdql_func_helper__try_quantile
+            , "p" );
+    if(HDQL_ERR_CODE_OK != rc) return rc;
+
     return 0;
 }
 
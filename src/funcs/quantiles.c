@@ -0,0 +1,424 @@
+#include "hdql/attr-def.h"
+#include "hdql/context.h"
+#include "hdql/errors.h"
+#include "hdql/function.h"
+#include "hdql/query.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Streaming quantiles: median(), quantile(), percentile()
+ *
+ * Values are accumulated in a hierarchy of compactors ("levels") of fixed
+ * capacity `k'. Item at level `h' stands for 2^h original values. Once level
+ * gets full, it is sorted and every other item (with alternating offset) is
+ * promoted to next level, so memory is bounded by `k' times number of
+ * levels, i.e. grows as log2(N/k). Rank error is of order log2(N/k)/k; for
+ * N <= k no compaction ever happens and result is exact.
+ *
+ * Quantile is computed by linear interpolation between the closest ranks
+ * (for exact mode it matches common definition with `(N-1)*q' position).
+ *
+ * Buffers are allocated on demand and kept between resets of the same
+ * query instance, so steady state evaluation does not allocate memory.
+ */
+
+#ifndef HDQL_QUANTILE_SKETCH_K
+/* Default capacity of a compactor; exact result for up to that many values */
+#   define HDQL_QUANTILE_SKETCH_K 256
+#endif
+
+#ifndef HDQL_QUANTILE_SKETCH_MAX_K
+/* Max capacity of a compactor allowed to be set as accuracy parameter */
+#   define HDQL_QUANTILE_SKETCH_MAX_K (1 << 20)
+#endif
+
+#ifndef HDQL_QUANTILE_SKETCH_MAX_LEVELS
+/* Max number of levels, limits number of values to k*2^(N-1) */
+#   define HDQL_QUANTILE_SKETCH_MAX_LEVELS 48
+#endif
+
+typedef struct {
+    /* value query */
+    struct hdql_Query * query;
+    /* static parameter queries (quantile and accuracy), can be NULL; kept
+     * here as they are owned by function's definition */
+    struct hdql_Query * params[2];
+    /* value interface of value query result */
+    const struct hdql_ValueInterface * vi;
+    /* quantile to compute, [0:1] */
+    double q;
+    /* capacity of a compactor (even) */
+    size_t k;
+} QuantileFuncDefData_t;
+
+/* Weighted item of a sketch used to compute quantile */
+typedef struct {
+    double value, weight;
+} QuantileSketchItem_t;
+
+typedef struct {
+    /* compactors, allocated on demand, `k' items each */
+    double * levels[HDQL_QUANTILE_SKETCH_MAX_LEVELS];
+    /* number of items in each compactor */
+    size_t sizes[HDQL_QUANTILE_SKETCH_MAX_LEVELS];
+    /* number of levels in use and allocated */
+    size_t nLevels, nLevelsAllocated;
+    /* bit per level, alternates offset of promoted items */
+    uint64_t offsets;
+    /* number of values */
+    uint64_t n;
+    /* result datum */
+    double result;
+} QuantileSketch_t;
+
+static int
+_quantile__cmp_values(const void * a_, const void * b_) {
+    const double a = *((const double *) a_), b = *((const double *) b_);
+    return (a > b) - (a < b);
+}
+
+static int
+_quantile__cmp_items(const void * a_, const void * b_) {
+    const double a = ((const QuantileSketchItem_t *) a_)->value
+               , b = ((const QuantileSketchItem_t *) b_)->value;
+    return (a > b) - (a < b);
+}
+
+/* Allocates compactor for the next level */
+static int
+_quantile__alloc_level(QuantileSketch_t * s, size_t k, hdql_Context_t context) {
+    if(s->nLevelsAllocated == HDQL_QUANTILE_SKETCH_MAX_LEVELS)
+        return HDQL_ERR_MEMORY;
+    double * level = (double *) hdql_context_alloc(context, sizeof(double)*k);
+    if(!level) return HDQL_ERR_MEMORY;
+    s->levels[s->nLevelsAllocated++] = level;
+    return HDQL_ERR_CODE_OK;
+}
+
+/* Promotes every other item of full h-th level to the next one */
+static int
+_quantile__compact(QuantileSketch_t * s, size_t h, size_t k, hdql_Context_t context) {
+    int rc;
+    assert(s->sizes[h] == k);
+    if(h + 1 == s->nLevelsAllocated
+            && HDQL_ERR_CODE_OK != (rc = _quantile__alloc_level(s, k, context)))
+        return rc;
+    if(h + 1 == s->nLevels) s->sizes[s->nLevels++] = 0;
+    /* next level is filled by halves of `k' */
+    if(s->sizes[h + 1] == k
+            && HDQL_ERR_CODE_OK != (rc = _quantile__compact(s, h + 1, k, context)))
+        return rc;
+    qsort(s->levels[h], k, sizeof(double), _quantile__cmp_values);
+    const uint64_t bit = ((uint64_t) 1) << h;
+    double * dest = s->levels[h + 1] + s->sizes[h + 1];
+    for(size_t i = (s->offsets & bit) ? 1 : 0; i < k; i += 2)
+        *(dest++) = s->levels[h][i];
+    s->offsets ^= bit;
+    s->sizes[h + 1] += k/2;
+    s->sizes[h] = 0;
+    return HDQL_ERR_CODE_OK;
+}
+
+static int
+_quantile__add(QuantileSketch_t * s, double v, size_t k, hdql_Context_t context) {
+    if(isnan(v)) return HDQL_ERR_CODE_OK;  /* NaNs are not ordered */
+    if(s->sizes[0] == k) {
+        int rc = _quantile__compact(s, 0, k, context);
+        if(HDQL_ERR_CODE_OK != rc) return rc;
+    }
+    s->levels[0][s->sizes[0]++] = v;
+    ++(s->n);
+    return HDQL_ERR_CODE_OK;
+}
+
+/* Computes q-th quantile with non-empty sketch
+ *
+ * Levels are merged in a buffer taken from the evaluation frame of the
+ * context, released on return. */
+static int
+_quantile__get(const QuantileSketch_t * s, double q, double * result
+        , hdql_Context_t context) {
+    assert(s->n);
+    size_t nItems = 0;
+    for(size_t h = 0; h < s->nLevels; ++h) nItems += s->sizes[h];
+    int rc = hdql_context_frame_begin(context);
+    if(HDQL_ERR_CODE_OK != rc) return rc;
+    QuantileSketchItem_t * items = (QuantileSketchItem_t *)
+        hdql_context_frame_alloc(context, sizeof(QuantileSketchItem_t)*nItems);
+    if(!items) {
+        hdql_context_frame_rewind(context);
+        return HDQL_ERR_MEMORY;
+    }
+    nItems = 0;
+    for(size_t h = 0; h < s->nLevels; ++h) {
+        const double w = ldexp(1., (int) h);
+        for(size_t i = 0; i < s->sizes[h]; ++i, ++nItems) {
+            items[nItems].value = s->levels[h][i];
+            items[nItems].weight = w;
+        }
+    }
+    qsort(items, nItems, sizeof(QuantileSketchItem_t), _quantile__cmp_items);
+    /* item of weight `w' covers ranks [c, c + w - 1], its value is attributed
+     * to the middle of the range */
+    const double pos = q*(s->n - 1);
+    double c = 0, prevCenter = 0;
+    *result = items[nItems - 1].value;
+    for(size_t i = 0; i < nItems; ++i) {
+        const double center = c + (items[i].weight - 1)/2;
+        if(center >= pos) {
+            if(0 == i) {
+                *result = items[0].value;
+            } else {
+                const double a = items[i - 1].value, b = items[i].value;
+                *result = a + (b - a)*(pos - prevCenter)/(center - prevCenter);
+            }
+            break;
+        }
+        prevCenter = center;
+        c += items[i].weight;
+    }
+    return hdql_context_frame_rewind(context);
+}
+
+static hdql_Datum_t
+_quantile__new_dyn_data
+            ( hdql_Datum_t newOwner
+            , const struct hdql_Datum *defData_
+            , hdql_Context_t context
+            ) {
+    ((void) newOwner);  /* owner unused here */
+    const QuantileFuncDefData_t *defData = hdql_cast(context, const QuantileFuncDefData_t, defData_);
+    QuantileSketch_t *s = hdql_alloc(context, QuantileSketch_t);
+    if(!s) return NULL;
+    bzero(s, sizeof(QuantileSketch_t));
+    if(HDQL_ERR_CODE_OK != _quantile__alloc_level(s, defData->k, context)) {
+        hdql_context_free(context, (hdql_Datum_t) s);
+        return NULL;
+    }
+    return (hdql_Datum_t) s;
+}
+
+static hdql_Datum_t
+_quantile__reset
+            ( hdql_Datum_t newOwner
+            , hdql_Datum_t dynData_, const struct hdql_Datum *defData_
+            , struct hdql_Key *key
+            , hdql_Context_t context
+            ) {
+    const QuantileFuncDefData_t *defData = hdql_cast(context, const QuantileFuncDefData_t, defData_);
+    QuantileSketch_t *s = hdql_cast(context, QuantileSketch_t, dynData_);
+    s->nLevels = 1;
+    s->sizes[0] = 0;
+    s->offsets = 0;
+    s->n = 0;
+    for( hdql_Datum_t r = hdql_query_reset(defData->query, newOwner, key, context)
+       ; r
+       ; r = hdql_query_get(defData->query, NULL, context) ) {
+        if(HDQL_ERR_CODE_OK != _quantile__add(s, defData->vi->get_as_float(r)
+                    , defData->k, context)) {
+            hdql_context_err_push(context, HDQL_ERR_MEMORY
+                    , "failed to extend quantile sketch (%zu levels of %zu items)"
+                    , s->nLevelsAllocated, defData->k );
+            return NULL;
+        }
+    }
+    if(!s->n) return NULL;
+    if(HDQL_ERR_CODE_OK != _quantile__get(s, defData->q, &s->result, context)) {
+        hdql_context_err_push(context, HDQL_ERR_MEMORY
+                , "failed to allocate buffer to merge quantile sketch of"
+                  " %zu items", (size_t) s->n );
+        return NULL;
+    }
+    return (hdql_Datum_t) &s->result;
+}
+
+static void
+_quantile__destroy
+            ( hdql_Datum_t dynData_
+            , const struct hdql_Datum *defData_
+            , hdql_Context_t context
+            ) {
+    if(!defData_) return;
+    if(!dynData_) return;
+    QuantileSketch_t *s = hdql_cast(context, QuantileSketch_t, dynData_);
+    for(size_t h = 0; h < s->nLevelsAllocated; ++h)
+        hdql_context_free(context, (hdql_Datum_t) s->levels[h]);
+    hdql_context_free(context, (hdql_Datum_t) s);
+}
+
+static void
+_transient_dtr__quantile(hdql_Datum_t dd_, hdql_Context_t context) {
+    if(!dd_) return;
+    const QuantileFuncDefData_t *dd = hdql_cast(context, const QuantileFuncDefData_t, dd_);
+    hdql_query_destroy(dd->query, context);
+    for(int i = 0; i < 2; ++i) {
+        if(dd->params[i]) hdql_query_destroy(dd->params[i], context);
+    }
+    hdql_context_free(context, dd_);
+}
+
+static hdql_Datum_t
+_transient_cpy__quantile( const struct hdql_Datum * dd_
+                        , struct hdql_QueryCloneState * cs
+                        , hdql_Context_t context
+                        ) {
+    const QuantileFuncDefData_t *dd = hdql_cast(context, const QuantileFuncDefData_t, dd_);
+    QuantileFuncDefData_t * copy = hdql_alloc(context, QuantileFuncDefData_t);
+    if(!copy) return NULL;
+    *copy = *dd;
+    copy->params[0] = copy->params[1] = NULL;
+    if(!(copy->query = hdql_query_clone_with(dd->query, cs, context)))
+        goto onFailCleanup;
+    for(int i = 0; i < 2; ++i) {
+        if(!dd->params[i]) continue;
+        if(!(copy->params[i] = hdql_query_clone_with(dd->params[i], cs, context)))
+            goto onFailCleanup;
+    }
+    return (hdql_Datum_t) copy;
+onFailCleanup:
+    if(copy->query) hdql_query_destroy(copy->query, context);
+    for(int i = 0; i < 2; ++i) {
+        if(copy->params[i]) hdql_query_destroy(copy->params[i], context);
+    }
+    hdql_context_free(context, (hdql_Datum_t) copy);
+    return NULL;
+}
+
+/* Retrieves value of static parameter given as function argument; returns
+ * non-zero if argument is not a static numeric scalar */
+static int
+_quantile__get_param(struct hdql_Query * q, struct hdql_ValueTypes * types, double * dest) {
+    if(hdql_query_next_query(q)) return -1;
+    const struct hdql_AttrDef * ad = hdql_query_get_subject(q);
+    if( !hdql_attr_def_is_static_const_value(ad)
+     || !hdql_attr_def_is_atomic(ad)
+     || !hdql_attr_def_is_scalar(ad) ) return -1;
+    const struct hdql_ValueInterface * vi = hdql_types_get_type(types
+            , hdql_attr_def_get_atomic_value_type_code(ad));
+    if(!vi || !vi->get_as_float) return -1;
+    *dest = vi->get_as_float(hdql_attr_def_get_static_value(ad));
+    return 0;
+}
+
+struct hdql_AttrDef *
+hdql_func_helper__try_quantile(
+          struct hdql_Query ** args, void * userdata
+        , char * failureBuffer, size_t failureBufferSize
+        , hdql_Context_t context
+        ) {
+    assert(userdata);
+    char nm = *((const char *) userdata);
+    assert(nm == 'm' || nm == 'q' || nm == 'p');
+    struct hdql_ValueTypes * types = hdql_context_get_types(context);
+    size_t nArgs = 0;
+    while(args[nArgs]) ++nArgs;
+    /* median() takes value and optional accuracy, quantile() and
+     * percentile() take value, quantile and optional accuracy */
+    const size_t nMinArgs = nm == 'm' ? 1 : 2;
+    if(nArgs < nMinArgs || nArgs > nMinArgs + 1) {
+        if(failureBuffer)
+            snprintf( failureBuffer, failureBufferSize
+                    , "%zu arguments given, %zu or %zu expected"
+                    , nArgs, nMinArgs, nMinArgs + 1 );
+        return NULL;
+    }
+    /* check value argument */
+    const struct hdql_AttrDef * qAD = hdql_attr_def_top_attr(hdql_query_top_attr(args[0]));
+    if(!hdql_attr_def_is_atomic(qAD)) {
+        if(failureBuffer)
+            strncpy(failureBuffer, "argument #1 is not of atomic type", failureBufferSize);
+        return NULL;
+    }
+    const hdql_ValueTypeCode_t argTC = hdql_attr_def_get_atomic_value_type_code(qAD);
+    if(argTC == hdql_types_get_type_code(types, "bool")) {
+        if(failureBuffer)
+            strncpy(failureBuffer, "argument #1 is of logic type", failureBufferSize);
+        return NULL;
+    }
+    const struct hdql_ValueInterface * vi = hdql_types_get_type(types, argTC);
+    if(!vi || !vi->get_as_float) {
+        if(failureBuffer)
+            strncpy(failureBuffer, "argument #1 can not be converted to floating point"
+                    , failureBufferSize);
+        return NULL;
+    }
+    const hdql_ValueTypeCode_t rTypeCode = hdql_types_get_type_code(types, "double");
+    if(0x0 == rTypeCode) {
+        if(failureBuffer)
+            strncpy(failureBuffer, "no \"double\" type defined in the evaluation context"
+                    , failureBufferSize);
+        return NULL;
+    }
+    /* get static parameters */
+    double q = .5, k = HDQL_QUANTILE_SKETCH_K;
+    if(nm != 'm') {
+        if(_quantile__get_param(args[1], types, &q)) {
+            if(failureBuffer)
+                strncpy(failureBuffer, "argument #2 must be a static number"
+                        , failureBufferSize);
+            return NULL;
+        }
+        if(nm == 'p') q /= 100;
+        if(!(q >= 0 && q <= 1)) {
+            if(failureBuffer)
+                snprintf( failureBuffer, failureBufferSize
+                        , "argument #2 is out of range [0:%d]", nm == 'p' ? 100 : 1 );
+            return NULL;
+        }
+    }
+    if(nArgs > nMinArgs) {
+        if( _quantile__get_param(args[nMinArgs], types, &k)
+         || k != floor(k) || k < 2 || k > HDQL_QUANTILE_SKETCH_MAX_K ) {
+            if(failureBuffer)
+                snprintf( failureBuffer, failureBufferSize
+                        , "argument #%zu (accuracy) must be a static integer in"
+                          " range [2:%d]", nArgs, HDQL_QUANTILE_SKETCH_MAX_K );
+            return NULL;
+        }
+    }
+
+    QuantileFuncDefData_t * dd = hdql_alloc(context, QuantileFuncDefData_t);
+    if(!dd) {
+        if(failureBuffer)
+            snprintf(failureBuffer, failureBufferSize, "failed to allocate quantile definition");
+        return NULL;
+    }
+    dd->query = args[0];
+    dd->params[0] = nArgs > 1 ? args[1] : NULL;
+    dd->params[1] = nArgs > 2 ? args[2] : NULL;
+    dd->vi = vi;
+    dd->q = q;
+    dd->k = (size_t) k;
+    dd->k += dd->k % 2;  /* compactor halves its items */
+
+    /* form interface */
+    struct hdql_ScalarAttrInterface iface;
+    iface.definitionData = (hdql_Datum_t) dd;
+    iface.new_dyn_data = _quantile__new_dyn_data;
+    iface.reset = _quantile__reset;
+    iface.destroy_dyn_data = _quantile__destroy;
+
+    /* create (transient) attribute definition */
+    struct hdql_AtomicTypeFeatures typeInfo;
+    typeInfo.isReadOnly = 0x1;
+    typeInfo.arithTypeCode = rTypeCode;
+    struct hdql_AttrDef * r = hdql_attr_def_create_atomic_scalar(&typeInfo
+            , &iface
+            , 0x0
+            , NULL
+            , context);
+    if(!r) {
+        hdql_context_free(context, (hdql_Datum_t) dd);
+        return NULL;
+    }
+    hdql_attr_def_set_transient(r, _transient_dtr__quantile);
+    hdql_attr_def_set_transient_copy(r, _transient_cpy__quantile);
+    return r;
+}
@@ -18,6 +18,7 @@
 struct FuncDef {
     void * userdata;
     hdql_FunctionConstructor_t try_instantiate;
+    bool isPure;
 };
 
 struct hdql_Functions : public std::unordered_multimap<std::string, FuncDef> {
@@ -36,10 +37,33 @@ hdql_functions_define( struct hdql_Functions * functions
     if(*name == '\0') return -1;
     // TODO: other checks for function name validity
     if(!fdef) return -2;
-    functions->emplace(name, FuncDef{userdata, fdef});
+    functions->emplace(name, FuncDef{userdata, fdef, false});
     return 0;
 }
 
+int
+hdql_functions_set_pure(struct hdql_Functions * functions, const char * name) {
+    auto eqRange = functions->equal_range(name);
+    if(eqRange.first == eqRange.second) return HDQL_ERR_FUNC_UNKNOWN;
+    for(auto it = eqRange.first; it != eqRange.second; ++it) {
+        it->second.isPure = true;
+    }
+    return HDQL_ERR_CODE_OK;
+}
+
+bool
+hdql_functions_is_pure(const struct hdql_Functions * funcDict, const char * name) {
+    auto eqRange = funcDict->equal_range(name);
+    if(eqRange.first == eqRange.second) {
+        if(!funcDict->parent) return false;
+        return hdql_functions_is_pure(funcDict->parent, name);
+    }
+    for(auto it = eqRange.first; it != eqRange.second; ++it) {
+        if(!it->second.isPure) return false;
+    }
+    return true;
+}
+
 int
 hdql_functions_resolve( struct hdql_Functions * funcDict
                       , const char * name
@@ -51,7 +75,7 @@ hdql_functions_resolve( struct hdql_Functions * funcDict
     auto eqRange = funcDict->equal_range(name);
     if(eqRange.first == eqRange.second) {
         if(!funcDict->parent) return HDQL_ERR_FUNC_UNKNOWN;
-        return hdql_functions_resolve(funcDict, name, argsQueries, r, context);
+        return hdql_functions_resolve(funcDict->parent, name, argsQueries, r, context);
     }
     *r = NULL;
     for(auto it = eqRange.first; it != eqRange.second; ++it) {
@@ -75,7 +99,8 @@ int
 hdql_functions_add_standard_math(struct hdql_Functions * functions) {
     using namespace hdql;
     #define _M_ADD_STD_MATH_FUNC(fname) \
-        hdql_functions_define(functions, # fname, hdql::helpers::math_f_construct(:: fname), reinterpret_cast<void*>(&:: fname));
+        hdql_functions_define(functions, # fname, hdql::helpers::math_f_construct(:: fname), reinterpret_cast<void*>(&:: fname)); \
+        hdql_functions_set_pure(functions, # fname);
     _M_ADD_STD_MATH_FUNC(sin);
     _M_ADD_STD_MATH_FUNC(asin);
     _M_ADD_STD_MATH_FUNC(sinh);
@@ -112,6 +137,9 @@ hdql_functions_add_standard_math(struct hdql_Functions * functions) {
     bool (*isinf_d)(double) = &std::isinf;
     hdql_functions_define(functions, "isinf", hdql::helpers::math_f_construct<bool, double>(std::isinf)
             , reinterpret_cast<void*>(isinf_d));
+    for(const char * name : {"isnan", "isfinite", "isinf"}) {
+        hdql_functions_set_pure(functions, name);
+    }
     // ... other math functions?
     #undef _M_ADD_STD_MATH_FUNC
     return 0;
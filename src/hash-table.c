@@ -6,6 +6,19 @@
 
 #include <stdio.h>  // XXX
 
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#   define HDQL_HT_GROUP_SIZE 32
+#elif defined(__SSE2__)
+#   include <emmintrin.h>
+#   define HDQL_HT_GROUP_SIZE 16
+#else
+#   define HDQL_HT_GROUP_SIZE 16
+#endif
+
+/* Control byte of vacant slot (for occupied ones it keeps 7 bits of hash) */
+#define HDQL_HT_CTRL_EMPTY 0x80
+
 typedef struct hdql_htEntry {
     /* Item key, as is */
     uint8_t * key;
@@ -17,6 +30,19 @@ typedef struct hdql_htEntry {
     struct hdql_htEntry * next;
 } hdql_ht_entry;
 
+/* Slot of open addressing table */
+typedef struct hdql_htSlot {
+    /* Stored value */
+    void * value;
+    /* Full hash of the key and key length */
+    uint32_t hash, keySize;
+    /* Key, stored inline if fits */
+    union {
+        uint8_t inl[HDQL_HT_INLINE_KEY_SIZE];
+        uint8_t * ptr;
+    } key;
+} hdql_htSlot;
+
 struct hdql_ht {
     /* Array of buckets (linked lists) referring to items with
      * hash%capacity == N */
@@ -27,6 +53,12 @@ struct hdql_ht {
          ;  
     struct hdql_Allocator allocator;
     size_t hashSeed;
+    int flags;
+    /* Open addressing: array of slots and control bytes, with first group
+     * of the latter cloned past the end so every group can be loaded at
+     * once */
+    hdql_htSlot * slots;
+    uint8_t * ctrl;
 };
 
 #if 0
@@ -50,9 +82,9 @@ static uint32_t murmur3_32(const uint8_t *key, size_t len, uint32_t seed) {
     const uint32_t c2 = 0x1b873593;
 
     const int nblocks = len >> 2;
-    const uint32_t *blocks = (const uint32_t *)(key);
     for (int i = 0; i < nblocks; ++i) {
-        uint32_t k = blocks[i];
+        uint32_t k;
+        memcpy(&k, key + (i << 2), sizeof(k));  /* key may be unaligned */
         k *= c1;
         k = (k << 15) | (k >> 17);
         k *= c2;
@@ -83,10 +115,251 @@ static uint32_t murmur3_32(const uint8_t *key, size_t len, uint32_t seed) {
 }
 #endif
 
+/*
+ * Open addressing variant
+ */
+
+/* Returns bitmask of group's control bytes equal to given one */
+static inline uint32_t
+_ht_group_match(const uint8_t * g, uint8_t c) {
+    #if defined(__AVX2__)
+    const __m256i v = _mm256_loadu_si256((const __m256i *) g);
+    return (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8((char) c)));
+    #elif defined(__SSE2__)
+    const __m128i v = _mm_loadu_si128((const __m128i *) g);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char) c)));
+    #else
+    uint32_t m = 0;
+    for(int i = 0; i < HDQL_HT_GROUP_SIZE; ++i)
+        m |= ((uint32_t) (g[i] == c)) << i;
+    return m;
+    #endif
+}
+
+/* Returns bitmask of vacant slots in a group (only these have high bit set) */
+static inline uint32_t
+_ht_group_match_empty(const uint8_t * g) {
+    #if defined(__AVX2__)
+    return (uint32_t) _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) g));
+    #elif defined(__SSE2__)
+    return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) g));
+    #else
+    uint32_t m = 0;
+    for(int i = 0; i < HDQL_HT_GROUP_SIZE; ++i)
+        m |= ((uint32_t) (g[i] >> 7)) << i;
+    return m;
+    #endif
+}
+
+static inline uint8_t
+_ht_h2(uint32_t h) { return (uint8_t) (h >> 25); }
+
+static inline const uint8_t *
+_ht_slot_key(const hdql_htSlot * s) {
+    return s->keySize > HDQL_HT_INLINE_KEY_SIZE ? s->key.ptr : s->key.inl;
+}
+
+/* Sets control byte, maintaining its clone past the end */
+static inline void
+_ht_set_ctrl(hdql_ht * ht, size_t n, uint8_t c) {
+    ht->ctrl[n] = c;
+    if(n < HDQL_HT_GROUP_SIZE - 1) ht->ctrl[n + ht->mask + 1] = c;
+}
+
+/* Finds slot with given key. If not found, sets `nb` to vacant slot the key
+ * has to be inserted to */
+static hdql_htSlot *
+_ht_oa_find( const hdql_ht * ht
+           , const unsigned char * key, size_t keyLen
+           , uint32_t h, size_t * nb
+           ) {
+    const uint8_t h2 = _ht_h2(h);
+    size_t pos = h & ht->mask;
+    for(;;) {  /* terminates as table always has vacant slots */
+        const uint8_t * g = ht->ctrl + pos;
+        uint32_t match = _ht_group_match(g, h2);
+        const uint32_t empty = _ht_group_match_empty(g);
+        /* matches past vacant slot belong to other runs */
+        if(empty) match &= empty ^ (empty - 1);
+        while(match) {
+            const size_t n = (pos + __builtin_ctz(match)) & ht->mask;
+            hdql_htSlot * s = ht->slots + n;
+            if( s->hash == h && s->keySize == keyLen
+             && 0 == memcmp(_ht_slot_key(s), key, keyLen) ) {
+                *nb = n;
+                return s;
+            }
+            match &= match - 1;
+        }
+        if(empty) {
+            *nb = (pos + __builtin_ctz(empty)) & ht->mask;
+            return NULL;
+        }
+        pos = (pos + HDQL_HT_GROUP_SIZE) & ht->mask;
+    }
+}
+
+/* Allocates arrays for 2^log2Cap slots, marking all vacant */
+static int
+_ht_oa_alloc( const struct hdql_Allocator * a, size_t log2Cap
+            , hdql_htSlot ** slots, uint8_t ** ctrl ) {
+    const size_t cap = ((size_t) 1) << log2Cap;
+    *ctrl = (uint8_t *) a->alloc(cap + HDQL_HT_GROUP_SIZE - 1, a->userdata);
+    if(NULL == *ctrl) return HDQL_HT_ERR_MEM;
+    *slots = (hdql_htSlot *) a->alloc(cap*sizeof(hdql_htSlot), a->userdata);
+    if(NULL == *slots) {
+        a->free(*ctrl, a->userdata);
+        return HDQL_HT_ERR_MEM;
+    }
+    memset(*ctrl, HDQL_HT_CTRL_EMPTY, cap + HDQL_HT_GROUP_SIZE - 1);
+    return HDQL_HT_RC_OK;
+}
+
+static int
+_ht_oa_rebuild(hdql_ht * ht) {
+    hdql_htSlot * oldSlots = ht->slots;
+    uint8_t * oldCtrl = ht->ctrl;
+    const size_t oldCap = ht->mask + 1;
+    int rc = _ht_oa_alloc(&ht->allocator, ht->capacity + 1, &ht->slots, &ht->ctrl);
+    if(HDQL_HT_ERROR & rc) {
+        ht->slots = oldSlots;
+        ht->ctrl = oldCtrl;
+        return rc;
+    }
+    ++ht->capacity;
+    ht->mask = (((size_t) 1) << ht->capacity) - 1;
+    /* keys are unique, so just put entries to first vacant slots */
+    for(size_t i = 0; i < oldCap; ++i) {
+        if(HDQL_HT_CTRL_EMPTY == oldCtrl[i]) continue;
+        size_t pos = oldSlots[i].hash & ht->mask;
+        uint32_t empty;
+        while(!(empty = _ht_group_match_empty(ht->ctrl + pos)))
+            pos = (pos + HDQL_HT_GROUP_SIZE) & ht->mask;
+        const size_t n = (pos + __builtin_ctz(empty)) & ht->mask;
+        ht->slots[n] = oldSlots[i];
+        _ht_set_ctrl(ht, n, oldCtrl[i]);
+    }
+    ht->allocator.free(oldCtrl, ht->allocator.userdata);
+    ht->allocator.free(oldSlots, ht->allocator.userdata);
+    return HDQL_HT_RC_OK;
+}
+
+static int
+_ht_oa_ins( hdql_ht * ht
+          , const unsigned char * key, size_t keyLen
+          , void * value
+          ) {
+    assert(keyLen <= UINT32_MAX);
+    /* keep load factor below 3/4 as probing is linear */
+    if(4*(ht->size + 1) > 3*(ht->mask + 1)) {
+        int rc = _ht_oa_rebuild(ht);
+        if(HDQL_HT_ERROR & rc) return rc;
+    }
+    const uint32_t h = murmur3_32(key, keyLen, ht->hashSeed);
+    size_t nb;
+    hdql_htSlot * s = _ht_oa_find(ht, key, keyLen, h, &nb);
+    if(s) {
+        s->value = value;
+        return HDQL_HT_RC_UPDATED;
+    }
+    s = ht->slots + nb;
+    if(keyLen > HDQL_HT_INLINE_KEY_SIZE) {
+        s->key.ptr = (uint8_t *) ht->allocator.alloc(keyLen, ht->allocator.userdata);
+        if(NULL == s->key.ptr) return HDQL_HT_ERR_MEM;
+        memcpy(s->key.ptr, key, keyLen);
+    } else {
+        memcpy(s->key.inl, key, keyLen);
+    }
+    s->hash = h;
+    s->keySize = (uint32_t) keyLen;
+    s->value = value;
+    _ht_set_ctrl(ht, nb, _ht_h2(h));
+    ++ht->size;
+    return HDQL_HT_RC_INSERTED;
+}
+
+/* Vacates the slot, shifting subsequent entries of the run backward, so
+ * lookups do not need tombstones */
+static int
+_ht_oa_erase(hdql_ht * ht, size_t nb) {
+    assert(nb <= ht->mask);
+    if(HDQL_HT_CTRL_EMPTY == ht->ctrl[nb]) return HDQL_HT_RC_ERR_NOENT;
+    if(ht->slots[nb].keySize > HDQL_HT_INLINE_KEY_SIZE)
+        ht->allocator.free(ht->slots[nb].key.ptr, ht->allocator.userdata);
+    size_t j = nb, k = nb;
+    for(;;) {
+        k = (k + 1) & ht->mask;
+        if(HDQL_HT_CTRL_EMPTY == ht->ctrl[k]) break;
+        const size_t home = ht->slots[k].hash & ht->mask;
+        /* entry can not be moved to the hole if its home is cyclically
+         * within (j, k] */
+        if(j < k ? (j < home && home <= k) : (j < home || home <= k)) continue;
+        ht->slots[j] = ht->slots[k];
+        _ht_set_ctrl(ht, j, ht->ctrl[k]);
+        j = k;
+    }
+    _ht_set_ctrl(ht, j, HDQL_HT_CTRL_EMPTY);
+    --ht->size;
+    return HDQL_HT_RC_OK;
+}
+
+static int
+_ht_oa_iter( const hdql_ht * ht
+        , int (* callback)(const unsigned char * key, size_t keyLen, void ** value, void * userdata)
+        , void * userdata
+        ) {
+    for(size_t i = 0; i <= ht->mask; ++i) {
+        if(HDQL_HT_CTRL_EMPTY == ht->ctrl[i]) continue;
+        hdql_htSlot * s = ht->slots + i;
+        int rc = callback(_ht_slot_key(s), s->keySize, &s->value, userdata);
+        if(rc != 0) return rc;
+    }
+    return 0;
+}
+
+static void
+_ht_oa_destroy(hdql_ht * ht) {
+    for(size_t i = 0; i <= ht->mask; ++i) {
+        if( HDQL_HT_CTRL_EMPTY != ht->ctrl[i]
+         && ht->slots[i].keySize > HDQL_HT_INLINE_KEY_SIZE )
+            ht->allocator.free(ht->slots[i].key.ptr, ht->allocator.userdata);
+    }
+    ht->allocator.free(ht->ctrl,  ht->allocator.userdata);
+    ht->allocator.free(ht->slots, ht->allocator.userdata);
+    ht->allocator.free(ht,        ht->allocator.userdata);
+}
+
+/*
+ * Public API
+ */
+
 hdql_ht *
 hdql_ht_create(const struct hdql_Allocator * a, size_t dftCap, size_t hashSeed) {
+    return hdql_ht_create_with(a, dftCap, hashSeed, 0x0);
+}
+
+hdql_ht *
+hdql_ht_create_with(const struct hdql_Allocator * a, size_t dftCap, size_t hashSeed, int flags) {
     hdql_ht * ht = (hdql_ht *) a->alloc(sizeof(hdql_ht), a->userdata);
     if (!ht) return NULL;  /* Error: can't allocate ht instance */
+    ht->allocator = *a;
+    ht->hashSeed = hashSeed;
+    ht->flags = flags;
+    ht->size = 0;
+    if(flags & HDQL_HT_OPEN_ADDRESSING) {
+        /* group must fit the table */
+        while((((size_t) 1) << dftCap) < HDQL_HT_GROUP_SIZE) ++dftCap;
+        if(HDQL_HT_ERROR & _ht_oa_alloc(a, dftCap, &ht->slots, &ht->ctrl)) {
+            a->free(ht, a->userdata);
+            return NULL;  /* Error: can't allocate slots for HT */
+        }
+        ht->buckets = NULL;
+        ht->capacity = dftCap;
+        ht->mask = (((size_t) 1) << dftCap) - 1;
+        return ht;
+    }
+    ht->slots = NULL;
+    ht->ctrl = NULL;
     ht->buckets = (hdql_ht_entry **) a->alloc(
                   (1u << dftCap) * sizeof(hdql_ht_entry *)
                 , a->userdata
@@ -96,11 +369,8 @@ hdql_ht_create(const struct hdql_Allocator * a, size_t dftCap, size_t hashSeed)
         return NULL;  /* Error: can't allocate buckets for HT */
     }
     memset( ht->buckets, 0x0, (1u << dftCap) * sizeof(hdql_ht_entry *) );
-    ht->size = 0;
     ht->capacity = dftCap;
     ht->mask = (1u << ht->capacity) - 1;
-    ht->allocator = *a;
-    ht->hashSeed = hashSeed;
     return ht;
 }
 
@@ -112,6 +382,8 @@ hdql_ht_lookup( const hdql_ht * ht
         ) {
     assert(nb);
     const uint32_t h  = murmur3_32(key, keyLen, ht->hashSeed);
+    if(ht->flags & HDQL_HT_OPEN_ADDRESSING)
+        return (struct hdql_htEntry *) _ht_oa_find(ht, key, keyLen, h, nb);
     //*nb = h % (1u << ht->capacity);
     const size_t nbl = *nb = h & ht->mask;
     hdql_ht_entry * entry = ht->buckets[nbl];
@@ -131,6 +403,8 @@ hdql_ht_ins( hdql_ht * ht
            , const unsigned char * key, size_t keyLen
            , void * value
            ) {
+    if(ht->flags & HDQL_HT_OPEN_ADDRESSING)
+        return _ht_oa_ins(ht, key, keyLen, value);
     int rc;
     if( ht->size > (1u << (ht->capacity-1))) {
         rc = hdql_ht_rebuild(ht);  /* extend capacity */
@@ -176,6 +450,11 @@ hdql_ht_get(const hdql_ht *ht, const unsigned char * key, size_t keyLen) {
      * arguments and redirections for few (1-30) entries. */
     #if 1
     size_t nb;
+    if(ht->flags & HDQL_HT_OPEN_ADDRESSING) {
+        hdql_htSlot * s = _ht_oa_find(ht, key, keyLen
+                , murmur3_32(key, keyLen, ht->hashSeed), &nb);
+        return s ? s->value : NULL;
+    }
     hdql_ht_entry * entry = hdql_ht_lookup(ht, key, keyLen, &nb);
     if(entry) return entry->value;
     return NULL;
@@ -207,6 +486,10 @@ int
 hdql_ht_erase( hdql_ht * ht, hdql_ht_entry * entry, size_t nb ) {
     assert(entry);
     assert(nb < (1u << ht->capacity));
+    if(ht->flags & HDQL_HT_OPEN_ADDRESSING) {
+        assert((hdql_htSlot *) entry == ht->slots + nb);
+        return _ht_oa_erase(ht, nb);
+    }
     hdql_ht_entry  * cur   = ht->buckets[nb]
                 , ** prevP = ht->buckets + nb;
     while( cur ) {
@@ -228,6 +511,8 @@ hdql_ht_iter( const hdql_ht * ht
         , int (* callback)(const unsigned char * key, size_t keyLen, void ** value, void * userdata)
         , void * userdata
         ) {
+    if(ht->flags & HDQL_HT_OPEN_ADDRESSING)
+        return _ht_oa_iter(ht, callback, userdata);
     const size_t cap = (1u << ht->capacity);
     for (size_t i = 0; i < cap; ++i) {
         hdql_ht_entry * entry = ht->buckets[i];
@@ -242,6 +527,8 @@ hdql_ht_iter( const hdql_ht * ht
 
 int
 hdql_ht_rebuild( hdql_ht * ht ) {
+    if(ht->flags & HDQL_HT_OPEN_ADDRESSING)
+        return _ht_oa_rebuild(ht);
     size_t newCap = ht->capacity ? ht->capacity + 1 : 5;
     hdql_ht_entry ** newBuckets =
         (hdql_ht_entry **) ht->allocator.alloc(
@@ -274,6 +561,10 @@ hdql_ht_rebuild( hdql_ht * ht ) {
 }
 
 void hdql_ht_destroy(hdql_ht * ht) {
+    if(ht->flags & HDQL_HT_OPEN_ADDRESSING) {
+        _ht_oa_destroy(ht);
+        return;
+    }
     const size_t cap = (1u << ht->capacity);
     /* iterate over all entries and free key */
     for(size_t i = 0; i < cap; ++i) {
@@ -35,13 +35,19 @@ struct hdql_QueryResultsWorkspace {
 static int
 _query_result_table_init_keys( struct hdql_QueryResultsWorkspace * ws ) {
     ws->keys = hdql_key_new(ws->ctx);
+    if(NULL == ws->keys) return HDQL_ERR_MEMORY;
     int rc = hdql_key_reserve_for_query(ws->q, ws->keys, ws->ctx);
-    assert(rc == HDQL_ERR_CODE_OK);
+    if(HDQL_ERR_CODE_OK != rc) return rc;
     /* populate flat key views */
     ws->flatKeyViewLength = hdql_key_flat_view_size(ws->keys, ws->ctx);
     ws->kv = ws->flatKeyViewLength
                       ? (struct hdql_Key **) malloc(sizeof(struct hdql_Key *)*ws->flatKeyViewLength)
                       : NULL;
+    if(ws->flatKeyViewLength && NULL == ws->kv) {
+        hdql_context_err_push(ws->ctx, HDQL_ERR_MEMORY
+                , "failed to allocate flat keys view of query results");
+        return HDQL_ERR_MEMORY;
+    }
     hdql_key_flat_view_populate(ws->keys, ws->kv);
     assert(ws->iqr->handle_keys);
     return ws->iqr->handle_keys( ws->keys, ws->kv, ws->flatKeyViewLength
@@ -67,11 +73,15 @@ hdql_query_results_init(
     /* allocate workspace */
     struct hdql_QueryResultsWorkspace * ws = (struct hdql_QueryResultsWorkspace *)
         hdql_context_alloc(ctx, sizeof(struct hdql_QueryResultsWorkspace));
+    if(NULL == ws) return NULL;
 
     /* set query instance, context and ptr to the interface in use */
     ws->q   = q;
     ws->ctx = ctx;
     ws->iqr = iqr;
+    ws->flatKeyViewLength = 0;
+    ws->keys = NULL;
+    ws->kv = NULL;
 
     /* if attribute handling is enabled in iface implem, process attributes */
     if(iqr->handle_result_type) {
@@ -80,6 +90,7 @@ hdql_query_results_init(
         if(0 != (rc = iqr->handle_result_type(ad, iqr->userdata))) {
             /* TODO communicate error other way */
             fprintf(stderr, "Can't process attributes of query result: %d\n", rc);
+            hdql_query_results_destroy(ws);
             return NULL;
         }
     }
@@ -87,12 +98,9 @@ hdql_query_results_init(
         if(0 != (rc = _query_result_table_init_keys(ws))) {
             /* TODO communicate error other way */
             fprintf(stderr, "Can't process keys of query result: %d\n", rc);
+            hdql_query_results_destroy(ws);
             return NULL;
         }
-    } else {
-        ws->flatKeyViewLength = 0;
-        ws->keys = NULL;
-        ws->kv = NULL;
     }
     if(iqr->finalize_schema) iqr->finalize_schema(iqr->userdata);
 
@@ -103,13 +111,23 @@ int
 hdql_query_results_process_records_from( struct hdql_Datum * d
         , struct hdql_QueryResultsWorkspace * ws ) {
     hdql_Datum_t r;
+    int rc = hdql_context_frame_begin(ws->ctx);
+    if(HDQL_ERR_CODE_OK != rc) return rc;
     for( r = hdql_query_reset(ws->q, d, ws->keys, ws->ctx)
        ; r
        ; r = hdql_query_get(ws->q, ws->keys, ws->ctx)
        ) {
         ws->iqr->handle_record(r, ws->iqr->userdata);
     }
-    return HDQL_ERR_CODE_OK;
+    /* records are handled, release evaluation-scoped data */
+    return hdql_context_frame_rewind(ws->ctx);
+}
+
+struct hdql_Key **
+hdql_query_results_get_flat_keys( struct hdql_QueryResultsWorkspace * ws
+        , size_t * n ) {
+    if(n) *n = ws->flatKeyViewLength;
+    return ws->kv;
 }
 
 int
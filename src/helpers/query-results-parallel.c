@@ -0,0 +1,474 @@
+#include "hdql/helpers/query-results-parallel.h"
+#include "hdql/helpers/query-results-handler.h"
+#include "hdql/attr-def.h"
+#include "hdql/context.h"
+#include "hdql/errors.h"
+#include "hdql/query-key.h"
+#include "hdql/query.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Records of root datums are stored with this alignment to be delivered
+ * to handler in-place */
+#define HDQL_PARALLEL_RECORD_ALIGN 16
+
+/* Buffered records yielded by query on certain root datum */
+struct RootResults {
+    /* records, each of `recordSize` bytes: value followed by keys */
+    unsigned char * data;
+    size_t nRecords, nAllocated;
+    /* evaluation result code, set by worker */
+    int rc;
+    /* set when evaluation on root datum is done, guarded by driver lock */
+    int isDone;
+};
+
+/* Worker thread state */
+struct Worker {
+    struct hdql_QueryResultsParallelDriver * drv;
+    pthread_t thread;
+    /* worker's own evaluation context, query clone and keys */
+    hdql_Context_t ctx;
+    struct hdql_Query * q;
+    struct hdql_Key * keys;
+    struct hdql_Key ** kv;
+    /* range of root datum indexes within the window, pending evaluation */
+    pthread_mutex_t rangeLock;
+    size_t bgn, end;
+};
+
+struct hdql_QueryResultsParallelDriver {
+    /* main workspace bound to handler */
+    struct hdql_QueryResultsWorkspace * ws;
+    struct hdql_iQueryResultsHandler * iqr;
+    struct hdql_Context * ctx;
+    /* flat key views of main workspace */
+    struct hdql_Key ** kv;
+    size_t nKeys;
+
+    /* record layout: value size, sizes of key datums and record stride */
+    size_t valueSize;
+    size_t * keySizes;
+    size_t recordSize;
+
+    size_t nWorkers, windowSize;
+    struct Worker * workers;
+    /* number of running worker threads */
+    size_t nStarted;
+
+    /* current window */
+    struct hdql_Datum ** roots;
+    struct RootResults * results;
+    size_t nRoots;
+
+    /* guards window generation, workers counter and results readiness */
+    pthread_mutex_t lock;
+    /* signaled on new window or stop */
+    pthread_cond_t windowCond;
+    /* signaled when root datum awaited by delivering thread is done or
+     * worker has finished with the window */
+    pthread_cond_t doneCond;
+    size_t generation;
+    size_t nActive;
+    /* index of root datum awaited by delivering thread, `SIZE_MAX` if none */
+    size_t awaited;
+    int stop;
+};
+
+/* Takes next root datum index to evaluate; steals half of the remaining
+ * range of other worker if own range is exhausted. Never holds two locks at
+ * once. */
+static int
+_worker_take(struct Worker * w, size_t * idx) {
+    pthread_mutex_lock(&w->rangeLock);
+    if(w->bgn < w->end) {
+        *idx = w->bgn++;
+        pthread_mutex_unlock(&w->rangeLock);
+        return 1;
+    }
+    pthread_mutex_unlock(&w->rangeLock);
+
+    struct hdql_QueryResultsParallelDriver * drv = w->drv;
+    const size_t nSelf = w - drv->workers;
+    for(size_t i = 1; i < drv->nWorkers; ++i) {
+        struct Worker * v = drv->workers + (nSelf + i) % drv->nWorkers;
+        size_t sBgn, sEnd;
+        pthread_mutex_lock(&v->rangeLock);
+        if(v->bgn == v->end) {
+            pthread_mutex_unlock(&v->rangeLock);
+            continue;
+        }
+        sEnd = v->end;
+        sBgn = sEnd - (sEnd - v->bgn + 1)/2;
+        v->end = sBgn;
+        pthread_mutex_unlock(&v->rangeLock);
+
+        *idx = sBgn;
+        pthread_mutex_lock(&w->rangeLock);
+        w->bgn = sBgn + 1;
+        w->end = sEnd;
+        pthread_mutex_unlock(&w->rangeLock);
+        return 1;
+    }
+    return 0;
+}
+
+/* Evaluates query on root datum, copying records into results buffer */
+static void
+_worker_evaluate(struct Worker * w, size_t idx) {
+    struct hdql_QueryResultsParallelDriver * drv = w->drv;
+    struct RootResults * res = drv->results + idx;
+    res->nRecords = 0;
+    res->rc = HDQL_ERR_CODE_OK;
+    hdql_context_errors_clear(w->ctx);
+    hdql_Datum_t r;
+    for( r = hdql_query_reset(w->q, drv->roots[idx], w->keys, w->ctx)
+       ; r
+       ; r = hdql_query_get(w->q, w->keys, w->ctx)
+       ) {
+        if(res->nRecords == res->nAllocated) {
+            size_t nNew = res->nAllocated ? 2*res->nAllocated : 16;
+            unsigned char * data = (unsigned char *) realloc(res->data
+                    , nNew*drv->recordSize);
+            if(NULL == data) {
+                res->rc = HDQL_ERR_MEMORY;
+                break;
+            }
+            res->data = data;
+            res->nAllocated = nNew;
+        }
+        unsigned char * rec = res->data + res->nRecords*drv->recordSize;
+        memcpy(rec, r, drv->valueSize);
+        rec += drv->valueSize;
+        for(size_t i = 0; i < drv->nKeys; ++i) {
+            if(!drv->keySizes[i]) continue;
+            memcpy(rec, hdql_key_datum_get(w->kv[i]), drv->keySizes[i]);
+            rec += drv->keySizes[i];
+        }
+        ++res->nRecords;
+    }
+    /* query yields no errors but pushes them to the worker's context */
+    if(HDQL_ERR_CODE_OK == res->rc && hdql_context_has_errors(w->ctx))
+        res->rc = hdql_context_error_get(w->ctx, 0)->code;
+    pthread_mutex_lock(&drv->lock);
+    res->isDone = 1;
+    if(drv->awaited == idx)
+        pthread_cond_signal(&drv->doneCond);
+    pthread_mutex_unlock(&drv->lock);
+}
+
+static void *
+_worker_run(void * arg) {
+    struct Worker * w = (struct Worker *) arg;
+    struct hdql_QueryResultsParallelDriver * drv = w->drv;
+    size_t seen = 0, idx;
+    pthread_mutex_lock(&drv->lock);
+    for(;;) {
+        while(!drv->stop && seen == drv->generation)
+            pthread_cond_wait(&drv->windowCond, &drv->lock);
+        if(drv->stop) break;
+        seen = drv->generation;
+        pthread_mutex_unlock(&drv->lock);
+
+        while(_worker_take(w, &idx))
+            _worker_evaluate(w, idx);
+
+        pthread_mutex_lock(&drv->lock);
+        if(0 == --drv->nActive)
+            pthread_cond_signal(&drv->doneCond);
+    }
+    pthread_mutex_unlock(&drv->lock);
+    return NULL;
+}
+
+/* Returns size of the value of given type code or 0 if it is not of fixed
+ * size */
+static size_t
+_fixed_type_size(hdql_ValueTypeCode_t vtc, hdql_Context_t ctx) {
+    const struct hdql_ValueInterface * vi
+        = hdql_types_get_type(hdql_context_get_types(ctx), vtc);
+    if(NULL == vi || vi->isVariadic) return 0;
+    return vi->size;
+}
+
+/* Initializes worker's state */
+static int
+_worker_init( struct Worker * w
+            , struct hdql_Query * q
+            , struct hdql_QueryResultsParallelDriver * drv
+            ) {
+    w->drv = drv;
+    w->ctx = hdql_context_create_descendant(drv->ctx, HDQL_CTX_LOCAL_RANDGEN);
+    if(NULL == w->ctx) return HDQL_ERR_MEMORY;
+    w->q = hdql_query_clone(q, w->ctx);
+    if(NULL == w->q) {
+        /* reason is in worker's context, that is about to be destroyed */
+        const int rc = hdql_context_has_errors(w->ctx)
+                     ? hdql_context_error_get(w->ctx, 0)->code
+                     : HDQL_ERR_GENERIC;
+        hdql_context_err_push(drv->ctx, rc
+                , "failed to clone query for parallel worker");
+        return rc;
+    }
+    if(!drv->kv) return HDQL_ERR_CODE_OK;
+    w->keys = hdql_key_new(w->ctx);
+    if(NULL == w->keys) {
+        hdql_context_err_push(drv->ctx, HDQL_ERR_MEMORY
+                , "failed to allocate keys for parallel worker");
+        return HDQL_ERR_MEMORY;
+    }
+    int rc = hdql_key_reserve_for_query(w->q, w->keys, w->ctx);
+    if(HDQL_ERR_CODE_OK != rc) return rc;
+    if(hdql_key_flat_view_size(w->keys, w->ctx) != drv->nKeys) {
+        hdql_context_err_push(drv->ctx, HDQL_ERR_GENERIC
+                , "keys layout of query clone differs from the original");
+        return HDQL_ERR_GENERIC;
+    }
+    w->kv = (struct hdql_Key **) malloc(sizeof(struct hdql_Key *)*drv->nKeys);
+    if(NULL == w->kv) {
+        hdql_context_err_push(drv->ctx, HDQL_ERR_MEMORY
+                , "failed to allocate keys view for parallel worker");
+        return HDQL_ERR_MEMORY;
+    }
+    hdql_key_flat_view_populate(w->keys, w->kv);
+    return HDQL_ERR_CODE_OK;
+}
+
+static void
+_worker_cleanup(struct Worker * w) {
+    if(w->kv) free(w->kv);
+    if(w->keys) hdql_key_destroy(w->keys, w->ctx);
+    if(w->q) hdql_query_destroy(w->q, w->ctx);
+    if(w->ctx) hdql_context_destroy(w->ctx);
+}
+
+/* Returns code of first error pushed to the context since it had
+ * \p nPushed errors pushed in total, `HDQL_ERR_CODE_OK` if none */
+static int
+_first_error_since(hdql_Context_t ctx, size_t nPushed) {
+    const size_t nKept = hdql_context_errors_count(ctx)
+               , nDropped = hdql_context_errors_overflow(ctx)
+               ;
+    if(nKept + nDropped == nPushed) return HDQL_ERR_CODE_OK;
+    /* oldest kept one if first new record is overwritten */
+    return hdql_context_error_get(ctx
+            , nPushed > nDropped ? nPushed - nDropped : 0)->code;
+}
+
+/*                                                          ________________
+ * _______________________________________________________/ public API */
+
+struct hdql_QueryResultsParallelDriver *
+hdql_query_results_parallel_init(
+          struct hdql_Query * q
+        , struct hdql_iQueryResultsHandler * iqr
+        , size_t nWorkers
+        , size_t windowSize
+        , struct hdql_Context * ctx
+        ) {
+    const struct hdql_AttrDef * ad = hdql_query_top_attr(q);
+    assert(ad);
+    size_t valueSize = 0;
+    if(hdql_attr_def_is_atomic(ad)) {
+        valueSize = _fixed_type_size(hdql_attr_def_get_atomic_value_type_code(ad), ctx);
+    }
+    if(nWorkers && !valueSize) {
+        hdql_context_err_push(ctx, HDQL_ERR_OPERATION_NOT_SUPPORTED
+                , "parallel processing of query results is supported only"
+                  " for atomic values of fixed size");
+        return NULL;
+    }
+    struct hdql_QueryResultsWorkspace * ws
+        = hdql_query_results_init(q, NULL, iqr, ctx);
+    if(NULL == ws) return NULL;
+
+    struct hdql_QueryResultsParallelDriver * drv
+        = (struct hdql_QueryResultsParallelDriver *) calloc(1
+                , sizeof(struct hdql_QueryResultsParallelDriver));
+    if(NULL == drv) {
+        hdql_context_err_push(ctx, HDQL_ERR_MEMORY
+                , "failed to allocate parallel results driver");
+        hdql_query_results_destroy(ws);
+        return NULL;
+    }
+    drv->ws = ws;
+    drv->iqr = iqr;
+    drv->ctx = ctx;
+    drv->nWorkers = nWorkers;
+    drv->windowSize = windowSize ? windowSize : HDQL_QUERY_RESULTS_PARALLEL_WINDOW;
+    if(!nWorkers) return drv;  /* sequential mode */
+
+    /* define records layout */
+    drv->kv = hdql_query_results_get_flat_keys(ws, &drv->nKeys);
+    drv->valueSize = valueSize;
+    drv->recordSize = valueSize;
+    if(drv->nKeys) {
+        drv->keySizes = (size_t *) malloc(sizeof(size_t)*drv->nKeys);
+        if(NULL == drv->keySizes) {
+            hdql_context_err_push(ctx, HDQL_ERR_MEMORY
+                    , "failed to allocate record layout of parallel results");
+            hdql_query_results_parallel_destroy(drv);
+            return NULL;
+        }
+        for(size_t i = 0; i < drv->nKeys; ++i) {
+            drv->keySizes[i] = hdql_key_is_datum(drv->kv[i])
+                    ? _fixed_type_size(hdql_key_datum_get_type_code(drv->kv[i]), ctx)
+                    : 0;
+            drv->recordSize += drv->keySizes[i];
+        }
+    }
+    drv->recordSize = (drv->recordSize + HDQL_PARALLEL_RECORD_ALIGN - 1)
+                    / HDQL_PARALLEL_RECORD_ALIGN * HDQL_PARALLEL_RECORD_ALIGN;
+    drv->results = (struct RootResults *) calloc(drv->windowSize
+            , sizeof(struct RootResults));
+    drv->awaited = SIZE_MAX;
+    if(NULL == drv->results) {
+        hdql_context_err_push(ctx, HDQL_ERR_MEMORY
+                , "failed to allocate results window of %zu root datums"
+                , drv->windowSize );
+        hdql_query_results_parallel_destroy(drv);
+        return NULL;
+    }
+
+    /* clone query for every worker before any thread started as cloning
+     * reads the original query */
+    drv->workers = (struct Worker *) calloc(nWorkers, sizeof(struct Worker));
+    if(NULL == drv->workers) {
+        hdql_context_err_push(ctx, HDQL_ERR_MEMORY
+                , "failed to allocate %zu parallel workers", nWorkers);
+        hdql_query_results_parallel_destroy(drv);
+        return NULL;
+    }
+    /* synchronization primitives are destroyed along with workers */
+    pthread_mutex_init(&drv->lock, NULL);
+    pthread_cond_init(&drv->windowCond, NULL);
+    pthread_cond_init(&drv->doneCond, NULL);
+    for(size_t i = 0; i < nWorkers; ++i) {
+        struct Worker * w = drv->workers + i;
+        pthread_mutex_init(&w->rangeLock, NULL);
+        if(HDQL_ERR_CODE_OK != _worker_init(w, q, drv)) {
+            drv->nWorkers = i + 1;  /* cleanup initialized ones only */
+            hdql_query_results_parallel_destroy(drv);
+            return NULL;
+        }
+    }
+    for(size_t i = 0; i < nWorkers; ++i) {
+        if(0 != pthread_create(&drv->workers[i].thread, NULL
+                    , _worker_run, drv->workers + i)) {
+            hdql_context_err_push(ctx, HDQL_ERR_GENERIC
+                    , "failed to start worker thread #%zu", i);
+            hdql_query_results_parallel_destroy(drv);
+            return NULL;
+        }
+        ++drv->nStarted;
+    }
+    return drv;
+}
+
+int
+hdql_query_results_parallel_process(
+          struct hdql_Datum ** roots
+        , size_t nRoots
+        , struct hdql_QueryResultsParallelDriver * drv
+        ) {
+    if(!drv->nWorkers) {
+        for(size_t i = 0; i < nRoots; ++i) {
+            const size_t nPushed = hdql_context_errors_count(drv->ctx)
+                                 + hdql_context_errors_overflow(drv->ctx);
+            int rc = hdql_query_results_process_records_from(roots[i], drv->ws);
+            if(HDQL_ERR_CODE_OK == rc)
+                rc = _first_error_since(drv->ctx, nPushed);
+            if(HDQL_ERR_CODE_OK != rc) return rc;
+        }
+        return HDQL_ERR_CODE_OK;
+    }
+    int rc = HDQL_ERR_CODE_OK;
+    for(size_t off = 0; off < nRoots; off += drv->windowSize) {
+        const size_t n = nRoots - off < drv->windowSize ? nRoots - off : drv->windowSize;
+        /* workers are idle at this point, so ranges and results can be set
+         * without range locks */
+        pthread_mutex_lock(&drv->lock);
+        drv->roots = roots + off;
+        drv->nRoots = n;
+        for(size_t i = 0; i < n; ++i) drv->results[i].isDone = 0;
+        for(size_t i = 0; i < drv->nWorkers; ++i) {
+            drv->workers[i].bgn = n*i/drv->nWorkers;
+            drv->workers[i].end = n*(i + 1)/drv->nWorkers;
+        }
+        drv->nActive = drv->nWorkers;
+        ++drv->generation;
+        pthread_cond_broadcast(&drv->windowCond);
+        pthread_mutex_unlock(&drv->lock);
+
+        /* deliver records in order, as root datums got evaluated */
+        for(size_t i = 0; i < n; ++i) {
+            struct RootResults * res = drv->results + i;
+            pthread_mutex_lock(&drv->lock);
+            drv->awaited = i;
+            while(!res->isDone)
+                pthread_cond_wait(&drv->doneCond, &drv->lock);
+            drv->awaited = SIZE_MAX;
+            pthread_mutex_unlock(&drv->lock);
+            if(HDQL_ERR_CODE_OK != rc) continue;  /* delivery interrupted */
+            if(HDQL_ERR_CODE_OK != res->rc) {
+                rc = res->rc;
+                hdql_context_err_push(drv->ctx, rc
+                        , "evaluation failed on root datum #%zu", off + i);
+                continue;
+            }
+            for(size_t nr = 0; nr < res->nRecords; ++nr) {
+                unsigned char * rec = res->data + nr*drv->recordSize;
+                unsigned char * keyData = rec + drv->valueSize;
+                for(size_t k = 0; k < drv->nKeys; ++k) {
+                    if(!drv->keySizes[k]) continue;
+                    memcpy(hdql_key_datum_get(drv->kv[k]), keyData, drv->keySizes[k]);
+                    keyData += drv->keySizes[k];
+                }
+                rc = drv->iqr->handle_record((hdql_Datum_t) rec, drv->iqr->userdata);
+                if(HDQL_ERR_CODE_OK != rc) break;
+            }
+        }
+        /* wait for workers to finish with the window */
+        pthread_mutex_lock(&drv->lock);
+        while(drv->nActive)
+            pthread_cond_wait(&drv->doneCond, &drv->lock);
+        pthread_mutex_unlock(&drv->lock);
+        if(HDQL_ERR_CODE_OK != rc) break;
+    }
+    return rc;
+}
+
+int
+hdql_query_results_parallel_destroy(struct hdql_QueryResultsParallelDriver * drv) {
+    if(drv->workers) {
+        pthread_mutex_lock(&drv->lock);
+        drv->stop = 1;
+        pthread_cond_broadcast(&drv->windowCond);
+        pthread_mutex_unlock(&drv->lock);
+        for(size_t i = 0; i < drv->nWorkers; ++i) {
+            struct Worker * w = drv->workers + i;
+            if(i < drv->nStarted) pthread_join(w->thread, NULL);
+            _worker_cleanup(w);
+            pthread_mutex_destroy(&w->rangeLock);
+        }
+        free(drv->workers);
+        pthread_cond_destroy(&drv->doneCond);
+        pthread_cond_destroy(&drv->windowCond);
+        pthread_mutex_destroy(&drv->lock);
+    }
+    if(drv->results) {
+        for(size_t i = 0; i < drv->windowSize; ++i)
+            free(drv->results[i].data);
+        free(drv->results);
+    }
+    if(drv->keySizes) free(drv->keySizes);
+    hdql_query_results_destroy(drv->ws);
+    free(drv);
+    return HDQL_ERR_CODE_OK;
+}
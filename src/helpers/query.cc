@@ -174,22 +174,54 @@ Query::Query( const char * expression
                 " definition (top attribute)" );
     }
     // reserve keys and flat keys view, if need
-    if(keysNeeded) {
-        // reserve ordinary keys list
-        _keys = hdql_key_new(_ownContext);
-        rc = hdql_key_reserve_for_query(_query, _keys, _ownContext);
-        if(HDQL_ERR_CODE_OK != rc) {
-            snprintf(errBuf, sizeof(errBuf), "Failed to reserve keys for HDQL"
-                    " query result; returns code is %d: %s.", rc, hdql_err_str(rc));
-            throw errors::HDQLExpressionError(expression, errBuf);
-        }
-        // reserve flat keys view
-        size_t flatKeyViewLength = hdql_key_flat_view_size(_keys, _ownContext);
-        _kv = flatKeyViewLength
-                      ? (hdql_Key **) malloc(sizeof(hdql_Key*)*flatKeyViewLength)
-                      : NULL;
-        hdql_key_flat_view_populate(_keys, _kv);
+    if(keysNeeded) _reserve_keys(expression);
+}
+
+Query::Query(const Query & orig, hdql_Context * ctx)
+                : _isSet(false)
+                , _ownContext(ctx)
+                , _rootCompound(orig._rootCompound)
+                , _query(nullptr)
+                , _keys(nullptr)
+                , _topAttrDef(nullptr)
+                , _kv(nullptr)
+                , _compounds(orig._compounds)
+                , _r(nullptr)
+                {
+    assert(orig._query);
+    assert(_ownContext);
+    _query = hdql_query_clone(orig._query, _ownContext);
+    if(!_query) {
+        hdql_context_destroy(_ownContext);
+        throw errors::HDQLError("Failed to clone HDQL query.");
+    }
+    _topAttrDef = hdql_query_top_attr(_query);
+    if(orig._keys) _reserve_keys(nullptr);
+}
+
+std::unique_ptr<Query>
+Query::clone() const {
+    return std::unique_ptr<Query>(new Query(*this
+                , hdql_context_create_descendant(_ownContext, HDQL_CTX_PRINT_PUSH_ERROR)));
+}
+
+void
+Query::_reserve_keys(const char * expression) {
+    // reserve ordinary keys list
+    _keys = hdql_key_new(_ownContext);
+    int rc = hdql_key_reserve_for_query(_query, _keys, _ownContext);
+    if(HDQL_ERR_CODE_OK != rc) {
+        char errBuf[256];
+        snprintf(errBuf, sizeof(errBuf), "Failed to reserve keys for HDQL"
+                " query result; returns code is %d: %s.", rc, hdql_err_str(rc));
+        throw errors::HDQLExpressionError(expression, errBuf);
     }
+    // reserve flat keys view
+    size_t flatKeyViewLength = hdql_key_flat_view_size(_keys, _ownContext);
+    _kv = flatKeyViewLength
+                  ? (hdql_Key **) malloc(sizeof(hdql_Key*)*flatKeyViewLength)
+                  : NULL;
+    hdql_key_flat_view_populate(_keys, _kv);
 }
 
 bool
@@ -222,15 +254,15 @@ Query::~Query() {
     if(_query && _ownContext) {
         hdql_query_destroy(_query, _ownContext);
     }
-    if(_ownContext) {
-        hdql_context_destroy(_ownContext);
-    }
     for(auto & p : _converters()) {
         if(p.second.second)
             hdql_context_free(_ownContext
                     , reinterpret_cast<hdql_Datum_t>(p.second.second)  // LABEL:CONVERSION-DEST_BUF:FREE
                     );
     }
+    if(_ownContext) {
+        hdql_context_destroy(_ownContext);
+    }
 }
 
 size_t
@@ -413,8 +445,8 @@ Query::_get_converter_to(const std::type_info & destTypeInfo) const {
                 throw std::runtime_error(errbf);
             }  // if conversion not found
             // conversion found -- allocate buffer in own context
-            cnvFAndBuf.second = reinterpret_cast<uint8_t*>(hdql_context_alloc(_ownContext
-                    , hdql_types_get_type(vts, destTypeCode)->size ));  // LABEL:CONVERSION-DEST_BUF:ALLOC
+            cnvFAndBuf.second = reinterpret_cast<uint8_t*>(hdql_context_alloc_as(_ownContext
+                    , hdql_types_get_type(vts, destTypeCode)->size, hdql_kMemDatum ));  // LABEL:CONVERSION-DEST_BUF:ALLOC
             if(!cnvFAndBuf.second) {
                 char errbf[128];
                 snprintf( errbf, sizeof(errbf)
@@ -436,6 +468,11 @@ Query::_get_converter_to(const std::type_info & destTypeInfo) const {
 void
 Query::_reset_subject_instance(hdql_Datum_t item) {
     assert(item);
+    // results of previous item are not accessible anymore -- release
+    // evaluation-scoped data and open frame for the new one
+    if(hdql_context_frame_depth(_ownContext))
+        hdql_context_frame_rewind(_ownContext);
+    hdql_context_frame_begin(_ownContext);
     _r = hdql_query_reset(_query, reinterpret_cast<hdql_Datum_t>(item)
             , _keys, _ownContext);
     if(hdql_context_has_errors(_ownContext)) {
@@ -9,6 +9,7 @@
 #include "hdql/value.h"
 
 #include <assert.h>
+#include <string.h>
 
 /*
  * Unary or binary arithmetic operation node for collection arguments resulting
@@ -21,14 +22,263 @@
  * arithmetic operations.
  *
  * To accomplish this task an "overloaded" advance operation is implemented
- * here as a choice of two callbacks. */
+ * here as a choice of two callbacks.
+ *
+ * If operation provides batched evaluator, values of collection elements are
+ * prefetched into contiguous buffer and evaluated at once, results are then
+ * yielded one by one. Batches grow from a single element, so short-circuiting
+ * consumers do not evaluate much more elements than they take. */
+
+/*                                          __________________________________
+ * _______________________________________/ Prefetching of collection values
+ */
+
+/* Returns value interface of query elements if they can be prefetched */
+static const struct hdql_ValueInterface *
+_collection_prefetch_value_iface(struct hdql_Query * q, hdql_Context_t ctx) {
+    const struct hdql_ValueInterface * vi = hdql_types_get_type(hdql_context_get_types(ctx)
+            , hdql_attr_def_get_atomic_value_type_code(hdql_query_top_attr(q)));
+    if(NULL == vi || 0 == vi->size || vi->isVariadic) return NULL;
+    return vi;
+}
+
+/* public API */
+bool
+hdql_collection_prefetch_is_possible(struct hdql_Query * q, hdql_Context_t ctx) {
+    return NULL != _collection_prefetch_value_iface(q, ctx);
+}
+
+/* public API */
+struct hdql_CollectionPrefetch *
+hdql_collection_prefetch_create(struct hdql_Query * q, hdql_Context_t ctx) {
+    const struct hdql_ValueInterface * vi = _collection_prefetch_value_iface(q, ctx);
+    if(NULL == vi) return NULL;
+    struct hdql_CollectionPrefetch * p = hdql_alloc(ctx, struct hdql_CollectionPrefetch);
+    if(NULL == p) return NULL;
+    p->query = q;
+    p->nItems = 0;
+    p->nNext = 1;
+    p->depleted = true;
+    p->withKeys = false;
+    p->valueSize = vi->size;
+    p->values = hdql_context_alloc_as(ctx
+            , HDQL_ARITH_OP_BATCH_SIZE*p->valueSize, hdql_kMemDatum);
+    p->keys = NULL;
+    if(NULL == p->values) {
+        hdql_context_free(ctx, (hdql_Datum_t) p);
+        return NULL;
+    }
+    return p;
+}
+
+static void
+_collection_prefetch_free_keys(struct hdql_CollectionPrefetch * p, hdql_Context_t ctx) {
+    for(size_t i = 0; i < HDQL_ARITH_OP_BATCH_SIZE; ++i) {
+        if(p->keys[i]) hdql_key_destroy(p->keys[i], ctx);
+    }
+    hdql_context_free(ctx, (hdql_Datum_t) p->keys);
+    p->keys = NULL;
+}
+
+/* public API */
+void
+hdql_collection_prefetch_destroy(struct hdql_CollectionPrefetch * p, hdql_Context_t ctx) {
+    if(p->keys) _collection_prefetch_free_keys(p, ctx);
+    hdql_context_free(ctx, p->values);
+    hdql_context_free(ctx, (hdql_Datum_t) p);
+}
+
+/* Allocates keys for prefetched elements */
+static int
+_collection_prefetch_reserve_keys(struct hdql_CollectionPrefetch * p, hdql_Context_t ctx) {
+    p->keys = (struct hdql_Key **) hdql_context_alloc_as(ctx
+            , HDQL_ARITH_OP_BATCH_SIZE*sizeof(struct hdql_Key *), hdql_kMemKey);
+    if(NULL == p->keys) return HDQL_ERR_MEMORY;
+    memset(p->keys, 0x0, HDQL_ARITH_OP_BATCH_SIZE*sizeof(struct hdql_Key *));
+    for(size_t i = 0; i < HDQL_ARITH_OP_BATCH_SIZE; ++i) {
+        p->keys[i] = hdql_key_new(ctx);
+        if(NULL == p->keys[i]) return HDQL_ERR_MEMORY;
+        int rc = hdql_key_reserve_for_query(p->query, p->keys[i], ctx);
+        if(HDQL_ERR_CODE_OK != rc) return rc;
+    }
+    return HDQL_ERR_CODE_OK;
+}
+
+/* Copies values of collection elements starting from given one */
+static size_t
+_collection_prefetch_fill( struct hdql_CollectionPrefetch * p
+                         , hdql_Datum_t first
+                         , hdql_Context_t ctx
+                         ) {
+    size_t n = 0;
+    for(hdql_Datum_t cr = first; ; ) {
+        /* values are copied as datum may be invalidated by next advance */
+        memcpy( ((char *) p->values) + n*p->valueSize, cr, p->valueSize );
+        if(++n == p->nNext) break;
+        /* advance updates only changed parts of the key, so it starts from
+         * the previous one */
+        if(p->withKeys) hdql_key_copy_value(p->keys[n], p->keys[n - 1], ctx);
+        cr = hdql_query_get(p->query, p->withKeys ? p->keys[n] : NULL, ctx);
+        if(!cr) {
+            p->depleted = true;
+            break;
+        }
+    }
+    p->nNext = 2*p->nNext < HDQL_ARITH_OP_BATCH_SIZE
+             ? 2*p->nNext : HDQL_ARITH_OP_BATCH_SIZE;
+    return p->nItems = n;
+}
+
+/* public API */
+size_t
+hdql_collection_prefetch_reset( struct hdql_CollectionPrefetch * p
+                              , hdql_Datum_t newOwner
+                              , bool withKeys
+                              , hdql_Context_t ctx
+                              ) {
+    p->nItems = 0;
+    p->nNext = 1;
+    p->depleted = true;
+    p->withKeys = withKeys;
+    if(withKeys && !p->keys) {
+        if(HDQL_ERR_CODE_OK != _collection_prefetch_reserve_keys(p, ctx)) {
+            if(p->keys) _collection_prefetch_free_keys(p, ctx);
+            hdql_context_err_push(ctx, HDQL_ERR_MEMORY
+                    , "failed to allocate keys for prefetched collection values");
+            return 0;
+        }
+    }
+    hdql_Datum_t cr = hdql_query_reset(p->query, newOwner
+            , withKeys ? p->keys[0] : NULL, ctx);
+    if(!cr) return 0;
+    p->depleted = false;
+    return _collection_prefetch_fill(p, cr, ctx);
+}
+
+/* public API */
+size_t
+hdql_collection_prefetch_next(struct hdql_CollectionPrefetch * p, hdql_Context_t ctx) {
+    if(p->depleted) {
+        p->nItems = 0;
+        return 0;
+    }
+    if(p->withKeys && p->nItems > 1)
+        hdql_key_copy_value(p->keys[0], p->keys[p->nItems - 1], ctx);
+    hdql_Datum_t cr = hdql_query_get(p->query, p->withKeys ? p->keys[0] : NULL, ctx);
+    if(!cr) {
+        p->depleted = true;
+        p->nItems = 0;
+        return 0;
+    }
+    return _collection_prefetch_fill(p, cr, ctx);
+}
+
+/*                                                  __________________________
+ * _______________________________________________/ Collection arithmetic node
+ */
+
+/* State of batched evaluation */
+struct ArithOpBatch {
+    /* values of collection argument */
+    struct hdql_CollectionPrefetch * prefetch;
+    /* index of next result to return */
+    size_t nCurrent;
+    /* contiguous buffer of results */
+    hdql_Datum_t results;
+    size_t resultSize;
+};
 
 struct ArithOpCollectionState {
     unsigned int collectionNArg:1;
     hdql_Datum_t scalarDatum;
     hdql_Datum_t cResult;
+    /* NULL if operation is not batched */
+    struct ArithOpBatch * batch;
 };
 
+/* Allocates batch state if operation provides batched evaluator
+ *
+ * Sets `*bPtr` to NULL if operation can not be batched. Returns
+ * `HDQL_ERR_MEMORY` if batch state can not be allocated. */
+static int
+_arith_op_batch_create( const struct hdql_ArithOpDefData * defData
+                      , struct hdql_Query * collectionArg
+                      , struct ArithOpBatch ** bPtr
+                      , hdql_Context_t ctx
+                      ) {
+    *bPtr = NULL;
+    if(NULL == defData->evaluator->batchOp || NULL == defData->args[1])
+        return HDQL_ERR_CODE_OK;
+    const struct hdql_ValueInterface * resultVI = hdql_types_get_type(
+            hdql_context_get_types(ctx), defData->evaluator->returnType);
+    if( NULL == resultVI
+     || !hdql_collection_prefetch_is_possible(collectionArg, ctx) )
+        return HDQL_ERR_CODE_OK;
+    struct ArithOpBatch * b = hdql_alloc(ctx, struct ArithOpBatch);
+    if(NULL == b) return HDQL_ERR_MEMORY;
+    b->nCurrent = 0;
+    b->resultSize = resultVI->size;
+    b->prefetch = hdql_collection_prefetch_create(collectionArg, ctx);
+    b->results = hdql_context_alloc_as(ctx
+            , HDQL_ARITH_OP_BATCH_SIZE*b->resultSize, hdql_kMemDatum);
+    if(NULL == b->prefetch || NULL == b->results) {
+        if(b->prefetch) hdql_collection_prefetch_destroy(b->prefetch, ctx);
+        if(b->results)  hdql_context_free(ctx, b->results);
+        hdql_context_free(ctx, (hdql_Datum_t) b);
+        return HDQL_ERR_MEMORY;
+    }
+    *bPtr = b;
+    return HDQL_ERR_CODE_OK;
+}
+
+static void
+_arith_op_batch_destroy(struct ArithOpBatch * b, hdql_Context_t ctx) {
+    hdql_collection_prefetch_destroy(b->prefetch, ctx);
+    hdql_context_free(ctx, b->results);
+    hdql_context_free(ctx, (hdql_Datum_t) b);
+}
+
+/* Evaluates prefetched batch */
+static void
+_arith_op_batch_eval( const struct hdql_ArithOpDefData * defData
+                    , struct ArithOpCollectionState * state
+                    , hdql_Context_t context
+                    ) {
+    struct ArithOpBatch * b = state->batch;
+    const struct hdql_CollectionPrefetch * p = b->prefetch;
+    b->nCurrent = 0;
+    int rc;
+    if(state->collectionNArg) {
+        rc = defData->evaluator->batchOp( state->scalarDatum, 0
+                                        , p->values, p->valueSize
+                                        , p->nItems, b->results );
+    } else {
+        rc = defData->evaluator->batchOp( p->values, p->valueSize
+                                        , state->scalarDatum, 0
+                                        , p->nItems, b->results );
+    }
+    if(0 != rc) {
+        hdql_context_err_push(context, rc, "batched arithmetic operation error %d", rc);
+    }
+}
+
+/* Returns next evaluated result, prefetching new batch if need */
+static hdql_Datum_t
+_arith_op_batch_next( const struct hdql_ArithOpDefData * defData
+                    , struct ArithOpCollectionState * state
+                    , struct hdql_Key * key
+                    , hdql_Context_t context
+                    ) {
+    struct ArithOpBatch * b = state->batch;
+    struct hdql_CollectionPrefetch * p = b->prefetch;
+    if(b->nCurrent == p->nItems) {
+        if(!hdql_collection_prefetch_next(p, context)) return NULL;
+        _arith_op_batch_eval(defData, state, context);
+    }
+    if(key && p->withKeys) hdql_key_copy_value(key, p->keys[b->nCurrent], context);
+    return (hdql_Datum_t) (((char *) b->results) + (b->nCurrent++)*b->resultSize);
+}
+
 static hdql_It_t
 _arith_op_new_iterator( hdql_Datum_t owner
                       , const struct hdql_Datum * defData_
@@ -38,9 +288,14 @@ _arith_op_new_iterator( hdql_Datum_t owner
     /* new state */
     struct ArithOpCollectionState * state
         = (struct ArithOpCollectionState *)
-            hdql_context_alloc(ctx, sizeof(struct ArithOpCollectionState));
+            hdql_context_alloc_as(ctx, sizeof(struct ArithOpCollectionState), hdql_kMemIterator);
+    if(NULL == state) return NULL;
     /* allocate result value */
     state->cResult = hdql_create_value(defData->evaluator->returnType, ctx);
+    if(NULL == state->cResult) {
+        hdql_context_free(ctx, (hdql_Datum_t) state);
+        return NULL;
+    }
 
     bool aIsFullyScalar = hdql_query_is_fully_scalar(defData->args[0]);
     assert( ((!aIsFullyScalar) && (!defData->args[1]))  /* either our single argument is collection */
@@ -48,6 +303,12 @@ _arith_op_new_iterator( hdql_Datum_t owner
          );
     /* set argument number to iterate over */
     state->collectionNArg = aIsFullyScalar ? 1 : 0;
+    if(HDQL_ERR_CODE_OK != _arith_op_batch_create(defData
+                , defData->args[state->collectionNArg], &state->batch, ctx)) {
+        hdql_destroy_value(defData->evaluator->returnType, state->cResult, ctx);
+        hdql_context_free(ctx, (hdql_Datum_t) state);
+        return NULL;
+    }
 
     return (hdql_It_t) state;
 }
@@ -63,10 +324,6 @@ _arith_op_collection_iterator_reset( hdql_It_t it_
     struct hdql_ArithOpDefData * defData = (struct hdql_ArithOpDefData *) defData_;
     struct ArithOpCollectionState * state = (struct ArithOpCollectionState *) it_;
 
-    hdql_Datum_t cr = hdql_query_reset( defData->args[state->collectionNArg]
-                                      , newOwner
-                                      , key
-                                      , context);
     if(defData->args[1]) {
         state->scalarDatum = hdql_query_reset(defData->args[state->collectionNArg ^ 0x1]
                            , newOwner, NULL, context);
@@ -74,6 +331,18 @@ _arith_op_collection_iterator_reset( hdql_It_t it_
         state->scalarDatum = NULL;
     }
 
+    struct ArithOpBatch * b = state->batch;
+    if(b) {
+        b->nCurrent = 0;
+        if(!hdql_collection_prefetch_reset(b->prefetch, newOwner, NULL != key, context))
+            return NULL;
+        _arith_op_batch_eval(defData, state, context);
+        return _arith_op_batch_next(defData, state, key, context);
+    }
+
+    hdql_Datum_t cr = hdql_query_reset( defData->args[state->collectionNArg]
+                                      , newOwner, key, context);
+    if(!cr) return NULL;
     if(state->collectionNArg) {
         defData->evaluator->op(state->scalarDatum, cr, state->cResult);
     } else {
@@ -92,6 +361,9 @@ _arith_op_collection_yield( hdql_It_t it_
     struct hdql_ArithOpDefData * defData = (struct hdql_ArithOpDefData *) defData_;
     struct ArithOpCollectionState * state = (struct ArithOpCollectionState *) it_;
     
+    if(state->batch)
+        return _arith_op_batch_next(defData, state, key, context);
+
     hdql_Datum_t cr;
     if(state->collectionNArg) {
         cr = hdql_query_get(defData->args[1], key, context);
@@ -119,6 +391,9 @@ _arith_op_collection_destroy_iterator( hdql_It_t it_
     if(NULL != state->cResult) {
         hdql_destroy_value(defData->evaluator->returnType, state->cResult, context);
     }
+    if(NULL != state->batch) {
+        _arith_op_batch_destroy(state->batch, context);
+    }
     hdql_context_free(context, (hdql_Datum_t) it_);
 }
 
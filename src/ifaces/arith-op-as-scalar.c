@@ -31,8 +31,12 @@ _arith_op_scalar_interface_instantiate(
     assert(defData_);
     struct hdql_ArithOpDefData * defData = (struct hdql_ArithOpDefData *) defData_;
     struct ArithOpScalarState * state = hdql_alloc(ctx, struct ArithOpScalarState);
-    assert(state);
+    if(NULL == state) return NULL;
     state->result = hdql_create_value(defData->evaluator->returnType, ctx);
+    if(NULL == state->result) {
+        hdql_context_free(ctx, (hdql_Datum_t) state);
+        return NULL;
+    }
     return (hdql_Datum_t) state;
 }
 
@@ -51,13 +55,11 @@ _arith_op_scalar_interface_reset(
     struct hdql_ArithOpDefData * defData = (struct hdql_ArithOpDefData *) defData_;
     struct ArithOpScalarState * state = (struct ArithOpScalarState *) state_;
 
-    hdql_query_reset(defData->args[0], newOwner, NULL, ctx);
-    if(defData->args[1]) {
-        hdql_query_reset(defData->args[1], newOwner, NULL, ctx);
-    }
     hdql_Datum_t a =                    hdql_query_reset(defData->args[0], newOwner, NULL, ctx)
                , b = defData->args[1] ? hdql_query_reset(defData->args[1], newOwner, NULL, ctx) : NULL
                ;
+    /* operand has no value (or failed to get one) */
+    if(NULL == a || (defData->args[1] && NULL == b)) return NULL;
     int rc = defData->evaluator->op(a, b, state->result);
     if(0 != rc) {
         hdql_context_err_push( ctx, HDQL_ERR_ARITH_OPERATION
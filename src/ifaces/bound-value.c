@@ -49,7 +49,8 @@
 
 /* NOTE: this is attribute definition data, not a dynamic data type! */
 struct BoundValueDefinitionData {
-    /* query that should provide the value. Set upon construction */
+    /* query that should provide the value. Set upon construction, owned by
+     * definition data */
     struct hdql_Query * q;
     /* value pointer */
     hdql_Datum_t * value;
@@ -59,13 +60,22 @@ struct BoundValueDefinitionData {
 hdql_Datum_t
 hdql_bound_value_interface_definition_data_init(struct hdql_Query * q, hdql_Context_t ctx) {
     struct BoundValueDefinitionData * d = hdql_alloc(ctx, struct BoundValueDefinitionData);
+    if(!d) return NULL;
     d->q = q;
     d->value = NULL;
     return (hdql_Datum_t) d;
 }
 
+struct hdql_Query *
+hdql_bound_value_interface_definition_data_get_query(const struct hdql_Datum * d) {
+    assert(d);
+    return ((const struct BoundValueDefinitionData *) d)->q;
+}
+
 void
 hdql_bound_value_interface_definition_data_destroy(hdql_Datum_t d, hdql_Context_t ctx) {
+    struct BoundValueDefinitionData * dd = (struct BoundValueDefinitionData *) d;
+    if(dd->q) hdql_query_destroy(dd->q, ctx);
     hdql_context_free(ctx, d);
 }
 
@@ -160,6 +170,7 @@ _hdql_cartesian_product_as_collection_new_iterator( hdql_Datum_t owner
     struct hdql_BindingCompoundCollectionDefData * dd
             = hdql_cast(ctx, struct hdql_BindingCompoundCollectionDefData, defData_);
     struct QueryProdIterator * it = hdql_alloc(ctx, struct QueryProdIterator);
+    if(NULL == it) return NULL;
     it->context = ctx;
     if(!!(it->filterQuery = dd->filterQuery)) {
         const struct hdql_AttrDef * ad = hdql_query_top_attr(it->filterQuery);
@@ -202,6 +213,12 @@ _hdql_cartesian_product_as_collection_new_iterator( hdql_Datum_t owner
             hdql_context_alloc(ctx
                 , it->nBindingQueries*sizeof(struct hdql_Query *));
     it->values = (hdql_Datum_t *) hdql_context_alloc(ctx, sizeof(hdql_Datum_t *)*it->nBindingQueries);
+    if(NULL == it->boundQueries || NULL == it->values) {
+        hdql_context_free(ctx, (hdql_Datum_t) it->boundQueries);
+        hdql_context_free(ctx, (hdql_Datum_t) it->values);
+        hdql_context_free(ctx, (hdql_Datum_t) it);
+        return NULL;
+    }
     _BindQueryUD_t bqud = {.it = it, .nBoundAttr = 0};
     hdql_compound_for_each_own_attribute(dd->vCompound, _bind_query, &bqud);
     /* assign definition data to this transient interface */
@@ -324,9 +341,7 @@ _hdql_cartesian_product_destroy_iterator( hdql_It_t it_
         , hdql_Context_t ctx
         ) {
     struct QueryProdIterator * it = hdql_cast(ctx, struct QueryProdIterator, it_);
-    for(size_t nq = 0; nq < it->nBindingQueries; ++nq) {
-        hdql_query_destroy(it->boundQueries[nq], ctx);
-    }
+    /* bound queries are owned by definition data of bound attributes */
     hdql_context_free(ctx, (hdql_Datum_t) it->values);
     hdql_context_free(ctx, (hdql_Datum_t) it->boundQueries);
     hdql_context_free(ctx, (hdql_Datum_t) it_);
@@ -337,6 +352,8 @@ typedef struct {
     size_t nBoundAttr;
     struct hdql_Key * objKeyList;
     hdql_Context_t ctx;
+    /* result of the first failed reservation, stops iteration */
+    int rc;
 } _AllocKeysUD_t;
 
 /* called for every bound attribute to reserve composite key for bound object */
@@ -359,11 +376,11 @@ _reserve_keys_list_for_binding_query( const char * attrName
      * hdql_bound_value_interface_definition_data_init() must be used */
     struct BoundValueDefinitionData * bDefData
         = (struct BoundValueDefinitionData*) boundAttrIFace->definitionData;
-    hdql_key_reserve_for_query(bDefData->q
+    ud->rc = hdql_key_reserve_for_query(bDefData->q
             , hdql_key_get_list_item(ud->objKeyList, ud->nBoundAttr)
             , ud->ctx);
     ++(ud->nBoundAttr);
-    return 0;
+    return ud->rc;
 }
 
 /* Called from AD interface to reserve keys
@@ -386,14 +403,15 @@ hdql_bound_compound_key_reserve( struct hdql_Key * key,
             , &nBindingQueries);
     assert(nBindingQueries > 0);  /* otherwise this compound could not be "bound" */
 
-    _AllocKeysUD_t ud = {.nBoundAttr = 0, .ctx = ctx};
+    _AllocKeysUD_t ud = {.nBoundAttr = 0, .ctx = ctx, .rc = HDQL_ERR_CODE_OK};
     /* top-level key (always a body of the list) */
-    hdql_key_mark_as_list(key, nBindingQueries, ctx);
+    int rc = hdql_key_mark_as_list(key, nBindingQueries, ctx);
+    if(HDQL_ERR_CODE_OK != rc) return rc;
     ud.objKeyList = key;
     hdql_compound_for_each_own_attribute(dd->vCompound
             , _reserve_keys_list_for_binding_query
             , &ud );
-    return HDQL_ERR_CODE_OK;
+    return ud.rc;
 }
 
 const struct hdql_CollectionAttrInterface _hdql_gBindingCompoundCollectionIFace = {
@@ -0,0 +1,619 @@
+#include "hdql/attr-def.h"
+#include "hdql/context.h"
+#include "hdql/errors.h"
+#include "hdql/internal-ifaces.h"
+#include "hdql/operations.h"
+#include "hdql/query-key.h"
+#include "hdql/query.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Fused arithmetic expression node.
+ *
+ * Sub-tree of nested arithmetic operation nodes like `(.x - x0)*k + b' is
+ * collapsed by the parser into single node evaluating a list of
+ * instructions. Each instruction applies operation evaluator to the slots
+ * and writes result into its own slot:
+ *
+ *      slots:  [.x] [x0] [k] [b] [#0] [#1] [#2] [NULL]
+ *      #0 = .x - x0;  #1 = #0 * k;  #2 = #1 + b
+ *
+ * First slots refer to results of leaf (argument) queries, next ones are
+ * values of intermediate results and the last one is always NULL (second
+ * operand of unary operations). Static constant leaves are set once, at the
+ * state creation.
+ *
+ * Node results in collection if one of the leaves is a collection (at most
+ * one can be, as arithmetic operation on two collections is prohibited).
+ * Instructions that do not depend on the collection leaf are placed first and
+ * evaluated once, on reset, while the rest is evaluated per item (or per
+ * batch of prefetched items, if operations provide batched evaluators).
+ */
+
+/* Returns arithmetic operation definition data of single-node query, if it
+ * is (not fused) operation node */
+static struct hdql_ArithOpDefData *
+_arith_op_def_data(struct hdql_Query * q) {
+    if(hdql_query_next_query(q)) return NULL;
+    const struct hdql_AttrDef * ad = hdql_query_get_subject(q);
+    if(hdql_attr_def_is_scalar(ad)) {
+        const struct hdql_ScalarAttrInterface * iface = hdql_attr_def_scalar_iface(ad);
+        if(iface->reset != _hdql_gScalarArithOpIFace.reset) return NULL;
+        return (struct hdql_ArithOpDefData *) iface->definitionData;
+    }
+    const struct hdql_CollectionAttrInterface * iface = hdql_attr_def_collection_iface(ad);
+    if(iface->reset_iterator != _hdql_gCollectionArithOpIFace.reset_iterator) return NULL;
+    return (struct hdql_ArithOpDefData *) iface->definitionData;
+}
+
+static void
+_fused_arith_op_count( struct hdql_ArithOpDefData * dd
+                     , size_t * nLeaves, size_t * nInstructions ) {
+    ++(*nInstructions);
+    for(int i = 0; i < 2; ++i) {
+        if(NULL == dd->args[i]) continue;
+        struct hdql_ArithOpDefData * sub = _arith_op_def_data(dd->args[i]);
+        if(sub) _fused_arith_op_count(sub, nLeaves, nInstructions);
+        else ++(*nLeaves);
+    }
+}
+
+/* Appends leaves and instructions of the operation sub-tree (in post-order),
+ * detaching leaf queries from operation nodes. Returns result slot */
+static size_t
+_fused_arith_op_fill( struct hdql_FusedArithOpDefData * fd
+                    , struct hdql_ArithOpDefData * dd
+                    , size_t nLeavesTotal
+                    , size_t nullSlot
+                    ) {
+    size_t slots[2] = {nullSlot, nullSlot};
+    for(int i = 0; i < 2; ++i) {
+        if(NULL == dd->args[i]) continue;
+        struct hdql_ArithOpDefData * sub = _arith_op_def_data(dd->args[i]);
+        if(sub) {
+            slots[i] = _fused_arith_op_fill(fd, sub, nLeavesTotal, nullSlot);
+            continue;
+        }
+        slots[i] = fd->nLeaves;
+        fd->leaves[fd->nLeaves++] = dd->args[i];
+        dd->args[i] = NULL;
+    }
+    struct hdql_FusedArithInstruction * ins = fd->instructions + fd->nInstructions;
+    ins->evaluator = dd->evaluator;
+    ins->a = slots[0];
+    ins->b = slots[1];
+    ins->r = nLeavesTotal + (fd->nInstructions++);
+    return ins->r;
+}
+
+/* Moves instructions not depending on collection leaf to the beginning of
+ * the list, keeping their order */
+static void
+_fused_arith_op_hoist(struct hdql_FusedArithOpDefData * fd, hdql_Context_t ctx) {
+    fd->nHoisted = fd->nInstructions;
+    if(fd->collectionLeaf == fd->nLeaves) return;
+    const size_t nullSlot = fd->nLeaves + fd->nInstructions;
+    bool * depends = (bool *) hdql_context_alloc(ctx, sizeof(bool)*(nullSlot + 1));
+    struct hdql_FusedArithInstruction * sorted = (struct hdql_FusedArithInstruction *)
+        hdql_context_alloc(ctx, sizeof(struct hdql_FusedArithInstruction)*fd->nInstructions);
+    if((!depends) || !sorted) {
+        /* evaluate everything per item then */
+        if(depends) hdql_context_free(ctx, (hdql_Datum_t) depends);
+        if(sorted) hdql_context_free(ctx, (hdql_Datum_t) sorted);
+        fd->nHoisted = 0;
+        return;
+    }
+    memset(depends, 0x0, sizeof(bool)*(nullSlot + 1));
+    depends[fd->collectionLeaf] = true;
+    /* instructions are in post-order, so operand slots are resolved before
+     * they are used */
+    for(size_t i = 0; i < fd->nInstructions; ++i) {
+        const struct hdql_FusedArithInstruction * ins = fd->instructions + i;
+        depends[ins->r] = depends[ins->a] || depends[ins->b];
+    }
+    size_t n = 0;
+    for(size_t i = 0; i < fd->nInstructions; ++i) {
+        if(!depends[fd->instructions[i].r]) sorted[n++] = fd->instructions[i];
+    }
+    fd->nHoisted = n;
+    for(size_t i = 0; i < fd->nInstructions; ++i) {
+        if(depends[fd->instructions[i].r]) sorted[n++] = fd->instructions[i];
+    }
+    memcpy(fd->instructions, sorted, sizeof(struct hdql_FusedArithInstruction)*fd->nInstructions);
+    hdql_context_free(ctx, (hdql_Datum_t) sorted);
+    hdql_context_free(ctx, (hdql_Datum_t) depends);
+}
+
+static struct hdql_FusedArithOpDefData *
+_fused_arith_op_def_data_alloc( size_t nLeaves, size_t nInstructions
+                              , hdql_Context_t ctx ) {
+    struct hdql_FusedArithOpDefData * fd = hdql_alloc(ctx, struct hdql_FusedArithOpDefData);
+    if(!fd) return NULL;
+    fd->leaves = (struct hdql_Query **) hdql_context_alloc(ctx
+            , sizeof(struct hdql_Query *)*nLeaves);
+    fd->instructions = (struct hdql_FusedArithInstruction *) hdql_context_alloc(ctx
+            , sizeof(struct hdql_FusedArithInstruction)*nInstructions);
+    if((!fd->leaves) || !fd->instructions) {
+        if(fd->leaves) hdql_context_free(ctx, (hdql_Datum_t) fd->leaves);
+        if(fd->instructions) hdql_context_free(ctx, (hdql_Datum_t) fd->instructions);
+        hdql_context_free(ctx, (hdql_Datum_t) fd);
+        return NULL;
+    }
+    fd->nLeaves = fd->nInstructions = fd->nHoisted = 0;
+    fd->collectionLeaf = fd->resultSlot = 0;
+    return fd;
+}
+
+/* public API */
+struct hdql_FusedArithOpDefData *
+hdql_fused_arith_op_def_data_create( struct hdql_ArithOpDefData * root
+                                   , hdql_Context_t ctx
+                                   ) {
+    size_t nLeaves = 0, nInstructions = 0;
+    _fused_arith_op_count(root, &nLeaves, &nInstructions);
+    struct hdql_FusedArithOpDefData * fd
+            = _fused_arith_op_def_data_alloc(nLeaves, nInstructions, ctx);
+    if(!fd) return NULL;
+    fd->resultSlot = _fused_arith_op_fill(fd, root, nLeaves, nLeaves + nInstructions);
+    assert(fd->nLeaves == nLeaves);
+    assert(fd->nInstructions == nInstructions);
+    fd->collectionLeaf = nLeaves;
+    for(size_t i = 0; i < nLeaves; ++i) {
+        if(hdql_query_is_fully_scalar(fd->leaves[i])) continue;
+        assert(fd->collectionLeaf == nLeaves);  /* single collection leaf */
+        fd->collectionLeaf = i;
+    }
+    _fused_arith_op_hoist(fd, ctx);
+    return fd;
+}
+
+/* public API */
+void
+hdql_fused_arith_op_def_data_destroy(hdql_Datum_t d, hdql_Context_t ctx) {
+    struct hdql_FusedArithOpDefData * fd = (struct hdql_FusedArithOpDefData *) d;
+    for(size_t i = 0; i < fd->nLeaves; ++i) {
+        if(fd->leaves[i]) hdql_query_destroy(fd->leaves[i], ctx);
+    }
+    hdql_context_free(ctx, (hdql_Datum_t) fd->leaves);
+    hdql_context_free(ctx, (hdql_Datum_t) fd->instructions);
+    hdql_context_free(ctx, d);
+}
+
+/* public API */
+hdql_Datum_t
+hdql_fused_arith_op_def_data_copy( const struct hdql_Datum * d
+                                 , struct hdql_QueryCloneState * cs
+                                 , hdql_Context_t ctx
+                                 ) {
+    const struct hdql_FusedArithOpDefData * orig
+            = (const struct hdql_FusedArithOpDefData *) d;
+    struct hdql_FusedArithOpDefData * fd
+            = _fused_arith_op_def_data_alloc(orig->nLeaves, orig->nInstructions, ctx);
+    if(!fd) return NULL;
+    memcpy(fd->instructions, orig->instructions
+            , sizeof(struct hdql_FusedArithInstruction)*orig->nInstructions);
+    fd->nInstructions = orig->nInstructions;
+    fd->nHoisted = orig->nHoisted;
+    fd->collectionLeaf = orig->collectionLeaf;
+    fd->resultSlot = orig->resultSlot;
+    memset(fd->leaves, 0x0, sizeof(struct hdql_Query *)*orig->nLeaves);
+    fd->nLeaves = orig->nLeaves;
+    for(size_t i = 0; i < orig->nLeaves; ++i) {
+        if(NULL != (fd->leaves[i] = hdql_query_clone_with(orig->leaves[i], cs, ctx)))
+            continue;
+        hdql_fused_arith_op_def_data_destroy((hdql_Datum_t) fd, ctx);
+        return NULL;
+    }
+    return (hdql_Datum_t) fd;
+}
+
+/*                                                  __________________________
+ * _______________________________________________/ Evaluation of instructions
+ */
+
+struct FusedArithOpState {
+    /* leaf results, intermediate values and trailing NULL */
+    hdql_Datum_t * slots;
+    /* scalar leaves to be re-set with owner (all but static constants) */
+    size_t * dynamicLeaves;
+    size_t nDynamicLeaves;
+};
+
+static void
+_fused_arith_op_state_free( const struct hdql_FusedArithOpDefData *
+                          , struct FusedArithOpState *
+                          , hdql_Context_t );
+
+static struct FusedArithOpState *
+_fused_arith_op_state_create( const struct hdql_FusedArithOpDefData * fd
+                            , struct FusedArithOpState * state
+                            , hdql_Context_t ctx
+                            ) {
+    const size_t nSlots = fd->nLeaves + fd->nInstructions;
+    state->slots = (hdql_Datum_t *) hdql_context_alloc(ctx, sizeof(hdql_Datum_t)*(nSlots + 1));
+    if(!state->slots) return NULL;
+    memset(state->slots, 0x0, sizeof(hdql_Datum_t)*(nSlots + 1));
+    state->dynamicLeaves = (size_t *) hdql_context_alloc(ctx, sizeof(size_t)*(fd->nLeaves + 1));
+    if(!state->dynamicLeaves) {
+        hdql_context_free(ctx, (hdql_Datum_t) state->slots);
+        return NULL;
+    }
+    state->nDynamicLeaves = 0;
+    for(size_t i = 0; i < fd->nLeaves; ++i) {
+        if(i == fd->collectionLeaf) continue;
+        const struct hdql_AttrDef * ad = hdql_query_get_subject(fd->leaves[i]);
+        if( hdql_query_next_query(fd->leaves[i])
+         || !hdql_attr_def_is_static_const_value(ad) ) {
+            state->dynamicLeaves[state->nDynamicLeaves++] = i;
+            continue;
+        }
+        state->slots[i] = (hdql_Datum_t) hdql_attr_def_get_static_value(ad);
+    }
+    for(size_t i = 0; i < fd->nInstructions; ++i) {
+        const struct hdql_FusedArithInstruction * ins = fd->instructions + i;
+        state->slots[ins->r] = hdql_create_value(ins->evaluator->returnType, ctx);
+        if(!state->slots[ins->r]) {
+            _fused_arith_op_state_free(fd, state, ctx);
+            return NULL;
+        }
+    }
+    return state;
+}
+
+static void
+_fused_arith_op_state_free( const struct hdql_FusedArithOpDefData * fd
+                          , struct FusedArithOpState * state
+                          , hdql_Context_t ctx
+                          ) {
+    for(size_t i = 0; i < fd->nInstructions; ++i) {
+        const struct hdql_FusedArithInstruction * ins = fd->instructions + i;
+        if(state->slots[ins->r])
+            hdql_destroy_value(ins->evaluator->returnType, state->slots[ins->r], ctx);
+    }
+    hdql_context_free(ctx, (hdql_Datum_t) state->slots);
+    hdql_context_free(ctx, (hdql_Datum_t) state->dynamicLeaves);
+}
+
+/* Re-sets scalar leaves (except for static ones), returns false if any of
+ * them has no value */
+static bool
+_fused_arith_op_reset_scalar_leaves( const struct hdql_FusedArithOpDefData * fd
+                                   , struct FusedArithOpState * state
+                                   , hdql_Datum_t newOwner
+                                   , hdql_Context_t ctx
+                                   ) {
+    bool hasValues = true;
+    for(size_t n = 0; n < state->nDynamicLeaves; ++n) {
+        const size_t i = state->dynamicLeaves[n];
+        state->slots[i] = hdql_query_reset(fd->leaves[i], newOwner, NULL, ctx);
+        if(!state->slots[i]) hasValues = false;
+    }
+    return hasValues;
+}
+
+static void
+_fused_arith_op_run( const struct hdql_FusedArithInstruction * ins
+                   , const struct hdql_FusedArithInstruction * end
+                   , hdql_Datum_t * slots
+                   , hdql_Context_t ctx
+                   ) {
+    for( ; ins != end; ++ins ) {
+        int rc = ins->evaluator->op(slots[ins->a], slots[ins->b], slots[ins->r]);
+        if(0 == rc) continue;
+        hdql_context_err_push( ctx, HDQL_ERR_ARITH_OPERATION
+                             , "Arithmetic error (%d) on operation %p:%p"
+                             , rc, ins->evaluator, ins->evaluator->op
+                             );
+    }
+}
+
+/*                                                      ______________________
+ * ___________________________________________________/ Scalar fused operation
+ */
+
+static hdql_Datum_t
+_fused_arith_op_scalar_instantiate( hdql_Datum_t ownerDatum
+                                  , const struct hdql_Datum * defData_
+                                  , hdql_Context_t ctx
+                                  ) {
+    const struct hdql_FusedArithOpDefData * fd
+            = (const struct hdql_FusedArithOpDefData *) defData_;
+    struct FusedArithOpState * state = hdql_alloc(ctx, struct FusedArithOpState);
+    if(!state) return NULL;
+    if(!_fused_arith_op_state_create(fd, state, ctx)) {
+        hdql_context_free(ctx, (hdql_Datum_t) state);
+        return NULL;
+    }
+    return (hdql_Datum_t) state;
+}
+
+static hdql_Datum_t
+_fused_arith_op_scalar_reset( hdql_Datum_t newOwner
+                            , hdql_Datum_t state_
+                            , const struct hdql_Datum * defData_
+                            , struct hdql_Key * key
+                            , hdql_Context_t ctx
+                            ) {
+    assert(state_);
+    const struct hdql_FusedArithOpDefData * fd
+            = (const struct hdql_FusedArithOpDefData *) defData_;
+    struct FusedArithOpState * state = (struct FusedArithOpState *) state_;
+    if(!_fused_arith_op_reset_scalar_leaves(fd, state, newOwner, ctx)) return NULL;
+    _fused_arith_op_run( fd->instructions, fd->instructions + fd->nInstructions
+                       , state->slots, ctx );
+    return state->slots[fd->resultSlot];
+}
+
+static void
+_fused_arith_op_scalar_destroy( hdql_Datum_t state_
+                              , const struct hdql_Datum * defData_
+                              , hdql_Context_t ctx
+                              ) {
+    if(NULL == state_) return;
+    _fused_arith_op_state_free( (const struct hdql_FusedArithOpDefData *) defData_
+                              , (struct FusedArithOpState *) state_, ctx );
+    hdql_context_free(ctx, state_);
+}
+
+const struct hdql_ScalarAttrInterface _hdql_gScalarFusedArithOpIFace = {
+    .definitionData = NULL,
+    .new_dyn_data = _fused_arith_op_scalar_instantiate,
+    .reset = _fused_arith_op_scalar_reset,
+    .destroy_dyn_data = _fused_arith_op_scalar_destroy,
+};
+
+/*                                                  __________________________
+ * _______________________________________________/ Collection fused operation
+ */
+
+/* State of batched evaluation: when all the instructions depending on
+ * collection leaf provide batched evaluators, collection values are
+ * prefetched and instructions are applied to the whole buffers */
+struct FusedArithOpBatch {
+    struct hdql_CollectionPrefetch * prefetch;
+    /* index of next result to return */
+    size_t nCurrent;
+    /* buffers of values of the slots depending on collection leaf (NULL
+     * for others) and their strides (zero for others) */
+    hdql_Datum_t * buffers;
+    size_t * strides;
+};
+
+struct FusedArithOpIterator {
+    struct FusedArithOpState state;
+    /* NULL if expression is not batched */
+    struct FusedArithOpBatch * batch;
+};
+
+static void
+_fused_arith_op_batch_destroy( const struct hdql_FusedArithOpDefData * fd
+                             , struct FusedArithOpBatch * b
+                             , hdql_Context_t ctx
+                             ) {
+    for(size_t i = fd->nHoisted; i < fd->nInstructions; ++i) {
+        const size_t r = fd->instructions[i].r;
+        if(b->buffers[r]) hdql_context_free(ctx, b->buffers[r]);
+    }
+    if(b->prefetch) hdql_collection_prefetch_destroy(b->prefetch, ctx);
+    hdql_context_free(ctx, (hdql_Datum_t) b->buffers);
+    hdql_context_free(ctx, (hdql_Datum_t) b->strides);
+    hdql_context_free(ctx, (hdql_Datum_t) b);
+}
+
+/* Allocates batch state if expression can be evaluated in batches
+ *
+ * Sets `*bPtr` to NULL if expression can not be batched. Returns
+ * `HDQL_ERR_MEMORY` if batch state can not be allocated. */
+static int
+_fused_arith_op_batch_create( const struct hdql_FusedArithOpDefData * fd
+                            , struct FusedArithOpBatch ** bPtr
+                            , hdql_Context_t ctx
+                            ) {
+    *bPtr = NULL;
+    const struct hdql_ValueTypes * types = hdql_context_get_types(ctx);
+    for(size_t i = fd->nHoisted; i < fd->nInstructions; ++i) {
+        const struct hdql_OperationEvaluator * e = fd->instructions[i].evaluator;
+        if(NULL == e->batchOp) return HDQL_ERR_CODE_OK;
+        const struct hdql_ValueInterface * vi = hdql_types_get_type(types, e->returnType);
+        if(NULL == vi || 0 == vi->size) return HDQL_ERR_CODE_OK;
+    }
+    if(!hdql_collection_prefetch_is_possible(fd->leaves[fd->collectionLeaf], ctx))
+        return HDQL_ERR_CODE_OK;
+    const size_t nSlots = fd->nLeaves + fd->nInstructions + 1;
+    struct FusedArithOpBatch * b = hdql_alloc(ctx, struct FusedArithOpBatch);
+    if(NULL == b) return HDQL_ERR_MEMORY;
+    b->nCurrent = 0;
+    b->buffers = (hdql_Datum_t *) hdql_context_alloc(ctx, sizeof(hdql_Datum_t)*nSlots);
+    b->strides = (size_t *) hdql_context_alloc(ctx, sizeof(size_t)*nSlots);
+    b->prefetch = NULL;
+    if(NULL == b->buffers || NULL == b->strides) {
+        if(b->buffers) hdql_context_free(ctx, (hdql_Datum_t) b->buffers);
+        if(b->strides) hdql_context_free(ctx, (hdql_Datum_t) b->strides);
+        hdql_context_free(ctx, (hdql_Datum_t) b);
+        return HDQL_ERR_MEMORY;
+    }
+    memset(b->buffers, 0x0, sizeof(hdql_Datum_t)*nSlots);
+    memset(b->strides, 0x0, sizeof(size_t)*nSlots);
+    for(size_t i = fd->nHoisted; i < fd->nInstructions; ++i) {
+        const struct hdql_FusedArithInstruction * ins = fd->instructions + i;
+        b->strides[ins->r] = hdql_types_get_type(types, ins->evaluator->returnType)->size;
+        b->buffers[ins->r] = hdql_context_alloc_as(ctx
+                , HDQL_ARITH_OP_BATCH_SIZE*b->strides[ins->r], hdql_kMemDatum);
+        if(NULL == b->buffers[ins->r]) {
+            _fused_arith_op_batch_destroy(fd, b, ctx);
+            return HDQL_ERR_MEMORY;
+        }
+    }
+    b->prefetch = hdql_collection_prefetch_create(fd->leaves[fd->collectionLeaf], ctx);
+    if(NULL == b->prefetch) {
+        _fused_arith_op_batch_destroy(fd, b, ctx);
+        return HDQL_ERR_MEMORY;
+    }
+    b->buffers[fd->collectionLeaf] = b->prefetch->values;
+    b->strides[fd->collectionLeaf] = b->prefetch->valueSize;
+    *bPtr = b;
+    return HDQL_ERR_CODE_OK;
+}
+
+/* Applies instructions depending on collection leaf to prefetched values */
+static void
+_fused_arith_op_batch_eval( const struct hdql_FusedArithOpDefData * fd
+                          , struct FusedArithOpIterator * it
+                          , hdql_Context_t ctx
+                          ) {
+    struct FusedArithOpBatch * b = it->batch;
+    hdql_Datum_t * slots = it->state.slots;
+    b->nCurrent = 0;
+    for(size_t i = fd->nHoisted; i < fd->nInstructions; ++i) {
+        const struct hdql_FusedArithInstruction * ins = fd->instructions + i;
+        int rc = ins->evaluator->batchOp(
+                  b->strides[ins->a] ? b->buffers[ins->a] : slots[ins->a], b->strides[ins->a]
+                , b->strides[ins->b] ? b->buffers[ins->b] : slots[ins->b], b->strides[ins->b]
+                , b->prefetch->nItems, b->buffers[ins->r] );
+        if(0 == rc) continue;
+        hdql_context_err_push(ctx, rc, "batched arithmetic operation error %d", rc);
+    }
+}
+
+/* Returns next evaluated result, prefetching new batch if need */
+static hdql_Datum_t
+_fused_arith_op_batch_next( const struct hdql_FusedArithOpDefData * fd
+                          , struct FusedArithOpIterator * it
+                          , struct hdql_Key * key
+                          , hdql_Context_t ctx
+                          ) {
+    struct FusedArithOpBatch * b = it->batch;
+    struct hdql_CollectionPrefetch * p = b->prefetch;
+    if(b->nCurrent == p->nItems) {
+        if(!hdql_collection_prefetch_next(p, ctx)) return NULL;
+        _fused_arith_op_batch_eval(fd, it, ctx);
+    }
+    if(key && p->withKeys) hdql_key_copy_value(key, p->keys[b->nCurrent], ctx);
+    return (hdql_Datum_t) (((char *) b->buffers[fd->resultSlot])
+                          + (b->nCurrent++)*b->strides[fd->resultSlot]);
+}
+
+static hdql_It_t
+_fused_arith_op_new_iterator( hdql_Datum_t owner
+                            , const struct hdql_Datum * defData_
+                            , hdql_Context_t ctx
+                            ) {
+    const struct hdql_FusedArithOpDefData * fd
+            = (const struct hdql_FusedArithOpDefData *) defData_;
+    assert(fd->collectionLeaf < fd->nLeaves);
+    struct FusedArithOpIterator * it = (struct FusedArithOpIterator *)
+        hdql_context_alloc_as(ctx, sizeof(struct FusedArithOpIterator), hdql_kMemIterator);
+    if(!it) return NULL;
+    if(!_fused_arith_op_state_create(fd, &it->state, ctx)) {
+        hdql_context_free(ctx, (hdql_Datum_t) it);
+        return NULL;
+    }
+    if(HDQL_ERR_CODE_OK != _fused_arith_op_batch_create(fd, &it->batch, ctx)) {
+        _fused_arith_op_state_free(fd, &it->state, ctx);
+        hdql_context_free(ctx, (hdql_Datum_t) it);
+        return NULL;
+    }
+    return (hdql_It_t) it;
+}
+
+static hdql_Datum_t
+_fused_arith_op_iterator_reset( hdql_It_t it_
+                              , hdql_Datum_t newOwner
+                              , const struct hdql_Datum * defData_
+                              , hdql_SelectionArgs_t sel
+                              , struct hdql_Key * key
+                              , hdql_Context_t ctx
+                              ) {
+    const struct hdql_FusedArithOpDefData * fd
+            = (const struct hdql_FusedArithOpDefData *) defData_;
+    struct FusedArithOpIterator * it = (struct FusedArithOpIterator *) it_;
+    if(it->batch) {
+        /* nothing to yield until collection gets prefetched */
+        it->batch->nCurrent = it->batch->prefetch->nItems = 0;
+        it->batch->prefetch->depleted = true;
+    }
+    if(!_fused_arith_op_reset_scalar_leaves(fd, &it->state, newOwner, ctx)) return NULL;
+    /* instructions not depending on collection items are evaluated once */
+    _fused_arith_op_run( fd->instructions, fd->instructions + fd->nHoisted
+                       , it->state.slots, ctx );
+    if(it->batch) {
+        if(!hdql_collection_prefetch_reset(it->batch->prefetch, newOwner, NULL != key, ctx))
+            return NULL;
+        _fused_arith_op_batch_eval(fd, it, ctx);
+        return _fused_arith_op_batch_next(fd, it, key, ctx);
+    }
+    hdql_Datum_t cr = hdql_query_reset(fd->leaves[fd->collectionLeaf], newOwner, key, ctx);
+    if(!cr) return NULL;
+    it->state.slots[fd->collectionLeaf] = cr;
+    _fused_arith_op_run( fd->instructions + fd->nHoisted
+                       , fd->instructions + fd->nInstructions
+                       , it->state.slots, ctx );
+    return it->state.slots[fd->resultSlot];
+}
+
+static hdql_Datum_t
+_fused_arith_op_yield( hdql_It_t it_
+                     , const struct hdql_Datum * defData_
+                     , struct hdql_Key * key
+                     , struct hdql_Context * ctx
+                     ) {
+    const struct hdql_FusedArithOpDefData * fd
+            = (const struct hdql_FusedArithOpDefData *) defData_;
+    struct FusedArithOpIterator * it = (struct FusedArithOpIterator *) it_;
+    if(it->batch)
+        return _fused_arith_op_batch_next(fd, it, key, ctx);
+    hdql_Datum_t cr = hdql_query_get(fd->leaves[fd->collectionLeaf], key, ctx);
+    if(!cr) return NULL;
+    it->state.slots[fd->collectionLeaf] = cr;
+    _fused_arith_op_run( fd->instructions + fd->nHoisted
+                       , fd->instructions + fd->nInstructions
+                       , it->state.slots, ctx );
+    return it->state.slots[fd->resultSlot];
+}
+
+static void
+_fused_arith_op_destroy_iterator( hdql_It_t it_
+                                , const struct hdql_Datum * defData_
+                                , hdql_Context_t ctx
+                                ) {
+    if(NULL == it_) return;
+    const struct hdql_FusedArithOpDefData * fd
+            = (const struct hdql_FusedArithOpDefData *) defData_;
+    struct FusedArithOpIterator * it = (struct FusedArithOpIterator *) it_;
+    if(it->batch) _fused_arith_op_batch_destroy(fd, it->batch, ctx);
+    _fused_arith_op_state_free(fd, &it->state, ctx);
+    hdql_context_free(ctx, (hdql_Datum_t) it_);
+}
+
+/* public API */
+int
+hdql_reserve_fused_arith_op_collection_key( struct hdql_Key * key
+                                          , const struct hdql_Datum * defData_
+                                          , hdql_Context_t ctx
+                                          ) {
+    const struct hdql_FusedArithOpDefData * fd
+            = (const struct hdql_FusedArithOpDefData *) defData_;
+    assert(fd->collectionLeaf < fd->nLeaves);
+    int rc = hdql_key_reserve_for_query(fd->leaves[fd->collectionLeaf], key, ctx);
+    if(0 != rc) {
+        hdql_context_err_push( ctx, HDQL_ERR_INTERFACE_ERROR
+                             , "Key allocation error (%d) on fused arithmetic"
+                               " expression %p", rc, fd );
+        return HDQL_ERR_INTERFACE_ERROR;
+    }
+    return HDQL_ERR_CODE_OK;
+}
+
+const struct hdql_CollectionAttrInterface _hdql_gCollectionFusedArithOpIFace = {
+      .definitionData = NULL
+    , .new_iterator = _fused_arith_op_new_iterator
+    , .yield = _fused_arith_op_yield
+    , .reset_iterator = _fused_arith_op_iterator_reset
+    , .destroy_iterator = _fused_arith_op_destroy_iterator
+    , .compile_selection = NULL
+    , .free_selection = NULL
+};
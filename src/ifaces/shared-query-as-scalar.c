@@ -0,0 +1,304 @@
+#include "hdql/attr-def.h"
+#include "hdql/context.h"
+#include "hdql/errors.h"
+#include "hdql/query.h"
+#include "hdql/internal-ifaces.h"
+#include "hdql/types.h"
+
+#include <assert.h>
+
+/* Shared query implements scalar access interface to the result of a
+ * sub-query that is referenced from multiple places within a scope. It is
+ * produced by common sub-expression elimination performed by the parser:
+ *
+ *      .hits{r := sqrt(.x*.x + .y*.y), rr := sqrt(.x*.x + .y*.y)*2 : r > 5}
+ *                 ^^^^^^^^^^^^^^^^^^^^        ^^^^^^^^^^^^^^^^^^^^
+ *
+ * Each occurrence of common sub-expression gets its own attribute definition
+ * referring to the same shared query cell. The cell keeps the sub-query and
+ * caches its result for the owner it was evaluated with, so the sub-query is
+ * evaluated once per owner. Cached result is invalidated by the scope node
+ * of the virtual compound whenever it gets re-set with new owner (see
+ * `_hdql_gSharedQueriesScopeIFace`), as owner pointer by itself does not
+ * guarantee the same data (iterators may reuse the same instance). */
+
+struct hdql_SharedQuery {
+    /* evaluated sub-query, owned */
+    struct hdql_Query * query;
+    /* number of attribute definitions and scopes referring the cell */
+    size_t nRefs;
+    /* owner the cached result was evaluated for */
+    hdql_Datum_t owner;
+    /* cached result, valid only when `isValid' is set */
+    hdql_Datum_t result;
+    bool isValid;
+};
+
+/* public API */
+struct hdql_SharedQuery *
+hdql_shared_query_create(struct hdql_Query * q, hdql_Context_t ctx) {
+    struct hdql_SharedQuery * sq = hdql_alloc(ctx, struct hdql_SharedQuery);
+    if(!sq) return NULL;
+    sq->query = q;
+    sq->nRefs = 1;
+    sq->owner = NULL;
+    sq->result = NULL;
+    sq->isValid = false;
+    return sq;
+}
+
+/* public API */
+void
+hdql_shared_query_set_query(struct hdql_SharedQuery * sq, struct hdql_Query * q) {
+    assert(sq);
+    assert(NULL == sq->query);
+    sq->query = q;
+}
+
+/* public API */
+struct hdql_Query *
+hdql_shared_query_get_query(struct hdql_SharedQuery * sq) {
+    assert(sq);
+    return sq->query;
+}
+
+/* public API */
+void
+hdql_shared_query_ref(struct hdql_SharedQuery * sq) {
+    assert(sq);
+    ++(sq->nRefs);
+}
+
+/* public API */
+void
+hdql_shared_query_unref(struct hdql_SharedQuery * sq, hdql_Context_t ctx) {
+    assert(sq);
+    assert(sq->nRefs);
+    if(--(sq->nRefs)) return;
+    if(sq->query) hdql_query_destroy(sq->query, ctx);
+    hdql_context_free(ctx, (hdql_Datum_t) sq);
+}
+
+/* public API */
+void
+hdql_shared_query_invalidate(struct hdql_SharedQuery * sq) {
+    sq->isValid = false;
+}
+
+/* public API */
+struct hdql_SharedQuery *
+hdql_shared_query_clone( const struct hdql_SharedQuery * sq
+                       , struct hdql_QueryCloneState * cs
+                       , hdql_Context_t ctx
+                       ) {
+    struct hdql_SharedQuery * copy
+        = (struct hdql_SharedQuery *) hdql_query_clone_state_find(cs, sq);
+    if(copy) {
+        hdql_shared_query_ref(copy);
+        return copy;
+    }
+    copy = hdql_shared_query_create(NULL, ctx);
+    if(!copy) return NULL;
+    if( (!(copy->query = hdql_query_clone_with(sq->query, cs, ctx)))
+     || HDQL_ERR_CODE_OK != hdql_query_clone_state_add(cs, sq, copy, ctx) ) {
+        hdql_shared_query_unref(copy, ctx);
+        return NULL;
+    }
+    return copy;
+}
+
+/*                                                 ___________________________
+ * ______________________________________________/ Shared query occurrence AD
+ */
+
+static hdql_Datum_t
+_shared_query_scalar_interface_reset(
+          hdql_Datum_t newOwner
+        , hdql_Datum_t dd_
+        , const struct hdql_Datum * defData
+        , struct hdql_Key * key
+        , hdql_Context_t ctx
+        ) {
+    struct hdql_SharedQuery * sq = (struct hdql_SharedQuery *) defData;
+    if(sq->isValid && sq->owner == newOwner) return sq->result;
+    sq->result = hdql_query_reset(sq->query, newOwner, key, ctx);
+    sq->owner = newOwner;
+    sq->isValid = true;
+    return sq->result;
+}
+
+const struct hdql_ScalarAttrInterface _hdql_gScalarSharedQueryIFace = {
+    .definitionData = NULL,  /* set to shared query cell in copies */
+    .new_dyn_data = NULL,
+    .reset = _shared_query_scalar_interface_reset,
+    .destroy_dyn_data = NULL
+};
+
+static int
+_shared_query_reserve_key(struct hdql_Key * key
+        , const struct hdql_Datum * defData
+        , hdql_Context_t ctx) {
+    const struct hdql_SharedQuery * sq = (const struct hdql_SharedQuery *) defData;
+    return hdql_attr_def_reserve_key(hdql_query_get_subject(sq->query), key, ctx);
+}
+
+static void
+_transient_dtr__shared_query(hdql_Datum_t d, hdql_Context_t ctx) {
+    hdql_shared_query_unref((struct hdql_SharedQuery *) d, ctx);
+}
+
+static hdql_Datum_t
+_transient_cpy__shared_query(const struct hdql_Datum * d
+        , struct hdql_QueryCloneState * cs, hdql_Context_t ctx) {
+    return (hdql_Datum_t) hdql_shared_query_clone(
+            (const struct hdql_SharedQuery *) d, cs, ctx);
+}
+
+/* public API */
+struct hdql_AttrDef *
+hdql_attr_def_create_shared_query( struct hdql_SharedQuery * sq
+                                 , const struct hdql_AtomicTypeFeatures * typeInfo
+                                 , hdql_Context_t ctx
+                                 ) {
+    struct hdql_ScalarAttrInterface iface = _hdql_gScalarSharedQueryIFace;
+    iface.definitionData = (hdql_Datum_t) sq;
+    struct hdql_AtomicTypeFeatures typeInfoCopy = *typeInfo;
+    struct hdql_AttrDef * ad = hdql_attr_def_create_atomic_scalar(
+              &typeInfoCopy, &iface, 0x0, _shared_query_reserve_key, ctx );
+    if(!ad) return NULL;
+    hdql_attr_def_set_transient(ad, _transient_dtr__shared_query);
+    hdql_attr_def_set_transient_copy(ad, _transient_cpy__shared_query);
+    hdql_shared_query_ref(sq);
+    return ad;
+}
+
+/*                                             _______________________________
+ * __________________________________________/ Scope invalidating shared query
+ */
+
+/* public API */
+hdql_Datum_t
+hdql_shared_queries_scope_definition_data_init( struct hdql_Query * filterQuery
+        , struct hdql_SharedQuery ** sqs
+        , size_t nSharedQueries
+        , hdql_Context_t ctx
+        ) {
+    struct hdql_SharedQueriesScopeDefData * dd
+            = hdql_alloc(ctx, struct hdql_SharedQueriesScopeDefData);
+    if(!dd) return NULL;
+    dd->sharedQueries = (struct hdql_SharedQuery **) hdql_context_alloc(ctx
+            , nSharedQueries*sizeof(struct hdql_SharedQuery *));
+    if(!dd->sharedQueries) {
+        hdql_context_free(ctx, (hdql_Datum_t) dd);
+        return NULL;
+    }
+    dd->filterQuery = filterQuery;
+    dd->nSharedQueries = nSharedQueries;
+    for(size_t i = 0; i < nSharedQueries; ++i) {
+        dd->sharedQueries[i] = sqs[i];
+        hdql_shared_query_ref(sqs[i]);
+    }
+    return (hdql_Datum_t) dd;
+}
+
+/* public API */
+void
+hdql_shared_queries_scope_definition_data_destroy(hdql_Datum_t dd_, hdql_Context_t ctx) {
+    struct hdql_SharedQueriesScopeDefData * dd
+            = (struct hdql_SharedQueriesScopeDefData *) dd_;
+    if(dd->filterQuery)
+        hdql_query_destroy(dd->filterQuery, ctx);
+    for(size_t i = 0; i < dd->nSharedQueries; ++i) {
+        hdql_shared_query_unref(dd->sharedQueries[i], ctx);
+    }
+    if(dd->sharedQueries)
+        hdql_context_free(ctx, (hdql_Datum_t) dd->sharedQueries);
+    hdql_context_free(ctx, dd_);
+}
+
+/* public API */
+hdql_Datum_t
+hdql_shared_queries_scope_definition_data_copy(const struct hdql_Datum * dd_
+        , struct hdql_QueryCloneState * cs
+        , hdql_Context_t ctx
+        ) {
+    const struct hdql_SharedQueriesScopeDefData * dd
+            = (const struct hdql_SharedQueriesScopeDefData *) dd_;
+    struct hdql_SharedQueriesScopeDefData * copy
+            = hdql_alloc(ctx, struct hdql_SharedQueriesScopeDefData);
+    if(!copy) return NULL;
+    copy->filterQuery = NULL;
+    copy->nSharedQueries = 0;
+    copy->sharedQueries = (struct hdql_SharedQuery **) hdql_context_alloc(ctx
+            , dd->nSharedQueries*sizeof(struct hdql_SharedQuery *));
+    if( (!copy->sharedQueries)
+     || (dd->filterQuery && !(copy->filterQuery = hdql_query_clone_with(dd->filterQuery, cs, ctx)))
+      ) {
+        hdql_shared_queries_scope_definition_data_destroy((hdql_Datum_t) copy, ctx);
+        return NULL;
+    }
+    for(; copy->nSharedQueries < dd->nSharedQueries; ++(copy->nSharedQueries)) {
+        struct hdql_SharedQuery * sq = hdql_shared_query_clone(
+                dd->sharedQueries[copy->nSharedQueries], cs, ctx);
+        if(!sq) {
+            hdql_shared_queries_scope_definition_data_destroy((hdql_Datum_t) copy, ctx);
+            return NULL;
+        }
+        copy->sharedQueries[copy->nSharedQueries] = sq;
+    }
+    return (hdql_Datum_t) copy;
+}
+
+/* Filtering is delegated to `_hdql_gFilteredCompoundIFace'; for scopes
+ * without filter, dynamic data callbacks are omitted in the interface copy */
+
+static hdql_Datum_t
+_shared_queries_scope_interface_instantiate(
+          hdql_Datum_t ownerDatum
+        , const struct hdql_Datum * defData_
+        , hdql_Context_t ctx
+        ) {
+    const struct hdql_SharedQueriesScopeDefData * dd
+            = (const struct hdql_SharedQueriesScopeDefData *) defData_;
+    assert(dd->filterQuery);
+    return _hdql_gFilteredCompoundIFace.new_dyn_data(ownerDatum
+            , (const struct hdql_Datum *) dd->filterQuery, ctx);
+}
+
+static hdql_Datum_t
+_shared_queries_scope_interface_reset(
+          hdql_Datum_t newOwner
+        , hdql_Datum_t s_
+        , const struct hdql_Datum * defData_
+        , struct hdql_Key * key
+        , hdql_Context_t ctx
+        ) {
+    const struct hdql_SharedQueriesScopeDefData * dd
+            = (const struct hdql_SharedQueriesScopeDefData *) defData_;
+    for(size_t i = 0; i < dd->nSharedQueries; ++i) {
+        hdql_shared_query_invalidate(dd->sharedQueries[i]);
+    }
+    if(!dd->filterQuery) return newOwner;
+    return _hdql_gFilteredCompoundIFace.reset(newOwner, s_
+            , (const struct hdql_Datum *) dd->filterQuery, key, ctx);
+}
+
+static void
+_shared_queries_scope_interface_destroy(
+          hdql_Datum_t s_
+        , const struct hdql_Datum * defData_
+        , hdql_Context_t ctx
+        ) {
+    const struct hdql_SharedQueriesScopeDefData * dd
+            = (const struct hdql_SharedQueriesScopeDefData *) defData_;
+    if(!(dd->filterQuery && s_)) return;
+    _hdql_gFilteredCompoundIFace.destroy_dyn_data(s_
+            , (const struct hdql_Datum *) dd->filterQuery, ctx);
+}
+
+const struct hdql_ScalarAttrInterface _hdql_gSharedQueriesScopeIFace = {
+    .definitionData = NULL,  /* set to `hdql_SharedQueriesScopeDefData' in copies */
+    .new_dyn_data = _shared_queries_scope_interface_instantiate,
+    .reset = _shared_queries_scope_interface_reset,
+    .destroy_dyn_data = _shared_queries_scope_interface_destroy,
+};
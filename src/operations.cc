@@ -14,6 +14,7 @@
 #include <stdexcept>
 #include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #include <cassert>
 #include <cstring>
@@ -21,6 +22,14 @@
 #include <cmath>
 #include <cstdint>
 
+#if defined(__AVX__) || defined(__AVX2__)
+#   include <immintrin.h>
+#elif defined(__SSE4_1__)
+#   include <smmintrin.h>
+#elif defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
 namespace hdql {
 
 //
@@ -219,6 +228,7 @@ hdql_converters_add_std(hdql_Converters *cnvs, hdql_ValueTypes * vts, hdql_Conte
     #undef _M_add_atomic_to_str_conversion
 
     #undef _M_add_conversion_implem
+    hdql_converters_freeze(cnvs);
 }
 
 // -- implement binary arithmetic ---------------------------------------------
@@ -246,6 +256,218 @@ _M_EXPAND(_M_for_each_numerical_type(_M_for_each_numerical_type__, _M_implement_
 #undef _M_implement_arith_ops
 #undef _M_implement_arith_op
 
+// -- implement batched binary arithmetic -------------------------------------
+//
+// Kernels evaluate operation over arrays of operands (see
+// `hdql_ArithOpBatchCallback_t`). Packed arrays of same-typed operands are
+// processed with SIMD instructions if available, remaining elements and
+// mixed types are processed element-wise.
+
+#define _M_implement_arith_op_tag(op, sign, ...) \
+    struct ArithOp ## op { \
+        template<typename T1, typename T2> static auto \
+        apply(T1 a, T2 b) -> decltype(a sign b) { return a sign b; } \
+        template<typename VecT> static auto \
+        apply_v(typename VecT::V a, typename VecT::V b) -> decltype(VecT::op(a, b)) { return VecT::op(a, b); } \
+    };
+_M_for_every_binary_arith_op(_M_implement_arith_op_tag)
+#undef _M_implement_arith_op_tag
+
+// SIMD vector traits, specialized for available instruction sets
+template<typename T> struct SIMDVec;
+
+#if defined(__AVX__)
+template<> struct SIMDVec<double> {
+    typedef __m256d V;
+    static constexpr size_t width = 4;
+    static V load(const double * p) { return _mm256_loadu_pd(p); }
+    static V set1(double v) { return _mm256_set1_pd(v); }
+    static void store(double * p, V v) { _mm256_storeu_pd(p, v); }
+    static V Sum(V a, V b)     { return _mm256_add_pd(a, b); }
+    static V Minus(V a, V b)   { return _mm256_sub_pd(a, b); }
+    static V Product(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V Divide(V a, V b)  { return _mm256_div_pd(a, b); }
+};
+template<> struct SIMDVec<float> {
+    typedef __m256 V;
+    static constexpr size_t width = 8;
+    static V load(const float * p) { return _mm256_loadu_ps(p); }
+    static V set1(float v) { return _mm256_set1_ps(v); }
+    static void store(float * p, V v) { _mm256_storeu_ps(p, v); }
+    static V Sum(V a, V b)     { return _mm256_add_ps(a, b); }
+    static V Minus(V a, V b)   { return _mm256_sub_ps(a, b); }
+    static V Product(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V Divide(V a, V b)  { return _mm256_div_ps(a, b); }
+};
+#elif defined(__SSE2__)
+template<> struct SIMDVec<double> {
+    typedef __m128d V;
+    static constexpr size_t width = 2;
+    static V load(const double * p) { return _mm_loadu_pd(p); }
+    static V set1(double v) { return _mm_set1_pd(v); }
+    static void store(double * p, V v) { _mm_storeu_pd(p, v); }
+    static V Sum(V a, V b)     { return _mm_add_pd(a, b); }
+    static V Minus(V a, V b)   { return _mm_sub_pd(a, b); }
+    static V Product(V a, V b) { return _mm_mul_pd(a, b); }
+    static V Divide(V a, V b)  { return _mm_div_pd(a, b); }
+};
+template<> struct SIMDVec<float> {
+    typedef __m128 V;
+    static constexpr size_t width = 4;
+    static V load(const float * p) { return _mm_loadu_ps(p); }
+    static V set1(float v) { return _mm_set1_ps(v); }
+    static void store(float * p, V v) { _mm_storeu_ps(p, v); }
+    static V Sum(V a, V b)     { return _mm_add_ps(a, b); }
+    static V Minus(V a, V b)   { return _mm_sub_ps(a, b); }
+    static V Product(V a, V b) { return _mm_mul_ps(a, b); }
+    static V Divide(V a, V b)  { return _mm_div_ps(a, b); }
+};
+#endif
+
+// (integer vectors wrap around on overflow, as signed overflow is undefined
+// for element-wise evaluation, results are same for the defined cases)
+#if defined(__AVX2__)
+template<typename T> struct SIMDIntVec {
+    typedef __m256i V;
+    static constexpr size_t width = 32/sizeof(T);
+    static V load(const T * p) { return _mm256_loadu_si256(reinterpret_cast<const V *>(p)); }
+    static void store(T * p, V v) { _mm256_storeu_si256(reinterpret_cast<V *>(p), v); }
+};
+template<typename T> struct SIMDInt32Vec : public SIMDIntVec<T> {
+    typedef __m256i V;
+    static V set1(T v) { return _mm256_set1_epi32(v); }
+    static V Sum(V a, V b)     { return _mm256_add_epi32(a, b); }
+    static V Minus(V a, V b)   { return _mm256_sub_epi32(a, b); }
+    static V Product(V a, V b) { return _mm256_mullo_epi32(a, b); }
+};
+template<typename T> struct SIMDInt64Vec : public SIMDIntVec<T> {
+    typedef __m256i V;
+    static V set1(T v) { return _mm256_set1_epi64x(v); }
+    static V Sum(V a, V b)     { return _mm256_add_epi64(a, b); }
+    static V Minus(V a, V b)   { return _mm256_sub_epi64(a, b); }
+};
+#elif defined(__SSE2__)
+template<typename T> struct SIMDIntVec {
+    typedef __m128i V;
+    static constexpr size_t width = 16/sizeof(T);
+    static V load(const T * p) { return _mm_loadu_si128(reinterpret_cast<const V *>(p)); }
+    static void store(T * p, V v) { _mm_storeu_si128(reinterpret_cast<V *>(p), v); }
+};
+template<typename T> struct SIMDInt32Vec : public SIMDIntVec<T> {
+    typedef __m128i V;
+    static V set1(T v) { return _mm_set1_epi32(v); }
+    static V Sum(V a, V b)     { return _mm_add_epi32(a, b); }
+    static V Minus(V a, V b)   { return _mm_sub_epi32(a, b); }
+    #if defined(__SSE4_1__)
+    static V Product(V a, V b) { return _mm_mullo_epi32(a, b); }
+    #endif
+};
+template<typename T> struct SIMDInt64Vec : public SIMDIntVec<T> {
+    typedef __m128i V;
+    static V set1(T v) { return _mm_set1_epi64x(v); }
+    static V Sum(V a, V b)     { return _mm_add_epi64(a, b); }
+    static V Minus(V a, V b)   { return _mm_sub_epi64(a, b); }
+};
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+template<> struct SIMDVec<int32_t>  : public SIMDInt32Vec<int32_t>  {};
+template<> struct SIMDVec<uint32_t> : public SIMDInt32Vec<uint32_t> {};
+template<> struct SIMDVec<int64_t>  : public SIMDInt64Vec<int64_t>  {};
+template<> struct SIMDVec<uint64_t> : public SIMDInt64Vec<uint64_t> {};
+#endif
+
+// Set if operation is vectorized for the type
+template<typename T, typename OpT, typename EnableT=void>
+struct HasSIMDOp : public std::false_type {};
+
+template<typename T, typename OpT>
+struct HasSIMDOp< T, OpT
+                , decltype((void) OpT::template apply_v<SIMDVec<T>>(
+                        std::declval<typename SIMDVec<T>::V>(), std::declval<typename SIMDVec<T>::V>()))
+                > : public std::true_type {};
+
+template<typename T>
+static inline T
+_load_unaligned(const char * p) {
+    T v;
+    memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+// Processes leading part of packed or broadcast operand arrays with SIMD
+// instructions, returns number of processed elements
+template<typename T1, typename T2, typename OpT, typename EnableT=void>
+struct VectorizedArithOp {
+    static size_t
+    run(const char *, size_t, const char *, size_t, size_t, void *) { return 0; }
+};
+
+template<typename T, typename OpT>
+struct VectorizedArithOp<T, T, OpT, typename std::enable_if<HasSIMDOp<T, OpT>::value>::type> {
+    typedef SIMDVec<T> Vec;
+    static size_t
+    run( const char * a_, size_t aStride, const char * b_, size_t bStride
+       , size_t n, void * r_ ) {
+        const T * a = reinterpret_cast<const T *>(a_)
+              , * b = reinterpret_cast<const T *>(b_);
+        T * r = reinterpret_cast<T *>(r_);
+        const size_t nV = n - n % Vec::width;
+        size_t i = 0;
+        if(aStride == sizeof(T) && bStride == sizeof(T)) {
+            for(; i < nV; i += Vec::width)
+                Vec::store(r + i, OpT::template apply_v<Vec>(Vec::load(a + i), Vec::load(b + i)));
+        } else if(aStride == sizeof(T) && 0 == bStride) {
+            const typename Vec::V bv = Vec::set1(*b);
+            for(; i < nV; i += Vec::width)
+                Vec::store(r + i, OpT::template apply_v<Vec>(Vec::load(a + i), bv));
+        } else if(0 == aStride && bStride == sizeof(T)) {
+            const typename Vec::V av = Vec::set1(*a);
+            for(; i < nV; i += Vec::width)
+                Vec::store(r + i, OpT::template apply_v<Vec>(av, Vec::load(b + i)));
+        }
+        return i;
+    }
+};
+
+// Implements `hdql_ArithOpBatchCallback_t` for binary arithmetic operation
+template<typename T1, typename T2, typename OpT>
+struct BatchArithOp {
+    typedef typename ArithmeticOpTraits<T1, T2>::Result_t Result_t;
+
+    // element-wise loop; steps are known at compile time for packed and
+    // broadcast operands (negative means run-time stride)
+    template<long aStep, long bStep> static void
+    loop( const char * a, size_t aStride, const char * b, size_t bStride
+        , size_t i, size_t n, Result_t * __restrict__ r ) {
+        for(; i < n; ++i) {
+            r[i] = OpT::apply( _load_unaligned<T1>(a + i*(aStep < 0 ? aStride : aStep))
+                             , _load_unaligned<T2>(b + i*(bStep < 0 ? bStride : bStep)) );
+        }
+    }
+
+    static int
+    run( const hdql_Datum * a_, size_t aStride
+       , const hdql_Datum * b_, size_t bStride
+       , size_t n, hdql_Datum_t r_ ) {
+        assert(a_);
+        assert(b_);
+        assert(r_);
+        const char * a = reinterpret_cast<const char *>(a_)
+                 , * b = reinterpret_cast<const char *>(b_);
+        Result_t * r = reinterpret_cast<Result_t *>(r_);
+        size_t i = VectorizedArithOp<T1, T2, OpT>::run(a, aStride, b, bStride, n, r);
+        if(aStride == sizeof(T1) && bStride == sizeof(T2))
+            loop<sizeof(T1), sizeof(T2)>(a, aStride, b, bStride, i, n, r);
+        else if(aStride == sizeof(T1) && 0 == bStride)
+            loop<sizeof(T1), 0>(a, aStride, b, bStride, i, n, r);
+        else if(0 == aStride && bStride == sizeof(T2))
+            loop<0, sizeof(T2)>(a, aStride, b, bStride, i, n, r);
+        else
+            loop<-1, -1>(a, aStride, b, bStride, i, n, r);
+        return 0;
+    }
+};
+
 // -- implement binary logic --------------------------------------------------
 #define _M_for_every_binary_logic_op(m, ...) \
     m( Or,    ||, __VA_ARGS__ ) \
@@ -403,11 +625,42 @@ struct std::hash<hdql::OpKey> {
   }
 };
 
+namespace hdql {
+
+/* Frozen dense index of operations, flattened across the parent chain:
+ * evaluators are addressed by operation code and compact indexes of operand
+ * types. Index 0 is reserved for types without operations. */
+struct DenseOperations {
+    /* sum of revisions along the chain at the moment of building */
+    size_t chainRevision;
+    size_t nTypes;
+    /* compact type index by type code */
+    std::vector<uint16_t> typeIndex;
+    /* evaluators by [opCode][t1][t2] */
+    std::vector<const hdql_OperationEvaluator *> evaluators;
+};
+
+static const size_t gNOperationCodes = hdql_kUOpMinus + 1;
+
+}  // namespace hdql
+
 struct hdql_Operations : public std::unordered_map<hdql::OpKey, hdql_OperationEvaluator> {
     hdql_Operations * parent;
-    hdql_Operations(hdql_Operations * parent_) : parent(parent_) {}
+    /* incremented on every definition */
+    size_t revision;
+    /* set by `hdql_op_freeze()`, used while chain revision stays same */
+    hdql::DenseOperations * dense;
+    hdql_Operations(hdql_Operations * parent_) : parent(parent_), revision(0), dense(nullptr) {}
+    ~hdql_Operations() { delete dense; }
 };
 
+static size_t
+_hdql_op_chain_revision(const struct hdql_Operations * ops) {
+    size_t r = 0;
+    for(; ops; ops = ops->parent) r += ops->revision;
+    return r;
+}
+
 extern "C" {
 
 int
@@ -420,6 +673,7 @@ hdql_op_define( struct hdql_Operations * ops
     hdql::OpKey opKey{t1, t2, opCode};
     auto ir = ops->emplace(opKey, *evaluator);
     if(!ir.second) return -1;
+    ++ops->revision;
     return 0;
 }
 
@@ -429,6 +683,16 @@ hdql_op_get( const struct hdql_Operations * ops
         , hdql_OperationCode_t opCode
         , hdql_ValueTypeCode_t t2
         ) {
+    const hdql::DenseOperations * d = ops->dense;
+    if( d && (size_t) opCode < hdql::gNOperationCodes
+     && d->chainRevision == _hdql_op_chain_revision(ops) ) {
+        const size_t i1 = t1 < d->typeIndex.size() ? d->typeIndex[t1] : 0
+                   , i2 = t2 < d->typeIndex.size() ? d->typeIndex[t2] : 0
+                   ;
+        return d->evaluators[(opCode*d->nTypes + i1)*d->nTypes + i2];
+    }
+    /* descendant without own definitions -- rely on parent's index */
+    if(ops->empty() && ops->parent) return hdql_op_get(ops->parent, t1, opCode, t2);
     hdql::OpKey opKey{t1, t2, opCode};
     auto it = ops->find(opKey);
     if(ops->end() != it) return &(it->second);
@@ -436,6 +700,36 @@ hdql_op_get( const struct hdql_Operations * ops
     return NULL;
 }
 
+int
+hdql_op_freeze(struct hdql_Operations * ops) {
+    /* collect definitions from root to this table, so descendants' ones
+     * override */
+    std::vector<const hdql_Operations *> chain;
+    for(const hdql_Operations * o = ops; o; o = o->parent) chain.push_back(o);
+    hdql::DenseOperations * d = new hdql::DenseOperations;
+    d->chainRevision = _hdql_op_chain_revision(ops);
+    d->nTypes = 1;
+    for(auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        for(const auto & p : **it) {
+            for(hdql_ValueTypeCode_t t : {p.first.t1, p.first.t2}) {
+                if(d->typeIndex.size() <= t) d->typeIndex.resize(t + 1, 0);
+                if(!d->typeIndex[t]) d->typeIndex[t] = d->nTypes++;
+            }
+        }
+    }
+    d->evaluators.assign(hdql::gNOperationCodes*d->nTypes*d->nTypes, nullptr);
+    for(auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        for(const auto & p : **it) {
+            if((size_t) p.first.opCode >= hdql::gNOperationCodes) continue;
+            d->evaluators[ (p.first.opCode*d->nTypes + d->typeIndex[p.first.t1])*d->nTypes
+                         + d->typeIndex[p.first.t2] ] = &p.second;
+        }
+    }
+    delete ops->dense;
+    ops->dense = d;
+    return 0;
+}
+
 int
 hdql_op_define_std_arith( struct hdql_Operations * operations
                         , struct hdql_ValueTypes * types
@@ -459,7 +753,8 @@ hdql_op_define_std_arith( struct hdql_Operations * operations
                                              , hdql::DynamicTraits<t2>::tCode   \
                                              , hdql_kOp ## op}                  \
                                 , hdql_OperationEvaluator{ hdql::DynamicTraits<hdql::ArithmeticOpTraits<t1, t2>::Result_t>::tCode \
-                                    , hdql:: _ ## t1 ## _ ## op ## _ ## t2 });  \
+                                    , hdql:: _ ## t1 ## _ ## op ## _ ## t2      \
+                                    , hdql::BatchArithOp<t1, t2, hdql::ArithOp ## op>::run });  \
         assert(ir.second);
     
     #define _M_impose_std_arith_ops_of_types(t1, t2) \
@@ -552,6 +847,8 @@ hdql_op_define_std_arith( struct hdql_Operations * operations
     _M_for_each_atomic_type(_M_impose_logic_unary_not);
     #undef _M_impose_logic_unary_not
 
+    ++operations->revision;
+    hdql_op_freeze(operations);
     return ir.second ? 0 : -1;
 }
 
@@ -572,10 +869,15 @@ hdql_scalar_arith_op_create( hdql_Query * a
                            , hdql_Context_t ctx
                            ) {
     struct ScalarOperation * scalarOp = hdql_alloc(ctx, struct ScalarOperation);
+    if(NULL == scalarOp) return NULL;
     scalarOp->argQueries[0] = a;
     scalarOp->argQueries[1] = b;
     scalarOp->evaluator = *evaluator;
     scalarOp->result = hdql_create_value(evaluator->returnType, ctx);
+    if(NULL == scalarOp->result) {
+        hdql_context_free(ctx, reinterpret_cast<hdql_Datum_t>(scalarOp));
+        return NULL;
+    }
     return reinterpret_cast<hdql_Datum_t>(scalarOp);
 }
 
@@ -587,11 +889,11 @@ hdql_scalar_arith_op_dereference( hdql_Datum_t root
                                 ) {
     struct ScalarOperation * op = hdql_cast(ctx, struct ScalarOperation, scalarOperation);
     assert(op->argQueries[0]);
-    hdql_Datum_t a, b;
+    hdql_Datum_t a, b = NULL;
     a = hdql_query_reset(op->argQueries[0], root, hdql_key_get_list_item(key, 0), ctx);
     if(op->argQueries[1])
         b = hdql_query_reset(op->argQueries[1], root, hdql_key_get_list_item(key, 1), ctx);
-    assert(a);
+    if(!a || (op->argQueries[1] && !b)) return NULL;
     int rc = op->evaluator.op(a, b, op->result);
     if(0 != rc) {
         hdql_context_err_push(ctx, rc, "arithmetic operation error %d", rc);  // TODO: elaborate
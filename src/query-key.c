@@ -72,8 +72,9 @@ bool hdql__key_is_terminal(const struct hdql_Key * k) {
 
 hdql_Key_t
 hdql_key_new(hdql_Context_t context) {
-    hdql_Key_t k = (hdql_Key_t) hdql_alloc(context, struct hdql_Key);
-    assert(k);
+    hdql_Key_t k = (hdql_Key_t) hdql_context_alloc_as(context
+            , sizeof(struct hdql_Key), hdql_kMemKey);
+    if(NULL == k) return NULL;
     hdql_key_mark_empty(k);
     return k;
 }
@@ -150,7 +151,8 @@ hdql_key_mark_as_list(struct hdql_Key * k, size_t n, struct hdql_Context * conte
     assert(context);
     if(k->code || k->plType) return HDQL_ERR_GENERIC;
     const size_t nb = sizeof(struct hdql_Key)*n;
-    k->pl.keysList = (struct hdql_Key *) hdql_context_alloc(context, nb);
+    k->pl.keysList = (struct hdql_Key *) hdql_context_alloc_as(context, nb, hdql_kMemKey);
+    if(NULL == k->pl.keysList) return HDQL_ERR_MEMORY;
     bzero(k->pl.keysList, nb);
     k->plType = 0x1;
     k->pl.keysList[n-1].isTerminal = 0x1;
@@ -285,7 +287,7 @@ hdql_key_reserve_for_query( struct hdql_Query * query
         cKey->code = hdql_attr_def_get_key_type_code(subj);
         if(0x0 != cKey->code) {
             const struct hdql_ValueInterface * vi = hdql_types_get_type(types, cKey->code);
-            cKey->pl.datum = hdql_context_alloc(context, vi->size);
+            cKey->pl.datum = hdql_context_alloc_as(context, vi->size, hdql_kMemKey);
             if(!cKey->pl.datum) {
                 /* TODO: cleanup */
                 hdql_context_err_push(context, HDQL_ERR_MEMORY
@@ -300,15 +302,13 @@ hdql_key_reserve_for_query( struct hdql_Query * query
             // type code for query is zero, that can be a list or null key
             rc = hdql_attr_def_reserve_key(subj, cKey, context);
             if(0 != rc) {
-                /* TODO: cleanup */
+                /* reserved part of the key is kept consistent, to be
+                 * deleted with `hdql_key_destroy()` */
                 hdql_context_err_push(context, HDQL_ERR_INTERFACE_ERROR
                         , "Attribute definition reserve method failed"
                           " to reserve key for query %p with code %d"
                         , query, rc
                         );
-                cKey->plType = KEY_PL_TYPE_LIST;
-                bzero(&cKey->pl, sizeof(cKey->pl));
-                cKey->isTerminal = 0x1;
                 return HDQL_ERR_INTERFACE_ERROR;
             }
         }  /* TODO: consider union key here? */
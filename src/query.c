@@ -8,8 +8,34 @@
 #include "hdql/internal-api.h"
 
 #include <assert.h>
+#include <string.h>
 
 #define HDQL_QUERY_OWNS_SUBJECT 0x1
+#define HDQL_QUERY_SHARES_SELECTION 0x2
+
+#ifndef HDQL_QUERY_BATCH_SIZE
+/* Max number of elements prefetched by collection interface's
+ * `yield_batch()` */
+#   define HDQL_QUERY_BATCH_SIZE 64
+#endif
+
+/* Elements prefetched from collection supporting batched yield
+ *
+ * Allocated on first advance of the collection query which interface
+ * provides `yield_batch()`. Per-element keys are allocated only when query is
+ * advanced with (datum) key. */
+struct hdql_QueryBatch {
+    /* number of buffered elements and index of next one to return */
+    size_t nItems, nCurrent;
+    /* buffered elements */
+    hdql_Datum_t items[HDQL_QUERY_BATCH_SIZE];
+    /* keys of buffered elements, can be NULL */
+    struct hdql_Key ** keys;
+    /* size of key datum, used to copy keys */
+    size_t keySize;
+};
+
+struct hdql_QueryPlan;  /* fwd */
 
 /* A chain link -- runtime state of the elements selection, a double-linked
  * list of iterators.
@@ -29,7 +55,7 @@ struct hdql_Query {
     const struct hdql_AttrDef * ad;
     /* when HDQL_QUERY_OWNS_SUBJECT set, the AD is transient and should be
      * destroyed with query */
-    unsigned int flags;  /* currentYielded, ownsSubject */
+    unsigned int flags;  /* ownsSubject, sharesSelection */
 
     /* This is actual selection state with all data mutable during query
      * lifecycle */
@@ -42,24 +68,58 @@ struct hdql_Query {
             hdql_It_t iterator;
             // internal copy of selector expression, used to create new iterators
             hdql_SelectionArgs_t selectionArgs;
+            // prefetched elements, used if iface provides `yield_batch()`
+            struct hdql_QueryBatch * batch;
         } collection;
     } state;
 
+    /* execution plan of the chain starting from this query, set by
+     * `hdql_query_finalize()` */
+    struct hdql_QueryPlan * plan;
+
     /* query label used by external API sometimes */
     char * label;
 };
 
+/* Level of the query execution plan
+ *
+ * Caches everything that is needed to reset or advance single query of the
+ * chain, so evaluation loops do not have to inspect attribute definitions. */
+struct hdql_QueryPlanLevel {
+    /* query which runtime state is steered at this level */
+    struct hdql_Query * q;
+    /* access interface of the query subject */
+    union {
+        const struct hdql_ScalarAttrInterface     * scalar;
+        const struct hdql_CollectionAttrInterface * collection;
+    } iface;
+    /* set if level is a collection */
+    unsigned int isCollection:1;
+    /* set if collection provides batched yield */
+    unsigned int hasBatchYield:1;
+};
+
+/* Immutable execution plan of the query chain
+ *
+ * Contiguous array of chain levels with pre-resolved interfaces, built once
+ * by `hdql_query_finalize()`. Level number is also an offset of the
+ * corresponding key in query's key list. */
+struct hdql_QueryPlan {
+    size_t nLevels;
+    struct hdql_QueryPlanLevel levels[];
+};
 
 /* module-local API: atomic reset of one query instance within a chain */
 static hdql_Datum_t
-hdql__query_reset( struct hdql_Query * q
+hdql__query_reset( const struct hdql_QueryPlanLevel * l
                  , hdql_Datum_t owner
                  , hdql_Key_t key
                  , hdql_Context_t context
                  ) {
+    struct hdql_Query * q = l->q;
     q->owner = owner;
-    if(hdql_attr_def_is_collection(q->ad)) {
-        const struct hdql_CollectionAttrInterface * iface = hdql_attr_def_collection_iface(q->ad);
+    if(l->isCollection) {
+        const struct hdql_CollectionAttrInterface * iface = l->iface.collection;
         /* create iterator if it was not previously created */
         if(NULL == q->state.collection.iterator) {
             /* create new iterator for the collection dereferencing subject
@@ -75,6 +135,11 @@ hdql__query_reset( struct hdql_Query * q
                 return NULL;
             }
         }
+        /* drop elements prefetched for previous owner */
+        if(q->state.collection.batch) {
+            q->state.collection.batch->nItems
+                = q->state.collection.batch->nCurrent = 0;
+        }
         /* (re)initialize iterator */
         hdql_Datum_t r = iface->reset_iterator(
                   q->state.collection.iterator
@@ -93,8 +158,7 @@ hdql__query_reset( struct hdql_Query * q
         }
         return r;
     }
-    assert(hdql_attr_def_is_scalar(q->ad));
-    const struct hdql_ScalarAttrInterface * iface = hdql_attr_def_scalar_iface(q->ad);
+    const struct hdql_ScalarAttrInterface * iface = l->iface.scalar;
     /* scalar attribute "iteration" is slightly different; instead of the
      * iterator we only return value at reset(). Still, dynamic data (cache)
      * can be defined by the scalar interface (allocated
@@ -125,47 +189,176 @@ hdql__query_reset( struct hdql_Query * q
             );
 }
 
+/* module-local API: allocates per-element keys of the batch, similar to
+ * given datum key */
+static int
+hdql__query_batch_reserve_keys( struct hdql_QueryBatch * b
+                              , const struct hdql_Key * key
+                              , hdql_Context_t context
+                              ) {
+    hdql_ValueTypeCode_t keyCode = hdql_key_datum_get_type_code(key);
+    const struct hdql_ValueInterface * vi
+            = hdql_types_get_type(hdql_context_get_types(context), keyCode);
+    if(NULL == vi) {
+        hdql_context_err_push(context, HDQL_ERR_CONTEXT_INCOMPLETE
+                , "no key type %#x in context %p, can't allocate keys for"
+                  " batched collection yield", keyCode, context );
+        return HDQL_ERR_CONTEXT_INCOMPLETE;
+    }
+    b->keySize = vi->size;
+    b->keys = (struct hdql_Key **) hdql_context_alloc_as(context
+            , HDQL_QUERY_BATCH_SIZE*sizeof(struct hdql_Key *), hdql_kMemKey);
+    if(NULL == b->keys) return HDQL_ERR_MEMORY;
+    for(size_t i = 0; i < HDQL_QUERY_BATCH_SIZE; ++i) {
+        hdql_Datum_t d = NULL;
+        if( NULL == (b->keys[i] = hdql_key_new(context))
+         || NULL == (d = hdql_context_alloc_as(context, vi->size, hdql_kMemKey)) ) {
+            /* free keys reserved so far */
+            if(b->keys[i]) hdql_key_destroy(b->keys[i], context);
+            while(i) hdql_key_destroy(b->keys[--i], context);
+            hdql_context_free(context, (hdql_Datum_t) b->keys);
+            b->keys = NULL;
+            return HDQL_ERR_MEMORY;
+        }
+        hdql_key_set_datum(b->keys[i], keyCode, d);
+    }
+    return HDQL_ERR_CODE_OK;
+}
+
+/* module-local API: advances collection with batch-capable interface
+ *
+ * Returns next element from prefetched batch, refilling it with
+ * `yield_batch()` when exhausted. Key (if given) is copied from the
+ * per-element batch key. */
 static hdql_Datum_t
-hdql__query_yield( struct hdql_Query *q
+hdql__query_yield_batched( struct hdql_Query *q
+              , const struct hdql_CollectionAttrInterface * iface
               , struct hdql_Key *key
-              , hdql_Context_t context );  /* need by reset() */
+              , hdql_Context_t context ) {
+    struct hdql_QueryBatch * b = q->state.collection.batch;
+    if(NULL == b) {
+        b = hdql_alloc(context, struct hdql_QueryBatch);
+        if(NULL == b) return NULL;
+        b->nItems = b->nCurrent = 0;
+        b->keys = NULL;
+        b->keySize = 0;
+        q->state.collection.batch = b;
+    }
+    const bool withKeys = key && hdql_key_is_datum(key);
+    if(withKeys && NULL == b->keys) {
+        if(HDQL_ERR_CODE_OK != hdql__query_batch_reserve_keys(b, key, context))
+            return NULL;
+    }
+    if(b->nCurrent == b->nItems) {
+        /* batch exhausted, prefetch next one */
+        b->nCurrent = 0;
+        b->nItems = iface->yield_batch( q->state.collection.iterator
+                , iface->definitionData
+                , b->items
+                , withKeys ? b->keys : NULL
+                , HDQL_QUERY_BATCH_SIZE
+                , context );
+        if(0 == b->nItems) return NULL;
+    }
+    if(withKeys) {
+        memcpy( hdql_key_datum_get(key)
+              , hdql_key_datum_get(b->keys[b->nCurrent])
+              , b->keySize );
+    }
+    return b->items[b->nCurrent++];
+}
+
+/* module-local API: tries to advance iterator
+ * Advances collection iterator and returns the datum of advanced element of
+ * the sequence.
+ * Returns NULL when collection depleted, or when called on a scalar.
+ *  */
+static hdql_Datum_t
+hdql__query_yield( const struct hdql_QueryPlanLevel * l
+              , struct hdql_Key *key
+              , hdql_Context_t context ) {
+    if(!l->isCollection)
+        return NULL;  /* scalars never yield, anly reset() can access its value */
+    const struct hdql_CollectionAttrInterface * iface = l->iface.collection;
+    /* batched yield is used for collections with trivial or datum keys */
+    if(l->hasBatchYield
+    && (NULL == key || hdql_key_is_datum(key) || hdql_key_is_empty(key))) {
+        return hdql__query_yield_batched(l->q, iface, key, context);
+    }
+    return iface->yield(l->q->state.collection.iterator, iface->definitionData, key, context);
+    /* ^^^ note: yield should tolerate advancing when depletion */
+}
+
+/* module-local API: initializes execution plan level steering given query */
+static void
+hdql__query_plan_level_init(struct hdql_QueryPlanLevel * l, struct hdql_Query * q) {
+    l->q = q;
+    if(hdql_attr_def_is_collection(q->ad)) {
+        l->isCollection = 0x1;
+        l->iface.collection = hdql_attr_def_collection_iface(q->ad);
+        l->hasBatchYield = l->iface.collection->yield_batch ? 0x1 : 0x0;
+    } else {
+        l->isCollection = 0x0;
+        l->iface.scalar = hdql_attr_def_scalar_iface(q->ad);
+        l->hasBatchYield = 0x0;
+    }
+}
 
-/* module-local API: reset till descendants, not the key is list bgn */
+/* public API: builds execution plan of the chain */
+int
+hdql_query_finalize(struct hdql_Query * q, hdql_Context_t context) {
+    assert(q);
+    if(q->plan) return HDQL_ERR_CODE_OK;  /* finalized already */
+    size_t nLevels = hdql_query_depth(q);
+    struct hdql_QueryPlan * plan = (struct hdql_QueryPlan *)
+        hdql_context_alloc_as(context, sizeof(struct hdql_QueryPlan)
+                + nLevels*sizeof(struct hdql_QueryPlanLevel), hdql_kMemQuery);
+    if(NULL == plan) {
+        hdql_context_err_push(context, HDQL_ERR_MEMORY
+                , "failed to allocate execution plan of %zu levels for"
+                  " query %p", nLevels, q );
+        return HDQL_ERR_MEMORY;
+    }
+    plan->nLevels = nLevels;
+    struct hdql_QueryPlanLevel * l = plan->levels;
+    for(struct hdql_Query * cq = q; cq; cq = cq->next, ++l) {
+        hdql__query_plan_level_init(l, cq);
+    }
+    q->plan = plan;
+    return HDQL_ERR_CODE_OK;
+}
+
+/* module-local API: reset chain starting from given level
+ *
+ * \p keys is the query's key list (not its begin), can be NULL. */
 static hdql_Datum_t
-hdql__query_reset_descendant(struct hdql_Query * q
+hdql__query_reset_descendant( const struct hdql_QueryPlan * p
+                , size_t i
                 , hdql_Datum_t datum
-                , hdql_Key_t key
+                , hdql_Key_t keys
                 , hdql_Context_t context
                 ) {
-    if(!q) return NULL;
-
-    struct hdql_Query *cq = q;
-    hdql_Key_t ckey = key;
+    const size_t iLast = p->nLevels - 1;
     hdql_Datum_t r = datum;
-
+    #define _M_key(n) (keys ? hdql__key_get_list_at(keys, n) : NULL)
     for(;;) {
         /* Descend as far as possible. */
-        while(cq) {
-            r = hdql__query_reset(cq, r, ckey, context);
+        for(;;) {
+            r = hdql__query_reset(p->levels + i, r, _M_key(i), context);
             if(!r) break;
-            if(!cq->next) return r;  /* full chain initialized */
-            cq = cq->next;
-            if(ckey) ckey = hdql__keys_next(ckey);
-        }
-        /* Reset failed at cq.  Climb to parent and try to advance it. */
-        while(cq) {
-            if(!cq->prev) return NULL;  /* root exhausted or initially empty */
-            cq = cq->prev;
-            if(ckey) ckey = hdql__keys_prev(ckey);
-            r = hdql__query_yield(cq, ckey, context);
-            if(r)
-                break;
+            if(i == iLast) return r;  /* full chain initialized */
+            ++i;
         }
-        /* Parent yielded a new datum.  Try descendants again. */
-        if(!cq->next) return r;
-        cq = cq->next;
-        if(ckey) ckey = hdql__keys_next(ckey);
+        /* Reset failed at i-th level. Climb to parent and try to advance it. */
+        do {
+            if(0 == i) return NULL;  /* root exhausted or initially empty */
+            --i;
+            r = hdql__query_yield(p->levels + i, _M_key(i), context);
+        } while(!r);
+        /* Parent yielded a new datum. Try descendants again. */
+        ++i;
     }
+    #undef _M_key
 }
 
 /* public API: chained reset of the query */
@@ -175,73 +368,54 @@ hdql_query_reset( struct hdql_Query * q
                 , hdql_Key_t key
                 , hdql_Context_t context
                 ) {
-    /* get pointer to key list begin */
-    if(key) {
-        assert(hdql_key_is_list(key));  /* query key must always be a list */
-        key = hdql__key_get_list_bgn(key);
-    }
-    return hdql__query_reset_descendant(q, datum, key, context);
-}
-
-
-/* module-local API: tries to advance iterator
- * Advances collection iterator and returns the datum of advanced element of
- * the sequence.
- * Returns NULL when collection depleted, or when called on a scalar.
- *  */
-static hdql_Datum_t
-hdql__query_yield( struct hdql_Query *q
-              , struct hdql_Key *key
-              , hdql_Context_t context ) {
-    if(hdql_attr_def_is_scalar(q->ad))
-        return NULL;  /* scalars never yield, anly reset() can access its value */
-    const struct hdql_CollectionAttrInterface * iface = hdql_attr_def_collection_iface(q->ad);
-    return iface->yield(q->state.collection.iterator, iface->definitionData, key, context);
-    /* ^^^ note: yield should tolerate advancing when depletion */
+    if(!q) return NULL;
+    /* query key must always be a list */
+    assert((!key) || hdql_key_is_list(key));
+    if(NULL == q->plan && HDQL_ERR_CODE_OK != hdql_query_finalize(q, context))
+        return NULL;
+    return hdql__query_reset_descendant(q->plan, 0, datum, key, context);
 }
 
 /* exported API: advance and get */
 hdql_Datum_t
 hdql_query_get( struct hdql_Query *q
-              , struct hdql_Key *key_
+              , struct hdql_Key *key
               , hdql_Context_t context
               ) {
     assert(q);
-    struct hdql_Key * key = key_ ? hdql__key_get_list_bgn(key_) : NULL;
-    struct hdql_Query * cq = q;
+    if(NULL == q->plan && HDQL_ERR_CODE_OK != hdql_query_finalize(q, context))
+        return NULL;
+    const struct hdql_QueryPlan * p = q->plan;
+    const size_t iLast = p->nLevels - 1;
+    #define _M_key(n) (key ? hdql__key_get_list_at(key, n) : NULL)
     /* Start from terminal query and terminal key. */
-    while(cq->next) {
-        cq = cq->next;
-        if(key) key = hdql__keys_next(key);
-    }
-    /* ^^^ TODO: this fragment is repeated each call; consider caching it */
+    size_t i = iLast;
     for(;;) {
         hdql_Datum_t r = NULL;
         /* Backtrack until some iterator yields a value. */
-        while(NULL == (r = hdql__query_yield(cq, key, context))) {
-            if(NULL == cq->prev) {
+        while(NULL == (r = hdql__query_yield(p->levels + i, _M_key(i), context))) {
+            if(0 == i) {
                 return NULL;  /* whole query chain depleted */
             }
-            cq = cq->prev;
-            if(key) key = hdql__keys_prev(key);
+            --i;
         }
         /* Descend again: reset each child iterator on the value
          * yielded by its parent. */
-        while(cq->next) {
-            cq = cq->next;
-            if(key) key = hdql__keys_next(key);
-            r = hdql__query_reset(cq, r, key, context);
+        while(i < iLast) {
+            ++i;
+            r = hdql__query_reset(p->levels + i, r, _M_key(i), context);
             /* Empty child collection. Need to backtrack from this child on the
              * next outer iteration. */
             if(NULL == r) break;
         }
         /* Reached terminal query successfully. */
-        if(NULL != r && NULL == cq->next)
+        if(NULL != r && i == iLast)
             return r;
-        /* Otherwise child reset failed. Continue from current cq,
+        /* Otherwise child reset failed. Continue from current level,
          * so the next iteration will try to yield it; if depleted,
          * it will backtrack to its parent. */
     }
+    #undef _M_key
 }
 
 /* module-local API: intializes query data with attribute definition and
@@ -252,6 +426,7 @@ static void hdql__init_query(struct hdql_Query * q, const struct hdql_AttrDef *
     q->owner = NULL;
     if(hdql_attr_def_is_collection(q->ad)) {
         q->state.collection.iterator = NULL;
+        q->state.collection.batch = NULL;
         if(selexpr)
             q->state.collection.selectionArgs = selexpr;
         else
@@ -263,6 +438,7 @@ static void hdql__init_query(struct hdql_Query * q, const struct hdql_AttrDef *
     q->next = NULL;
     q->prev = NULL;
     q->flags = 0x0;
+    q->plan = NULL;
     q->label = NULL;
 }
 
@@ -273,7 +449,9 @@ hdql_query_create(
         , hdql_SelectionArgs_t selArgs
         , hdql_Context_t context
         ) {
-    struct hdql_Query * q = (struct hdql_Query *) hdql_context_alloc(context, sizeof(struct hdql_Query));
+    struct hdql_Query * q = (struct hdql_Query *) hdql_context_alloc_as(context
+            , sizeof(struct hdql_Query), hdql_kMemQuery);
+    if(NULL == q) return NULL;
     hdql__init_query(q, attrDef, selArgs);
     return q;
 }
@@ -305,7 +483,18 @@ hdql__query_destroy(struct hdql_Query * q, struct hdql_Context * context) {
                     , iface->definitionData, context );
             q->state.collection.iterator = NULL;
         }
-        if(q->state.collection.selectionArgs) {
+        if(q->state.collection.batch) {
+            struct hdql_QueryBatch * b = q->state.collection.batch;
+            if(b->keys) {
+                for(size_t i = 0; i < HDQL_QUERY_BATCH_SIZE; ++i)
+                    hdql_key_destroy(b->keys[i], context);
+                hdql_context_free(context, (hdql_Datum_t) b->keys);
+            }
+            hdql_context_free(context, (hdql_Datum_t) b);
+            q->state.collection.batch = NULL;
+        }
+        if( q->state.collection.selectionArgs
+        && !(q->flags & HDQL_QUERY_SHARES_SELECTION) ) {
             if(!hdql__attr_def_is_fwd_query(q->ad)) {
                 assert(iface->free_selection);
                 iface->free_selection( iface->definitionData
@@ -335,6 +524,8 @@ hdql_query_destroy(struct hdql_Query * q, hdql_Context_t context) {
     assert(q);
     if(q->label)
         hdql_context_free(context, (hdql_Datum_t)q->label);
+    if(q->plan)
+        hdql_context_free(context, (hdql_Datum_t)q->plan);
     hdql__query_destroy(q, context);
     hdql_context_free(context, (hdql_Datum_t)(q));
 }
@@ -346,12 +537,208 @@ hdql_query_append(
         , struct hdql_Query * next
         ) {
     struct hdql_Query * root = current;
+    assert(NULL == root->plan);  /* chain is finalized already */
     while(NULL != current->next) current = (struct hdql_Query*) current->next;
     current->next = next;
     next->prev = current;
     return root;
 }
 
+/*
+ * Query cloning
+ */
+
+/* Original-to-copy pair of virtual compound or its attribute definition */
+struct hdql_QueryClonePair {
+    const void * orig;
+    void * copy;
+};
+
+struct hdql_QueryCloneState {
+    struct hdql_QueryClonePair * pairs;
+    size_t nPairs, nPairsAllocated;
+};
+
+/* public API */
+void *
+hdql_query_clone_state_find(struct hdql_QueryCloneState * cs, const void * orig) {
+    for(size_t i = 0; i < cs->nPairs; ++i) {
+        if(cs->pairs[i].orig == orig) return cs->pairs[i].copy;
+    }
+    return NULL;
+}
+
+/* public API */
+int
+hdql_query_clone_state_add( struct hdql_QueryCloneState * cs
+                          , const void * orig, void * copy
+                          , hdql_Context_t context ) {
+    if(cs->nPairs == cs->nPairsAllocated) {
+        size_t nAllocated = cs->nPairsAllocated ? 2*cs->nPairsAllocated : 8;
+        struct hdql_QueryClonePair * pairs = (struct hdql_QueryClonePair *)
+                hdql_context_alloc(context, nAllocated*sizeof(struct hdql_QueryClonePair));
+        if(!pairs) return HDQL_ERR_MEMORY;
+        if(cs->pairs) {
+            memcpy(pairs, cs->pairs, cs->nPairs*sizeof(struct hdql_QueryClonePair));
+            hdql_context_free(context, (hdql_Datum_t) cs->pairs);
+        }
+        cs->pairs = pairs;
+        cs->nPairsAllocated = nAllocated;
+    }
+    cs->pairs[cs->nPairs].orig = orig;
+    cs->pairs[cs->nPairs].copy = copy;
+    ++(cs->nPairs);
+    return HDQL_ERR_CODE_OK;
+}
+
+/* public API */
+struct hdql_Compound *
+hdql_query_clone_compound( struct hdql_Compound * c
+                         , struct hdql_QueryCloneState * cs
+                         , hdql_Context_t context
+                         ) {
+    assert(c);
+    assert(cs);
+    if(!hdql_compound_is_virtual(c)) return c;  /* static compounds are shared */
+    struct hdql_Compound * copy
+        = (struct hdql_Compound *) hdql_query_clone_state_find(cs, c);
+    if(copy) return copy;  /* cloned already */
+    struct hdql_Compound * parent = hdql_query_clone_compound(
+              (struct hdql_Compound *) hdql_virtual_compound_get_parent(c)
+            , cs, context );
+    if(!parent) return NULL;
+    copy = hdql_virtual_compound_new(parent, context);
+    if(!copy) {
+        hdql_context_err_push(context, HDQL_ERR_MEMORY
+                , "failed to create copy of virtual compound %p", c );
+        return NULL;
+    }
+    /* clone state entries added from this point refer to the copy (or its
+     * attributes) and are dropped if copying fails */
+    const size_t nPairsBefore = cs->nPairs;
+    if(HDQL_ERR_CODE_OK != hdql_query_clone_state_add(cs, c, copy, context)) {
+        hdql_context_err_push(context, HDQL_ERR_MEMORY
+                , "failed to map copy of virtual compound %p", c );
+        hdql_virtual_compound_destroy(copy, context);
+        return NULL;
+    }
+    /* copy own attributes; they are transient (forwarding or bound queries)
+     * and get mapped in clone state, so that cloned queries can refer them.
+     * Attributes are added in reverse order to reproduce the enumeration
+     * order of the original, so that keys of bound attributes
+     * are arranged identically */
+    const size_t nAttrs = hdql_compound_get_nattrs(c);
+    const char ** names = NULL;
+    if(nAttrs) {
+        names = (const char **) hdql_context_alloc(context
+                , nAttrs*sizeof(const char *));
+        if(!names) {
+            cs->nPairs = nPairsBefore;
+            hdql_virtual_compound_destroy(copy, context);
+            return NULL;
+        }
+        hdql_compound_get_attr_names(c, names);
+    }
+    for(size_t i = nAttrs; i--; ) {
+        const struct hdql_AttrDef * ad = hdql_compound_get_attr(c, names[i]);
+        assert(ad);
+        assert(hdql_attr_def_is_transient(ad));
+        struct hdql_AttrDef * adCopy = hdql_attr_def_copy_transient(ad, cs, context);
+        /* once added, the copied attribute is owned by compound copy */
+        if(adCopy && 0 != hdql_compound_add_attr(copy, names[i], adCopy)) {
+            hdql_attr_def_destroy(adCopy, context);
+            adCopy = NULL;
+        }
+        if( (!adCopy)
+         || HDQL_ERR_CODE_OK != hdql_query_clone_state_add(cs, ad, adCopy, context) ) {
+            hdql_context_err_push(context, HDQL_ERR_GENERIC
+                    , "failed to copy attribute \"%s\" of virtual compound %p"
+                    , names[i], c );
+            cs->nPairs = nPairsBefore;
+            hdql_virtual_compound_destroy(copy, context);
+            copy = NULL;
+            break;
+        }
+    }
+    if(names) hdql_context_free(context, (hdql_Datum_t) names);
+    /* compound copy is managed by context only when complete */
+    if(copy) hdql_context_add_virtual_compound(context, copy);
+    return copy;
+}
+
+/* public API */
+struct hdql_Query *
+hdql_query_clone_with( const struct hdql_Query * q
+                     , struct hdql_QueryCloneState * cs
+                     , hdql_Context_t context
+                     ) {
+    assert(q);
+    assert(cs);
+    struct hdql_Query * root = NULL;
+    for(; q; q = q->next) {
+        const struct hdql_AttrDef * ad
+            = (const struct hdql_AttrDef *) hdql_query_clone_state_find(cs, q->ad);
+        bool ownsSubject = false;
+        if(NULL == ad) {
+            if( hdql_attr_def_is_transient(q->ad)
+             && !( hdql_attr_def_is_static_const_value(q->ad)
+                || hdql_attr_def_is_static_external_value(q->ad) ) ) {
+                /* transient AD with (possibly) stateful definition data */
+                ad = hdql_attr_def_copy_transient(q->ad, cs, context);
+                ownsSubject = true;
+            } else {
+                /* static compound's attribute or static value */
+                ad = q->ad;
+            }
+        }
+        if(NULL == ad) {
+            hdql_context_err_push(context, HDQL_ERR_GENERIC
+                    , "failed to clone query %p: can't copy its subject", q );
+            if(root) hdql_query_destroy(root, context);
+            return NULL;
+        }
+        hdql_SelectionArgs_t selArgs = NULL;
+        if(hdql_attr_def_is_collection(q->ad))
+            selArgs = q->state.collection.selectionArgs;
+        struct hdql_Query * cq = hdql_query_create(ad, selArgs, context);
+        if(NULL == cq) {
+            if(ownsSubject)
+                hdql_attr_def_destroy(ad, context);
+            if(root) hdql_query_destroy(root, context);
+            return NULL;
+        }
+        if(ownsSubject) cq->flags |= HDQL_QUERY_OWNS_SUBJECT;
+        if(selArgs) cq->flags |= HDQL_QUERY_SHARES_SELECTION;
+        if(q->label) {
+            const size_t labelLen = strlen(q->label) + 1;
+            cq->label = (char *) hdql_context_alloc_as(context, labelLen, hdql_kMemQuery);
+            if(NULL == cq->label) {
+                /* destroys copied subject as well, if owned */
+                hdql_query_destroy(cq, context);
+                if(root) hdql_query_destroy(root, context);
+                return NULL;
+            }
+            memcpy(cq->label, q->label, labelLen);
+        }
+        root = root ? hdql_query_append(root, cq) : cq;
+    }
+    return root;
+}
+
+/* public API */
+struct hdql_Query *
+hdql_query_clone(const struct hdql_Query * q, hdql_Context_t context) {
+    assert(q);
+    struct hdql_QueryCloneState cs = {NULL, 0, 0};
+    struct hdql_Query * r = hdql_query_clone_with(q, &cs, context);
+    if(cs.pairs) hdql_context_free(context, (hdql_Datum_t) cs.pairs);
+    if(r && HDQL_ERR_CODE_OK != hdql_query_finalize(r, context)) {
+        hdql_query_destroy(r, context);
+        return NULL;
+    }
+    return r;
+}
+
 /* public API */
 size_t
 hdql_query_depth(struct hdql_Query * q) {
@@ -392,6 +779,38 @@ hdql_query_get_collection_selection(struct hdql_Query * q) {
     return q->state.collection.selectionArgs;
 }
 
+/* public API */
+void
+hdql_query_set_collection_selection(struct hdql_Query * q, hdql_SelectionArgs_t selArgs) {
+    assert(q->ad);
+    assert(hdql_attr_def_is_collection(q->ad));
+    assert(!q->plan);
+    q->state.collection.selectionArgs = selArgs;
+    q->flags &= ~HDQL_QUERY_SHARES_SELECTION;
+}
+
+/* public API */
+void
+hdql_query_swap_subjects(struct hdql_Query * a, struct hdql_Query * b) {
+    assert(a->ad && b->ad);
+    assert(hdql_attr_def_is_scalar(a->ad) == hdql_attr_def_is_scalar(b->ad));
+    assert(!(a->plan || b->plan));
+    if(hdql_attr_def_is_scalar(a->ad)) {
+        assert(!(a->state.scalar.dynamicSuppData || b->state.scalar.dynamicSuppData));
+    } else {
+        assert(!(a->state.collection.iterator || b->state.collection.iterator));
+        assert(!(a->state.collection.batch || b->state.collection.batch));
+        /* selection is bound to the subject's interface */
+        assert(!(a->state.collection.selectionArgs || b->state.collection.selectionArgs));
+    }
+    const struct hdql_AttrDef * ad = a->ad;
+    a->ad = b->ad;
+    b->ad = ad;
+    const unsigned int aOwns = a->flags & HDQL_QUERY_OWNS_SUBJECT;
+    a->flags = (a->flags & ~HDQL_QUERY_OWNS_SUBJECT) | (b->flags & HDQL_QUERY_OWNS_SUBJECT);
+    b->flags = (b->flags & ~HDQL_QUERY_OWNS_SUBJECT) | aOwns;
+}
+
 /* public API */
 const struct hdql_AttrDef *
 hdql_query_get_subject( const struct hdql_Query * q ) {
@@ -434,9 +853,10 @@ hdql_query_product_reserve_key(struct hdql_Query ** qs
         , size_t n
         , struct hdql_Context *context
         ) {
-    hdql_key_mark_as_list(key, n, context);
+    int rc = hdql_key_mark_as_list(key, n, context);
+    if(HDQL_ERR_CODE_OK != rc) return rc;
     for(size_t i = 0; i < n; ++i) {
-        int rc = hdql_key_reserve_for_query( qs[i]
+        rc = hdql_key_reserve_for_query( qs[i]
                 , hdql_key_get_list_item(key, i)
                 , context );
         if(HDQL_ERR_CODE_OK != rc) {
@@ -521,6 +941,180 @@ hdql_query_product_advance( struct hdql_Query **qs
     }
 }
 
+/*
+ * Query trie
+ */
+
+/* Node of the query trie
+ *
+ * Corresponds to a query (chain link) shared by all the queries which chains
+ * start with the same path. Children are kept as singly-linked list of
+ * siblings. */
+struct hdql_QueryTrieNode {
+    /* level steering (representative) query of the node */
+    struct hdql_QueryPlanLevel level;
+    /* first child and next sibling nodes */
+    struct hdql_QueryTrieNode * children, * next;
+    /* indexes of queries terminated at this node */
+    size_t * terminals;
+    size_t nTerminals;
+};
+
+struct hdql_QueryTrie {
+    /* nodes corresponding to first queries in chains */
+    struct hdql_QueryTrieNode * roots;
+    /* number of nodes in the trie */
+    size_t nNodes;
+};
+
+/* module-local API: checks whether two chain links do the same
+ *
+ * Selection arguments are opaque objects compiled by collection interface,
+ * with no means to compare their content. Links with selection are therefore
+ * merged only if they share the very same compiled selection (as query and
+ * its clones do), while separately compiled selections are never merged,
+ * even if written identically. */
+static bool
+hdql__query_trie_same_link(const struct hdql_Query * a, const struct hdql_Query * b) {
+    if(a == b) return true;
+    /* transient attribute definitions are owned by queries and never shared */
+    if(a->ad != b->ad || hdql_attr_def_is_transient(a->ad)) return false;
+    /* compiled selections are compared by identity, see above */
+    if(hdql_attr_def_is_collection(a->ad)
+     && a->state.collection.selectionArgs != b->state.collection.selectionArgs)
+        return false;
+    return true;
+}
+
+/* module-local API: finds or inserts node for given chain link among
+ * siblings */
+static struct hdql_QueryTrieNode *
+hdql__query_trie_node( struct hdql_QueryTrie * t
+                     , struct hdql_QueryTrieNode ** siblings
+                     , struct hdql_Query * q
+                     , hdql_Context_t context
+                     ) {
+    struct hdql_QueryTrieNode ** n;
+    for(n = siblings; *n; n = &((*n)->next)) {
+        if(hdql__query_trie_same_link((*n)->level.q, q)) return *n;
+    }
+    /* not found -- append new one to keep queries order */
+    *n = hdql_alloc(context, struct hdql_QueryTrieNode);
+    if(NULL == *n) return NULL;
+    hdql__query_plan_level_init(&((*n)->level), q);
+    (*n)->children = (*n)->next = NULL;
+    (*n)->terminals = NULL;
+    (*n)->nTerminals = 0;
+    ++(t->nNodes);
+    return *n;
+}
+
+/* module-local API: recursively destroys nodes */
+static void
+hdql__query_trie_nodes_destroy(struct hdql_QueryTrieNode * n, hdql_Context_t context) {
+    while(n) {
+        struct hdql_QueryTrieNode * next = n->next;
+        hdql__query_trie_nodes_destroy(n->children, context);
+        if(n->terminals)
+            hdql_context_free(context, (hdql_Datum_t) n->terminals);
+        hdql_context_free(context, (hdql_Datum_t) n);
+        n = next;
+    }
+}
+
+/* public API */
+struct hdql_QueryTrie *
+hdql_query_trie_create( struct hdql_Query ** qs
+                      , size_t nQueries
+                      , hdql_Context_t context
+                      ) {
+    struct hdql_QueryTrie * t = hdql_alloc(context, struct hdql_QueryTrie);
+    if(NULL == t) return NULL;
+    t->roots = NULL;
+    t->nNodes = 0;
+    for(size_t i = 0; i < nQueries; ++i) {
+        assert(qs[i]);
+        struct hdql_QueryTrieNode ** siblings = &(t->roots), * n = NULL;
+        for(struct hdql_Query * q = qs[i]; q; q = q->next) {
+            n = hdql__query_trie_node(t, siblings, q, context);
+            if(NULL == n) {
+                hdql_context_err_push(context, HDQL_ERR_MEMORY
+                        , "failed to allocate query trie node for query #%zu", i);
+                hdql_query_trie_destroy(t, context);
+                return NULL;
+            }
+            siblings = &(n->children);
+        }
+        /* mark query as terminated at the last node */
+        size_t * terminals = (size_t *) hdql_context_alloc_as(context
+                , (n->nTerminals + 1)*sizeof(size_t), hdql_kMemQuery);
+        if(NULL == terminals) {
+            hdql_context_err_push(context, HDQL_ERR_MEMORY
+                    , "failed to allocate query trie terminals for query #%zu", i);
+            hdql_query_trie_destroy(t, context);
+            return NULL;
+        }
+        if(n->terminals) {
+            memcpy(terminals, n->terminals, n->nTerminals*sizeof(size_t));
+            hdql_context_free(context, (hdql_Datum_t) n->terminals);
+        }
+        terminals[n->nTerminals++] = i;
+        n->terminals = terminals;
+    }
+    return t;
+}
+
+/* public API */
+size_t
+hdql_query_trie_n_nodes(const struct hdql_QueryTrie * t) {
+    return t->nNodes;
+}
+
+/* module-local API: iterates node on owner, dispatching results to terminals
+ * and children */
+static int
+hdql__query_trie_process( const struct hdql_QueryTrieNode * n
+                        , hdql_Datum_t owner
+                        , hdql_QueryTrieResultCallback_t callback
+                        , void * userdata
+                        , hdql_Context_t context
+                        ) {
+    int rc;
+    for(; n; n = n->next) {
+        for( hdql_Datum_t r = hdql__query_reset(&(n->level), owner, NULL, context)
+           ; r
+           ; r = hdql__query_yield(&(n->level), NULL, context) ) {
+            for(size_t i = 0; i < n->nTerminals; ++i) {
+                if(0 != (rc = callback(n->terminals[i], r, userdata))) return rc;
+            }
+            if(n->children
+            && 0 != (rc = hdql__query_trie_process(n->children, r, callback, userdata, context)))
+                return rc;
+        }
+    }
+    return HDQL_ERR_CODE_OK;
+}
+
+/* public API */
+int
+hdql_query_trie_process( const struct hdql_QueryTrie * t
+                       , hdql_Datum_t root
+                       , hdql_QueryTrieResultCallback_t callback
+                       , void * userdata
+                       , hdql_Context_t context
+                       ) {
+    assert(t);
+    assert(callback);
+    return hdql__query_trie_process(t->roots, root, callback, userdata, context);
+}
+
+/* public API */
+void
+hdql_query_trie_destroy(struct hdql_QueryTrie * t, hdql_Context_t context) {
+    hdql__query_trie_nodes_destroy(t->roots, context);
+    hdql_context_free(context, (hdql_Datum_t) t);
+}
+
 /* public API */
 void
 hdql_query_assign_label(struct hdql_Query * q, char * label) {
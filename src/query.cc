@@ -352,7 +352,8 @@ hdql_query_create(
         , hdql_SelectionArgs_t selArgs
         , hdql_Context_t ctx
         ) {
-    hdql_Datum_t bf = hdql_context_alloc(ctx, sizeof(hdql_Query));
+    hdql_Datum_t bf = hdql_context_alloc_as(ctx, sizeof(hdql_Query), hdql_kMemQuery);
+    if(NULL == bf) return NULL;
     return new (bf) hdql_Query( attrDef, selArgs );
 }
 
@@ -6,77 +6,102 @@
 #include "hdql/internal-api.h"
 
 #include <stdlib.h>
+#include <string.h>
 
-#ifndef HDQL_PROMOTION_TABLE_MAX_ENTRIES
-#   define HDQL_PROMOTION_TABLE_MAX_ENTRIES 64
+#ifndef HDQL_PROMOTION_TABLE_MAX_TYPES
+#   define HDQL_PROMOTION_TABLE_MAX_TYPES 16
 #endif
 
-typedef struct {
-    union {
-        struct {
-            hdql_ValueTypeCode_t a:HDQL_VALUE_TYPEDEF_CODE_BITSIZE;
-            hdql_ValueTypeCode_t b:HDQL_VALUE_TYPEDEF_CODE_BITSIZE;
-        } semantic;
-        unsigned int numeric;
-    } key;
-    hdql_ValueTypeCode_t r:HDQL_VALUE_TYPEDEF_CODE_BITSIZE;
-} ArithTypePromotionRecord_t;
-
+/* Dense matrix of promoted types, indexed by compact indexes of arithmetic
+ * types. Index 0 is reserved for non-arithmetic types (its row and column
+ * are zeroes), so lookup involves no branching. */
 struct hdql_ArithTypePromotionTable {
-    int nEntres;
-    ArithTypePromotionRecord_t records[HDQL_PROMOTION_TABLE_MAX_ENTRIES];
+    hdql_Context_t context;
+    /* range of type codes covered by `typeIndex` */
+    hdql_ValueTypeCode_t minCode, nCodes;
+    /* compact index by `code - minCode` */
+    uint8_t * typeIndex;
+    size_t nTypes;
+    hdql_ValueTypeCode_t result[ (HDQL_PROMOTION_TABLE_MAX_TYPES + 1)
+                               * (HDQL_PROMOTION_TABLE_MAX_TYPES + 1) ];
 };
 
 struct hdql_ArithTypePromotionTable *
 hdql_arith_type_promotion_create(hdql_Context_t context) {
-    return hdql_alloc(context, struct hdql_ArithTypePromotionTable);
+    struct hdql_ArithTypePromotionTable * t
+        = hdql_alloc(context, struct hdql_ArithTypePromotionTable);
+    if(!t) return NULL;
+    t->context = context;
+    t->minCode = t->nCodes = 0;
+    t->typeIndex = NULL;
+    t->nTypes = 0;
+    memset(t->result, 0x0, sizeof(t->result));
+    return t;
 }
 
 void
 hdql_arith_type_promotion_destroy(hdql_Context_t context
         , struct hdql_ArithTypePromotionTable * t) {
+    if(t->typeIndex)
+        hdql_context_free(context, (hdql_Datum_t) t->typeIndex);
     hdql_context_free(context, (hdql_Datum_t) t);
 }
 
-
-
-static int _compare_records(const void * a_, const void * b_) {
-    const ArithTypePromotionRecord_t * a = (const ArithTypePromotionRecord_t *) a_;
-    const ArithTypePromotionRecord_t * b = (const ArithTypePromotionRecord_t *) b_;
-    if(a->key.numeric < b->key.numeric) return -1;
-    if(a->key.numeric > b->key.numeric) return  1;
-    return 0;
-}
-
 int
 hdql_arith_type_promotion_rebuild(const struct hdql_ValueTypes * vt,
         struct hdql_ArithTypePromotionTable * t) {
-    size_t n = 0;
-    /* (re)populate the table */
     hdql_ValueTypeCode_t a, b, r;
+    if(t->typeIndex) {
+        hdql_context_free(t->context, (hdql_Datum_t) t->typeIndex);
+        t->typeIndex = NULL;
+    }
+    t->minCode = t->nCodes = 0;
+    t->nTypes = 0;
+    /* cleared before any return, so lookups fall back to zero */
+    memset(t->result, 0x0, sizeof(t->result));
+    /* find range of codes of types involved */
+    hdql_ValueTypeCode_t minCode = HDQL_VALUE_TYPE_CODE_MAX, maxCode = 0;
+    #define _M_update_range(A, B, R)  \
+    a = hdql_types_get_type_code(vt, #A);  \
+    b = hdql_types_get_type_code(vt, #B);  \
+    r = hdql_types_get_type_code(vt, #R);  \
+    if( a && b && r ) {  \
+        if(a < minCode) minCode = a;  \
+        if(b < minCode) minCode = b;  \
+        if(a > maxCode) maxCode = a;  \
+        if(b > maxCode) maxCode = b;  \
+    }
+    hdql_M_for_each_arith_types_pair(_M_update_range);
+    #undef _M_update_range
+    if(0 == maxCode) return HDQL_ERR_EMPTY_SET;
+    t->typeIndex = (uint8_t *) hdql_context_alloc(t->context, maxCode - minCode + 1);
+    if(!t->typeIndex) return HDQL_ERR_MEMORY;
+    memset(t->typeIndex, 0x0, maxCode - minCode + 1);
+    t->minCode = minCode;
+    t->nCodes = maxCode - minCode + 1;
+    /* assign compact indexes and (re)populate the table */
+    size_t nTypes = 1;
     #define _M_add_entry(A, B, R)  \
     a = hdql_types_get_type_code(vt, #A);  \
     b = hdql_types_get_type_code(vt, #B);  \
     r = hdql_types_get_type_code(vt, #R);  \
     if( a && b && r ) {  \
-        if(n >= HDQL_PROMOTION_TABLE_MAX_ENTRIES) \
-            return HDQL_ERR_MEMORY; \
-        t->records[n].key.numeric    = 0x0;  \
-        if(a < b) { \
-            t->records[n].key.semantic.a = a;  \
-            t->records[n].key.semantic.b = b;  \
-        } else {  \
-            t->records[n].key.semantic.a = b;  \
-            t->records[n].key.semantic.b = a;  \
+        if(!t->typeIndex[a - minCode]) {  \
+            if(nTypes > HDQL_PROMOTION_TABLE_MAX_TYPES) return HDQL_ERR_MEMORY; \
+            t->typeIndex[a - minCode] = nTypes++;  \
+        }  \
+        if(!t->typeIndex[b - minCode]) {  \
+            if(nTypes > HDQL_PROMOTION_TABLE_MAX_TYPES) return HDQL_ERR_MEMORY; \
+            t->typeIndex[b - minCode] = nTypes++;  \
         }  \
-        t->records[n++].r            = r;  \
+        t->result[ t->typeIndex[a - minCode]*(HDQL_PROMOTION_TABLE_MAX_TYPES + 1)  \
+                 + t->typeIndex[b - minCode] ] = r;  \
+        t->result[ t->typeIndex[b - minCode]*(HDQL_PROMOTION_TABLE_MAX_TYPES + 1)  \
+                 + t->typeIndex[a - minCode] ] = r;  \
     }
     hdql_M_for_each_arith_types_pair(_M_add_entry);
-    t->nEntres = n;
-    if(0 == n) return HDQL_ERR_EMPTY_SET;
-    /* sort table */
-    qsort(t->records, n, sizeof(ArithTypePromotionRecord_t)
-            , _compare_records);
+    #undef _M_add_entry
+    t->nTypes = nTypes;
     return HDQL_ERR_CODE_OK;
 }
 
@@ -84,22 +109,11 @@ hdql_ValueTypeCode_t
 hdql_arith_type_promote(const struct hdql_ArithTypePromotionTable * t
         , hdql_ValueTypeCode_t a, hdql_ValueTypeCode_t b
         ) {
-    if(0 == a || 0 == b || 0 == t->nEntres) return 0;
-
-    ArithTypePromotionRecord_t k;
-    k.key.numeric = 0x0;
-    if(a < b) {
-        k.key.semantic.a = a;
-        k.key.semantic.b = b;
-    } else {
-        k.key.semantic.a = b;
-        k.key.semantic.b = a;
-    }
-
-    void *r_ = bsearch(&k, t->records, t->nEntres
-            , sizeof(ArithTypePromotionRecord_t)
-            , _compare_records);
-    if(!r_) return 0;
-    return ((ArithTypePromotionRecord_t*) r_)->r;
+    /* (unsigned wrap makes codes below the range fail the check as well) */
+    const hdql_ValueTypeCode_t ia = (hdql_ValueTypeCode_t) (a - t->minCode) < t->nCodes
+                                  ? t->typeIndex[a - t->minCode] : 0
+                             , ib = (hdql_ValueTypeCode_t) (b - t->minCode) < t->nCodes
+                                  ? t->typeIndex[b - t->minCode] : 0
+                             ;
+    return t->result[ia*(HDQL_PROMOTION_TABLE_MAX_TYPES + 1) + ib];
 }
-
@@ -315,7 +315,8 @@ hdql_create_value(hdql_ValueTypeCode_t tc, hdql_Context_t ctx) {
     if(vti->size > 0) {
     if(vti->size <= 0) return NULL;
         // const-size data type
-        hdql_Datum_t r = hdql_context_alloc(ctx, vti->size);
+        hdql_Datum_t r = hdql_context_alloc_as(ctx, vti->size, hdql_kMemDatum);
+        if(NULL == r) return NULL;
         if(vti->init) {
             int rc = vti->init(r, vti->size, ctx);
             if(rc != 0) {
@@ -15,6 +15,7 @@
 #include <cstdint>
 #include <gtest/gtest.h>
 #include <stdexcept>
+#include <vector>
 
 namespace hdql {
 namespace test {
@@ -490,6 +491,126 @@ TEST_F(BasicQuerySelectedCollection, queryResolvesSelectedCollectionElementsRigh
     TestSelection(values, "2-9", expected, keys);
 }
 
+// Chained queries
+//
+
+namespace {
+
+int tenfoldDefData = 0x10;
+
+hdql_Datum_t
+new_tenfold_dyn_data( hdql_Datum_t newOwner
+                    , const struct hdql_Datum * defData
+                    , hdql_Context_t context
+                    ) {
+    return reinterpret_cast<hdql_Datum_t>(new int);
+}
+
+// scalar attribute of the collection item: tenfold value, none for even
+// values
+hdql_Datum_t
+reset_tenfold( hdql_Datum_t owner
+             , hdql_Datum_t dynData
+             , const struct hdql_Datum * defData
+             , struct hdql_Key * key
+             , hdql_Context_t context
+             ) {
+    if(!owner) throw std::runtime_error("NULL owner");
+    if(!dynData) throw std::runtime_error("no dyn. data");
+    const int item = *reinterpret_cast<int*>(owner);
+    if(0 == item % 2) return NULL;
+    *reinterpret_cast<int*>(dynData) = 10*item;
+    return dynData;
+}
+
+void
+destroy_tenfold_dyn_data( hdql_Datum_t dynData
+                        , const struct hdql_Datum * defData
+                        , hdql_Context_t context
+                        ) {
+    delete reinterpret_cast<int*>(dynData);
+}
+
+hdql_ScalarAttrInterface tenfoldScalarAttrIFace {
+    .definitionData = reinterpret_cast<hdql_Datum *>(&tenfoldDefData),
+    .new_dyn_data = new_tenfold_dyn_data,
+    .reset = reset_tenfold,
+    .destroy_dyn_data = destroy_tenfold_dyn_data
+};
+
+}  // anon ns
+
+// Chain of collection and scalar query, assembled manually (i.e. not
+// finalized by the compiler)
+class BasicQueryChain : public BasicQueryCollection {
+protected:
+    hdql_AttrDef * _scalarAD;
+public:
+    BasicQueryChain() : _scalarAD(nullptr) {}
+
+    void SetUp() override {
+        BasicQueryCollection::SetUp();
+        hdql_AtomicTypeFeatures typeInfo;
+        typeInfo.arithTypeCode = 0x1;  // just to prevent assertions, must be unused
+        typeInfo.isReadOnly = 0x1;
+        _scalarAD = hdql_attr_def_create_atomic_scalar(&typeInfo
+                , &tenfoldScalarAttrIFace
+                , 0x0
+                , NULL
+                , _context);
+        ASSERT_TRUE(_scalarAD);
+        hdql_Query * q = hdql_query_create(_scalarAD, NULL, _context);
+        ASSERT_TRUE(q);
+        _q = hdql_query_append(_q, q);
+        ASSERT_EQ(2, hdql_query_depth(_q));
+    }
+
+    void TearDown() override {
+        // chain has to be destroyed before attribute definitions
+        if(_q) hdql_query_destroy(_q, _context);
+        _q = nullptr;
+        if(_scalarAD) hdql_attr_def_destroy(_scalarAD, _context);
+        BasicQueryCollection::TearDown();
+    }
+
+    // collects all the results of the chain
+    std::vector<int> Collect(ItemWithCollectionAttr & item) {
+        std::vector<int> r;
+        for( hdql_Datum_t d = hdql_query_reset(_q, reinterpret_cast<hdql_Datum_t>(&item), NULL, _context)
+           ; d
+           ; d = hdql_query_get(_q, NULL, _context) ) {
+            r.push_back(*reinterpret_cast<int*>(d));
+        }
+        // depleted chain keeps returning nothing
+        EXPECT_FALSE(hdql_query_get(_q, NULL, _context));
+        return r;
+    }
+};
+
+TEST_F(BasicQueryChain, chainIsFinalizedOnFirstReset) {
+    ItemWithCollectionAttr item = {.ints = {1, 2, 3, 4, -1}};
+    EXPECT_EQ(std::vector<int>({10, 30}), Collect(item));
+    // finalization is idempotent
+    EXPECT_EQ(HDQL_ERR_CODE_OK, hdql_query_finalize(_q, _context));
+    // plan is re-used on the next reset
+    item.ints[3] = 5;
+    EXPECT_EQ(std::vector<int>({10, 30, 50}), Collect(item));
+}
+
+TEST_F(BasicQueryChain, finalizedChainBacktracksOverEmptyDescendants) {
+    ASSERT_EQ(HDQL_ERR_CODE_OK, hdql_query_finalize(_q, _context));
+    // first items yield nothing on the terminal level, so reset has to
+    // advance the collection
+    ItemWithCollectionAttr item = {.ints = {2, 4, 7, 6, -1}};
+    EXPECT_EQ(std::vector<int>({70}), Collect(item));
+    // none of the items results in a value
+    ItemWithCollectionAttr evenItem = {.ints = {2, 4, -1}};
+    EXPECT_TRUE(Collect(evenItem).empty());
+    // empty collection
+    ItemWithCollectionAttr emptyItem = {.ints = {-1}};
+    EXPECT_TRUE(Collect(emptyItem).empty());
+}
+
 }  // namespace ::hdql::test
 }  // namespace hdql
 
@@ -1,9 +1,14 @@
 // Usage:
 //  $ make
+//  $ ./hdql-ht-benchmark [count] [distribution]
 //  $ python ../hdql/drafts/run.py | tee ./results.dat
 //  $ gnuplot
 //  gnuplot>  set log xy
-//  gnuplot> plot 'results.dat' using 1:5 with linespoints title "Map", '' using 1:9 with linespoints title "UMap Lookup", '' using 1:13 w linespoints t 'HT'
+//  gnuplot> plot 'results.dat' using 1:5 with linespoints title "Map", '' using 1:9 with linespoints title "UMap Lookup", '' using 1:13 w linespoints t 'HT', '' using 1:17 w linespoints t 'OA HT'
+//
+// Distribution is one of `random' (default, high entropy keys of 4-64
+// chars), `prefixed' (keys sharing common prefixes, 4-32 chars) or `short'
+// (1-12 chars, fit inline in open addressing table).
 
 #include <iostream>
 #include <map>
@@ -30,7 +35,6 @@ double elapsed_seconds(std::chrono::time_point<Clock> start, std::chrono::time_p
 }
 
 // --- Key/value generators
-#if 1
 // randomized, high entropy
 std::string random_string(size_t min_len = 1, size_t max_len = 128) {
     static const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
@@ -46,7 +50,7 @@ std::string random_string(size_t min_len = 1, size_t max_len = 128) {
     }
     return result;
 }
-#else
+
 // Global prefix pool (simulates shared path structure)
 std::vector<std::string> prefix_pool = {
     "a", "ab", "abc", "abd", "abe",
@@ -54,7 +58,7 @@ std::vector<std::string> prefix_pool = {
     "c", "cd", "cde", "cdf", "cxyz"
 };
 
-std::string random_string(size_t min_len = 4, size_t max_len = 32) {
+std::string prefixed_string(size_t min_len = 4, size_t max_len = 32) {
     static const char charset[] =
         "abcdefghijklmnopqrstuvwxyz"
         "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -74,7 +78,6 @@ std::string random_string(size_t min_len = 4, size_t max_len = 32) {
 
     return prefix + suffix;
 }
-#endif
 
 #if 0
 // --- Radix Tree wrapper
@@ -108,11 +111,13 @@ void benchmark_hdql_rt(const std::vector<std::string> &keys, const std::vector<i
 }
 #endif
 
-// --- hash table benchmark
-void benchmark_hash_table(const std::vector<std::string> &keys, const std::vector<int> &values) {
+// --- hash table benchmark (chained or open addressing variant, by flags)
+void benchmark_hash_table(const std::vector<std::string> &keys, const std::vector<int> &values
+        , int flags = 0x0) {
     hdql_Allocator alloc = hdql_gHeapAllocator;
     //hdql_alloc_arena_init(&alloc);
-    struct hdql_ht * ht = hdql_ht_create(&alloc, 5, HDQL_MURMUR3_32_DEFAULT_SEED);
+    struct hdql_ht * ht = hdql_ht_create_with(&alloc, 5, HDQL_MURMUR3_32_DEFAULT_SEED, flags);
+    const char * name = (flags & HDQL_HT_OPEN_ADDRESSING) ? "hdql_ht (OA)" : "hdql_ht";
     std::vector<int *> vs;
 
     auto start_insert = Clock::now();
@@ -138,8 +143,8 @@ void benchmark_hash_table(const std::vector<std::string> &keys, const std::vecto
     }
     auto end_lookup = Clock::now();
 
-    std::cout << "hdql_ht insert time:   " << elapsed_seconds(start_insert, end_insert) << " sec\n";
-    std::cout << "hdql_ht lookup time:   " << elapsed_seconds(start_lookup, end_lookup) << " sec\n";
+    std::cout << name << " insert time:   " << elapsed_seconds(start_insert, end_insert) << " sec\n";
+    std::cout << name << " lookup time:   " << elapsed_seconds(start_lookup, end_lookup) << " sec\n";
     std::cout << "  (hits: " << hits << ")\n";
 
     hdql_ht_destroy(ht);
@@ -192,8 +197,21 @@ void benchmark_std_unordered_map(const std::vector<std::string> &keys, const std
 int main(int argc, char **argv) {
     size_t count = 100000;
     if (argc > 1) count = std::stoul(argv[1]);
+    const std::string distribution = argc > 2 ? argv[2] : "random";
+    std::string (*generate)();
+    if (distribution == "random") {
+        generate = []() { return random_string(4, 64); };
+    } else if (distribution == "prefixed") {
+        generate = []() { return prefixed_string(4, 32); };
+    } else if (distribution == "short") {
+        generate = []() { return random_string(1, 12); };
+    } else {
+        std::cerr << "Unknown keys distribution: \"" << distribution << "\"\n";
+        return 1;
+    }
 
-    std::cout << "# Benchmarking with " << count << " items.\n";
+    std::cout << "# Benchmarking with " << count << " items of "
+              << distribution << " keys.\n";
 
     std::vector<std::string> keys;
     std::vector<int> values;
@@ -204,7 +222,7 @@ int main(int argc, char **argv) {
     std::uniform_int_distribution<int> val_dist(0, 1 << 30);
 
     for (size_t i = 0; i < count; ++i) {
-        keys.push_back(random_string(4, 64));
+        keys.push_back(generate());
         values.push_back(val_dist(rng));
     }
 
@@ -212,6 +230,7 @@ int main(int argc, char **argv) {
     benchmark_std_unordered_map(keys, values);
     //benchmark_hdql_rt(keys, values);
     benchmark_hash_table(keys, values);
+    benchmark_hash_table(keys, values, HDQL_HT_OPEN_ADDRESSING);
 
     return 0;
 }
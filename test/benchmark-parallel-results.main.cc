@@ -0,0 +1,174 @@
+// Benchmarks parallel query results driver against sequential processing
+//
+// Usage:
+//  $ ./hdql-parallel-benchmark [nEvents [maxWorkers [query]]]
+//
+// Generates synthetic events of testing `Event` model, evaluates query on
+// them with 0 (sequential), 1, 2, 4, ... workers and prints throughput for
+// each run. Order-sensitive checksum of delivered records is compared with
+// the sequential run to assure ordered delivery.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "events-struct.hh"
+
+#include "hdql/attr-def.h"
+#include "hdql/compound.h"
+#include "hdql/context.h"
+#include "hdql/function.h"
+#include "hdql/helpers/query-results-parallel.h"
+#include "hdql/operations.h"
+#include "hdql/query.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+// --- Timing utilities
+using Clock = std::chrono::high_resolution_clock;
+using Duration = std::chrono::duration<double>;
+
+// --- Synthetic events generator
+static void
+fill_random_event(hdql::test::Event & ev, int eventID, std::mt19937 & rng) {
+    using namespace hdql::test;
+    std::uniform_int_distribution<int> nHitsDist(5, 40), nTracksDist(0, 5);
+    std::uniform_real_distribution<float> valDist(0, 10);
+    ev.eventID = eventID;
+    std::vector<std::shared_ptr<Hit>> hits;
+    const int nHits = nHitsDist(rng);
+    for(int i = 0; i < nHits; ++i) {
+        auto h = std::make_shared<Hit>(Hit{ valDist(rng), valDist(rng)
+                , valDist(rng), valDist(rng), valDist(rng), nullptr });
+        ev.hits.emplace(100 + i, h);
+        hits.push_back(h);
+    }
+    const int nTracks = nTracksDist(rng);
+    std::uniform_int_distribution<int> hitIdxDist(0, nHits - 1);
+    for(int i = 0; i < nTracks; ++i) {
+        auto t = std::make_shared<Track>(Track{ valDist(rng), 2, valDist(rng)/10 });
+        for(int j = 0; j < 4; ++j) {
+            int n = hitIdxDist(rng);
+            t->hits.emplace(100 + n, hits[n]);
+        }
+        ev.tracks.push_back(t);
+    }
+}
+
+// --- Results handler computing order-sensitive checksum
+struct Checksum {
+    hdql_Context_t ctx;
+    size_t valueSize;
+    size_t nRecords;
+    uint64_t hash;
+};
+
+static int
+handle_result_type(const hdql_AttrDef * ad, void * ud) {
+    Checksum * cs = reinterpret_cast<Checksum *>(ud);
+    if(!hdql_attr_def_is_atomic(ad)) return -1;
+    const hdql_ValueInterface * vi = hdql_types_get_type(
+            hdql_context_get_types(cs->ctx), hdql_attr_def_get_atomic_value_type_code(ad));
+    cs->valueSize = vi ? vi->size : 0;
+    return 0;
+}
+
+static int
+handle_keys(hdql_Key *, hdql_Key **, size_t, void *) { return 0; }
+
+static int
+handle_record(hdql_Datum_t d, void * ud) {
+    Checksum * cs = reinterpret_cast<Checksum *>(ud);
+    const unsigned char * bytes = reinterpret_cast<const unsigned char *>(d);
+    // FNV-1a over value bytes
+    for(size_t i = 0; i < cs->valueSize; ++i) {
+        cs->hash ^= bytes[i];
+        cs->hash *= 1099511628211ULL;
+    }
+    ++cs->nRecords;
+    return 0;
+}
+
+int
+main(int argc, char * argv[]) {
+    const size_t nEvents = argc > 1 ? strtoul(argv[1], NULL, 0) : 20000;
+    const size_t maxWorkers = argc > 2 ? strtoul(argv[2], NULL, 0)
+                            : std::thread::hardware_concurrency();
+    const char * expression = argc > 3 ? argv[3]
+                            : "{th:=*.tracks.hits, h:=*.hits}{dx:=.h.x-.th.x}.dx";
+
+    hdql_Context_t ctx = hdql_context_create(HDQL_CTX_PRINT_PUSH_ERROR);
+    hdql_ValueTypes * valTypes = hdql_context_get_types(ctx);
+    hdql_value_types_table_add_std_types(valTypes);
+    hdql_op_define_std_arith(hdql_context_get_operations(ctx), valTypes);
+    hdql::helpers::Compounds compounds = hdql::test::define_test_event_compound(ctx);
+    auto it = compounds.find(typeid(hdql::test::Event));
+    if(compounds.end() == it) return EXIT_FAILURE;
+    hdql_functions_add_standard_math(hdql_context_get_functions(ctx));
+    hdql_converters_add_std(hdql_context_get_conversions(ctx), valTypes, ctx);
+
+    char errBuf[256] = "";
+    int errDetails[5] = {0, -1, -1, -1, -1};
+    hdql_Query * q = hdql_compile_query(expression, it->second, ctx
+            , errBuf, sizeof(errBuf), errDetails);
+    if(!q) {
+        fprintf(stderr, "Failed to compile query \"%s\": %s\n", expression, errBuf);
+        return EXIT_FAILURE;
+    }
+
+    std::mt19937 rng(1337);
+    std::vector<hdql::test::Event> events(nEvents);
+    std::vector<hdql_Datum *> roots;
+    for(size_t i = 0; i < nEvents; ++i) {
+        fill_random_event(events[i], i, rng);
+        roots.push_back(reinterpret_cast<hdql_Datum *>(&events[i]));
+    }
+
+    printf("# query: %s\n# events: %zu\n", expression, nEvents);
+    printf("# workers    time,s   events/s     records  speedup  checksum\n");
+    double seqTime = 0;
+    uint64_t seqHash = 0;
+    int rc = EXIT_SUCCESS;
+    for(size_t nWorkers = 0; nWorkers <= maxWorkers; nWorkers = nWorkers ? 2*nWorkers : 1) {
+        Checksum cs = {ctx, 0, 0, 14695981039346656037ULL};
+        hdql_iQueryResultsHandler iqr = {
+              .userdata = &cs
+            , .handle_result_type = handle_result_type
+            , .handle_keys = handle_keys
+            , .finalize_schema = NULL
+            , .handle_record = handle_record
+        };
+        hdql_QueryResultsParallelDriver * drv
+            = hdql_query_results_parallel_init(q, &iqr, nWorkers, 0, ctx);
+        if(!drv) {
+            fputs("Failed to initialize parallel driver.\n", stderr);
+            rc = EXIT_FAILURE;
+            break;
+        }
+        auto start = Clock::now();
+        hdql_query_results_parallel_process(roots.data(), roots.size(), drv);
+        const double t = std::chrono::duration_cast<Duration>(Clock::now() - start).count();
+        hdql_query_results_parallel_destroy(drv);
+
+        if(!nWorkers) {
+            seqTime = t;
+            seqHash = cs.hash;
+        }
+        printf("%9zu %9.4f %10.0f %11zu %8.2f  %s\n", nWorkers, t, nEvents/t
+                , cs.nRecords, seqTime/t, cs.hash == seqHash ? "match" : "MISMATCH");
+        if(cs.hash != seqHash) rc = EXIT_FAILURE;
+    }
+
+    hdql_query_destroy(q, ctx);
+    hdql_context_destroy_virtual_compounds(ctx);
+    for(auto & ce : compounds) {
+        hdql_compound_destroy(ce.second, ctx);
+    }
+    hdql_context_destroy(ctx);
+    return rc;
+}
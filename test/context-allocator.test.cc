@@ -0,0 +1,603 @@
+// Tests that context memory is provided by user-supplied allocator, inherited
+// by descendant contexts, evaluation frames of the context, arena and pool
+// allocators, context memory accounting and limit.
+
+#include "hdql/allocator.h"
+#include "hdql/attr-def.h"
+#include "hdql/compound.h"
+#include "hdql/context.h"
+#include "hdql/errors.h"
+#include "hdql/operations.h"
+#include "hdql/query.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hdql {
+namespace test {
+
+namespace {
+
+// Forwards allocations to system heap, counting them
+struct CountingAllocator {
+    size_t nAllocs, nFrees;
+
+    static void * alloc(size_t sz, void * self) {
+        ++(reinterpret_cast<CountingAllocator *>(self)->nAllocs);
+        return malloc(sz);
+    }
+
+    static void free(void * ptr, void * self) {
+        ++(reinterpret_cast<CountingAllocator *>(self)->nFrees);
+        ::free(ptr);
+    }
+
+    hdql_Allocator allocator() {
+        return hdql_Allocator{this, CountingAllocator::alloc, CountingAllocator::free};
+    }
+};
+
+}  // anon ns
+
+TEST(ContextAllocator, contextUsesGivenAllocator) {
+    CountingAllocator counts = {0, 0};
+    hdql_Allocator allocator = counts.allocator();
+    hdql_Context_t ctx = hdql_context_create_with_allocator(HDQL_CTX_PRINT_PUSH_ERROR, &allocator);
+    ASSERT_TRUE(ctx);
+    EXPECT_EQ(hdql_context_get_allocator(ctx)->userdata, &counts);
+    hdql_value_types_table_add_std_types(hdql_context_get_types(ctx));
+    hdql_op_define_std_arith(hdql_context_get_operations(ctx), hdql_context_get_types(ctx));
+
+    hdql_Compound * root = hdql_compound_new("Empty", ctx);
+    char errBuf[128] = "";
+    int errDetails[5];
+    hdql_Query * q = hdql_compile_query("(1 + 2)*3 - 4", root, ctx
+            , errBuf, sizeof(errBuf), errDetails);
+    ASSERT_TRUE(q) << errBuf;
+    EXPECT_GT(counts.nAllocs, 0);
+
+    hdql_Datum_t r = hdql_query_reset(q, NULL, NULL, ctx);
+    ASSERT_TRUE(r);
+    EXPECT_EQ(*reinterpret_cast<hdql_Int_t *>(r), 5);
+    hdql_query_destroy(q, ctx);
+    hdql_compound_destroy(root, ctx);
+    hdql_context_destroy(ctx);
+    // everything taken from allocator was returned to it
+    EXPECT_EQ(counts.nAllocs, counts.nFrees);
+}
+
+// Compounds can be destroyed after the context they were created within;
+// their attribute definitions are returned to the allocator
+TEST(ContextAllocator, compoundsOutliveContext) {
+    CountingAllocator counts = {0, 0};
+    hdql_Allocator allocator = counts.allocator();
+    hdql_Context_t ctx = hdql_context_create_with_allocator(0x0, &allocator);
+    ASSERT_TRUE(ctx);
+    hdql_value_types_table_add_std_types(hdql_context_get_types(ctx));
+    hdql_Compound * compound = hdql_compound_new("Sample", ctx);
+    hdql_AtomicTypeFeatures typeInfo;
+    typeInfo.arithTypeCode = hdql_types_get_type_code(hdql_context_get_types(ctx), "hdql_Int_t");
+    typeInfo.isReadOnly = 0x1;
+    hdql_ScalarAttrInterface iface = {
+        .definitionData = nullptr,
+        .new_dyn_data = nullptr,
+        .reset = nullptr,
+        .destroy_dyn_data = nullptr
+    };
+    for(const char * name : {"a", "b"}) {
+        ASSERT_EQ(0, hdql_compound_add_attr(compound, name
+                , hdql_attr_def_create_atomic_scalar(&typeInfo, &iface, 0x0, NULL, ctx)));
+    }
+    hdql_context_destroy(ctx);
+    EXPECT_EQ(counts.nAllocs, counts.nFrees + 2);
+    hdql_compound_destroy(compound, ctx);
+    EXPECT_EQ(counts.nAllocs, counts.nFrees);
+}
+
+TEST(ContextAllocator, descendantInheritsAllocator) {
+    CountingAllocator counts = {0, 0};
+    hdql_Allocator allocator = counts.allocator();
+    hdql_Context_t ctx = hdql_context_create_with_allocator(0x0, &allocator);
+    ASSERT_TRUE(ctx);
+    hdql_Context_t dCtx = hdql_context_create_descendant(ctx, 0x0);
+    ASSERT_TRUE(dCtx);
+    EXPECT_EQ(hdql_context_get_allocator(dCtx)->alloc, CountingAllocator::alloc);
+    EXPECT_EQ(hdql_context_get_allocator(dCtx)->userdata, &counts);
+
+    const size_t nAllocs = counts.nAllocs;
+    hdql_Datum_t d = hdql_context_alloc(dCtx, 64);
+    ASSERT_TRUE(d);
+    EXPECT_EQ(counts.nAllocs, nAllocs + 1);
+    // variadic data is provided by allocator too, including reallocation
+    hdql_Datum_t vd = hdql_context_variadic_datum_alloc(dCtx, 16, 16);
+    ASSERT_TRUE(vd);
+    vd = hdql_context_variadic_datum_realloc(dCtx, vd, 256);
+    ASSERT_TRUE(vd);
+    hdql_context_variadic_datum_free(dCtx, vd);
+    hdql_context_free(dCtx, d);
+
+    hdql_context_destroy(dCtx);
+    hdql_context_destroy(ctx);
+    EXPECT_EQ(counts.nAllocs, counts.nFrees);
+}
+
+TEST(ContextAllocator, defaultContextUsesDefaultAllocator) {
+    hdql_Context_t ctx = hdql_context_create(0x0);
+    ASSERT_TRUE(ctx);
+    #ifdef HDQL_POOL_ALLOCATOR
+    const hdql_Allocator & expected = hdql_gPoolAllocator;
+    #else
+    const hdql_Allocator & expected = hdql_gHeapAllocator;
+    #endif
+    EXPECT_EQ(hdql_context_get_allocator(ctx)->alloc, expected.alloc);
+    EXPECT_EQ(hdql_context_get_allocator(ctx)->free, expected.free);
+    EXPECT_EQ(hdql_context_get_allocator(ctx)->userdata, expected.userdata);
+    hdql_context_destroy(ctx);
+}
+
+TEST(ContextAllocator, variadicDatumGrowsGeometrically) {
+    CountingAllocator counts = {0, 0};
+    hdql_Allocator allocator = counts.allocator();
+    hdql_Context_t ctx = hdql_context_create_with_allocator(0x0, &allocator);
+    ASSERT_TRUE(ctx);
+    hdql_Datum_t vd = hdql_context_variadic_datum_alloc(ctx, 1, 1);
+    ASSERT_TRUE(vd);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(vd) % alignof(std::max_align_t), 0);
+    reinterpret_cast<char *>(vd)[0] = 0;
+    const size_t nAllocs = counts.nAllocs;
+    // append bytes one by one, "waveform" of 10k samples
+    for(uint32_t n = 2; n <= 10000; ++n) {
+        vd = hdql_context_variadic_datum_realloc(ctx, vd, n);
+        ASSERT_TRUE(vd);
+        EXPECT_EQ(hdql_context_variadic_datum_size(ctx, vd), n);
+        reinterpret_cast<char *>(vd)[n - 1] = static_cast<char>(n - 1);
+    }
+    // log2(10000) reallocations
+    EXPECT_LE(counts.nAllocs - nAllocs, 14);
+    for(uint32_t n = 0; n < 10000; ++n) {
+        ASSERT_EQ(reinterpret_cast<char *>(vd)[n], static_cast<char>(n));
+    }
+    // shrinking keeps the block
+    EXPECT_EQ(hdql_context_variadic_datum_realloc(ctx, vd, 10), vd);
+    EXPECT_EQ(hdql_context_variadic_datum_size(ctx, vd), 10);
+    hdql_context_variadic_datum_free(ctx, vd);
+    EXPECT_EQ(hdql_context_variadic_datum_size(ctx, NULL), UINT32_MAX);
+    hdql_context_destroy(ctx);
+    EXPECT_EQ(counts.nAllocs, counts.nFrees);
+}
+
+TEST(ContextFrames, rewindReusesFrameMemory) {
+    CountingAllocator counts = {0, 0};
+    hdql_Allocator allocator = counts.allocator();
+    hdql_Context_t ctx = hdql_context_create_with_allocator(0x0, &allocator);
+    ASSERT_TRUE(ctx);
+    EXPECT_EQ(hdql_context_frame_depth(ctx), 0);
+
+    hdql_Datum_t first = nullptr;
+    size_t nAllocs = 0;
+    for(int nEvent = 0; nEvent < 10; ++nEvent) {
+        ASSERT_EQ(hdql_context_frame_begin(ctx), HDQL_ERR_CODE_OK);
+        EXPECT_EQ(hdql_context_frame_depth(ctx), 1);
+        // more than single block in total
+        for(int i = 0; i < 1000; ++i) {
+            hdql_Datum_t d = hdql_context_frame_alloc(ctx, 3 + i%50);
+            ASSERT_TRUE(d);
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(d) % alignof(std::max_align_t), 0);
+            memset(d, 0xff, 3 + i%50);
+            if(0 == i) {
+                if(0 == nEvent) first = d;
+                EXPECT_EQ(d, first);
+            }
+        }
+        ASSERT_EQ(hdql_context_frame_rewind(ctx), HDQL_ERR_CODE_OK);
+        // no allocator calls once arena is warmed up
+        if(0 == nEvent) nAllocs = counts.nAllocs;
+        EXPECT_EQ(counts.nAllocs, nAllocs);
+    }
+    EXPECT_EQ(hdql_context_frame_depth(ctx), 0);
+    EXPECT_NE(hdql_context_frame_rewind(ctx), HDQL_ERR_CODE_OK);
+
+    hdql_context_destroy(ctx);
+    EXPECT_EQ(counts.nAllocs, counts.nFrees);
+}
+
+TEST(ContextFrames, nestedFramesRewindToOwnMarks) {
+    hdql_Context_t ctx = hdql_context_create(0x0);
+    ASSERT_TRUE(ctx);
+    hdql_context_frame_begin(ctx);
+    hdql_Datum_t outer = hdql_context_frame_alloc(ctx, 16);
+    ASSERT_TRUE(outer);
+    *reinterpret_cast<uint64_t *>(outer) = 0xdeadbeef;
+
+    hdql_context_frame_begin(ctx);
+    hdql_Datum_t inner = hdql_context_frame_alloc(ctx, 16);
+    ASSERT_TRUE(inner);
+    EXPECT_NE(inner, outer);
+    // larger than the block
+    hdql_Datum_t big = hdql_context_frame_alloc(ctx, 2*HDQL_CONTEXT_FRAME_BLOCK_SIZE);
+    ASSERT_TRUE(big);
+    memset(big, 0, 2*HDQL_CONTEXT_FRAME_BLOCK_SIZE);
+    EXPECT_EQ(hdql_context_frame_depth(ctx), 2);
+    hdql_context_frame_rewind(ctx);
+
+    // inner frame memory is reused, outer one is kept
+    EXPECT_EQ(hdql_context_frame_alloc(ctx, 16), inner);
+    EXPECT_EQ(*reinterpret_cast<uint64_t *>(outer), 0xdeadbeef);
+    hdql_context_frame_rewind(ctx);
+    EXPECT_EQ(hdql_context_frame_alloc(ctx, 16), outer);
+    hdql_context_destroy(ctx);
+}
+
+TEST(ArenaAllocator, rewindRetainsBlocksForReuse) {
+    hdql_Allocator arena;
+    hdql_ArenaParameters pars = {64*1024, 0};
+    ASSERT_EQ(hdql_alloc_arena_init_with(&arena, &pars), 0);
+    hdql_ArenaStats stats;
+
+    void * persistent = arena.alloc(100, arena.userdata);
+    ASSERT_TRUE(persistent);
+    const hdql_ArenaMark m = hdql_alloc_arena_mark(&arena);
+    hdql_alloc_arena_get_stats(&arena, &stats);
+    const size_t usedAtMark = stats.bytesUsed;
+    EXPECT_GE(usedAtMark, 100);
+
+    size_t nBlocks = 0;
+    for(int nEvent = 0; nEvent < 5; ++nEvent) {
+        for(int i = 0; i < 1000; ++i) {  // few blocks in total
+            void * d = arena.alloc(200, arena.userdata);
+            ASSERT_TRUE(d);
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(d) % alignof(std::max_align_t), 0);
+            memset(d, 0xff, 200);
+        }
+        hdql_alloc_arena_get_stats(&arena, &stats);
+        EXPECT_GT(stats.nBlocks, 1);
+        EXPECT_GE(stats.bytesReserved, stats.bytesUsed);
+        EXPECT_GE(stats.bytesReserved, stats.nBlocks*pars.blockSize);
+        if(0 == nEvent) nBlocks = stats.nBlocks;
+        // no new blocks are mapped after first rewind
+        EXPECT_EQ(stats.nBlocks, nBlocks);
+        hdql_alloc_arena_rewind(&arena, m);
+        hdql_alloc_arena_get_stats(&arena, &stats);
+        EXPECT_EQ(stats.bytesUsed, usedAtMark);
+        EXPECT_GE(stats.peakBytesUsed, usedAtMark + 1000*200);
+    }
+    // memory allocated before the mark is kept, allocation continues after it
+    EXPECT_EQ(arena.alloc(8, arena.userdata)
+            , reinterpret_cast<char *>(persistent) + usedAtMark);
+
+    hdql_alloc_arena_trim(&arena);
+    hdql_alloc_arena_get_stats(&arena, &stats);
+    EXPECT_EQ(stats.nBlocks, 1);
+    hdql_alloc_arena_reset(&arena);
+    hdql_alloc_arena_get_stats(&arena, &stats);
+    EXPECT_EQ(stats.bytesUsed, 0);
+    hdql_alloc_arena_destroy(&arena);
+}
+
+TEST(ArenaAllocator, largeAllocationsAndHugePages) {
+    hdql_Allocator arena;
+    hdql_ArenaParameters pars = {0, 1};
+    ASSERT_EQ(hdql_alloc_arena_init_with(&arena, &pars), 0);
+    // huge pages are used if available, ordinary ones otherwise
+    const size_t sz = HDQL_ARENA_HUGE_PAGE_SIZE + 1;
+    void * d = arena.alloc(sz, arena.userdata);
+    ASSERT_TRUE(d);
+    memset(d, 0xff, sz);
+    hdql_ArenaStats stats;
+    hdql_alloc_arena_get_stats(&arena, &stats);
+    EXPECT_EQ(stats.nBlocks, 1);
+    EXPECT_LE(stats.nHugeTLBBlocks, 1);
+    EXPECT_EQ(stats.bytesReserved % HDQL_ARENA_HUGE_PAGE_SIZE, 0);
+    EXPECT_GE(stats.bytesReserved, sz);
+    hdql_alloc_arena_destroy(&arena);
+}
+
+TEST(ArenaAllocator, servesContext) {
+    hdql_Allocator arena;
+    hdql_alloc_arena_init(&arena);
+    hdql_Context_t ctx = hdql_context_create_with_allocator(HDQL_CTX_PRINT_PUSH_ERROR, &arena);
+    ASSERT_TRUE(ctx);
+    hdql_value_types_table_add_std_types(hdql_context_get_types(ctx));
+    hdql_op_define_std_arith(hdql_context_get_operations(ctx), hdql_context_get_types(ctx));
+    hdql_ArenaStats stats;
+    hdql_alloc_arena_get_stats(&arena, &stats);
+    EXPECT_GT(stats.bytesUsed, 0);
+
+    hdql_Compound * root = hdql_compound_new("Empty", ctx);
+    const hdql_ArenaMark m = hdql_alloc_arena_mark(&arena);
+    for(int i = 0; i < 3; ++i) {
+        char errBuf[128] = "";
+        int errDetails[5];
+        hdql_Query * q = hdql_compile_query("(1 + 2)*3 - 4", root, ctx
+                , errBuf, sizeof(errBuf), errDetails);
+        ASSERT_TRUE(q) << errBuf;
+        hdql_Datum_t r = hdql_query_reset(q, NULL, NULL, ctx);
+        ASSERT_TRUE(r);
+        EXPECT_EQ(*reinterpret_cast<hdql_Int_t *>(r), 5);
+        hdql_query_destroy(q, ctx);
+        // drop query memory at once
+        hdql_alloc_arena_rewind(&arena, m);
+    }
+    hdql_compound_destroy(root, ctx);
+    hdql_context_destroy(ctx);
+    hdql_alloc_arena_destroy(&arena);
+}
+
+TEST(PoolAllocator, freedObjectsAreReused) {
+    hdql_Allocator pool;
+    ASSERT_EQ(hdql_alloc_pool_init(&pool, NULL), 0);
+    hdql_PoolStats stats;
+
+    std::vector<void *> ptrs;
+    for(size_t sz = 1; sz <= 600; sz += 7) {  // all classes and large blocks
+        void * p = pool.alloc(sz, pool.userdata);
+        ASSERT_TRUE(p);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t), 0);
+        memset(p, 0xff, sz);
+        ptrs.push_back(p);
+    }
+    hdql_alloc_pool_get_stats(&pool, &stats);
+    const size_t nSlabs = stats.nSlabs;
+    EXPECT_GT(nSlabs, 0);
+    EXPECT_EQ(stats.bytesReserved, nSlabs*HDQL_POOL_SLAB_SIZE);
+    for(void * p : ptrs) pool.free(p, pool.userdata);
+    // same size class is served by last freed object
+    void * p1 = pool.alloc(40, pool.userdata);
+    pool.free(p1, pool.userdata);
+    EXPECT_EQ(pool.alloc(33, pool.userdata), p1);
+    pool.free(p1, pool.userdata);
+
+    // steady alloc/free does not take new slabs
+    for(int nIt = 0; nIt < 100; ++nIt) {
+        ptrs.clear();
+        for(size_t sz = 1; sz <= 600; sz += 7) ptrs.push_back(pool.alloc(sz, pool.userdata));
+        for(void * p : ptrs) pool.free(p, pool.userdata);
+    }
+    hdql_alloc_pool_get_stats(&pool, &stats);
+    EXPECT_EQ(stats.nSlabs, nSlabs);
+    hdql_alloc_pool_destroy(&pool);
+}
+
+TEST(PoolAllocator, servesMultipleThreads) {
+    hdql_Allocator pool;
+    ASSERT_EQ(hdql_alloc_pool_init(&pool, NULL), 0);
+    // objects are allocated in one thread and freed in another
+    std::vector<std::vector<void *>> blocks(4);
+    std::vector<std::thread> threads;
+    for(size_t nt = 0; nt < blocks.size(); ++nt) {
+        threads.emplace_back([&pool, &blocks, nt]() {
+            for(int i = 0; i < 10000; ++i) {
+                void * p = pool.alloc(8 + (i % 300), pool.userdata);
+                *reinterpret_cast<size_t *>(p) = nt;
+                blocks[nt].push_back(p);
+            }
+        });
+    }
+    for(auto & t : threads) t.join();
+    threads.clear();
+    for(size_t nt = 0; nt < blocks.size(); ++nt) {
+        threads.emplace_back([&pool, &blocks, nt]() {
+            auto & bs = blocks[(nt + 1) % blocks.size()];
+            for(void * p : bs) {
+                EXPECT_EQ(*reinterpret_cast<size_t *>(p), (nt + 1) % blocks.size());
+                pool.free(p, pool.userdata);
+            }
+        });
+    }
+    for(auto & t : threads) t.join();
+    hdql_alloc_pool_destroy(&pool);
+}
+
+// Context keeps accounting info in the pool's object header (tag word), so
+// small allocations take single size class
+TEST(PoolAllocator, contextKeepsAccountingInObjectTag) {
+    hdql_Allocator pool;
+    ASSERT_EQ(hdql_alloc_pool_init(&pool, NULL), 0);
+    hdql_Context_t ctx = hdql_context_create_with_allocator(0x0, &pool);
+    ASSERT_TRUE(ctx);
+    hdql_PoolStats ps0, ps;
+    hdql_alloc_pool_get_stats(&pool, &ps0);
+    hdql_ContextMemoryStats s0, s;
+    hdql_context_get_memory_stats(ctx, &s0);
+    // two slabs fit 4000 objects of 16 bytes class only with single header
+    std::vector<hdql_Datum_t> ptrs;
+    for(int i = 0; i < 4000; ++i) {
+        hdql_Datum_t p = hdql_context_alloc_as(ctx, 16, hdql_kMemKey);
+        ASSERT_TRUE(p);
+        memset(p, 0xff, 16);
+        ptrs.push_back(p);
+    }
+    hdql_alloc_pool_get_stats(&pool, &ps);
+    EXPECT_LE(ps.nSlabs - ps0.nSlabs, 2);
+    hdql_context_get_memory_stats(ctx, &s);
+    EXPECT_EQ(s.nLive[hdql_kMemKey], s0.nLive[hdql_kMemKey] + 4000);
+    EXPECT_EQ(s.bytesLiveByCategory[hdql_kMemKey], s0.bytesLiveByCategory[hdql_kMemKey] + 4000*16);
+    for(hdql_Datum_t p : ptrs) hdql_context_free(ctx, p);
+    hdql_context_get_memory_stats(ctx, &s);
+    EXPECT_EQ(s.nLive[hdql_kMemKey], s0.nLive[hdql_kMemKey]);
+    EXPECT_EQ(s.bytesLive, s0.bytesLive);
+    hdql_context_destroy(ctx);
+    hdql_alloc_pool_destroy(&pool);
+}
+
+TEST(ContextErrors, keepsRecordsInRingBuffer) {
+    hdql_Context_t ctx = hdql_context_create(0x0);
+    EXPECT_FALSE(hdql_context_has_errors(ctx));
+    EXPECT_EQ(hdql_context_error_get(ctx, 0), nullptr);
+    hdql_context_err_push(ctx, HDQL_ERR_MEMORY, "error #%d", 1);
+    const int line = __LINE__ - 1;
+    ASSERT_TRUE(hdql_context_has_errors(ctx));
+    ASSERT_EQ(hdql_context_errors_count(ctx), 1);
+    const hdql_ErrorRecord * r = hdql_context_error_get(ctx, 0);
+    ASSERT_TRUE(r);
+    EXPECT_EQ(r->code, HDQL_ERR_MEMORY);
+    EXPECT_STREQ(r->message, "error #1");
+    ASSERT_TRUE(r->file);
+    EXPECT_TRUE(strstr(r->file, "context-allocator.test.cc"));
+    EXPECT_EQ(r->line, line);
+    // overwrite the oldest records
+    for(int i = 2; i <= HDQL_CONTEXT_ERRORS_CAPACITY + 3; ++i) {
+        hdql_context_err_push(ctx, HDQL_ERR_GENERIC, "error #%d", i);
+    }
+    ASSERT_EQ(hdql_context_errors_count(ctx), HDQL_CONTEXT_ERRORS_CAPACITY);
+    EXPECT_EQ(hdql_context_errors_overflow(ctx), 3);
+    EXPECT_STREQ(hdql_context_error_get(ctx, 0)->message, "error #4");
+    EXPECT_STREQ(hdql_context_error_get(ctx, HDQL_CONTEXT_ERRORS_CAPACITY - 1)->message
+            , ("error #" + std::to_string(HDQL_CONTEXT_ERRORS_CAPACITY + 3)).c_str());
+    EXPECT_EQ(hdql_context_error_get(ctx, HDQL_CONTEXT_ERRORS_CAPACITY), nullptr);
+    hdql_context_errors_clear(ctx);
+    EXPECT_FALSE(hdql_context_has_errors(ctx));
+    EXPECT_EQ(hdql_context_errors_overflow(ctx), 0);
+    hdql_context_destroy(ctx);
+}
+
+TEST(ContextErrors, truncatesLongMessages) {
+    hdql_Context_t ctx = hdql_context_create(0x0);
+    std::string msg(2*HDQL_ERROR_MESSAGE_LENGTH, 'x');
+    (hdql_context_err_push)(ctx, HDQL_ERR_GENERIC, "%s", msg.c_str());
+    const hdql_ErrorRecord * r = hdql_context_error_get(ctx, 0);
+    ASSERT_TRUE(r);
+    EXPECT_EQ(r->file, nullptr);
+    EXPECT_EQ(strlen(r->message), HDQL_ERROR_MESSAGE_LENGTH - 1);
+    hdql_context_destroy(ctx);
+}
+
+TEST(ContextMemory, accountsAllocationsByCategory) {
+    hdql_Context_t ctx = hdql_context_create(0x0);
+    hdql_ContextMemoryStats s0, s;
+    hdql_context_get_memory_stats(ctx, &s0);
+    hdql_Datum_t k = hdql_context_alloc_as(ctx, 24, hdql_kMemKey);
+    hdql_Datum_t o = hdql_context_alloc(ctx, 100);
+    hdql_Datum_t v = hdql_context_variadic_datum_alloc(ctx, 10, 64);
+    ASSERT_TRUE(k && o && v);
+    hdql_context_get_memory_stats(ctx, &s);
+    EXPECT_EQ(s.nLive[hdql_kMemKey], s0.nLive[hdql_kMemKey] + 1);
+    EXPECT_EQ(s.bytesLiveByCategory[hdql_kMemKey], s0.bytesLiveByCategory[hdql_kMemKey] + 24);
+    EXPECT_EQ(s.nLive[hdql_kMemOther], s0.nLive[hdql_kMemOther] + 1);
+    EXPECT_EQ(s.nLive[hdql_kMemVariadic], s0.nLive[hdql_kMemVariadic] + 1);
+    EXPECT_GE(s.bytesLiveByCategory[hdql_kMemVariadic], 64);
+    EXPECT_EQ(s.bytesLive, s0.bytesLive + 124 + s.bytesLiveByCategory[hdql_kMemVariadic]);
+    EXPECT_EQ(s.bytesPeak, s.bytesLive);
+    const size_t peak = s.bytesPeak;
+    hdql_context_free(ctx, k);
+    hdql_context_free(ctx, o);
+    hdql_context_variadic_datum_free(ctx, v);
+    hdql_context_get_memory_stats(ctx, &s);
+    EXPECT_EQ(s.bytesLive, s0.bytesLive);
+    EXPECT_EQ(s.nLive[hdql_kMemKey], s0.nLive[hdql_kMemKey]);
+    EXPECT_EQ(s.nLive[hdql_kMemVariadic], 0);
+    EXPECT_EQ(s.bytesPeak, peak);
+    EXPECT_EQ(s.nFailed, 0);
+    hdql_context_destroy(ctx);
+}
+
+TEST(ContextMemory, limitDeniesAllocations) {
+    hdql_Context_t ctx = hdql_context_create(0x0);
+    hdql_ContextMemoryStats s;
+    hdql_context_get_memory_stats(ctx, &s);
+    hdql_context_set_memory_limit(ctx, s.bytesLive + 1024);
+    EXPECT_EQ(hdql_context_get_memory_limit(ctx), s.bytesLive + 1024);
+    hdql_Datum_t a = hdql_context_alloc(ctx, 512);
+    ASSERT_TRUE(a);
+    EXPECT_FALSE(hdql_context_has_errors(ctx));
+    EXPECT_EQ(hdql_context_alloc(ctx, 600), nullptr);
+    EXPECT_EQ(hdql_context_variadic_datum_alloc(ctx, 600, 600), nullptr);
+    EXPECT_EQ(hdql_context_alloc(ctx, SIZE_MAX), nullptr);
+    ASSERT_TRUE(hdql_context_has_errors(ctx));
+    EXPECT_EQ(hdql_context_error_get(ctx, 0)->code, HDQL_ERR_MEMORY);
+    hdql_context_get_memory_stats(ctx, &s);
+    EXPECT_EQ(s.nFailed, 3);
+    // limit is inherited, accounting is not
+    hdql_Context_t dCtx = hdql_context_create_descendant(ctx, 0x0);
+    EXPECT_EQ(hdql_context_get_memory_limit(dCtx), hdql_context_get_memory_limit(ctx));
+    hdql_context_destroy(dCtx);
+    // memory gets available once freed
+    hdql_context_free(ctx, a);
+    hdql_Datum_t b = hdql_context_alloc(ctx, 600);
+    EXPECT_TRUE(b);
+    hdql_context_free(ctx, b);
+    hdql_context_set_memory_limit(ctx, 0);
+    b = hdql_context_alloc(ctx, 4096);
+    EXPECT_TRUE(b);
+    hdql_context_free(ctx, b);
+    hdql_context_destroy(ctx);
+}
+
+TEST(ContextMemory, queryMemoryIsReturned) {
+    hdql_Context_t ctx = hdql_context_create(0x0);
+    hdql_value_types_table_add_std_types(hdql_context_get_types(ctx));
+    hdql_op_define_std_arith(hdql_context_get_operations(ctx), hdql_context_get_types(ctx));
+    hdql_Compound * root = hdql_compound_new("Empty", ctx);
+    hdql_ContextMemoryStats s0, s;
+    hdql_context_get_memory_stats(ctx, &s0);
+    char errBuf[128] = "";
+    int errDetails[5];
+    hdql_Query * q = hdql_compile_query("(1 + 2)*3 - 4", root, ctx
+            , errBuf, sizeof(errBuf), errDetails);
+    ASSERT_TRUE(q) << errBuf;
+    ASSERT_TRUE(hdql_query_reset(q, NULL, NULL, ctx));
+    hdql_context_get_memory_stats(ctx, &s);
+    EXPECT_GT(s.nLive[hdql_kMemQuery], s0.nLive[hdql_kMemQuery]);
+    hdql_query_destroy(q, ctx);
+    hdql_context_get_memory_stats(ctx, &s);
+    EXPECT_EQ(s.nLive[hdql_kMemQuery], s0.nLive[hdql_kMemQuery]);
+    EXPECT_EQ(s.bytesLiveByCategory[hdql_kMemQuery], s0.bytesLiveByCategory[hdql_kMemQuery]);
+    hdql_compound_destroy(root, ctx);
+    hdql_context_destroy(ctx);
+}
+
+// Compilation and evaluation under any limit either succeed or fail with
+// memory error, all the memory taken is returned
+TEST(ContextMemory, tightLimitFailsWithMemoryError) {
+    size_t nFailed = 0;
+    for(size_t extra = 0; extra < 8192; extra += 8) {
+        hdql_Context_t ctx = hdql_context_create(0x0);
+        hdql_value_types_table_add_std_types(hdql_context_get_types(ctx));
+        hdql_op_define_std_arith(hdql_context_get_operations(ctx), hdql_context_get_types(ctx));
+        hdql_Compound * root = hdql_compound_new("Empty", ctx);
+        hdql_ContextMemoryStats s0, s;
+        hdql_context_get_memory_stats(ctx, &s0);
+        hdql_context_set_memory_limit(ctx, s0.bytesLive + extra);
+        char errBuf[128] = "";
+        int errDetails[5] = {0, 0, 0, 0, 0};
+        hdql_Query * q = hdql_compile_query("(1 + 2)*3 - 4", root, ctx
+                , errBuf, sizeof(errBuf), errDetails);
+        hdql_Datum_t r = nullptr;
+        if(q) {
+            EXPECT_EQ(errDetails[0], 0) << "limit +" << extra;
+            r = hdql_query_reset(q, NULL, NULL, ctx);
+            if(r) {
+                EXPECT_EQ(*reinterpret_cast<hdql_Int_t *>(r), 5) << "limit +" << extra;
+            }
+            hdql_query_destroy(q, ctx);
+        } else {
+            EXPECT_EQ(errDetails[0], HDQL_ERR_MEMORY) << "limit +" << extra;
+        }
+        if(!r) {
+            ++nFailed;
+            ASSERT_TRUE(hdql_context_has_errors(ctx)) << "limit +" << extra;
+            bool isMemoryError = false;
+            for(size_t i = 0; i < hdql_context_errors_count(ctx); ++i)
+                isMemoryError |= hdql_context_error_get(ctx, i)->code == HDQL_ERR_MEMORY;
+            EXPECT_TRUE(isMemoryError) << "limit +" << extra;
+        }
+        hdql_context_get_memory_stats(ctx, &s);
+        EXPECT_EQ(s.bytesLive, s0.bytesLive) << "limit +" << extra;
+        hdql_compound_destroy(root, ctx);
+        hdql_context_destroy(ctx);
+    }
+    // first limits are too tight, last one is enough
+    EXPECT_GT(nFailed, 0);
+    EXPECT_LT(nFailed, 8192/8);
+}
+
+}  // namespace ::hdql::test
+}  // namespace hdql
@@ -0,0 +1,169 @@
+// Tests lookup of value converters in frozen (dense) and plain tables,
+// resolution of multi-step conversions and arithmetic types promotion.
+
+#include "hdql/allocator.h"
+#include "hdql/context.h"
+#include "hdql/errors.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace hdql {
+namespace test {
+
+namespace {
+
+int
+int_to_flt(hdql_Datum * __restrict__ dest, hdql_Datum * __restrict__ src) {
+    *reinterpret_cast<hdql_Flt_t *>(dest) = *reinterpret_cast<hdql_Int_t *>(src) + .5;
+    return HDQL_ERR_CODE_OK;
+}
+
+int
+flt_to_bool(hdql_Datum * __restrict__ dest, hdql_Datum * __restrict__ src) {
+    *reinterpret_cast<hdql_Bool_t *>(dest) = *reinterpret_cast<hdql_Flt_t *>(src) > 1;
+    return HDQL_ERR_CODE_OK;
+}
+
+int
+bool_to_int(hdql_Datum * __restrict__ dest, hdql_Datum * __restrict__ src) {
+    *reinterpret_cast<hdql_Int_t *>(dest) = *reinterpret_cast<hdql_Bool_t *>(src) ? 10 : 20;
+    return HDQL_ERR_CODE_OK;
+}
+
+}  // anon ns
+
+class ConvertersTable : public ::testing::Test {
+protected:
+    hdql_Context_t _ctx;
+    hdql_ValueTypes * _vts;
+    hdql_Converters * _cnvs;
+    hdql_ValueTypeCode_t _int, _flt, _bool;
+public:
+    void SetUp() override {
+        _ctx = hdql_context_create(0x0);
+        _vts = hdql_context_get_types(_ctx);
+        hdql_value_types_table_add_std_types(_vts);
+        _cnvs = hdql_context_get_conversions(_ctx);
+        _int  = hdql_types_get_type_code(_vts, "hdql_Int_t");
+        _flt  = hdql_types_get_type_code(_vts, "hdql_Flt_t");
+        _bool = hdql_types_get_type_code(_vts, "hdql_Bool_t");
+        ASSERT_TRUE(_int && _flt && _bool);
+    }
+
+    void TearDown() override {
+        hdql_context_destroy(_ctx);
+    }
+};
+
+TEST_F(ConvertersTable, frozenTableResolvesConverters) {
+    ASSERT_EQ(HDQL_ERR_CODE_OK, hdql_converters_add(_cnvs, _flt, _int, int_to_flt, _ctx));
+    EXPECT_EQ(HDQL_ERR_CODE_OK, hdql_converters_freeze(_cnvs));
+    EXPECT_EQ(hdql_converters_get(_cnvs, _flt, _int), int_to_flt);
+    EXPECT_FALSE(hdql_converters_get(_cnvs, _int, _flt));
+    EXPECT_FALSE(hdql_converters_get(_cnvs, _flt, HDQL_VALUE_TYPE_CODE_MAX));
+    // frozen table is kept up to date on addition
+    ASSERT_EQ(HDQL_ERR_CODE_OK, hdql_converters_add(_cnvs, _bool, _flt, flt_to_bool, _ctx));
+    EXPECT_EQ(hdql_converters_get(_cnvs, _bool, _flt), flt_to_bool);
+    EXPECT_EQ(HDQL_ERR_NAME_COLLISION
+            , hdql_converters_add(_cnvs, _bool, _flt, int_to_flt, _ctx));
+}
+
+TEST_F(ConvertersTable, descendantFallsBackToParent) {
+    ASSERT_EQ(HDQL_ERR_CODE_OK, hdql_converters_add(_cnvs, _flt, _int, int_to_flt, _ctx));
+    hdql_Context_t dCtx = hdql_context_create_descendant(_ctx, 0x0);
+    hdql_Converters * dCnvs = hdql_context_get_conversions(dCtx);
+    ASSERT_EQ(HDQL_ERR_CODE_OK, hdql_converters_add(dCnvs, _bool, _flt, flt_to_bool, dCtx));
+    for(int nFreeze = 0; nFreeze < 2; ++nFreeze) {
+        // own and inherited
+        EXPECT_EQ(hdql_converters_get(dCnvs, _bool, _flt), flt_to_bool);
+        EXPECT_EQ(hdql_converters_get(dCnvs, _flt, _int), int_to_flt);
+        EXPECT_FALSE(hdql_converters_get(_cnvs, _bool, _flt));
+        EXPECT_EQ(HDQL_ERR_CODE_OK, hdql_converters_freeze(dCnvs));
+    }
+    // addition to parent invalidates descendant's frozen index
+    ASSERT_EQ(HDQL_ERR_CODE_OK, hdql_converters_add(_cnvs, _int, _bool, bool_to_int, _ctx));
+    EXPECT_EQ(hdql_converters_get(dCnvs, _int, _bool), bool_to_int);
+    hdql_context_destroy(dCtx);
+}
+
+TEST_F(ConvertersTable, chainedConversionIsShortest) {
+    ASSERT_EQ(HDQL_ERR_CODE_OK, hdql_converters_add(_cnvs, _flt, _int, int_to_flt, _ctx));
+    ASSERT_EQ(HDQL_ERR_CODE_OK, hdql_converters_add(_cnvs, _bool, _flt, flt_to_bool, _ctx));
+    hdql_TypeConverterChain chain;
+    // no way back
+    EXPECT_EQ(HDQL_ERR_CONVERSION
+            , hdql_converters_get_chained(_cnvs, _int, _bool, &chain, _ctx));
+    EXPECT_EQ(HDQL_ERR_CODE_OK
+            , hdql_converters_get_chained(_cnvs, _bool, _int, &chain, _ctx));
+    ASSERT_EQ(chain.nSteps, 2);
+    EXPECT_EQ(chain.types[0], _int);
+    EXPECT_EQ(chain.types[1], _flt);
+    EXPECT_EQ(chain.types[2], _bool);
+    hdql_Int_t src = 1;
+    hdql_Bool_t dst = false;
+    EXPECT_EQ(HDQL_ERR_CODE_OK, hdql_converters_chain_apply(&chain
+                , reinterpret_cast<hdql_Datum_t>(&dst), reinterpret_cast<hdql_Datum_t>(&src)));
+    EXPECT_TRUE(dst);  // 1 + .5 > 1
+    hdql_converters_chain_free(&chain, _ctx);
+    // cycle back to the same type
+    ASSERT_EQ(HDQL_ERR_CODE_OK, hdql_converters_add(_cnvs, _int, _bool, bool_to_int, _ctx));
+    EXPECT_EQ(HDQL_ERR_CODE_OK
+            , hdql_converters_get_chained(_cnvs, _int, _int, &chain, _ctx));
+    ASSERT_EQ(chain.nSteps, 3);
+    hdql_Int_t r = 0;
+    EXPECT_EQ(HDQL_ERR_CODE_OK, hdql_converters_chain_apply(&chain
+                , reinterpret_cast<hdql_Datum_t>(&r), reinterpret_cast<hdql_Datum_t>(&src)));
+    EXPECT_EQ(r, 10);
+    hdql_converters_chain_free(&chain, _ctx);
+    // direct one is preferred
+    EXPECT_EQ(HDQL_ERR_CODE_OK
+            , hdql_converters_get_chained(_cnvs, _flt, _int, &chain, _ctx));
+    ASSERT_EQ(chain.nSteps, 1);
+    EXPECT_EQ(chain.converters[0], int_to_flt);
+    hdql_converters_chain_free(&chain, _ctx);
+}
+
+TEST_F(ConvertersTable, arithTypesArePromotedSymmetrically) {
+    EXPECT_EQ(hdql_types_numeric_promote(_vts, _int, _flt), _flt);
+    EXPECT_EQ(hdql_types_numeric_promote(_vts, _flt, _int), _flt);
+    const hdql_ValueTypeCode_t i8 = hdql_types_get_type_code(_vts, "int8_t");
+    ASSERT_TRUE(i8);
+    EXPECT_EQ( hdql_types_numeric_promote(_vts, i8, _int)
+             , hdql_types_numeric_promote(_vts, _int, i8) );
+    EXPECT_EQ(hdql_types_numeric_promote(_vts, _int, HDQL_VALUE_TYPE_CODE_MAX), 0);
+    EXPECT_EQ(hdql_types_numeric_promote(_vts, 0x0, _int), 0);
+}
+
+namespace {
+// Allocator filling new blocks with garbage, to reveal uninitialized reads
+void * garbage_alloc(size_t sz, void *) {
+    void * p = malloc(sz);
+    if(p) memset(p, 0xa5, sz);
+    return p;
+}
+void garbage_free(void * p, void *) { free(p); }
+}  // anon ns
+
+TEST(ArithTypePromotionTable, promotesToZeroWithoutArithTypes) {
+    const hdql_Allocator allocator = {NULL, garbage_alloc, garbage_free};
+    hdql_Context_t ctx = hdql_context_create_with_allocator(0x0, &allocator);
+    ASSERT_TRUE(ctx);
+    hdql_ArithTypePromotionTable * t = hdql_arith_type_promotion_create(ctx);
+    ASSERT_TRUE(t);
+    EXPECT_EQ(hdql_arith_type_promote(t, 1, 2), 0);
+    // no arithmetic types defined in a new context
+    EXPECT_EQ(HDQL_ERR_EMPTY_SET
+            , hdql_arith_type_promotion_rebuild(hdql_context_get_types(ctx), t));
+    EXPECT_EQ(hdql_arith_type_promote(t, 1, 2), 0);
+    EXPECT_EQ(hdql_arith_type_promote(t, 0x0, 0x0), 0);
+    hdql_arith_type_promotion_destroy(ctx, t);
+    hdql_context_destroy(ctx);
+}
+
+}  // namespace ::hdql::test
+}  // namespace hdql
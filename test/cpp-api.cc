@@ -282,5 +282,29 @@ TEST_F(TestCppHelpers, UseStaticQueryResultOnAtomicScalarCppWrappers) {
     }
 }
 
+TEST_F(TestCppHelpers, ClonedQueryIteratesIndependently) {
+    Query q(".tracks{h := .hits}.h.x", _rootCompound, _thisContext, _compounds, true);
+    std::unique_ptr<Query> qClone = q.clone();
+    ASSERT_TRUE(qClone);
+    EXPECT_EQ(qClone->keys_depth(), q.keys_depth());
+    EXPECT_EQ(qClone->is_atomic(), q.is_atomic());
+
+    // nested iteration over original and the clone must not interfere
+    size_t nOuter = 0, nInner = 0;
+    float sumOuter = 0, sumInner = 0;
+    for(QueryCursor<float> qc = q.cursor_on<float>(_ev); qc; ++qc) {
+        ++nOuter;
+        sumOuter += qc.get();
+        for(QueryCursor<float> cqc = qClone->cursor_on<float>(_ev); cqc; ++cqc) {
+            ++nInner;
+            sumInner += cqc.get();
+        }
+    }
+    EXPECT_EQ(nOuter, 5);
+    EXPECT_EQ(nInner, 5*5);
+    EXPECT_NEAR(sumOuter, 3.4 + 4.5 + 5.6 + 6.7 + 7.8, 1e-4);
+    EXPECT_NEAR(sumInner, 5*sumOuter, 1e-3);
+}
+
 }  // namespace ::hdql::test
 }  // namespace hdql
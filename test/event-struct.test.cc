@@ -755,3 +755,89 @@ TEST(CppTemplatedInterfaces, VectorCompoundAttributeAccess) {  // {{{
     hdql_context_destroy(context);
 }  // }}} TEST(CppTemplatedInterfaces, VectorCompoundAttributeAccess)
 
+
+//
+// Vector of compound values attribute, batched yield
+TEST(CppTemplatedInterfaces, VectorCompoundAttributeBatchedAccess) {  // {{{
+    // Instantiate context
+    hdql_Context_t context = hdql_context_create(HDQL_CTX_PRINT_PUSH_ERROR);
+    hdql_ValueTypes * valTypes = hdql_context_get_types(context);
+    assert(valTypes);
+    hdql_value_types_table_add_std_types(valTypes);
+
+    // Create compounds index helper
+    hdql::helpers::Compounds compounds;
+    // Create new compounds
+    struct hdql_Compound * trackCompound = hdql_compound_new("Track", context);
+    compounds.emplace(typeid(hdql::test::Track), trackCompound);
+
+    struct hdql_Compound * eventCompound = hdql_compound_new("Event", context);
+    compounds.emplace(typeid(hdql::test::Event), eventCompound);
+    hdql_ValueTypeCode_t keyTypeCode
+        = hdql_types_get_type_code(valTypes, "size_t");
+    ASSERT_NE(0x0, keyTypeCode);
+    {  // Event::tracks
+        struct hdql_Compound * typeInfo
+            = hdql::helpers::IFace<&hdql::test::Event::tracks>::type_info(valTypes, compounds);
+        assert(typeInfo == trackCompound);
+        struct hdql_CollectionAttrInterface iface
+            = hdql::helpers::IFace<&hdql::test::Event::tracks>::iface();
+        struct hdql_AttrDef * ad = hdql_attr_def_create_compound_collection(
+                  typeInfo
+                , &iface
+                , keyTypeCode
+                , NULL  // key type iface
+                , context );
+        hdql_compound_add_attr( eventCompound
+                              , "tracks"
+                              , ad);
+    }
+    const hdql_AttrDef * ad = hdql_compound_get_attr(eventCompound, "tracks");
+    ASSERT_TRUE(ad);  // attribute resolved
+    const hdql_CollectionAttrInterface * iface = hdql_attr_def_collection_iface(ad);
+    ASSERT_TRUE(iface->yield_batch);
+
+    hdql::test::Event event;
+    const size_t nTracks = 7;
+    for(size_t i = 0; i < nTracks; ++i) {
+        event.tracks.push_back(std::make_shared<hdql::test::Track>(
+                    hdql::test::Track{.ndf=static_cast<int>(i)}));
+    }
+
+    // keys for the batch of 3 elements
+    const hdql_ValueInterface * keyIFace = hdql_types_get_type(valTypes, keyTypeCode);
+    ASSERT_TRUE(keyIFace);
+    hdql_Key * keys[3];
+    for(size_t i = 0; i < 3; ++i) {
+        keys[i] = hdql_key_new(context);
+        hdql_key_set_datum(keys[i], keyTypeCode, hdql_context_alloc(context, keyIFace->size));
+    }
+
+    hdql_It_t it = iface->new_iterator( reinterpret_cast<hdql_Datum_t>(&event), iface->definitionData, context );
+    hdql_Datum_t first = iface->reset_iterator(it, reinterpret_cast<hdql_Datum_t>(&event)
+                , iface->definitionData, NULL, keys[0], context);
+    ASSERT_EQ(reinterpret_cast<hdql::test::Track*>(first), event.tracks[0].get());
+    // remaining 6 elements are expected to come in batches of 3, 3, 0
+    size_t nRead = 1;
+    for(size_t nBatch = 0; nBatch < 3; ++nBatch) {
+        hdql_Datum_t dest[3];
+        size_t n = iface->yield_batch(it, iface->definitionData, dest, keys, 3, context);
+        EXPECT_EQ(n, nBatch < 2 ? 3 : 0);
+        for(size_t i = 0; i < n; ++i, ++nRead) {
+            EXPECT_EQ(reinterpret_cast<hdql::test::Track*>(dest[i]), event.tracks[nRead].get());
+            EXPECT_EQ(*reinterpret_cast<size_t*>(hdql_key_datum_get(keys[i])), nRead);
+        }
+    }
+    EXPECT_EQ(nRead, nTracks);
+    // depleted iterator must tolerate further advancing
+    EXPECT_FALSE(iface->yield(it, iface->definitionData, NULL, context));
+
+    iface->destroy_iterator(it, iface->definitionData, context);
+    for(size_t i = 0; i < 3; ++i) hdql_key_destroy(keys[i], context);
+
+    hdql_compound_destroy(trackCompound, context);
+    hdql_compound_destroy(eventCompound, context);
+
+    // delete context
+    hdql_context_destroy(context);
+}  // }}} TEST(CppTemplatedInterfaces, VectorCompoundAttributeBatchedAccess)
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <cstring>
+#include <random>
 #include <stdexcept>
 #include <unordered_map>
 #include <unordered_set>
@@ -230,3 +232,82 @@ TEST_F(HDQLHashTableStressTest, InsertsLookupsDeletionsAndIteration) {
     for(auto vPtr : values) free(vPtr);
 }
 
+
+TEST_F(HDQLHashTable, OpenAddressingBasicOperations) {
+    hdql_ht * ht = hdql_ht_create_with(&_alloc, 2, HDQL_MURMUR3_32_DEFAULT_SEED
+            , HDQL_HT_OPEN_ADDRESSING);
+    ASSERT_NE(ht, nullptr);
+
+    int a = 1, b = 2, c = 3;
+    const char longKey[] = "some rather long key, not stored inline";
+    EXPECT_EQ(HDQL_HT_RC_INSERTED, hdql_ht_s_ins(ht, "a", &a));
+    EXPECT_EQ(HDQL_HT_RC_INSERTED, hdql_ht_s_ins(ht, longKey, &b));
+    EXPECT_EQ(HDQL_HT_RC_UPDATED,  hdql_ht_s_ins(ht, "a", &c));
+    EXPECT_EQ(hdql_ht_s_get(ht, "a"), &c);
+    EXPECT_EQ(hdql_ht_s_get(ht, longKey), &b);
+    EXPECT_EQ(hdql_ht_s_get(ht, "b"), nullptr);
+
+    size_t nb;
+    struct hdql_htEntry * e = hdql_ht_lookup(ht
+            , (const unsigned char *) longKey, strlen(longKey), &nb);
+    ASSERT_NE(e, nullptr);
+    EXPECT_EQ(HDQL_HT_RC_OK, hdql_ht_erase(ht, e, nb));
+    EXPECT_EQ(hdql_ht_s_get(ht, longKey), nullptr);
+    EXPECT_EQ(HDQL_HT_RC_ERR_NOENT, hdql_ht_s_rm(ht, longKey));
+
+    std::set<std::string> keys;
+    auto visit = [](const unsigned char * key, size_t keyLen, void **, void * userdata) {
+        static_cast<std::set<std::string> *>(userdata)->insert(std::string(key, key + keyLen));
+        return 0;
+    };
+    EXPECT_EQ(0, hdql_ht_iter(ht, visit, &keys));
+    EXPECT_EQ(keys, std::set<std::string>{"a"});
+
+    hdql_ht_destroy(ht);
+}
+
+// Random insertions, updates and removals on a small set of keys (thus
+// producing long runs of probed slots to be shifted on removal) must
+// leave table in the same state as of `std::unordered_map`
+TEST_F(HDQLHashTable, OpenAddressingMatchesUnorderedMap) {
+    hdql_ht * ht = hdql_ht_create_with(&_alloc, 0, HDQL_MURMUR3_32_DEFAULT_SEED
+            , HDQL_HT_OPEN_ADDRESSING);
+    ASSERT_NE(ht, nullptr);
+    std::unordered_map<std::string, uintptr_t> expected;
+    std::mt19937 rng(1337);
+    std::uniform_int_distribution<int> keyDist(0, 999), opDist(0, 2);
+    char keyBuffer[64];
+    for(int i = 0; i < 20000; ++i) {
+        const int nKey = keyDist(rng);
+        // mix of short (inline) and long keys
+        snprintf(keyBuffer, sizeof(keyBuffer)
+                , nKey % 2 ? "%d" : "long_prefix_to_exceed_inline_size_%d", nKey);
+        const std::string key = keyBuffer;
+        if(opDist(rng)) {
+            const uintptr_t v = i + 1;
+            int rc = hdql_ht_s_ins(ht, key.c_str(), reinterpret_cast<void *>(v));
+            EXPECT_EQ(rc, expected.count(key) ? HDQL_HT_RC_UPDATED : HDQL_HT_RC_INSERTED);
+            expected[key] = v;
+        } else {
+            int rc = hdql_ht_s_rm(ht, key.c_str());
+            EXPECT_EQ(rc, expected.erase(key) ? HDQL_HT_RC_OK : HDQL_HT_RC_ERR_NOENT);
+        }
+    }
+    for(int nKey = 0; nKey < 1000; ++nKey) {
+        snprintf(keyBuffer, sizeof(keyBuffer)
+                , nKey % 2 ? "%d" : "long_prefix_to_exceed_inline_size_%d", nKey);
+        auto it = expected.find(keyBuffer);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(hdql_ht_s_get(ht, keyBuffer))
+                , it == expected.end() ? 0 : it->second) << keyBuffer;
+    }
+    std::unordered_map<std::string, uintptr_t> iterated;
+    auto visit = [](const unsigned char * key, size_t keyLen, void ** value, void * userdata) {
+        auto & m = *static_cast<std::unordered_map<std::string, uintptr_t> *>(userdata);
+        m[std::string(key, key + keyLen)] = reinterpret_cast<uintptr_t>(*value);
+        return 0;
+    };
+    hdql_ht_iter(ht, visit, &iterated);
+    EXPECT_EQ(iterated, expected);
+
+    hdql_ht_destroy(ht);
+}
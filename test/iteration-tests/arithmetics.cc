@@ -51,3 +51,84 @@ TEST_F(QueryIterationTest, iterationWorksOnDifferentLevelsOfRootObject) {
     CheckAllResolved();
 };
 
+
+//
+// Nested arithmetics on collection are fused into single node keeping keys
+// of the collection argument
+
+TEST_F(QueryIterationTest, fusedArithmeticsIterationWorksOnDifferentLevels) {
+    // batched evaluation: all the operations are binary arithmetics
+    CompileQuery("(.hits.rawData.time + .eventID)*2 - .eventID", true);
+
+    ExpectedEntry expectedQueryResults[] = {
+        {{101, -1}, 2*.01 + 104501 },
+        {{102, -1}, 2*.02 + 104501 },
+        {{103, -1}, 2*.03 + 104501 },
+        {{301, -1}, 2*.05 + 104501 },
+
+        {{401, -1}, 2*.10 + 104502 },
+        {{402, -1}, 2*.11 + 104502 },
+        {{501, -1}, 2*.12 + 104502 },
+        {{502, -1}, 2*.15 + 104502 },
+
+        {{10, -1}, 2*.21 + 104503 },
+        {{11, -1}, 2*.23 + 104503 },
+        {{12, -1}, 2*.24 + 104503 },
+        {{99, -1}, 2*.25 + 104503 },
+        {{-1}}  // sentinel
+    };
+    SetExpectations(expectedQueryResults);
+
+    {
+        hdql::test::Event event;
+        hdql::test::fill_data_sample_1(event);
+        IterateResultsOn(event);
+    }
+
+    {
+        hdql::test::Event event;
+        hdql::test::fill_data_sample_2(event);
+        IterateResultsOn(event);
+    }
+
+    {
+        hdql::test::Event event;
+        hdql::test::fill_data_sample_3(event);
+        IterateResultsOn(event);
+    }
+
+    CheckAllResolved();
+};
+
+TEST_F(QueryIterationTest, fusedArithmeticsWithUnaryOperationWorks) {
+    // unary operation has no batched evaluator, items are evaluated one by one
+    CompileQuery("-(.hits.rawData.time*(-2)) + .eventID", true);
+
+    ExpectedEntry expectedQueryResults[] = {
+        {{101, -1}, 2*.01 + 104501 },
+        {{102, -1}, 2*.02 + 104501 },
+        {{103, -1}, 2*.03 + 104501 },
+        {{301, -1}, 2*.05 + 104501 },
+
+        {{401, -1}, 2*.10 + 104502 },
+        {{402, -1}, 2*.11 + 104502 },
+        {{501, -1}, 2*.12 + 104502 },
+        {{502, -1}, 2*.15 + 104502 },
+        {{-1}}  // sentinel
+    };
+    SetExpectations(expectedQueryResults);
+
+    {
+        hdql::test::Event event;
+        hdql::test::fill_data_sample_1(event);
+        IterateResultsOn(event);
+    }
+
+    {
+        hdql::test::Event event;
+        hdql::test::fill_data_sample_2(event);
+        IterateResultsOn(event);
+    }
+
+    CheckAllResolved();
+};
@@ -0,0 +1,257 @@
+// Tests common sub-expression elimination: structurally identical
+// computations within a scope (virtual compound attributes and filter) are
+// evaluated once per scope instance. Compounds used here are defined with C
+// API to count attribute accesses.
+
+#include "hdql/attr-def.h"
+#include "hdql/compound.h"
+#include "hdql/context.h"
+#include "hdql/function.h"
+#include "hdql/operations.h"
+#include "hdql/query.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include "../basic-context.hh"
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+namespace hdql {
+namespace test {
+
+namespace {
+
+struct Point {
+    hdql_Flt_t x, y;
+};
+
+struct Cloud {
+    std::vector<Point> points;
+};
+
+// Number of `x' attribute accesses
+size_t gNXAccesses = 0;
+
+struct PointsIterator {
+    Cloud * owner;
+    std::vector<Point>::iterator it;
+};
+
+hdql_It_t
+points_new_iterator(hdql_Datum_t, const hdql_Datum *, hdql_Context_t) {
+    return reinterpret_cast<hdql_It_t>(new PointsIterator);
+}
+
+hdql_Datum_t
+points_yield(hdql_It_t it_, const hdql_Datum *, hdql_Key *, hdql_Context_t) {
+    PointsIterator * it = reinterpret_cast<PointsIterator *>(it_);
+    if(it->it == it->owner->points.end()) return NULL;
+    ++(it->it);
+    if(it->it == it->owner->points.end()) return NULL;
+    return reinterpret_cast<hdql_Datum_t>(&*(it->it));
+}
+
+hdql_Datum_t
+points_reset( hdql_It_t it_, hdql_Datum_t owner, const hdql_Datum *
+            , hdql_SelectionArgs_t, hdql_Key *, hdql_Context_t ) {
+    PointsIterator * it = reinterpret_cast<PointsIterator *>(it_);
+    it->owner = reinterpret_cast<Cloud *>(owner);
+    it->it = it->owner->points.begin();
+    if(it->it == it->owner->points.end()) return NULL;
+    return reinterpret_cast<hdql_Datum_t>(&*(it->it));
+}
+
+void
+points_destroy_iterator(hdql_It_t it_, const hdql_Datum *, hdql_Context_t) {
+    delete reinterpret_cast<PointsIterator *>(it_);
+}
+
+hdql_Datum_t
+point_x_reset(hdql_Datum_t owner, hdql_Datum_t, const hdql_Datum *, hdql_Key *, hdql_Context_t) {
+    ++gNXAccesses;
+    return reinterpret_cast<hdql_Datum_t>(&reinterpret_cast<Point *>(owner)->x);
+}
+
+hdql_Datum_t
+point_y_reset(hdql_Datum_t owner, hdql_Datum_t, const hdql_Datum *, hdql_Key *, hdql_Context_t) {
+    return reinterpret_cast<hdql_Datum_t>(&reinterpret_cast<Point *>(owner)->y);
+}
+
+}  // anon ns
+
+class CommonSubexpressionsTest : public TestingContext {
+protected:
+    hdql_Compound * _cloudCompound, * _pointCompound;
+    Cloud _cloud;
+
+    void add_point_attr(const char * name, hdql_Datum_t (*reset)(hdql_Datum_t
+                , hdql_Datum_t, const hdql_Datum *, hdql_Key *, hdql_Context_t)) {
+        hdql_AtomicTypeFeatures typeInfo;
+        typeInfo.arithTypeCode = hdql_types_get_type_code(_valueTypes, "hdql_Flt_t");
+        typeInfo.isReadOnly = 0x1;
+        hdql_ScalarAttrInterface iface = {
+            .definitionData = nullptr,
+            .new_dyn_data = nullptr,
+            .reset = reset,
+            .destroy_dyn_data = nullptr
+        };
+        hdql_compound_add_attr(_pointCompound, name
+                , hdql_attr_def_create_atomic_scalar(&typeInfo, &iface, 0x0, NULL, _ctx));
+    }
+public:
+    void SetUp() override {
+        TestingContext::SetUp();
+        hdql_converters_add_std(hdql_context_get_conversions(_ctx), _valueTypes, _ctx);
+        hdql_functions_add_standard_math(hdql_context_get_functions(_ctx));
+        hdql_functions_add_monoids(hdql_context_get_functions(_ctx));
+        _pointCompound = hdql_compound_new("Point", _ctx);
+        add_point_attr("x", point_x_reset);
+        add_point_attr("y", point_y_reset);
+        _cloudCompound = hdql_compound_new("Cloud", _ctx);
+        {
+            hdql_CollectionAttrInterface iface = {
+                .definitionData = nullptr,
+                .new_iterator = points_new_iterator,
+                .yield = points_yield,
+                .reset_iterator = points_reset,
+                .destroy_iterator = points_destroy_iterator,
+                .compile_selection = nullptr,
+                .free_selection = nullptr,
+                .yield_batch = nullptr,
+                .compile_predicate = nullptr
+            };
+            hdql_compound_add_attr(_cloudCompound, "points"
+                    , hdql_attr_def_create_compound_collection(_pointCompound
+                        , &iface, 0x0, NULL, _ctx));
+        }
+        for(int i = 0; i < 10; ++i) {
+            _cloud.points.push_back(Point{ hdql_Flt_t(i), hdql_Flt_t(10 - i) });
+        }
+        gNXAccesses = 0;
+    }
+
+    void TearDown() override {
+        hdql_context_destroy_virtual_compounds(_ctx);
+        hdql_compound_destroy(_cloudCompound, _ctx);
+        hdql_compound_destroy(_pointCompound, _ctx);
+        TestingContext::TearDown();
+    }
+
+    hdql_Query * compile(const char * expr) {
+        char errBuf[128] = "";
+        int errDetails[5];
+        hdql_Query * q = hdql_compile_query(expr, _cloudCompound, _ctx
+                , errBuf, sizeof(errBuf), errDetails);
+        EXPECT_TRUE(q) << errBuf;
+        return q;
+    }
+
+    std::vector<hdql_Flt_t> collect(hdql_Query * q) {
+        std::vector<hdql_Flt_t> r;
+        for( hdql_Datum_t d = hdql_query_reset(q, reinterpret_cast<hdql_Datum_t>(&_cloud), NULL, _ctx)
+           ; d ; d = hdql_query_get(q, NULL, _ctx) ) {
+            r.push_back(*reinterpret_cast<hdql_Flt_t *>(d));
+        }
+        return r;
+    }
+
+    std::vector<hdql_Flt_t> collect(const char * expr) {
+        std::vector<hdql_Flt_t> r;
+        hdql_Query * q = compile(expr);
+        if(!q) return r;
+        r = collect(q);
+        hdql_query_destroy(q, _ctx);
+        return r;
+    }
+
+    // Returns number of `x' accesses made by evaluating the query, resets
+    // the counter
+    size_t accesses(const char * expr) {
+        gNXAccesses = 0;
+        collect(expr);
+        const size_t n = gNXAccesses;
+        gNXAccesses = 0;
+        return n;
+    }
+};
+
+TEST_F(CommonSubexpressionsTest, sharedSubexpressionIsEvaluatedOncePerInstance) {
+    const size_t nSingle = accesses(".points{a := .x*.x + 1.}.a");
+    auto r = collect(".points{a := .x*.x + 1., b := (.x*.x + 1.)*2.}{s := .a + .b}.s");
+    ASSERT_EQ(r.size(), 10);
+    for(int i = 0; i < 10; ++i) {
+        EXPECT_DOUBLE_EQ(r[i], 3*(i*i + 1.));
+    }
+    // costs the same as single evaluation of `.x*.x + 1.' per point
+    EXPECT_EQ(gNXAccesses, nSingle);
+}
+
+TEST_F(CommonSubexpressionsTest, commonPartOfDifferentSubexpressionsIsShared) {
+    const size_t nSingle = accesses(".points{a := .x*.x}.a");
+    auto r = collect(".points{a := .x*.x + 1., b := (.x*.x + 2.)*2.}{s := .a + .b}.s");
+    ASSERT_EQ(r.size(), 10);
+    for(int i = 0; i < 10; ++i) {
+        EXPECT_DOUBLE_EQ(r[i], (i*i + 1.) + 2*(i*i + 2.));
+    }
+    // only `.x*.x' is shared
+    EXPECT_EQ(gNXAccesses, nSingle);
+}
+
+TEST_F(CommonSubexpressionsTest, functionCallIsSharedWithFilter) {
+    const size_t nSingle = accesses(".points{r := sqrt(.x*.x + .y*.y)}.r");
+    auto r = collect(".points{r := sqrt(.x*.x + .y*.y), rr := sqrt(.x*.x + .y*.y)*2"
+                     " : sqrt(.x*.x + .y*.y) > 8}.rr");
+    std::vector<hdql_Flt_t> expected;
+    for(const Point & p : _cloud.points) {
+        const hdql_Flt_t r = std::sqrt(p.x*p.x + p.y*p.y);
+        if(r > 8) expected.push_back(r*2);
+    }
+    ASSERT_FALSE(expected.empty());
+    ASSERT_EQ(r.size(), expected.size());
+    for(size_t i = 0; i < r.size(); ++i) {
+        EXPECT_DOUBLE_EQ(r[i], expected[i]);
+    }
+    // computed once per point by the filter, reused by `rr'
+    EXPECT_EQ(gNXAccesses, nSingle);
+}
+
+TEST_F(CommonSubexpressionsTest, clonedQuerySharesSubexpressionsOfItsOwn) {
+    hdql_Query * q = compile(".points{a := .x*.x + 1., b := (.x*.x + 1.)*2.}{s := .a + .b}.s");
+    ASSERT_TRUE(q);
+    hdql_Query * c = hdql_query_clone(q, _ctx);
+    ASSERT_TRUE(c);
+    auto r = collect(q);
+    const size_t nOrig = gNXAccesses;
+    gNXAccesses = 0;
+    EXPECT_EQ(collect(c), r);
+    EXPECT_EQ(gNXAccesses, nOrig);
+    hdql_query_destroy(q, _ctx);
+    // clone keeps working when the original is gone
+    EXPECT_EQ(collect(c), r);
+    hdql_query_destroy(c, _ctx);
+}
+
+TEST_F(CommonSubexpressionsTest, impureFunctionCallsAreNotShared) {
+    const size_t nSingle = accesses("{a := narb(.points.x)}.a");
+    ASSERT_EQ(nSingle, _cloud.points.size());
+    hdql_Query * q = compile("{a := narb(.points.x), b := narb(.points.x)}{d := .a - .b}.d");
+    ASSERT_TRUE(q);
+    // every call draws on its own
+    gNXAccesses = 0;
+    auto r = collect(q);
+    ASSERT_EQ(r.size(), 1);
+    EXPECT_EQ(gNXAccesses, 2*nSingle);
+    bool differ = r[0] != 0.;
+    for(int i = 0; i < 32 && !differ; ++i) {
+        r = collect(q);
+        ASSERT_EQ(r.size(), 1);
+        differ = r[0] != 0.;
+    }
+    EXPECT_TRUE(differ);
+    hdql_query_destroy(q, _ctx);
+}
+
+}  // namespace ::hdql::test
+}  // namespace hdql
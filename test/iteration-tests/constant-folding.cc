@@ -0,0 +1,180 @@
+// Tests compile-time constant folding and algebraic simplification: static
+// sub-expressions (including standard math constants and calls of pure
+// functions) become single static values and identity operations are
+// omitted. Compounds used here are defined with C API to count attribute
+// accesses.
+
+#include "hdql/attr-def.h"
+#include "hdql/compound.h"
+#include "hdql/context.h"
+#include "hdql/function.h"
+#include "hdql/operations.h"
+#include "hdql/query.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include "../basic-context.hh"
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+namespace hdql {
+namespace test {
+
+namespace {
+
+struct Sample {
+    hdql_Flt_t x;
+    hdql_Int_t n;
+};
+
+// Number of `x' attribute accesses
+size_t gNXAccesses = 0;
+
+hdql_Datum_t
+sample_x_reset(hdql_Datum_t owner, hdql_Datum_t, const hdql_Datum *, hdql_Key *, hdql_Context_t) {
+    ++gNXAccesses;
+    return reinterpret_cast<hdql_Datum_t>(&reinterpret_cast<Sample *>(owner)->x);
+}
+
+hdql_Datum_t
+sample_n_reset(hdql_Datum_t owner, hdql_Datum_t, const hdql_Datum *, hdql_Key *, hdql_Context_t) {
+    return reinterpret_cast<hdql_Datum_t>(&reinterpret_cast<Sample *>(owner)->n);
+}
+
+}  // anon ns
+
+class ConstantFoldingTest : public TestingContext {
+protected:
+    hdql_Compound * _sampleCompound;
+    Sample _sample;
+
+    void add_attr(const char * name, const char * typeName
+            , hdql_Datum_t (*reset)(hdql_Datum_t, hdql_Datum_t
+                , const hdql_Datum *, hdql_Key *, hdql_Context_t)) {
+        hdql_AtomicTypeFeatures typeInfo;
+        typeInfo.arithTypeCode = hdql_types_get_type_code(_valueTypes, typeName);
+        typeInfo.isReadOnly = 0x1;
+        hdql_ScalarAttrInterface iface = {
+            .definitionData = nullptr,
+            .new_dyn_data = nullptr,
+            .reset = reset,
+            .destroy_dyn_data = nullptr
+        };
+        hdql_compound_add_attr(_sampleCompound, name
+                , hdql_attr_def_create_atomic_scalar(&typeInfo, &iface, 0x0, NULL, _ctx));
+    }
+public:
+    void SetUp() override {
+        TestingContext::SetUp();
+        hdql_converters_add_std(hdql_context_get_conversions(_ctx), _valueTypes, _ctx);
+        hdql_functions_add_standard_math(hdql_context_get_functions(_ctx));
+        hdql_constants_define_standard_math(hdql_context_get_constants(_ctx));
+        _sampleCompound = hdql_compound_new("Sample", _ctx);
+        add_attr("x", "hdql_Flt_t", sample_x_reset);
+        add_attr("n", "hdql_Int_t", sample_n_reset);
+        _sample.x = 1.5;
+        _sample.n = 7;
+        gNXAccesses = 0;
+    }
+
+    void TearDown() override {
+        hdql_context_destroy_virtual_compounds(_ctx);
+        hdql_compound_destroy(_sampleCompound, _ctx);
+        TestingContext::TearDown();
+    }
+
+    hdql_Query * compile(const char * expr) {
+        char errBuf[128] = "";
+        int errDetails[5];
+        hdql_Query * q = hdql_compile_query(expr, _sampleCompound, _ctx
+                , errBuf, sizeof(errBuf), errDetails);
+        EXPECT_TRUE(q) << errBuf;
+        return q;
+    }
+
+    // Returns single result of the query converted to float
+    hdql_Flt_t evaluate(hdql_Query * q) {
+        const hdql_AttrDef * ad = hdql_query_top_attr(q);
+        const hdql_ValueInterface * vi = hdql_types_get_type(_valueTypes
+                , hdql_attr_def_get_atomic_value_type_code(ad));
+        hdql_Datum_t d = hdql_query_reset(q, reinterpret_cast<hdql_Datum_t>(&_sample), NULL, _ctx);
+        EXPECT_TRUE(d);
+        if(!d) return NAN;
+        return vi->get_as_float(d);
+    }
+
+    // Compiles the query and checks whether it is reduced to static value
+    void expect_static(const char * expr, hdql_Flt_t expected) {
+        hdql_Query * q = compile(expr);
+        ASSERT_TRUE(q);
+        EXPECT_TRUE(hdql_attr_def_is_static_const_value(hdql_query_top_attr(q))) << expr;
+        EXPECT_DOUBLE_EQ(evaluate(q), expected) << expr;
+        hdql_query_destroy(q, _ctx);
+    }
+};
+
+TEST_F(ConstantFoldingTest, staticExpressionsWithConstantsAreFolded) {
+    expect_static("2*pi/360", 2*M_PI/360);
+    expect_static("-(3 - 5)", 2);
+}
+
+TEST_F(ConstantFoldingTest, pureFunctionsOfStaticArgumentsAreFolded) {
+    expect_static("sqrt(4.)", 2);
+    expect_static("cos(pi/3)*2", 2*std::cos(M_PI/3));
+    expect_static("pow(2., sqrt(9.))", 8);
+    // not folded, same arguments order
+    hdql_Query * q = compile("pow(.x, 2.)");
+    ASSERT_TRUE(q);
+    EXPECT_FALSE(hdql_attr_def_is_static_const_value(hdql_query_top_attr(q)));
+    EXPECT_DOUBLE_EQ(evaluate(q), 1.5*1.5);
+    hdql_query_destroy(q, _ctx);
+}
+
+TEST_F(ConstantFoldingTest, foldedSubexpressionIsEvaluatedOnce) {
+    hdql_Query * q = compile(".x*2.");
+    ASSERT_TRUE(q);
+    evaluate(q);
+    const size_t nSingle = gNXAccesses;
+    hdql_query_destroy(q, _ctx);
+    gNXAccesses = 0;
+    q = compile(".x*(2*pi/360)");
+    ASSERT_TRUE(q);
+    EXPECT_DOUBLE_EQ(evaluate(q), 1.5*2*M_PI/360);
+    // costs the same as single operation over `.x' and static value
+    EXPECT_EQ(gNXAccesses, nSingle);
+    hdql_query_destroy(q, _ctx);
+}
+
+TEST_F(ConstantFoldingTest, identitiesAreOmitted) {
+    const char * exprs[] = {"-(-.x)", ".x*1.", "1.*.x", ".x/1.", ".x - 0.", ".x*(3 - 2.)"};
+    for(const char * expr : exprs) {
+        hdql_Query * q = compile(expr);
+        ASSERT_TRUE(q);
+        gNXAccesses = 0;
+        EXPECT_DOUBLE_EQ(evaluate(q), 1.5) << expr;
+        // no operation node: attribute accessed once
+        EXPECT_EQ(gNXAccesses, 1) << expr;
+        hdql_query_destroy(q, _ctx);
+    }
+}
+
+TEST_F(ConstantFoldingTest, inexactIdentitiesAreKept) {
+    // `x + 0.' is not an identity for floating point (`-0. + 0.' is `+0.')
+    _sample.x = -0.;
+    hdql_Query * q = compile(".x + 0.");
+    ASSERT_TRUE(q);
+    const hdql_Flt_t r = evaluate(q);
+    EXPECT_EQ(r, 0.);
+    EXPECT_FALSE(std::signbit(r));
+    hdql_query_destroy(q, _ctx);
+
+    q = compile(".n + 0");
+    ASSERT_TRUE(q);
+    EXPECT_DOUBLE_EQ(evaluate(q), 7);
+    hdql_query_destroy(q, _ctx);
+}
+
+}  // namespace ::hdql::test
+}  // namespace hdql
@@ -0,0 +1,345 @@
+// Tests how many times collection interface gets called while evaluating
+// queries over a collection. Compound used here is defined with C API to
+// count yielded elements.
+
+#include "hdql/attr-def.h"
+#include "hdql/compound.h"
+#include "hdql/context.h"
+#include "hdql/errors.h"
+#include "hdql/function.h"
+#include "hdql/query-key.h"
+#include "hdql/query.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include "../basic-context.hh"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace hdql {
+namespace test {
+
+namespace {
+
+struct Counted {
+    std::vector<hdql_Int_t> values;
+};
+
+// Counters of collection interface calls
+struct CollectionCalls {
+    size_t nResets, nYielded, nSize, nIsEmpty;
+} gCalls;
+
+struct CountedIterator {
+    Counted * owner;
+    size_t n;
+};
+
+hdql_It_t
+counted_new_iterator(hdql_Datum_t owner, const hdql_Datum *, hdql_Context_t) {
+    CountedIterator * it = new CountedIterator;
+    it->owner = reinterpret_cast<Counted *>(owner);
+    it->n = 0;
+    return reinterpret_cast<hdql_It_t>(it);
+}
+
+// Sets key and returns current element, if any
+hdql_Datum_t
+counted_current(CountedIterator * it, hdql_Key * key) {
+    if(it->n >= it->owner->values.size()) return NULL;
+    ++gCalls.nYielded;
+    if(key) *reinterpret_cast<size_t *>(hdql_key_datum_get(key)) = it->n;
+    return reinterpret_cast<hdql_Datum_t>(it->owner->values.data() + it->n);
+}
+
+hdql_Datum_t
+counted_yield(hdql_It_t it_, const hdql_Datum *, hdql_Key * key, hdql_Context_t) {
+    CountedIterator * it = reinterpret_cast<CountedIterator *>(it_);
+    if(it->n >= it->owner->values.size()) return NULL;
+    ++it->n;
+    return counted_current(it, key);
+}
+
+hdql_Datum_t
+counted_reset( hdql_It_t it_, hdql_Datum_t owner, const hdql_Datum *
+             , hdql_SelectionArgs_t, hdql_Key * key, hdql_Context_t ) {
+    CountedIterator * it = reinterpret_cast<CountedIterator *>(it_);
+    ++gCalls.nResets;
+    it->owner = reinterpret_cast<Counted *>(owner);
+    it->n = 0;
+    return counted_current(it, key);
+}
+
+void
+counted_destroy_iterator(hdql_It_t it_, const hdql_Datum *, hdql_Context_t) {
+    delete reinterpret_cast<CountedIterator *>(it_);
+}
+
+size_t
+counted_size(hdql_Datum_t owner, const hdql_Datum *, hdql_Context_t) {
+    ++gCalls.nSize;
+    return reinterpret_cast<Counted *>(owner)->values.size();
+}
+
+bool
+counted_is_empty(hdql_Datum_t owner, const hdql_Datum *, hdql_Context_t) {
+    ++gCalls.nIsEmpty;
+    return reinterpret_cast<Counted *>(owner)->values.empty();
+}
+
+}  // anon ns
+
+class CountedCollectionTest : public TestingContext {
+protected:
+    hdql_Compound * _compound;
+    Counted _item;
+    hdql_CollectionAttrInterface _iface;
+
+    void add_collection_attr(const char * name) {
+        hdql_AtomicTypeFeatures typeInfo;
+        typeInfo.arithTypeCode = hdql_types_get_type_code(_valueTypes, "hdql_Int_t");
+        typeInfo.isReadOnly = 0x1;
+        hdql_compound_add_attr(_compound, name
+                , hdql_attr_def_create_atomic_collection(&typeInfo, &_iface
+                    , hdql_types_get_type_code(_valueTypes, "size_t"), NULL, _ctx));
+    }
+public:
+    void SetUp() override {
+        TestingContext::SetUp();
+        hdql_converters_add_std(hdql_context_get_conversions(_ctx), _valueTypes, _ctx);
+        hdql_functions_add_monoids(hdql_context_get_functions(_ctx));
+        _iface = hdql_CollectionAttrInterface{
+              .definitionData = nullptr
+            , .new_iterator = counted_new_iterator
+            , .yield = counted_yield
+            , .reset_iterator = counted_reset
+            , .destroy_iterator = counted_destroy_iterator
+            , .compile_selection = nullptr
+            , .free_selection = nullptr
+            };
+        _compound = hdql_compound_new("Counted", _ctx);
+        add_collection_attr("v");
+        gCalls = CollectionCalls{0, 0, 0, 0};
+    }
+
+    void TearDown() override {
+        hdql_context_destroy_virtual_compounds(_ctx);
+        hdql_compound_destroy(_compound, _ctx);
+        TestingContext::TearDown();
+    }
+
+    hdql_Query * compile(const char * expr) {
+        char errBuf[128] = "";
+        int errDetails[5];
+        hdql_Query * q = hdql_compile_query(expr, _compound, _ctx
+                , errBuf, sizeof(errBuf), errDetails);
+        EXPECT_TRUE(q) << errBuf;
+        return q;
+    }
+
+    // Returns single result of the query converted to integer
+    hdql_Int_t evaluate(hdql_Query * q) {
+        const hdql_AttrDef * ad = hdql_query_top_attr(q);
+        const hdql_ValueInterface * vi = hdql_types_get_type(_valueTypes
+                , hdql_attr_def_get_atomic_value_type_code(ad));
+        hdql_Datum_t d = hdql_query_reset(q, reinterpret_cast<hdql_Datum_t>(&_item), NULL, _ctx);
+        EXPECT_TRUE(d);
+        if(!d) return -1;
+        return vi->get_as_int(d);
+    }
+};
+
+TEST_F(CountedCollectionTest, anyStopsOnFirstTruthyItem) {
+    _item.values = {0, 0, 3, 1, 0, 5};
+    hdql_Query * q = compile("any(.v)");
+    ASSERT_TRUE(q);
+    EXPECT_EQ(1, evaluate(q));
+    EXPECT_EQ(1u, gCalls.nResets);
+    EXPECT_EQ(3u, gCalls.nYielded);
+    // no truthy items -- whole collection is iterated
+    _item.values = {0, 0, 0, 0};
+    gCalls = CollectionCalls{0, 0, 0, 0};
+    EXPECT_EQ(0, evaluate(q));
+    EXPECT_EQ(4u, gCalls.nYielded);
+    hdql_query_destroy(q, _ctx);
+}
+
+TEST_F(CountedCollectionTest, lenAndEmptyUseSizeHooks) {
+    _iface.size = counted_size;
+    _iface.is_empty = counted_is_empty;
+    add_collection_attr("sized");
+    _item.values = {3, 0, 1, 4};
+    hdql_Query * qLen = compile("len(.sized)")
+             , * qEmpty = compile("empty(.sized)")
+             ;
+    ASSERT_TRUE(qLen);
+    ASSERT_TRUE(qEmpty);
+    EXPECT_EQ(4, evaluate(qLen));
+    EXPECT_EQ(0, evaluate(qEmpty));
+    _item.values.clear();
+    EXPECT_EQ(0, evaluate(qLen));
+    EXPECT_EQ(1, evaluate(qEmpty));
+    // hooks are used, collection is never iterated
+    EXPECT_EQ(2u, gCalls.nSize);
+    EXPECT_EQ(2u, gCalls.nIsEmpty);
+    EXPECT_EQ(0u, gCalls.nResets);
+    EXPECT_EQ(0u, gCalls.nYielded);
+    hdql_query_destroy(qLen, _ctx);
+    hdql_query_destroy(qEmpty, _ctx);
+    // collection without hooks is iterated
+    _item.values = {3, 0, 1, 4};
+    hdql_Query * q = compile("len(.v)");
+    ASSERT_TRUE(q);
+    EXPECT_EQ(4, evaluate(q));
+    EXPECT_EQ(1u, gCalls.nResets);
+    EXPECT_EQ(4u, gCalls.nYielded);
+    EXPECT_EQ(2u, gCalls.nSize);
+    hdql_query_destroy(q, _ctx);
+}
+
+TEST_F(CountedCollectionTest, allStopsOnFirstFalsyItem) {
+    _item.values = {1, 2, 0, 3, 4};
+    hdql_Query * q = compile("all(.v)");
+    ASSERT_TRUE(q);
+    EXPECT_EQ(0, evaluate(q));
+    EXPECT_EQ(3u, gCalls.nYielded);
+    hdql_query_destroy(q, _ctx);
+}
+
+// Arithmetics over collection (plain and fused) yields every element with
+// right key across boundaries of prefetched batches
+TEST_F(CountedCollectionTest, arithmeticsCrossesBatchBoundaries) {
+    const std::pair<const char *, hdql_Int_t> cases[] = {{".v + 1", 1}, {"(.v - 1)*2", 2}};
+    for(const auto & [expr, factor] : cases) {
+        for(size_t nItems : {1, 63, 64, 65, 127, 129, 200}) {
+            _item.values.resize(nItems);
+            for(size_t i = 0; i < nItems; ++i) _item.values[i] = i;
+            for(bool withKeys : {false, true}) {
+                hdql_Query * q = compile(expr);
+                ASSERT_TRUE(q);
+                hdql_Key * keys = NULL;
+                hdql_Key * indexKey = NULL;
+                if(withKeys) {
+                    keys = hdql_key_new(_ctx);
+                    ASSERT_EQ(0, hdql_key_reserve_for_query(q, keys, _ctx));
+                    ASSERT_EQ(1u, hdql_key_flat_view_size(keys, _ctx));
+                    ASSERT_EQ(0, hdql_key_flat_view_populate(keys, &indexKey));
+                }
+                size_t n = 0;
+                for(hdql_Datum_t d = hdql_query_reset(q, reinterpret_cast<hdql_Datum_t>(&_item), keys, _ctx)
+                   ; d; d = hdql_query_get(q, keys, _ctx), ++n ) {
+                    const hdql_Int_t expected = factor == 1 ? (hdql_Int_t) n + 1
+                                                            : ((hdql_Int_t) n - 1)*2;
+                    EXPECT_EQ(expected, *reinterpret_cast<hdql_Int_t *>(d))
+                        << expr << ", " << nItems << " items, #" << n;
+                    if(withKeys) {
+                        EXPECT_EQ(n, *reinterpret_cast<size_t *>(hdql_key_datum_get(indexKey)))
+                            << expr << ", " << nItems << " items, #" << n;
+                    }
+                }
+                EXPECT_EQ(nItems, n) << expr << (withKeys ? ", with keys" : "");
+                if(keys) hdql_key_destroy(keys, _ctx);
+                hdql_query_destroy(q, _ctx);
+            }
+        }
+    }
+}
+
+// Prefetching batches of arithmetics does not defeat short-circuiting of
+// `any()' -- only few elements beyond the first truthy one are taken
+TEST_F(CountedCollectionTest, anyStopsEarlyOnArithmetics) {
+    _item.values.assign(1000, 1);
+    for(const char * expr : {"any(.v - 1)", "any((.v - 1)*2)"}) {
+        hdql_Query * q = compile(expr);
+        ASSERT_TRUE(q);
+        for(size_t nTruthy : {0, 2, 40, 300}) {
+            _item.values[nTruthy] = 5;
+            gCalls = CollectionCalls{0, 0, 0, 0};
+            EXPECT_EQ(1, evaluate(q)) << expr;
+            EXPECT_GT(gCalls.nYielded, nTruthy) << expr;
+            EXPECT_LE(gCalls.nYielded, 2*(nTruthy + 1)) << expr;
+            _item.values[nTruthy] = 1;
+        }
+        hdql_query_destroy(q, _ctx);
+    }
+}
+
+// Evaluation of arithmetics over collection (with keys) under any memory
+// limit either yields all the items or fails with memory error, returning
+// memory taken
+TEST_F(CountedCollectionTest, tightLimitFailsWithMemoryError) {
+    _item.values.resize(100);
+    for(size_t i = 0; i < _item.values.size(); ++i) _item.values[i] = i;
+    const std::pair<const char *, size_t> cases[] = {{".v + 1", 1}, {".v*2 + 1", 2}};
+    for(const auto & [expr, factor] : cases) {
+        size_t nFailed = 0;
+        for(size_t extra = 0; extra < 16384; extra += 16) {
+            hdql_ContextMemoryStats sBefore, s0, s;
+            hdql_context_get_memory_stats(_ctx, &sBefore);
+            hdql_Query * q = compile(expr);
+            ASSERT_TRUE(q);
+            hdql_Key * keys = hdql_key_new(_ctx);
+            ASSERT_EQ(0, hdql_key_reserve_for_query(q, keys, _ctx));
+            hdql_context_get_memory_stats(_ctx, &s0);
+            hdql_context_set_memory_limit(_ctx, s0.bytesLive + extra);
+            size_t nItems = 0;
+            for(hdql_Datum_t d = hdql_query_reset(q, reinterpret_cast<hdql_Datum_t>(&_item), keys, _ctx)
+               ; d; d = hdql_query_get(q, keys, _ctx) ) {
+                EXPECT_EQ(factor*nItems + 1, (size_t) *reinterpret_cast<hdql_Int_t *>(d))
+                    << expr << ", limit +" << extra;
+                ++nItems;
+            }
+            if(nItems != _item.values.size()) {
+                ++nFailed;
+                bool isMemoryError = false;
+                for(size_t i = 0; i < hdql_context_errors_count(_ctx); ++i)
+                    isMemoryError |= hdql_context_error_get(_ctx, i)->code == HDQL_ERR_MEMORY;
+                EXPECT_TRUE(isMemoryError) << expr << ", limit +" << extra;
+            }
+            hdql_context_set_memory_limit(_ctx, 0);
+            hdql_context_errors_clear(_ctx);
+            hdql_key_destroy(keys, _ctx);
+            hdql_query_destroy(q, _ctx);
+            hdql_context_get_memory_stats(_ctx, &s);
+            EXPECT_EQ(s.bytesLive, sBefore.bytesLive)
+                << expr << ", limit +" << extra;
+        }
+        EXPECT_GT(nFailed, 0u) << expr;
+        EXPECT_LT(nFailed, 16384u/16) << expr;
+    }
+    // compilation of function call on arithmetics under the limit
+    size_t nFailed = 0;
+    for(size_t extra = 0; extra < 16384; extra += 16) {
+        hdql_ContextMemoryStats s0, s;
+        hdql_context_get_memory_stats(_ctx, &s0);
+        hdql_context_set_memory_limit(_ctx, s0.bytesLive + extra);
+        char errBuf[128] = "";
+        int errDetails[5] = {0, 0, 0, 0, 0};
+        hdql_Query * q = hdql_compile_query("sum(.v*2 + 1) - 2*(3 + 1)", _compound, _ctx
+                , errBuf, sizeof(errBuf), errDetails);
+        if(q) {
+            EXPECT_EQ(errDetails[0], 0) << "limit +" << extra;
+            hdql_Datum_t d = hdql_query_reset(q, reinterpret_cast<hdql_Datum_t>(&_item), NULL, _ctx);
+            if(d) {
+                EXPECT_EQ(100*100 - 8, *reinterpret_cast<hdql_Int_t *>(d)) << "limit +" << extra;
+            } else {
+                ++nFailed;
+                EXPECT_TRUE(hdql_context_has_errors(_ctx)) << "limit +" << extra;
+            }
+            hdql_query_destroy(q, _ctx);
+        } else {
+            ++nFailed;
+            EXPECT_EQ(errDetails[0], HDQL_ERR_MEMORY) << errBuf << ", limit +" << extra;
+        }
+        hdql_context_set_memory_limit(_ctx, 0);
+        hdql_context_errors_clear(_ctx);
+        hdql_context_get_memory_stats(_ctx, &s);
+        EXPECT_EQ(s.bytesLive, s0.bytesLive) << "limit +" << extra;
+    }
+    EXPECT_GT(nFailed, 0u);
+    EXPECT_LT(nFailed, 16384u/16);
+}
+
+}  // namespace ::hdql::test
+}  // namespace hdql
@@ -0,0 +1,69 @@
+#include "../iteration-results.hh"
+#include "../samples.hh"
+#include "hdql/query.h"
+
+#include <gtest/gtest.h>
+
+using hdql::test::QueryIterationTest;
+
+//
+// Scalar expression scope yields value computed for each item, without
+// virtual compound
+
+TEST_F(QueryIterationTest, expressionScopeIteratesOnSample1) {
+    CompileQuery(".tracks{.chi2/.ndf}", true);
+
+    const hdql_AttrDef * ad = hdql_query_top_attr(_query);
+    ASSERT_TRUE(hdql_attr_def_is_atomic(ad));
+    ASSERT_FALSE(hdql_attr_def_is_compound(ad));
+    // collection and expression nodes only
+    ASSERT_EQ(hdql_query_depth(_query), 2);
+
+    ExpectedEntry expectedQueryResults[] = {
+        {{0, -1}, 0.1f/2},
+        {{1, -1}, 10.f/3},
+        {{2, -1}, 7.f/2},
+        {{-1}}
+    };
+    SetExpectations(expectedQueryResults);
+
+    hdql::test::Event ev;
+    fill_data_sample_1(ev);
+    IterateResultsOn(ev);
+
+    CheckAllResolved();
+}
+
+TEST_F(QueryIterationTest, filteredExpressionScopeIteratesOnSample1) {
+    CompileQuery(".tracks{.chi2/.ndf : .ndf > 2}", true);
+
+    ExpectedEntry expectedQueryResults[] = {
+        {{1, -1}, 10.f/3},
+        {{-1}}
+    };
+    SetExpectations(expectedQueryResults);
+
+    hdql::test::Event ev;
+    fill_data_sample_1(ev);
+    IterateResultsOn(ev);
+
+    CheckAllResolved();
+}
+
+TEST_F(QueryIterationTest, filteredCollectionExpressionScopeIteratesOnSample1) {
+    CompileQuery(".tracks{.hits : .chi2 > 5}.energyDeposition", true);
+
+    ExpectedEntry expectedQueryResults[] = {
+        {{2, 103, -1}, 3.},
+        {{2, 202, -1}, 4.},
+        {{2, 301, -1}, 5.},
+        {{-1}}
+    };
+    SetExpectations(expectedQueryResults);
+
+    hdql::test::Event ev;
+    fill_data_sample_1(ev);
+    IterateResultsOn(ev);
+
+    CheckAllResolved();
+}
@@ -0,0 +1,172 @@
+// Tests fusion of nested arithmetic operations: expression sub-tree gets
+// collapsed into single node evaluating instruction list, so every argument
+// is retrieved once per evaluation. Compounds used here are defined with C
+// API to count attribute accesses.
+
+#include "hdql/attr-def.h"
+#include "hdql/compound.h"
+#include "hdql/context.h"
+#include "hdql/function.h"
+#include "hdql/internal-ifaces.h"
+#include "hdql/operations.h"
+#include "hdql/query.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include "../basic-context.hh"
+
+#include <gtest/gtest.h>
+#include <cmath>
+
+namespace hdql {
+namespace test {
+
+namespace {
+
+struct Sample {
+    hdql_Flt_t x;
+    hdql_Int_t n;
+};
+
+// Number of `x' attribute accesses
+size_t gNXAccesses = 0;
+
+hdql_Datum_t
+sample_x_reset(hdql_Datum_t owner, hdql_Datum_t, const hdql_Datum *, hdql_Key *, hdql_Context_t) {
+    ++gNXAccesses;
+    return reinterpret_cast<hdql_Datum_t>(&reinterpret_cast<Sample *>(owner)->x);
+}
+
+hdql_Datum_t
+sample_n_reset(hdql_Datum_t owner, hdql_Datum_t, const hdql_Datum *, hdql_Key *, hdql_Context_t) {
+    return reinterpret_cast<hdql_Datum_t>(&reinterpret_cast<Sample *>(owner)->n);
+}
+
+}  // anon ns
+
+class FusedArithmeticsTest : public TestingContext {
+protected:
+    hdql_Compound * _sampleCompound;
+    Sample _sample;
+
+    void add_attr(const char * name, const char * typeName
+            , hdql_Datum_t (*reset)(hdql_Datum_t, hdql_Datum_t
+                , const hdql_Datum *, hdql_Key *, hdql_Context_t)) {
+        hdql_AtomicTypeFeatures typeInfo;
+        typeInfo.arithTypeCode = hdql_types_get_type_code(_valueTypes, typeName);
+        typeInfo.isReadOnly = 0x1;
+        hdql_ScalarAttrInterface iface = {
+            .definitionData = nullptr,
+            .new_dyn_data = nullptr,
+            .reset = reset,
+            .destroy_dyn_data = nullptr
+        };
+        hdql_compound_add_attr(_sampleCompound, name
+                , hdql_attr_def_create_atomic_scalar(&typeInfo, &iface, 0x0, NULL, _ctx));
+    }
+public:
+    void SetUp() override {
+        TestingContext::SetUp();
+        hdql_converters_add_std(hdql_context_get_conversions(_ctx), _valueTypes, _ctx);
+        hdql_functions_add_standard_math(hdql_context_get_functions(_ctx));
+        _sampleCompound = hdql_compound_new("Sample", _ctx);
+        add_attr("x", "hdql_Flt_t", sample_x_reset);
+        add_attr("n", "hdql_Int_t", sample_n_reset);
+        _sample.x = 1.5;
+        _sample.n = 7;
+        gNXAccesses = 0;
+    }
+
+    void TearDown() override {
+        hdql_context_destroy_virtual_compounds(_ctx);
+        hdql_compound_destroy(_sampleCompound, _ctx);
+        TestingContext::TearDown();
+    }
+
+    hdql_Query * compile(const char * expr) {
+        char errBuf[128] = "";
+        int errDetails[5];
+        hdql_Query * q = hdql_compile_query(expr, _sampleCompound, _ctx
+                , errBuf, sizeof(errBuf), errDetails);
+        EXPECT_TRUE(q) << errBuf;
+        return q;
+    }
+
+    // Returns single result of the query converted to float
+    hdql_Flt_t evaluate(hdql_Query * q) {
+        const hdql_AttrDef * ad = hdql_query_top_attr(q);
+        const hdql_ValueInterface * vi = hdql_types_get_type(_valueTypes
+                , hdql_attr_def_get_atomic_value_type_code(ad));
+        hdql_Datum_t d = hdql_query_reset(q, reinterpret_cast<hdql_Datum_t>(&_sample), NULL, _ctx);
+        EXPECT_TRUE(d);
+        if(!d) return NAN;
+        return vi->get_as_float(d);
+    }
+
+    static bool is_fused(hdql_Query * q) {
+        const hdql_AttrDef * ad = hdql_query_top_attr(q);
+        return hdql_attr_def_is_scalar(ad)
+            && hdql_attr_def_scalar_iface(ad)->reset == _hdql_gScalarFusedArithOpIFace.reset;
+    }
+};
+
+TEST_F(FusedArithmeticsTest, nestedOperationsAreFused) {
+    hdql_Query * q = compile("(.x - 0.5)*.n + 2*.x");
+    ASSERT_TRUE(q);
+    EXPECT_TRUE(is_fused(q));
+    EXPECT_DOUBLE_EQ(evaluate(q), (1.5 - .5)*7 + 2*1.5);
+    // every argument is retrieved once
+    EXPECT_EQ(gNXAccesses, 2);
+    _sample.x = -3;
+    _sample.n = 2;
+    EXPECT_DOUBLE_EQ(evaluate(q), (-3 - .5)*2 + 2*(-3));
+    hdql_query_destroy(q, _ctx);
+}
+
+TEST_F(FusedArithmeticsTest, singleOperationIsNotFused) {
+    hdql_Query * q = compile(".x*.n");
+    ASSERT_TRUE(q);
+    EXPECT_FALSE(is_fused(q));
+    EXPECT_DOUBLE_EQ(evaluate(q), 1.5*7);
+    hdql_query_destroy(q, _ctx);
+}
+
+TEST_F(FusedArithmeticsTest, unaryAndComparisonOperationsAreFused) {
+    hdql_Query * q = compile("-(.x*.n) < -10 && !(.n > 10)");
+    ASSERT_TRUE(q);
+    EXPECT_TRUE(is_fused(q));
+    EXPECT_DOUBLE_EQ(evaluate(q), 1);
+    _sample.n = 11;
+    EXPECT_DOUBLE_EQ(evaluate(q), 0);
+    hdql_query_destroy(q, _ctx);
+}
+
+TEST_F(FusedArithmeticsTest, operationsInFunctionArgumentsAreFused) {
+    hdql_Query * q = compile("sqrt(.x*.x + .n*.n) - 1");
+    ASSERT_TRUE(q);
+    EXPECT_DOUBLE_EQ(evaluate(q), std::sqrt(1.5*1.5 + 7*7) - 1);
+    EXPECT_EQ(gNXAccesses, 2);
+    hdql_query_destroy(q, _ctx);
+}
+
+TEST_F(FusedArithmeticsTest, operationsWithinScopeAreFused) {
+    hdql_Query * q = compile("{a := (.x + 1)*(.x - 1), b := .n : .a/2 + .b > 0}.a");
+    ASSERT_TRUE(q);
+    EXPECT_DOUBLE_EQ(evaluate(q), (1.5 + 1)*(1.5 - 1));
+    hdql_query_destroy(q, _ctx);
+}
+
+TEST_F(FusedArithmeticsTest, clonedFusedExpressionIsIndependent) {
+    hdql_Query * q = compile("(.x + .n)*(.x - .n)");
+    ASSERT_TRUE(q);
+    hdql_Query * c = hdql_query_clone(q, _ctx);
+    ASSERT_TRUE(c);
+    EXPECT_TRUE(is_fused(c));
+    EXPECT_DOUBLE_EQ(evaluate(q), evaluate(c));
+    hdql_query_destroy(q, _ctx);
+    EXPECT_DOUBLE_EQ(evaluate(c), (1.5 + 7)*(1.5 - 7));
+    hdql_query_destroy(c, _ctx);
+}
+
+}  // namespace ::hdql::test
+}  // namespace hdql
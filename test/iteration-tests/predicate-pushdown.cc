@@ -0,0 +1,216 @@
+// Tests predicate pushdown into collection interface: a filter of simple
+// form `.attr <op> <constant>` applied to collection items is handed to the
+// collection interface that then skips items not satisfying the predicate.
+// Compounds used here are defined with C API to provide custom collection
+// interface.
+
+#include "hdql/attr-def.h"
+#include "hdql/compound.h"
+#include "hdql/context.h"
+#include "hdql/operations.h"
+#include "hdql/query.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include "../basic-context.hh"
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+
+namespace hdql {
+namespace test {
+
+namespace {
+
+struct Item {
+    hdql_Flt_t e;
+};
+
+// Items are kept sorted by `e`
+struct Bucket {
+    std::vector<Item> items;
+};
+
+// Number of items yielded by the collection interface
+size_t gNItemsYielded = 0;
+
+// Selection: items with `e' greater (or equal) than threshold
+struct ThresholdSelection {
+    hdql_Flt_t threshold;
+    bool inclusive;
+};
+
+struct ItemsIterator {
+    Bucket * owner;
+    std::vector<Item>::iterator it;
+};
+
+hdql_It_t
+items_new_iterator(hdql_Datum_t, const hdql_Datum *, hdql_Context_t) {
+    return reinterpret_cast<hdql_It_t>(new ItemsIterator);
+}
+
+hdql_Datum_t
+items_yield(hdql_It_t it_, const hdql_Datum *, hdql_Key *, hdql_Context_t) {
+    ItemsIterator * it = reinterpret_cast<ItemsIterator *>(it_);
+    if(it->it == it->owner->items.end()) return NULL;
+    ++(it->it);
+    if(it->it == it->owner->items.end()) return NULL;
+    ++gNItemsYielded;
+    return reinterpret_cast<hdql_Datum_t>(&*(it->it));
+}
+
+hdql_Datum_t
+items_reset( hdql_It_t it_, hdql_Datum_t owner, const hdql_Datum *
+           , hdql_SelectionArgs_t sel_, hdql_Key *, hdql_Context_t ) {
+    ItemsIterator * it = reinterpret_cast<ItemsIterator *>(it_);
+    it->owner = reinterpret_cast<Bucket *>(owner);
+    it->it = it->owner->items.begin();
+    if(sel_) {
+        // sorted items: skip to first one satisfying the predicate
+        const ThresholdSelection * sel
+            = reinterpret_cast<const ThresholdSelection *>(sel_);
+        it->it = std::find_if(it->owner->items.begin(), it->owner->items.end()
+                , [sel](const Item & item) {
+                    return sel->inclusive ? item.e >= sel->threshold
+                                          : item.e >  sel->threshold;
+                });
+    }
+    if(it->it == it->owner->items.end()) return NULL;
+    ++gNItemsYielded;
+    return reinterpret_cast<hdql_Datum_t>(&*(it->it));
+}
+
+void
+items_destroy_iterator(hdql_It_t it_, const hdql_Datum *, hdql_Context_t) {
+    delete reinterpret_cast<ItemsIterator *>(it_);
+}
+
+// Accepts only `.e > <float>' and `.e >= <float>'
+hdql_SelectionArgs_t
+items_compile_predicate( const hdql_CollectionPredicate * p
+                       , hdql_SelectionArgs_t prevSelection
+                       , const hdql_Datum *
+                       , hdql_Context_t ctx
+                       ) {
+    if(prevSelection) return NULL;  // no selection combination
+    if(std::string("e") != p->attrName) return NULL;
+    if(p->opCode != hdql_kOpGT && p->opCode != hdql_kOpGTE) return NULL;
+    if(p->valueTypeCode != hdql_types_get_type_code(hdql_context_get_types(ctx), "hdql_Flt_t"))
+        return NULL;
+    ThresholdSelection * sel = new ThresholdSelection;
+    sel->threshold = *reinterpret_cast<const hdql_Flt_t *>(p->value);
+    sel->inclusive = hdql_kOpGTE == p->opCode;
+    return reinterpret_cast<hdql_SelectionArgs_t>(sel);
+}
+
+void
+items_free_selection(const hdql_Datum *, hdql_SelectionArgs_t sel, hdql_Context_t) {
+    delete reinterpret_cast<ThresholdSelection *>(sel);
+}
+
+hdql_Datum_t
+item_e_reset(hdql_Datum_t owner, hdql_Datum_t, const hdql_Datum *, hdql_Key *, hdql_Context_t) {
+    return reinterpret_cast<hdql_Datum_t>(&reinterpret_cast<Item *>(owner)->e);
+}
+
+}  // anon ns
+
+class PredicatePushdownTest : public TestingContext {
+protected:
+    hdql_Compound * _bucketCompound, * _itemCompound;
+    Bucket _bucket;
+public:
+    void SetUp() override {
+        TestingContext::SetUp();
+        hdql_converters_add_std(hdql_context_get_conversions(_ctx), _valueTypes, _ctx);
+        _itemCompound = hdql_compound_new("Item", _ctx);
+        {
+            hdql_AtomicTypeFeatures typeInfo;
+            typeInfo.arithTypeCode = hdql_types_get_type_code(_valueTypes, "hdql_Flt_t");
+            typeInfo.isReadOnly = 0x1;
+            hdql_ScalarAttrInterface iface = {
+                .definitionData = nullptr,
+                .new_dyn_data = nullptr,
+                .reset = item_e_reset,
+                .destroy_dyn_data = nullptr
+            };
+            hdql_compound_add_attr(_itemCompound, "e"
+                    , hdql_attr_def_create_atomic_scalar(&typeInfo, &iface, 0x0, NULL, _ctx));
+        }
+        _bucketCompound = hdql_compound_new("Bucket", _ctx);
+        {
+            hdql_CollectionAttrInterface iface = {
+                .definitionData = nullptr,
+                .new_iterator = items_new_iterator,
+                .yield = items_yield,
+                .reset_iterator = items_reset,
+                .destroy_iterator = items_destroy_iterator,
+                .compile_selection = nullptr,
+                .free_selection = items_free_selection,
+                .yield_batch = nullptr,
+                .compile_predicate = items_compile_predicate
+            };
+            hdql_compound_add_attr(_bucketCompound, "items"
+                    , hdql_attr_def_create_compound_collection(_itemCompound
+                        , &iface, 0x0, NULL, _ctx));
+        }
+        for(int i = 0; i < 10; ++i) {
+            _bucket.items.push_back(Item{ hdql_Flt_t(i) });
+        }
+        gNItemsYielded = 0;
+    }
+
+    void TearDown() override {
+        hdql_context_destroy_virtual_compounds(_ctx);
+        hdql_compound_destroy(_bucketCompound, _ctx);
+        hdql_compound_destroy(_itemCompound, _ctx);
+        TestingContext::TearDown();
+    }
+
+    std::vector<hdql_Flt_t> collect(const char * expr) {
+        char errBuf[128] = "";
+        int errDetails[5];
+        hdql_Query * q = hdql_compile_query(expr, _bucketCompound, _ctx
+                , errBuf, sizeof(errBuf), errDetails);
+        EXPECT_TRUE(q) << errBuf;
+        std::vector<hdql_Flt_t> r;
+        if(!q) return r;
+        for( hdql_Datum_t d = hdql_query_reset(q, reinterpret_cast<hdql_Datum_t>(&_bucket), NULL, _ctx)
+           ; d ; d = hdql_query_get(q, NULL, _ctx) ) {
+            r.push_back(*reinterpret_cast<hdql_Flt_t *>(d));
+        }
+        hdql_query_destroy(q, _ctx);
+        return r;
+    }
+};
+
+TEST_F(PredicatePushdownTest, supportedPredicateIsPushedDown) {
+    auto r = collect(".items{: .e > 6.5}.e");
+    EXPECT_EQ(r, std::vector<hdql_Flt_t>({7, 8, 9}));
+    // only matching items were yielded by collection
+    EXPECT_EQ(gNItemsYielded, 3);
+}
+
+TEST_F(PredicatePushdownTest, mirroredPredicateIsPushedDown) {
+    auto r = collect(".items{: 7. <= .e}.e");
+    EXPECT_EQ(r, std::vector<hdql_Flt_t>({7, 8, 9}));
+    EXPECT_EQ(gNItemsYielded, 3);
+}
+
+TEST_F(PredicatePushdownTest, unsupportedPredicateIsEvaluatedPerItem) {
+    auto r = collect(".items{: .e < 2.5}.e");
+    EXPECT_EQ(r, std::vector<hdql_Flt_t>({0, 1, 2}));
+    // all items were yielded and filtered generic way
+    EXPECT_EQ(gNItemsYielded, 10);
+}
+
+TEST_F(PredicatePushdownTest, compoundFilterIsEvaluatedPerItem) {
+    auto r = collect(".items{: .e > 6.5 && .e < 8.5}.e");
+    EXPECT_EQ(r, std::vector<hdql_Flt_t>({7, 8}));
+    EXPECT_EQ(gNItemsYielded, 10);
+}
+
+}  // namespace ::hdql::test
+}  // namespace hdql
@@ -0,0 +1,167 @@
+#include "../iteration-results.hh"
+#include "../samples.hh"
+
+#include <gtest/gtest.h>
+
+using hdql::test::QueryIterationTest;
+
+//
+// Cloned queries yield same results as the originals
+
+TEST_F(QueryIterationTest, clonedForwardingAttributeIteratesOnSample1) {
+    CompileQuery(".tracks{h := .hits}.h.energyDeposition", true);
+    hdql_Query * orig = _query;
+    _query = hdql_query_clone(orig, _compounds.context_ptr());
+    ASSERT_TRUE(_query);
+    ASSERT_NE(_query, orig);
+    ASSERT_EQ(hdql_query_depth(_query), hdql_query_depth(orig));
+
+    ExpectedEntry expectedQueryResults[] = {
+        {{0, 101, -1}, 1.},
+        {{0, 102, -1}, 2.},
+        {{2, 103, -1}, 3.},
+        {{2, 202, -1}, 4.},
+        {{2, 301, -1}, 5.},
+        {{-1}}
+    };
+    SetExpectations(expectedQueryResults);
+
+    hdql::test::Event ev;
+    fill_data_sample_1(ev);
+    IterateResultsOn(ev);
+    CheckAllResolved();
+
+    hdql_query_destroy(_query, _compounds.context_ptr());
+    _query = orig;
+}
+
+TEST_F(QueryIterationTest, clonedBoundAttributesProductIteratesOnSample1) {
+    CompileQuery("{th:=*.tracks.hits, h:=*.hits}{dx:=.h.x-.th.x}.dx", true);
+    hdql_Query * orig = _query;
+    _query = hdql_query_clone(orig, _compounds.context_ptr());
+    ASSERT_TRUE(_query);
+
+    ExpectedEntry expectedQueryResults[] = {
+        {{101, 0, 101, -1}, 3.4 - 3.4},
+        {{102, 0, 101, -1}, 4.5 - 3.4},
+        {{103, 0, 101, -1}, 5.6 - 3.4},
+        {{202, 0, 101, -1}, 6.7 - 3.4},
+        {{301, 0, 101, -1}, 7.8 - 3.4},
+
+        {{101, 0, 102, -1}, 3.4 - 4.5},
+        {{102, 0, 102, -1}, 4.5 - 4.5},
+        {{103, 0, 102, -1}, 5.6 - 4.5},
+        {{202, 0, 102, -1}, 6.7 - 4.5},
+        {{301, 0, 102, -1}, 7.8 - 4.5},
+
+        {{101, 2, 103, -1}, 3.4 - 5.6},
+        {{102, 2, 103, -1}, 4.5 - 5.6},
+        {{103, 2, 103, -1}, 5.6 - 5.6},
+        {{202, 2, 103, -1}, 6.7 - 5.6},
+        {{301, 2, 103, -1}, 7.8 - 5.6},
+
+        {{101, 2, 202, -1}, 3.4 - 6.7},
+        {{102, 2, 202, -1}, 4.5 - 6.7},
+        {{103, 2, 202, -1}, 5.6 - 6.7},
+        {{202, 2, 202, -1}, 6.7 - 6.7},
+        {{301, 2, 202, -1}, 7.8 - 6.7},
+
+        {{101, 2, 301, -1}, 3.4 - 7.8},
+        {{102, 2, 301, -1}, 4.5 - 7.8},
+        {{103, 2, 301, -1}, 5.6 - 7.8},
+        {{202, 2, 301, -1}, 6.7 - 7.8},
+        {{301, 2, 301, -1}, 7.8 - 7.8},
+        {{-1}}  // sentinel
+    };
+    SetExpectations(expectedQueryResults);
+
+    hdql::test::Event ev;
+    fill_data_sample_1(ev);
+    IterateResultsOn(ev);
+    CheckAllResolved();
+
+    hdql_query_destroy(_query, _compounds.context_ptr());
+    _query = orig;
+}
+
+//
+// Clone and original do not share runtime state
+
+TEST_F(QueryIterationTest, clonedQueryStateIsIndependent) {
+    CompileQuery(".tracks{h := *.hits}.h.energyDeposition");
+    hdql_Context_t ctx = _compounds.context_ptr();
+    hdql_Query * clone = hdql_query_clone(_query, ctx);
+    ASSERT_TRUE(clone);
+
+    hdql::test::Event ev;
+    fill_data_sample_1(ev);
+    hdql_Datum_t root = reinterpret_cast<hdql_Datum_t>(&ev);
+
+    // take first result from the original
+    size_t nOrig = 0;
+    hdql_Datum_t r = hdql_query_reset(_query, root, NULL, ctx);
+    ASSERT_TRUE(r);
+    ++nOrig;
+    // deplete the clone
+    size_t nClone = 0;
+    for( hdql_Datum_t cr = hdql_query_reset(clone, root, NULL, ctx)
+       ; cr ; cr = hdql_query_get(clone, NULL, ctx) ) {
+        ++nClone;
+    }
+    EXPECT_EQ(nClone, 5);
+    // original continues from where it has been left
+    while((r = hdql_query_get(_query, NULL, ctx))) ++nOrig;
+    EXPECT_EQ(nOrig, 5);
+    ASSERT_FALSE(hdql_context_has_errors(ctx));
+
+    hdql_query_destroy(clone, ctx);
+}
+
+
+//
+// Cloning under memory limit fails cleanly
+
+TEST_F(QueryIterationTest, cloneUnderTightLimitFailsWithMemoryError) {
+    const char * exprs[] = {
+        ".tracks{h := *.hits}.h.energyDeposition",
+        "{th:=*.tracks.hits, h:=*.hits}{dx:=.h.x-.th.x}.dx",
+    };
+    hdql_Context_t ctx = _compounds.context_ptr();
+    for(const char * expr : exprs) {
+        CompileQuery(expr);
+        // copies of virtual compounds are kept by context, so the successful
+        // clone leaves some bytes in use after it is destroyed; the failed
+        // one must not leave more
+        hdql_ContextMemoryStats s0, s;
+        hdql_context_get_memory_stats(ctx, &s0);
+        hdql_Query * clone = hdql_query_clone(_query, ctx);
+        ASSERT_TRUE(clone) << expr;
+        hdql_query_destroy(clone, ctx);
+        hdql_context_get_memory_stats(ctx, &s);
+        const size_t nKeptBytes = s.bytesLive - s0.bytesLive;
+        size_t nFailed = 0;
+        for(size_t extra = 0; extra < 8192; extra += 16) {
+            hdql_context_get_memory_stats(ctx, &s0);
+            hdql_context_set_memory_limit(ctx, s0.bytesLive + extra);
+            clone = hdql_query_clone(_query, ctx);
+            hdql_context_set_memory_limit(ctx, 0);
+            if(clone) {
+                hdql_query_destroy(clone, ctx);
+                continue;
+            }
+            ++nFailed;
+            bool isMemoryError = false;
+            for(size_t i = 0; i < hdql_context_errors_count(ctx); ++i)
+                isMemoryError |= hdql_context_error_get(ctx, i)->code == HDQL_ERR_MEMORY;
+            EXPECT_TRUE(isMemoryError) << expr << ", limit +" << extra;
+            hdql_context_errors_clear(ctx);
+            hdql_context_get_memory_stats(ctx, &s);
+            EXPECT_LE(s.bytesLive - s0.bytesLive, nKeptBytes)
+                << expr << ", limit +" << extra;
+        }
+        EXPECT_GT(nFailed, 0u) << expr;
+        EXPECT_LT(nFailed, 8192u/16) << expr;
+        hdql_query_destroy(_query, ctx);
+        _query = NULL;
+    }
+}
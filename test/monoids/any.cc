@@ -168,3 +168,49 @@ TEST_F(TestMonoidal, anyOfTwoSequences) {
         = hdql_types_get_type(_valueTypes, hdql_attr_def_get_atomic_value_type_code(ad));
     EXPECT_TRUE(vi->get_as_logic(r));
 }
+
+// Convolution is interrupted on first true element; make sure interrupted
+// iteration does not affect subsequent evaluation
+TEST_F(TestMonoidal, anyIsReevaluatedAfterInterruption) {
+    using namespace hdql::test;
+    RootItem root1, root2;
+    for(int v : {1, 0, 0}) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->i32f = v;
+        root1.a.push_back(item);
+    }
+    for(int v : {0, 0}) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->i32f = v;
+        root2.a.push_back(item);
+    }
+    CompileQuery("any(.a.i32f)");
+    const hdql_AttrDef * ad = hdql_query_top_attr(_query);
+    const hdql_ValueInterface * vi
+        = hdql_types_get_type(_valueTypes, hdql_attr_def_get_atomic_value_type_code(ad));
+    hdql_Datum_t r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root1), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    EXPECT_TRUE(vi->get_as_logic(r));
+    r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root2), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    EXPECT_FALSE(vi->get_as_logic(r));
+    r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root1), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    EXPECT_TRUE(vi->get_as_logic(r));
+}
+
+// Interrupted convolution still yields no result if other argument is empty
+TEST_F(TestMonoidal, anyInterruptedWithEmptyArgumentIsNone) {
+    using namespace hdql::test;
+    RootItem root;
+    std::shared_ptr<Item> item1 = std::make_shared<Item>();
+    item1->i32f = 1;
+    root.a.push_back(item1);
+    CompileQuery("any(.a.i32f, .b.i32f)");
+    hdql_Datum_t r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root), NULL, _compounds.context_ptr());
+    ASSERT_FALSE(r);
+}
@@ -271,3 +271,29 @@ TEST_F(TestMonoidal, bOROfCollectionsWithMaxInt) {
 }
 
 
+
+// Convolution saturated with all bits set is interrupted; subsequent
+// evaluation on other data must not be affected
+TEST_F(TestMonoidal, bORIsReevaluatedAfterSaturation) {
+    using namespace hdql::test;
+    RootItem root1, root2;
+    for(int32_t v : {(int32_t) ~0, 0x1, 0x2}) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->i32f = v;
+        root1.a.push_back(item);
+    }
+    for(int32_t v : {0x1, 0x2}) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->i32f = v;
+        root2.a.push_back(item);
+    }
+    CompileQuery("bOR(.a.i32f)");
+    hdql_Datum_t r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root1), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    EXPECT_EQ((int32_t) ~0, *((int32_t *) r));
+    r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root2), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    EXPECT_EQ(0x3, *((int32_t *) r));
+}
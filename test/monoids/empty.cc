@@ -123,3 +123,16 @@ TEST_F(TestMonoidal, emptyOfANonEmptyCollectionIsFalse) {
     EXPECT_FALSE(*((bool*) r));
 }
 
+
+TEST_F(TestMonoidal, emptyOfAFilteredCollectionAccountsForFilter) {
+    using namespace hdql::test;
+    RootItem root;
+    std::shared_ptr<Item> item = std::make_shared<Item>();
+    item->u32f = 1;
+    root.a.push_back(item);
+    CompileQuery("empty(.a{:.u32f > 100})");
+    hdql_Datum_t r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    EXPECT_TRUE(*((bool*) r));
+}
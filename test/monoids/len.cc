@@ -123,3 +123,23 @@ TEST_F(TestMonoidal, lenOfACollection) {
     EXPECT_EQ(3, *((uint64_t*) r));
 }
 
+
+TEST_F(TestMonoidal, lenOfAFilteredCollectionCountsSelectedItems) {
+    using namespace hdql::test;
+    RootItem root;
+    for(uint32_t v : {1, 200, 300}) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->u32f = v;
+        root.a.push_back(item);
+    }
+    // unfiltered collection length is provided by the interface
+    auto iface = hdql::helpers::IFace<&RootItem::a>::iface();
+    ASSERT_TRUE(iface.size);
+    EXPECT_EQ(3, iface.size(reinterpret_cast<hdql_Datum_t>(&root), NULL
+                , _compounds.context_ptr()));
+    CompileQuery("len(.a{:.u32f > 100})");
+    hdql_Datum_t r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    EXPECT_EQ(2, *((uint64_t*) r));
+}
@@ -0,0 +1,173 @@
+#include "hdql/context.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+#include "monoids.hh"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+using ::hdql::test::TestMonoidal;
+
+namespace {
+
+// Two-pass reference values for population moments
+struct ReferenceMoments {
+    double mean, variance, skewness, kurtosis, rms;
+
+    ReferenceMoments(const std::vector<double> & xs) {
+        mean = 0;
+        for(double x : xs) mean += x;
+        mean /= xs.size();
+        double m2 = 0, m3 = 0, m4 = 0, s2 = 0;
+        for(double x : xs) {
+            const double d = x - mean;
+            m2 += d*d;
+            m3 += d*d*d;
+            m4 += d*d*d*d;
+            s2 += x*x;
+        }
+        const double n = xs.size();
+        variance = m2/n;
+        skewness = std::sqrt(n)*m3/std::pow(m2, 1.5);
+        kurtosis = n*m4/(m2*m2) - 3;
+        rms = std::sqrt(s2/n);
+    }
+};
+
+}  // anon ns
+
+// Tests type inference rules
+//
+
+TEST_F(TestMonoidal, varianceOfIntegersResultsInDoubleKeylessScalar) {
+    using namespace hdql::test;
+
+    CompileQuery("variance(.a.i32f)");
+
+    const hdql_AttrDef * ad = hdql_query_top_attr(_query);
+    ASSERT_TRUE(ad);
+    ASSERT_FALSE(hdql_attr_def_is_collection(ad));
+    ASSERT_TRUE(hdql_attr_def_is_atomic(ad));
+    EXPECT_EQ(1, hdql_query_depth(_query));
+
+    hdql_ValueTypeCode_t dbltc = hdql_types_get_type_code(_valueTypes, "double");
+    ASSERT_NE(dbltc, 0x0);
+    EXPECT_EQ(dbltc, hdql_attr_def_get_atomic_value_type_code(ad));
+}
+
+TEST_F(TestMonoidal, stddevOfFloatsResultsInFloatScalar) {
+    using namespace hdql::test;
+
+    CompileQuery("stddev(.a.ff)");
+
+    const hdql_AttrDef * ad = hdql_query_top_attr(_query);
+    ASSERT_TRUE(ad);
+    hdql_ValueTypeCode_t flttc = hdql_types_get_type_code(_valueTypes, "float");
+    ASSERT_NE(flttc, 0x0);
+    EXPECT_EQ(flttc, hdql_attr_def_get_atomic_value_type_code(ad));
+}
+
+TEST_F(TestMonoidal, kurtosisRefusesBooleanType) {
+    using namespace hdql::test;
+    char errBuf[128]; int errDetails[5];
+    _query = hdql_compile_query("kurtosis(.a.bf)", _rootCompound, _compounds.context_ptr()
+            , errBuf, sizeof(errBuf), errDetails );
+    EXPECT_FALSE(_query);
+    EXPECT_EQ( errDetails[0]
+             , HDQL_ERR_TRANSLATION_FAILURE
+             );
+}
+
+// Result value tests
+//
+
+TEST_F(TestMonoidal, varianceOfAnEmptyCollectionIsNone) {
+    using namespace hdql::test;
+    RootItem root;
+    CompileQuery("variance(.a.df)");
+    hdql_Datum_t r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root), NULL, _compounds.context_ptr());
+    ASSERT_FALSE(r);
+}
+
+TEST_F(TestMonoidal, momentsOfASingleElement) {
+    using namespace hdql::test;
+    RootItem root;
+    std::shared_ptr<Item> item1 = std::make_shared<Item>();
+    item1->df = -3.5;
+    root.a.push_back(item1);
+
+    CompileQuery("variance(.a.df)");
+    hdql_Datum_t r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    EXPECT_EQ(0., *reinterpret_cast<double *>(r));
+    hdql_query_destroy(_query, _compounds.context_ptr());
+
+    CompileQuery("rms(.a.df)");
+    r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    EXPECT_DOUBLE_EQ(3.5, *reinterpret_cast<double *>(r));
+    hdql_query_destroy(_query, _compounds.context_ptr());
+
+    // undefined for degenerate distribution
+    CompileQuery("skewness(.a.df)");
+    r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    EXPECT_TRUE(std::isnan(*reinterpret_cast<double *>(r)));
+}
+
+TEST_F(TestMonoidal, momentsOfCollectionsMatchTwoPassValues) {
+    using namespace hdql::test;
+    RootItem root;
+    // large offset makes naive sum-of-squares approach lose all the digits
+    const double offset = 1e9;
+    const std::vector<double> as = {4, 7, 13, 16, 1.5}, bs = {-2, 30};
+    std::vector<double> all;
+    for(double a : as) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->df = offset + a;
+        root.a.push_back(item);
+        all.push_back(a);
+    }
+    for(double b : bs) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->i32f = b;
+        root.b.push_back(item);
+    }
+    const ReferenceMoments ref(all);
+
+    const struct {
+        const char * expr;
+        double expected;
+    } cases[] = {
+        { "variance(.a.df)",    ref.variance },
+        { "stddev(.a.df)",      std::sqrt(ref.variance) },
+        { "skewness(.a.df)",    ref.skewness },
+        { "kurtosis(.a.df)",    ref.kurtosis },
+    };
+    for(const auto & c : cases) {
+        CompileQuery(c.expr);
+        hdql_Datum_t r = hdql_query_reset(_query
+                , reinterpret_cast<hdql_Datum_t>(&root), NULL, _compounds.context_ptr());
+        ASSERT_TRUE(r) << c.expr;
+        EXPECT_NEAR(c.expected, *reinterpret_cast<double *>(r), 1e-6) << c.expr;
+        hdql_query_destroy(_query, _compounds.context_ptr());
+        _query = NULL;
+    }
+
+    // multiple arguments, converted from integer
+    std::vector<double> mixed(as);
+    mixed.insert(mixed.end(), bs.begin(), bs.end());
+    for(auto & item : root.a) item->i32f = static_cast<int32_t>(item->df - offset);
+    CompileQuery("rms(.a.i32f, .b.i32f)");
+    hdql_Datum_t r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root), NULL, _compounds.context_ptr());
+    ASSERT_TRUE(r);
+    // note: 1.5 is truncated to integer
+    mixed[4] = 1;
+    EXPECT_NEAR(ReferenceMoments(mixed).rms, *reinterpret_cast<double *>(r), 1e-9);
+}
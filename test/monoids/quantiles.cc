@@ -0,0 +1,184 @@
+#include "hdql/context.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+#include "monoids.hh"
+#include <gtest/gtest.h>
+#include <memory>
+
+using ::hdql::test::TestMonoidal;
+
+// Tests type inference and arguments validation
+//
+
+TEST_F(TestMonoidal, medianOfIntegersResultsInDoubleKeylessScalar) {
+    using namespace hdql::test;
+
+    CompileQuery("median(.a.i32f)");
+
+    const hdql_AttrDef * ad = hdql_query_top_attr(_query);
+    ASSERT_TRUE(ad);
+    ASSERT_FALSE(hdql_attr_def_is_collection(ad));
+    ASSERT_TRUE(hdql_attr_def_is_atomic(ad));
+    EXPECT_EQ(1, hdql_query_depth(_query));
+
+    hdql_ValueTypeCode_t dbltc = hdql_types_get_type_code(_valueTypes, "double");
+    ASSERT_NE(dbltc, 0x0);
+    EXPECT_EQ(dbltc, hdql_attr_def_get_atomic_value_type_code(ad));
+}
+
+TEST_F(TestMonoidal, quantileRefusesBadArguments) {
+    using namespace hdql::test;
+    const char * exprs[] = {
+        "median(.a.bf)",             // logic type
+        "median(.a)",                // compound type
+        "quantile(.a.df)",           // no quantile
+        "quantile(.a.df, .a.ff)",    // non-static quantile
+        "quantile(.a.df, 1.5)",      // quantile out of range
+        "percentile(.a.df, 101)",    // percentile out of range
+        "median(.a.df, 1)",          // bad accuracy
+        "median(.a.df, 16.5)",       // non-integer accuracy
+        "quantile(.a.df, .5, 16, 1)" // too many arguments
+    };
+    for(const char * expr : exprs) {
+        char errBuf[128]; int errDetails[5];
+        _query = hdql_compile_query(expr, _rootCompound, _compounds.context_ptr()
+                , errBuf, sizeof(errBuf), errDetails );
+        EXPECT_FALSE(_query) << expr;
+        EXPECT_EQ(errDetails[0], HDQL_ERR_TRANSLATION_FAILURE) << expr;
+    }
+}
+
+// Result value tests
+//
+
+namespace {
+double
+evaluate( hdql_Query * q, ::hdql::test::RootItem & root, hdql_Context_t ctx ) {
+    hdql_Datum_t r = hdql_query_reset(q, reinterpret_cast<hdql_Datum_t>(&root), NULL, ctx);
+    EXPECT_TRUE(r);
+    if(!r) return 0;
+    return *reinterpret_cast<double *>(r);
+}
+}  // anon ns
+
+TEST_F(TestMonoidal, medianOfAnEmptyCollectionIsNone) {
+    using namespace hdql::test;
+    RootItem root;
+    CompileQuery("median(.a.df)");
+    hdql_Datum_t r = hdql_query_reset(_query
+            , reinterpret_cast<hdql_Datum_t>(&root), NULL, _compounds.context_ptr());
+    ASSERT_FALSE(r);
+}
+
+TEST_F(TestMonoidal, exactQuantilesOfSmallCollection) {
+    using namespace hdql::test;
+    RootItem root;
+    for(int v : {7, -3, 12, 5}) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->i32f = v;
+        root.a.push_back(item);
+    }
+    // sorted: -3, 5, 7, 12
+    CompileQuery("median(.a.i32f)");
+    EXPECT_DOUBLE_EQ(6., evaluate(_query, root, _compounds.context_ptr()));
+    hdql_query_destroy(_query, _compounds.context_ptr());
+
+    CompileQuery("quantile(.a.i32f, 0)");
+    EXPECT_DOUBLE_EQ(-3., evaluate(_query, root, _compounds.context_ptr()));
+    hdql_query_destroy(_query, _compounds.context_ptr());
+
+    CompileQuery("quantile(.a.i32f, 1)");
+    EXPECT_DOUBLE_EQ(12., evaluate(_query, root, _compounds.context_ptr()));
+    hdql_query_destroy(_query, _compounds.context_ptr());
+
+    // position 3*0.25 = 0.75 between -3 and 5
+    CompileQuery("percentile(.a.i32f, 25)");
+    EXPECT_DOUBLE_EQ(-3. + .75*8, evaluate(_query, root, _compounds.context_ptr()));
+
+    // odd number of elements, instance is re-used
+    root.a.pop_back();
+    EXPECT_DOUBLE_EQ(-3. + .5*10, evaluate(_query, root, _compounds.context_ptr()));
+}
+
+TEST_F(TestMonoidal, approximateQuantilesOfLargeCollection) {
+    using namespace hdql::test;
+    RootItem root;
+    const int n = 5000;
+    // permutation of [0:n) as 1999 and n are co-prime
+    for(int i = 0; i < n; ++i) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->df = (i*1999) % n;
+        root.a.push_back(item);
+    }
+    // accuracy enough for exact result
+    CompileQuery("median(.a.df, 8192)");
+    EXPECT_DOUBLE_EQ((n - 1)/2., evaluate(_query, root, _compounds.context_ptr()));
+    hdql_query_destroy(_query, _compounds.context_ptr());
+
+    // sketch, few percents of rank error at most
+    CompileQuery("quantile(.a.df, 0.9, 64)");
+    const double q90 = evaluate(_query, root, _compounds.context_ptr());
+    EXPECT_NEAR(.9*(n - 1), q90, .03*n);
+    // repeated evaluation is not affected by previous state
+    EXPECT_DOUBLE_EQ(q90, evaluate(_query, root, _compounds.context_ptr()));
+    hdql_query_destroy(_query, _compounds.context_ptr());
+
+    CompileQuery("median(.a.df)");
+    EXPECT_NEAR((n - 1)/2., evaluate(_query, root, _compounds.context_ptr()), .01*n);
+}
+
+TEST_F(TestMonoidal, quantileMergesLevelsInEvaluationFrame) {
+    using namespace hdql::test;
+    RootItem root;
+    for(int i = 0; i < 1000; ++i) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->df = i;
+        root.a.push_back(item);
+    }
+    hdql_Context_t ctx = _compounds.context_ptr();
+    CompileQuery("quantile(.a.df, 0.5, 16)");
+    const double q50 = evaluate(_query, root, ctx);
+    EXPECT_EQ(0u, hdql_context_frame_depth(ctx));
+    // merging buffer is taken from retained frame arena, so repeated
+    // evaluation makes no new allocations
+    hdql_ContextMemoryStats before, after;
+    hdql_context_get_memory_stats(ctx, &before);
+    EXPECT_DOUBLE_EQ(q50, evaluate(_query, root, ctx));
+    hdql_context_get_memory_stats(ctx, &after);
+    EXPECT_EQ(0u, hdql_context_frame_depth(ctx));
+    EXPECT_EQ(before.bytesLive, after.bytesLive);
+    EXPECT_EQ(before.bytesPeak, after.bytesPeak);
+}
+
+TEST_F(TestMonoidal, quantileCloneUnderTightLimitFailsCleanly) {
+    using namespace hdql::test;
+    RootItem root;
+    for(int i = 0; i < 100; ++i) {
+        std::shared_ptr<Item> item = std::make_shared<Item>();
+        item->df = i;
+        root.a.push_back(item);
+    }
+    hdql_Context_t ctx = _compounds.context_ptr();
+    CompileQuery("quantile(.a.df, 0.5, 16)");
+    const double q50 = evaluate(_query, root, ctx);
+    size_t nFailed = 0;
+    for(size_t extra = 0; extra < 4096; extra += 8) {
+        hdql_ContextMemoryStats s0, s;
+        hdql_context_get_memory_stats(ctx, &s0);
+        hdql_context_set_memory_limit(ctx, s0.bytesLive + extra);
+        hdql_Query * clone = hdql_query_clone(_query, ctx);
+        hdql_context_set_memory_limit(ctx, 0);
+        if(clone) {
+            EXPECT_DOUBLE_EQ(q50, evaluate(clone, root, ctx)) << "limit +" << extra;
+            hdql_query_destroy(clone, ctx);
+        } else {
+            ++nFailed;
+        }
+        hdql_context_errors_clear(ctx);
+        // partial copies of the query and its parameters are not kept
+        hdql_context_get_memory_stats(ctx, &s);
+        EXPECT_EQ(s.bytesLive, s0.bytesLive) << "limit +" << extra;
+    }
+    EXPECT_GT(nFailed, 0u);
+    EXPECT_LT(nFailed, 4096u/8);
+}
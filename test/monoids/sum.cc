@@ -252,3 +252,24 @@ TEST_F(TestMonoidal, sumOfCollections) {
     EXPECT_EQ(-10, vi->get_as_int(r));
 }
 
+
+TEST_F(TestMonoidal, sumCloneUnderTightLimitFailsCleanly) {
+    using namespace hdql::test;
+    hdql_Context_t ctx = _compounds.context_ptr();
+    CompileQuery("sum(.b.u16f, .a.i64f)");
+    size_t nFailed = 0;
+    for(size_t extra = 0; extra < 4096; extra += 8) {
+        hdql_ContextMemoryStats s0, s;
+        hdql_context_get_memory_stats(ctx, &s0);
+        hdql_context_set_memory_limit(ctx, s0.bytesLive + extra);
+        hdql_Query * clone = hdql_query_clone(_query, ctx);
+        hdql_context_set_memory_limit(ctx, 0);
+        if(clone) hdql_query_destroy(clone, ctx);
+        else ++nFailed;
+        hdql_context_errors_clear(ctx);
+        hdql_context_get_memory_stats(ctx, &s);
+        EXPECT_EQ(s.bytesLive, s0.bytesLive) << "limit +" << extra;
+    }
+    EXPECT_GT(nFailed, 0u);
+    EXPECT_LT(nFailed, 4096u/8);
+}
@@ -0,0 +1,165 @@
+// Tests lookup of arithmetic operations in frozen (dense) and plain tables,
+// along the chain of descendant contexts.
+
+#include "hdql/context.h"
+#include "hdql/operations.h"
+#include "hdql/types.h"
+#include "hdql/value.h"
+
+#include <gtest/gtest.h>
+
+namespace hdql {
+namespace test {
+
+namespace {
+
+int
+dummy_op(const hdql_Datum *, const hdql_Datum *, hdql_Datum_t) {
+    return 0;
+}
+
+}  // anon ns
+
+class OperationsTable : public ::testing::Test {
+protected:
+    hdql_Context_t _ctx;
+    hdql_Operations * _ops;
+    hdql_ValueTypeCode_t _int, _flt, _bool;
+public:
+    void SetUp() override {
+        _ctx = hdql_context_create(0x0);
+        hdql_ValueTypes * vts = hdql_context_get_types(_ctx);
+        hdql_value_types_table_add_std_types(vts);
+        _ops = hdql_context_get_operations(_ctx);
+        hdql_op_define_std_arith(_ops, vts);  // (freezes the table)
+        _int  = hdql_types_get_type_code(vts, "hdql_Int_t");
+        _flt  = hdql_types_get_type_code(vts, "hdql_Flt_t");
+        _bool = hdql_types_get_type_code(vts, "hdql_Bool_t");
+        ASSERT_TRUE(_int && _flt && _bool);
+    }
+
+    void TearDown() override {
+        hdql_context_destroy(_ctx);
+    }
+};
+
+TEST_F(OperationsTable, frozenTableResolvesStandardOperations) {
+    hdql_OperationEvaluator_t e = hdql_op_get(_ops, _int, hdql_kOpSum, _int);
+    ASSERT_TRUE(e);
+    EXPECT_EQ(e->returnType, _int);
+    e = hdql_op_get(_ops, _int, hdql_kOpProduct, _flt);
+    ASSERT_TRUE(e);
+    EXPECT_EQ(e->returnType, _flt);
+    e = hdql_op_get(_ops, _flt, hdql_kOpLT, _int);
+    ASSERT_TRUE(e);
+    EXPECT_EQ(e->returnType, _bool);
+    e = hdql_op_get(_ops, _flt, hdql_kUOpMinus, 0x0);
+    ASSERT_TRUE(e);
+    EXPECT_EQ(e->returnType, _flt);
+    // not defined
+    EXPECT_FALSE(hdql_op_get(_ops, _flt, hdql_kOpBAnd, _flt));
+    EXPECT_FALSE(hdql_op_get(_ops, _flt, hdql_kUOpBNot, 0x0));
+    EXPECT_FALSE(hdql_op_get(_ops, HDQL_VALUE_TYPE_CODE_MAX, hdql_kOpSum, _int));
+}
+
+TEST_F(OperationsTable, definitionsAfterFreezeAreVisible) {
+    EXPECT_FALSE(hdql_op_get(_ops, _flt, hdql_kOpBAnd, _flt));
+    hdql_OperationEvaluator ev = {_flt, dummy_op};
+    EXPECT_EQ(0, hdql_op_define(_ops, _flt, hdql_kOpBAnd, _flt, &ev));
+    hdql_OperationEvaluator_t e = hdql_op_get(_ops, _flt, hdql_kOpBAnd, _flt);
+    ASSERT_TRUE(e);
+    EXPECT_EQ(e->op, dummy_op);
+    EXPECT_EQ(0, hdql_op_freeze(_ops));
+    e = hdql_op_get(_ops, _flt, hdql_kOpBAnd, _flt);
+    ASSERT_TRUE(e);
+    EXPECT_EQ(e->op, dummy_op);
+}
+
+TEST_F(OperationsTable, descendantOverridesParentDefinitions) {
+    hdql_Context_t dCtx = hdql_context_create_descendant(_ctx, 0x0);
+    hdql_Operations * dOps = hdql_context_get_operations(dCtx);
+    // no own definitions -- resolved by parent
+    EXPECT_EQ(hdql_op_get(dOps, _int, hdql_kOpSum, _int)
+            , hdql_op_get(_ops, _int, hdql_kOpSum, _int));
+    hdql_OperationEvaluator ev = {_int, dummy_op};
+    EXPECT_EQ(0, hdql_op_define(dOps, _int, hdql_kOpSum, _int, &ev));
+    for(int nFreeze = 0; nFreeze < 2; ++nFreeze) {
+        hdql_OperationEvaluator_t e = hdql_op_get(dOps, _int, hdql_kOpSum, _int);
+        ASSERT_TRUE(e);
+        EXPECT_EQ(e->op, dummy_op);
+        e = hdql_op_get(_ops, _int, hdql_kOpSum, _int);
+        ASSERT_TRUE(e);
+        EXPECT_NE(e->op, dummy_op);
+        // inherited one
+        EXPECT_EQ(hdql_op_get(dOps, _int, hdql_kOpMinus, _flt)
+                , hdql_op_get(_ops, _int, hdql_kOpMinus, _flt));
+        EXPECT_EQ(0, hdql_op_freeze(dOps));
+    }
+    // definition in parent invalidates descendant's frozen index
+    hdql_OperationEvaluator ev2 = {_flt, dummy_op};
+    EXPECT_EQ(0, hdql_op_define(_ops, _flt, hdql_kOpBOr, _flt, &ev2));
+    hdql_OperationEvaluator_t e = hdql_op_get(dOps, _flt, hdql_kOpBOr, _flt);
+    ASSERT_TRUE(e);
+    EXPECT_EQ(e->op, dummy_op);
+    hdql_context_destroy(dCtx);
+}
+
+TEST_F(OperationsTable, batchedOperationsMatchElementwiseOnes) {
+    // length not multiple of any vector width to cover the tail
+    const size_t n = 37;
+    hdql_Flt_t fa[n], fr[n];
+    hdql_Int_t ia[n];
+    for(size_t i = 0; i < n; ++i) {
+        fa[i] = .5*i + .25;
+        ia[i] = 7*i - 100;
+    }
+    const hdql_Flt_t fs = 1.25;
+    const hdql_Int_t is = 3;
+    // same types, packed by broadcast
+    hdql_OperationEvaluator_t e = hdql_op_get(_ops, _flt, hdql_kOpProduct, _flt);
+    ASSERT_TRUE(e);
+    ASSERT_TRUE(e->batchOp);
+    EXPECT_EQ(0, e->batchOp( (const hdql_Datum *) fa, sizeof(hdql_Flt_t)
+                           , (const hdql_Datum *) &fs, 0
+                           , n, (hdql_Datum_t) fr ));
+    for(size_t i = 0; i < n; ++i) {
+        hdql_Flt_t r;
+        e->op((const hdql_Datum *) (fa + i), (const hdql_Datum *) &fs, (hdql_Datum_t) &r);
+        EXPECT_EQ(r, fr[i]) << " at #" << i;
+    }
+    // broadcast by packed, integers
+    hdql_Int_t ir[n];
+    e = hdql_op_get(_ops, _int, hdql_kOpMinus, _int);
+    ASSERT_TRUE(e);
+    ASSERT_TRUE(e->batchOp);
+    EXPECT_EQ(0, e->batchOp( (const hdql_Datum *) &is, 0
+                           , (const hdql_Datum *) ia, sizeof(hdql_Int_t)
+                           , n, (hdql_Datum_t) ir ));
+    for(size_t i = 0; i < n; ++i) {
+        EXPECT_EQ(is - ia[i], ir[i]) << " at #" << i;
+    }
+    // mixed types, packed by packed
+    e = hdql_op_get(_ops, _int, hdql_kOpDivide, _flt);
+    ASSERT_TRUE(e);
+    ASSERT_TRUE(e->batchOp);
+    EXPECT_EQ(0, e->batchOp( (const hdql_Datum *) ia, sizeof(hdql_Int_t)
+                           , (const hdql_Datum *) fa, sizeof(hdql_Flt_t)
+                           , n, (hdql_Datum_t) fr ));
+    for(size_t i = 0; i < n; ++i) {
+        hdql_Flt_t r;
+        e->op((const hdql_Datum *) (ia + i), (const hdql_Datum *) (fa + i), (hdql_Datum_t) &r);
+        EXPECT_EQ(r, fr[i]) << " at #" << i;
+    }
+    // non-arithmetic operations and user definitions have no batched version
+    e = hdql_op_get(_ops, _flt, hdql_kOpLT, _flt);
+    ASSERT_TRUE(e);
+    EXPECT_FALSE(e->batchOp);
+    hdql_OperationEvaluator ev = {_flt, dummy_op};
+    EXPECT_EQ(0, hdql_op_define(_ops, _flt, hdql_kOpBAnd, _flt, &ev));
+    e = hdql_op_get(_ops, _flt, hdql_kOpBAnd, _flt);
+    ASSERT_TRUE(e);
+    EXPECT_FALSE(e->batchOp);
+}
+
+}  // namespace ::hdql::test
+}  // namespace hdql
@@ -0,0 +1,239 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "events-struct.hh"
+#include "samples.hh"
+
+#include "hdql/attr-def.h"
+#include "hdql/errors.h"
+#include "hdql/helpers/query-results-parallel.h"
+#include "hdql/query-key.h"
+#include "hdql/query.h"
+#include "hdql/value.h"
+
+//                                                                    ________
+// _________________________________________________________________/ Fixture
+
+namespace {
+
+// Collects raw bytes of values and datum keys of every record
+struct RecordsCollector {
+    hdql_Context_t ctx;
+    size_t valueSize;
+    hdql_Key ** kv;
+    size_t nKeys;
+    std::vector<std::string> records;
+
+    static int handle_result_type(const hdql_AttrDef * ad, void * ud) {
+        auto self = reinterpret_cast<RecordsCollector *>(ud);
+        const hdql_ValueInterface * vi = hdql_types_get_type(
+                hdql_context_get_types(self->ctx),
+                hdql_attr_def_get_atomic_value_type_code(ad));
+        self->valueSize = vi ? vi->size : 0;
+        return vi ? 0 : -1;
+    }
+
+    static int handle_keys(hdql_Key *, hdql_Key ** kv, size_t nKeys, void * ud) {
+        auto self = reinterpret_cast<RecordsCollector *>(ud);
+        self->kv = kv;
+        self->nKeys = nKeys;
+        return 0;
+    }
+
+    static int handle_record(hdql_Datum_t d, void * ud) {
+        auto self = reinterpret_cast<RecordsCollector *>(ud);
+        std::string rec(reinterpret_cast<const char *>(d), self->valueSize);
+        for(size_t i = 0; i < self->nKeys; ++i) {
+            if(!hdql_key_is_datum(self->kv[i])) continue;
+            const hdql_ValueInterface * vi = hdql_types_get_type(
+                    hdql_context_get_types(self->ctx),
+                    hdql_key_datum_get_type_code(self->kv[i]));
+            rec.append(reinterpret_cast<const char *>(hdql_key_datum_get(self->kv[i])), vi->size);
+        }
+        self->records.push_back(rec);
+        return 0;
+    }
+
+    RecordsCollector(hdql_Context_t ctx_) : ctx(ctx_), valueSize(0), kv(nullptr), nKeys(0) {}
+
+    hdql_iQueryResultsHandler iface() {
+        hdql_iQueryResultsHandler iqr = {
+              .userdata = this
+            , .handle_result_type = handle_result_type
+            , .handle_keys = handle_keys
+            , .finalize_schema = nullptr
+            , .handle_record = handle_record
+        };
+        return iqr;
+    }
+};
+
+class ParallelResultsTest : public hdql::test::TestingEventStruct {
+protected:
+    std::vector<hdql::test::Event> _events;
+    std::vector<hdql_Datum *> _roots;
+
+    void SetUp() override {
+        TestingEventStruct::SetUp();
+        _events.resize(300);
+        for(size_t i = 0; i < _events.size(); ++i) {
+            switch(i%3) {
+                case 0: hdql::test::fill_data_sample_1(_events[i]); break;
+                case 1: hdql::test::fill_data_sample_2(_events[i]); break;
+                case 2: hdql::test::fill_data_sample_3(_events[i]); break;
+            };
+            _events[i].eventID = i;
+            _roots.push_back(reinterpret_cast<hdql_Datum *>(&_events[i]));
+        }
+    }
+
+    std::vector<std::string> collect(size_t nWorkers, size_t windowSize) {
+        hdql_Context_t ctx = _compounds.context_ptr();
+        RecordsCollector c(ctx);
+        hdql_iQueryResultsHandler iqr = c.iface();
+        hdql_QueryResultsParallelDriver * drv
+            = hdql_query_results_parallel_init(_query, &iqr, nWorkers, windowSize, ctx);
+        EXPECT_TRUE(drv);
+        if(!drv) return c.records;
+        EXPECT_EQ(0, hdql_query_results_parallel_process(_roots.data(), _roots.size(), drv));
+        hdql_query_results_parallel_destroy(drv);
+        return c.records;
+    }
+};
+
+// Scalar attribute of plain `int32_t` root datum, fails on negative values
+hdql_Datum_t
+failing_attr_new_dyn_data(hdql_Datum_t, const hdql_Datum *, hdql_Context_t) {
+    return reinterpret_cast<hdql_Datum_t>(new int32_t(0));
+}
+
+hdql_Datum_t
+failing_attr_reset( hdql_Datum_t owner, hdql_Datum_t dynData
+                  , const hdql_Datum *, hdql_Key *, hdql_Context_t ctx ) {
+    const int32_t v = *reinterpret_cast<int32_t *>(owner);
+    if(v < 0) {
+        hdql_context_err_push(ctx, HDQL_ERR_INTERFACE_ERROR
+                , "negative value %d", (int) v);
+        return NULL;
+    }
+    *reinterpret_cast<int32_t *>(dynData) = 10*v;
+    return dynData;
+}
+
+void
+failing_attr_destroy_dyn_data(hdql_Datum_t dynData, const hdql_Datum *, hdql_Context_t) {
+    delete reinterpret_cast<int32_t *>(dynData);
+}
+
+hdql_ScalarAttrInterface gFailingAttrIFace = {
+      .definitionData = NULL
+    , .new_dyn_data = failing_attr_new_dyn_data
+    , .reset = failing_attr_reset
+    , .destroy_dyn_data = failing_attr_destroy_dyn_data
+};
+
+}  // anonymous namespace
+
+//                                                                      _____
+// ___________________________________________________________________/ Tests
+
+TEST_F(ParallelResultsTest, deliversRecordsInOrder) {
+    CompileQuery(".tracks{h := .hits}.h.energyDeposition");
+    auto sequential = collect(0, 0);
+    ASSERT_FALSE(sequential.empty());
+    EXPECT_EQ(sequential, collect(1, 0));
+    EXPECT_EQ(sequential, collect(4, 7));  // multiple windows, uneven split
+}
+
+TEST_F(ParallelResultsTest, deliversProductRecordsInOrder) {
+    CompileQuery("{th:=*.tracks.hits, h:=*.hits}{dx:=.h.x-.th.x}.dx");
+    auto sequential = collect(0, 0);
+    ASSERT_FALSE(sequential.empty());
+    EXPECT_EQ(sequential, collect(3, 16));
+}
+
+TEST_F(ParallelResultsTest, rejectsCompoundResults) {
+    CompileQuery(".tracks");
+    RecordsCollector c(_compounds.context_ptr());
+    hdql_iQueryResultsHandler iqr = c.iface();
+    EXPECT_FALSE(hdql_query_results_parallel_init(_query, &iqr, 2, 0
+                , _compounds.context_ptr()));
+    EXPECT_TRUE(hdql_context_has_errors(_compounds.context_ptr()));
+}
+
+TEST_F(ParallelResultsTest, reportsFirstFailedEvaluation) {
+    hdql_Context_t ctx = _compounds.context_ptr();
+    hdql_AtomicTypeFeatures typeInfo;
+    typeInfo.isReadOnly = 0x1;
+    typeInfo.arithTypeCode = hdql_types_get_type_code(
+            hdql_context_get_types(ctx), "int32_t");
+    ASSERT_NE(0x0, typeInfo.arithTypeCode);
+    hdql_AttrDef * ad = hdql_attr_def_create_atomic_scalar(&typeInfo
+            , &gFailingAttrIFace, 0x0, NULL, ctx);
+    ASSERT_TRUE(ad);
+    _query = hdql_query_create(ad, NULL, ctx);
+    ASSERT_TRUE(_query);
+
+    std::vector<int32_t> values(50);
+    for(size_t i = 0; i < values.size(); ++i) values[i] = i;
+    values[17] = values[41] = -1;
+    std::vector<hdql_Datum *> roots;
+    for(auto & v : values) roots.push_back(reinterpret_cast<hdql_Datum *>(&v));
+
+    for(size_t nWorkers : {0, 1, 4}) {
+        RecordsCollector c(ctx);
+        hdql_iQueryResultsHandler iqr = c.iface();
+        hdql_QueryResultsParallelDriver * drv
+            = hdql_query_results_parallel_init(_query, &iqr, nWorkers, 8, ctx);
+        ASSERT_TRUE(drv);
+        EXPECT_EQ(HDQL_ERR_INTERFACE_ERROR
+                , hdql_query_results_parallel_process(roots.data(), roots.size(), drv))
+            << nWorkers << " workers";
+        EXPECT_TRUE(hdql_context_has_errors(ctx));
+        hdql_context_errors_clear(ctx);
+        // records of root datums preceding failed one are delivered
+        EXPECT_EQ(17u, c.records.size()) << nWorkers << " workers";
+        hdql_query_results_parallel_destroy(drv);
+    }
+    hdql_query_destroy(_query, ctx);
+    _query = NULL;
+    hdql_attr_def_destroy(ad, ctx);
+}
+
+TEST_F(ParallelResultsTest, initFailsCleanlyUnderMemoryLimit) {
+    CompileQuery("{th:=*.tracks.hits, h:=*.hits}{dx:=.h.x-.th.x}.dx");
+    hdql_Context_t ctx = _compounds.context_ptr();
+    auto sequential = collect(0, 0);
+    ASSERT_FALSE(sequential.empty());
+    // limit is inherited by workers' contexts, so cloning fails first
+    size_t nFailed = 0;
+    for(size_t extra = 0; extra < 16384; extra += 64) {
+        hdql_ContextMemoryStats s0, s;
+        hdql_context_get_memory_stats(ctx, &s0);
+        hdql_context_set_memory_limit(ctx, s0.bytesLive + extra);
+        RecordsCollector c(ctx);
+        hdql_iQueryResultsHandler iqr = c.iface();
+        hdql_QueryResultsParallelDriver * drv
+            = hdql_query_results_parallel_init(_query, &iqr, 3, 16, ctx);
+        hdql_context_set_memory_limit(ctx, 0);
+        if(drv) {
+            EXPECT_EQ(0, hdql_query_results_parallel_process(_roots.data(), _roots.size(), drv))
+                << "limit +" << extra;
+            EXPECT_EQ(sequential, c.records) << "limit +" << extra;
+            hdql_query_results_parallel_destroy(drv);
+        } else {
+            ++nFailed;
+            bool isMemoryError = false;
+            for(size_t i = 0; i < hdql_context_errors_count(ctx); ++i)
+                isMemoryError |= hdql_context_error_get(ctx, i)->code == HDQL_ERR_MEMORY;
+            EXPECT_TRUE(isMemoryError) << "limit +" << extra;
+        }
+        hdql_context_errors_clear(ctx);
+        hdql_context_get_memory_stats(ctx, &s);
+        EXPECT_EQ(s.bytesLive, s0.bytesLive) << "limit +" << extra;
+    }
+    EXPECT_GT(nFailed, 0u);
+    EXPECT_LT(nFailed, 16384u/64);
+}
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <vector>
+
+#include "hdql/context.h"
+#include "hdql/errors.h"
+#include "hdql/query.h"
+#include "hdql/value.h"
+#include "samples.hh"
+
+namespace hdql {
+namespace test {
+
+// Evaluates set of queries with query trie and compares results of every
+// query with ones obtained by independent evaluation
+class QueryTrieTest : public hdql::test::TestingEventStruct {
+protected:
+    std::vector<hdql_Query *> _queries;
+
+    struct Results {
+        hdql_ValueTypes * types;
+        std::vector<hdql_Query *> * queries;
+        std::map<size_t, std::vector<double>> values;
+        size_t nLimit;
+    };
+
+    static int collect(size_t nQuery, hdql_Datum_t r, void * ud) {
+        Results * rs = reinterpret_cast<Results *>(ud);
+        const hdql_AttrDef * ad = hdql_query_top_attr((*rs->queries)[nQuery]);
+        const hdql_ValueInterface * vi = hdql_types_get_type(rs->types
+                , hdql_attr_def_get_atomic_value_type_code(ad));
+        rs->values[nQuery].push_back(vi->get_as_float(r));
+        if(rs->nLimit && !--(rs->nLimit)) return 1;
+        return 0;
+    }
+public:
+    void TearDown() override {
+        // reverse order, as clones must be destroyed before originals
+        for(auto it = _queries.rbegin(); it != _queries.rend(); ++it)
+            hdql_query_destroy(*it, _compounds.context_ptr());
+        hdql::test::TestingEventStruct::TearDown();
+    }
+
+    void compile(const char * expr) {
+        char errBuf[128] = ""; int errDetails[5];
+        hdql_Query * q = hdql_compile_query( expr
+                , _rootCompound, _compounds.context_ptr()
+                , errBuf, sizeof(errBuf), errDetails );
+        ASSERT_EQ(errDetails[0], 0) << "Error compiling \"" << expr << "\": " << errBuf;
+        _queries.push_back(q);
+    }
+
+    // results of independent evaluation of the query
+    std::vector<double> evaluate(hdql_Query * q, Event & ev) {
+        std::vector<double> values;
+        const hdql_ValueInterface * vi = hdql_types_get_type(_valueTypes
+                , hdql_attr_def_get_atomic_value_type_code(hdql_query_top_attr(q)));
+        hdql_Context_t ctx = _compounds.context_ptr();
+        for( hdql_Datum_t r = hdql_query_reset(q, reinterpret_cast<hdql_Datum_t>(&ev), NULL, ctx)
+           ; r ; r = hdql_query_get(q, NULL, ctx) ) {
+            values.push_back(vi->get_as_float(r));
+        }
+        return values;
+    }
+};
+
+TEST_F(QueryTrieTest, sharesCommonPrefixes) {
+    compile(".hits.x");
+    compile(".hits.y");
+    compile(".tracks.hits.energyDeposition");
+    compile(".tracks.chi2");
+    compile(".hits.x");  // duplicate
+    hdql_QueryTrie * t = hdql_query_trie_create(_queries.data(), _queries.size()
+            , _compounds.context_ptr());
+    ASSERT_TRUE(t);
+    // .hits{.x, .y}, .tracks{.hits.energyDeposition, .chi2}
+    EXPECT_EQ(hdql_query_trie_n_nodes(t), 7);
+    hdql_query_trie_destroy(t, _compounds.context_ptr());
+}
+
+TEST_F(QueryTrieTest, yieldsSameResultsAsIndependentQueries) {
+    compile(".hits.x");
+    compile(".hits.y");
+    compile(".hits{:.x > 4}.time");
+    compile(".tracks.hits.energyDeposition");
+    compile(".tracks{.chi2/.ndf : .ndf > 2}");
+    compile(".tracks{h := .hits}.h.x");
+    compile(".eventID");
+    compile(".hits.x");
+    hdql_Context_t ctx = _compounds.context_ptr();
+    hdql_QueryTrie * t = hdql_query_trie_create(_queries.data(), _queries.size(), ctx);
+    ASSERT_TRUE(t);
+
+    void (*samples[])(Event &) = {fill_data_sample_1, fill_data_sample_2, fill_data_sample_3};
+    for(auto fill : samples) {
+        Event ev;
+        fill(ev);
+        Results rs = {_valueTypes, &_queries, {}, 0};
+        EXPECT_EQ(HDQL_ERR_CODE_OK, hdql_query_trie_process(t
+                    , reinterpret_cast<hdql_Datum_t>(&ev), collect, &rs, ctx));
+        EXPECT_FALSE(hdql_context_has_errors(ctx));
+        for(size_t i = 0; i < _queries.size(); ++i) {
+            EXPECT_EQ(rs.values[i], evaluate(_queries[i], ev)) << "query #" << i;
+        }
+    }
+    hdql_query_trie_destroy(t, ctx);
+}
+
+TEST_F(QueryTrieTest, separatelyCompiledSelectionsAreNotMerged) {
+    compile(".hits[0:200].x");
+    compile(".hits[0:200].y");
+    hdql_Context_t ctx = _compounds.context_ptr();
+    hdql_QueryTrie * t = hdql_query_trie_create(_queries.data(), _queries.size(), ctx);
+    ASSERT_TRUE(t);
+    // .hits[0:200].x, .hits[0:200].y
+    EXPECT_EQ(hdql_query_trie_n_nodes(t), 4);
+    hdql_query_trie_destroy(t, ctx);
+}
+
+TEST_F(QueryTrieTest, clonesShareSelectedLinks) {
+    compile(".hits[0:200].x");
+    hdql_Context_t ctx = _compounds.context_ptr();
+    hdql_Query * clone = hdql_query_clone(_queries[0], ctx);
+    ASSERT_TRUE(clone);
+    ASSERT_EQ(hdql_query_get_collection_selection(clone)
+            , hdql_query_get_collection_selection(_queries[0]));
+    _queries.push_back(clone);
+    compile(".hits.x");
+    hdql_QueryTrie * t = hdql_query_trie_create(_queries.data(), _queries.size(), ctx);
+    ASSERT_TRUE(t);
+    // .hits[0:200].x shared by query and its clone, .hits.x
+    EXPECT_EQ(hdql_query_trie_n_nodes(t), 4);
+
+    Event ev;
+    fill_data_sample_1(ev);
+    Results rs = {_valueTypes, &_queries, {}, 0};
+    EXPECT_EQ(HDQL_ERR_CODE_OK, hdql_query_trie_process(t
+                , reinterpret_cast<hdql_Datum_t>(&ev), collect, &rs, ctx));
+    EXPECT_FALSE(hdql_context_has_errors(ctx));
+    EXPECT_FALSE(rs.values[0].empty());
+    EXPECT_EQ(rs.values[0], rs.values[1]);
+    EXPECT_EQ(rs.values[0], evaluate(_queries[0], ev));
+    EXPECT_EQ(rs.values[2], evaluate(_queries[2], ev));
+    hdql_query_trie_destroy(t, ctx);
+}
+
+TEST_F(QueryTrieTest, callbackInterruptsProcessing) {
+    compile(".hits.x");
+    compile(".hits.y");
+    hdql_Context_t ctx = _compounds.context_ptr();
+    hdql_QueryTrie * t = hdql_query_trie_create(_queries.data(), _queries.size(), ctx);
+    ASSERT_TRUE(t);
+    Event ev;
+    fill_data_sample_1(ev);
+    Results rs = {_valueTypes, &_queries, {}, 3};
+    EXPECT_EQ(1, hdql_query_trie_process(t, reinterpret_cast<hdql_Datum_t>(&ev)
+                , collect, &rs, ctx));
+    // results of two queries are interleaved per shared item
+    EXPECT_EQ(rs.values[0].size(), 2);
+    EXPECT_EQ(rs.values[1].size(), 1);
+    hdql_query_trie_destroy(t, ctx);
+}
+
+}  // namespace ::hdql::test
+}  // namespace hdql